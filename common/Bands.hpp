@@ -0,0 +1,34 @@
+#pragma once
+
+// Horizontal bands of a frame that are handed over one at a time.
+//
+// Instead of one fence value per frame the producer signals one value per
+// band, so the next stage can start on the first band while the later ones
+// are still being rendered. A frame of count bands takes count consecutive
+// fence values, the last of them means the whole frame is done. With one band
+// that is the usual single value per frame.
+
+#include <cstdint>
+
+namespace bands
+{
+struct Rows
+{
+    uint32_t y = 0;
+    uint32_t height = 0;
+};
+
+// The bands cover the frame top to bottom and differ in height by one row at most
+inline Rows bandRows(uint32_t band, uint32_t count, uint32_t height)
+{
+    const uint32_t top = static_cast<uint32_t>(static_cast<uint64_t>(band) * height / count);
+    const uint32_t bottom = static_cast<uint32_t>(static_cast<uint64_t>(band + 1) * height / count);
+    return Rows{top, bottom - top};
+}
+
+// Fence value of a band of the frame whose last band signals frameValue
+inline uint64_t bandFenceValue(uint64_t frameValue, uint32_t band, uint32_t count)
+{
+    return frameValue - (count - 1) + band;
+}
+} // namespace bands
@@ -0,0 +1,507 @@
+#pragma once
+
+// Real-time block compression of RGBA8 frames.
+//
+// Both encoders fit a line through the colors of each 4x4 block using its
+// bounding box (inset a little, like stb_dxt), then snap every pixel to the
+// nearest point on that line. That is far from the best quality a BC encoder
+// can reach but fast enough to run on every frame:
+// - BC1: 8 bytes per block (8:1 from RGBA8), 5:6:5 endpoints, 4 colors, no alpha
+// - BC7: 16 bytes per block (4:1), always mode 6, i.e. 7777 endpoints with a
+//   shared low bit each, 16 colors, with alpha
+//
+// BlockEncoder splits the block rows of a frame between its worker threads.
+// The decoders are only there to check the encoders on the CPU, the GPU
+// decodes the blocks when a shader reads the texture.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define BLOCKCOMPRESSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace blockcompression
+{
+enum class Format
+{
+    Bc1,
+    Bc7
+};
+
+inline uint32_t blockBytes(Format format)
+{
+    return format == Format::Bc1 ? 8 : 16;
+}
+
+// Bytes of one row of blocks of a width that is a multiple of 4
+inline uint32_t blockRowPitch(Format format, uint32_t width)
+{
+    return width / 4 * blockBytes(format);
+}
+
+// Gathers the 16 pixels of the block at x, y
+inline void loadBlock(const uint8_t* rgba, uint32_t rowPitch, uint32_t x, uint32_t y, uint8_t pixels[64])
+{
+    for (uint32_t row = 0; row < 4; ++row)
+    {
+        std::memcpy(pixels + row * 16, rgba + static_cast<size_t>(y + row) * rowPitch + x * 4, 16);
+    }
+}
+
+// Per channel bounding box of the block, inset by 1/16 of its size
+inline void insetBoundingBox(const uint8_t pixels[64], uint8_t minColor[4], uint8_t maxColor[4])
+{
+#if defined(BLOCKCOMPRESSION_SSE2)
+    __m128i minimum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+    __m128i maximum = minimum;
+    for (int row = 1; row < 4; ++row)
+    {
+        const __m128i rowPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + row * 16));
+        minimum = _mm_min_epu8(minimum, rowPixels);
+        maximum = _mm_max_epu8(maximum, rowPixels);
+    }
+    // Reduce the four pixels of a row to one
+    minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+    minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+    maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(1, 0, 3, 2)));
+    maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(2, 3, 0, 1)));
+    const int minimumBits = _mm_cvtsi128_si32(minimum);
+    const int maximumBits = _mm_cvtsi128_si32(maximum);
+    std::memcpy(minColor, &minimumBits, 4);
+    std::memcpy(maxColor, &maximumBits, 4);
+#else
+    std::memcpy(minColor, pixels, 4);
+    std::memcpy(maxColor, pixels, 4);
+    for (int i = 1; i < 16; ++i)
+    {
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            minColor[channel] = (std::min)(minColor[channel], pixels[i * 4 + channel]);
+            maxColor[channel] = (std::max)(maxColor[channel], pixels[i * 4 + channel]);
+        }
+    }
+#endif
+    for (int channel = 0; channel < 4; ++channel)
+    {
+        const int inset = (maxColor[channel] - minColor[channel]) >> 4;
+        minColor[channel] = static_cast<uint8_t>(minColor[channel] + inset);
+        maxColor[channel] = static_cast<uint8_t>(maxColor[channel] - inset);
+    }
+}
+
+// Position of every pixel along the line from start to end, 0 to levels - 1
+template<int channels, int levels>
+void projectPixels(const uint8_t pixels[64], const int start[4], const int end[4], int positions[16])
+{
+    int axis[4] = {};
+    int lengthSquared = 0;
+    for (int channel = 0; channel < channels; ++channel)
+    {
+        axis[channel] = end[channel] - start[channel];
+        lengthSquared += axis[channel] * axis[channel];
+    }
+    if (lengthSquared == 0)
+    {
+        std::fill(positions, positions + 16, 0);
+        return;
+    }
+
+    // 16.16 fixed point instead of a division per pixel
+    const int64_t scale = (static_cast<int64_t>(levels - 1) << 16) / lengthSquared;
+    for (int i = 0; i < 16; ++i)
+    {
+        int dot = 0;
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            dot += (pixels[i * 4 + channel] - start[channel]) * axis[channel];
+        }
+        const int position = static_cast<int>((dot * scale + (1 << 15)) >> 16);
+        positions[i] = (std::max)(0, (std::min)(levels - 1, position));
+    }
+}
+
+inline uint16_t packRgb565(const int color[3])
+{
+    return static_cast<uint16_t>(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+inline void unpackRgb565(uint16_t packed, int color[3])
+{
+    const int r = (packed >> 11) & 31;
+    const int g = (packed >> 5) & 63;
+    const int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+inline void encodeBc1Block(const uint8_t pixels[64], uint8_t* block)
+{
+    uint8_t minColor[4];
+    uint8_t maxColor[4];
+    insetBoundingBox(pixels, minColor, maxColor);
+
+    int color0[3] = {maxColor[0], maxColor[1], maxColor[2]};
+    int color1[3] = {minColor[0], minColor[1], minColor[2]};
+    uint16_t packed0 = packRgb565(color0);
+    uint16_t packed1 = packRgb565(color1);
+    uint32_t indices = 0;
+    if (packed0 != packed1)
+    {
+        // The four color mode needs color0 > color1
+        if (packed0 < packed1)
+        {
+            std::swap(packed0, packed1);
+        }
+        unpackRgb565(packed0, color0);
+        unpackRgb565(packed1, color1);
+
+        // Projected from color1 (0) to color0 (3), BC1 orders the colors 0, 1, 2/3 0 + 1/3 1, 1/3 0 + 2/3 1
+        static const uint32_t c_bc1Index[4] = {1, 3, 2, 0};
+        int positions[16];
+        projectPixels<3, 4>(pixels, color1, color0, positions);
+        for (int i = 0; i < 16; ++i)
+        {
+            indices |= c_bc1Index[positions[i]] << (i * 2);
+        }
+    }
+    std::memcpy(block, &packed0, 2);
+    std::memcpy(block + 2, &packed1, 2);
+    std::memcpy(block + 4, &indices, 4);
+}
+
+// Little endian bit stream of one 128 bit block
+class BlockBits
+{
+public:
+    void write(uint64_t value, int bitCount)
+    {
+        if (m_position < 64)
+        {
+            m_low |= value << m_position;
+            if (m_position + bitCount > 64)
+            {
+                m_high |= value >> (64 - m_position);
+            }
+        }
+        else
+        {
+            m_high |= value << (m_position - 64);
+        }
+        m_position += bitCount;
+    }
+
+    void store(uint8_t* block) const
+    {
+        std::memcpy(block, &m_low, 8);
+        std::memcpy(block + 8, &m_high, 8);
+    }
+
+private:
+    uint64_t m_low = 0;
+    uint64_t m_high = 0;
+    int m_position = 0;
+};
+
+const int c_bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Nearest weight for each of the 65 positions between two endpoints
+struct Bc7IndexTable
+{
+    uint8_t index[65];
+
+    Bc7IndexTable()
+    {
+        for (int position = 0, weight = 0; position <= 64; ++position)
+        {
+            while (weight < 15 && c_bc7Weights4[weight + 1] - position < position - c_bc7Weights4[weight])
+            {
+                ++weight;
+            }
+            index[position] = static_cast<uint8_t>(weight);
+        }
+    }
+};
+
+// 7 bit endpoint with a shared low bit that comes closest to the color
+inline void quantizeBc7Endpoint(const uint8_t color[4], uint32_t endpoint[4], uint32_t& pBit, int unpacked[4])
+{
+    int bestError = -1;
+    for (uint32_t p = 0; p < 2; ++p)
+    {
+        int error = 0;
+        uint32_t candidate[4];
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            candidate[channel] = static_cast<uint32_t>((std::max)(0, (std::min)(127, (color[channel] - static_cast<int>(p) + 1) >> 1)));
+            const int value = static_cast<int>(candidate[channel] << 1 | p);
+            error += (value - color[channel]) * (value - color[channel]);
+        }
+        if (bestError < 0 || error < bestError)
+        {
+            bestError = error;
+            pBit = p;
+            for (int channel = 0; channel < 4; ++channel)
+            {
+                endpoint[channel] = candidate[channel];
+                unpacked[channel] = static_cast<int>(candidate[channel] << 1 | p);
+            }
+        }
+    }
+}
+
+inline void encodeBc7Block(const uint8_t pixels[64], uint8_t* block)
+{
+    uint8_t minColor[4];
+    uint8_t maxColor[4];
+    insetBoundingBox(pixels, minColor, maxColor);
+
+    uint32_t endpoints[2][4];
+    uint32_t pBits[2] = {0, 0};
+    int unpacked[2][4];
+    quantizeBc7Endpoint(minColor, endpoints[0], pBits[0], unpacked[0]);
+    quantizeBc7Endpoint(maxColor, endpoints[1], pBits[1], unpacked[1]);
+
+    // Nearest of the 16 interpolation weights
+    static const Bc7IndexTable c_indexTable;
+    int positions[16];
+    projectPixels<4, 65>(pixels, unpacked[0], unpacked[1], positions);
+    uint32_t indices[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        indices[i] = c_indexTable.index[positions[i]];
+    }
+
+    // The first index is stored without its top bit, so it has to be below 8
+    if (indices[0] >= 8)
+    {
+        std::swap(endpoints[0], endpoints[1]);
+        std::swap(pBits[0], pBits[1]);
+        for (uint32_t& index : indices)
+        {
+            index = 15 - index;
+        }
+    }
+
+    BlockBits bits;
+    bits.write(1 << 6, 7); // Mode 6
+    for (int channel = 0; channel < 4; ++channel)
+    {
+        bits.write(endpoints[0][channel], 7);
+        bits.write(endpoints[1][channel], 7);
+    }
+    bits.write(pBits[0], 1);
+    bits.write(pBits[1], 1);
+    bits.write(indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+    {
+        bits.write(indices[i], 4);
+    }
+    bits.store(block);
+}
+
+// Encodes the block rows from firstRow up to endRow
+inline void encodeBlockRows(Format format, const uint8_t* rgba, uint32_t rowPitch, uint32_t width, uint32_t firstRow, uint32_t endRow, uint8_t* blocks)
+{
+    const uint32_t outputPitch = blockRowPitch(format, width);
+    const uint32_t bytes = blockBytes(format);
+    uint8_t pixels[64];
+    for (uint32_t blockRow = firstRow; blockRow < endRow; ++blockRow)
+    {
+        uint8_t* output = blocks + static_cast<size_t>(blockRow) * outputPitch;
+        for (uint32_t x = 0; x < width; x += 4, output += bytes)
+        {
+            loadBlock(rgba, rowPitch, x, blockRow * 4, pixels);
+            if (format == Format::Bc1)
+            {
+                encodeBc1Block(pixels, output);
+            }
+            else
+            {
+                encodeBc7Block(pixels, output);
+            }
+        }
+    }
+}
+
+inline void decodeBc1Block(const uint8_t* block, uint8_t pixels[64])
+{
+    uint16_t packed0;
+    uint16_t packed1;
+    uint32_t indices;
+    std::memcpy(&packed0, block, 2);
+    std::memcpy(&packed1, block + 2, 2);
+    std::memcpy(&indices, block + 4, 4);
+    int colors[4][3];
+    unpackRgb565(packed0, colors[0]);
+    unpackRgb565(packed1, colors[1]);
+    for (int channel = 0; channel < 3; ++channel)
+    {
+        if (packed0 > packed1)
+        {
+            colors[2][channel] = (2 * colors[0][channel] + colors[1][channel]) / 3;
+            colors[3][channel] = (colors[0][channel] + 2 * colors[1][channel]) / 3;
+        }
+        else
+        {
+            colors[2][channel] = (colors[0][channel] + colors[1][channel]) / 2;
+            colors[3][channel] = 0;
+        }
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        const int* color = colors[(indices >> (i * 2)) & 3];
+        pixels[i * 4 + 0] = static_cast<uint8_t>(color[0]);
+        pixels[i * 4 + 1] = static_cast<uint8_t>(color[1]);
+        pixels[i * 4 + 2] = static_cast<uint8_t>(color[2]);
+        pixels[i * 4 + 3] = 255;
+    }
+}
+
+// Only mode 6, which is the only mode encodeBc7Block() writes
+inline bool decodeBc7Block(const uint8_t* block, uint8_t pixels[64])
+{
+    int position = 0;
+    auto read = [&](int bitCount) {
+        uint32_t value = 0;
+        for (int i = 0; i < bitCount; ++i, ++position)
+        {
+            value |= static_cast<uint32_t>((block[position >> 3] >> (position & 7)) & 1) << i;
+        }
+        return value;
+    };
+    if (read(7) != 1 << 6)
+    {
+        return false;
+    }
+    int endpoints[2][4];
+    for (int channel = 0; channel < 4; ++channel)
+    {
+        endpoints[0][channel] = static_cast<int>(read(7));
+        endpoints[1][channel] = static_cast<int>(read(7));
+    }
+    for (int endpoint = 0; endpoint < 2; ++endpoint)
+    {
+        const int pBit = static_cast<int>(read(1));
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            endpoints[endpoint][channel] = endpoints[endpoint][channel] << 1 | pBit;
+        }
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        const int weight = c_bc7Weights4[read(i == 0 ? 3 : 4)];
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            pixels[i * 4 + channel] = static_cast<uint8_t>((endpoints[0][channel] * (64 - weight) + endpoints[1][channel] * weight + 32) >> 6);
+        }
+    }
+    return true;
+}
+
+class BlockEncoder
+{
+public:
+    explicit BlockEncoder(uint32_t threadCount)
+    {
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            m_threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    ~BlockEncoder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_workCondition.notify_all();
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    BlockEncoder(const BlockEncoder&) = delete;
+    BlockEncoder& operator=(const BlockEncoder&) = delete;
+
+    // width and height have to be multiples of 4. Returns when the whole frame is encoded.
+    void encode(Format format, const void* rgba, uint32_t rowPitch, uint32_t width, uint32_t height, void* blocks)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_job = Job{format, static_cast<const uint8_t*>(rgba), rowPitch, width, height / 4, static_cast<uint8_t*>(blocks)};
+        m_remaining = static_cast<uint32_t>(m_threads.size());
+        ++m_generation;
+        m_workCondition.notify_all();
+        m_doneCondition.wait(lock, [&] { return m_remaining == 0; });
+    }
+
+    uint32_t threadCount() const
+    {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+private:
+    struct Job
+    {
+        Format format;
+        const uint8_t* rgba;
+        uint32_t rowPitch;
+        uint32_t width;
+        uint32_t blockRows;
+        uint8_t* blocks;
+    };
+
+    void work(uint32_t threadIndex)
+    {
+        uint64_t generation = 0;
+        while (true)
+        {
+            Job job{};
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_workCondition.wait(lock, [&] { return m_stopped || m_generation != generation; });
+                if (m_stopped)
+                {
+                    return;
+                }
+                generation = m_generation;
+                job = m_job;
+            }
+
+            // Contiguous runs of block rows, so neighbouring threads do not share output cache lines
+            const uint32_t threadCount = static_cast<uint32_t>(m_threads.size());
+            const uint32_t firstRow = job.blockRows * threadIndex / threadCount;
+            const uint32_t endRow = job.blockRows * (threadIndex + 1) / threadCount;
+            encodeBlockRows(job.format, job.rgba, job.rowPitch, job.width, firstRow, endRow, job.blocks);
+
+            bool last = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                last = --m_remaining == 0;
+            }
+            if (last)
+            {
+                m_doneCondition.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_workCondition;
+    std::condition_variable m_doneCondition;
+    Job m_job{};
+    uint64_t m_generation = 0;
+    uint32_t m_remaining = 0;
+    bool m_stopped = false;
+};
+} // namespace blockcompression
@@ -0,0 +1,161 @@
+#pragma once
+
+// CPU stand-ins for a GPU fence and command queue.
+//
+// EmulatedFence has the part of the ID3D12Fence interface that FenceWaiter
+// uses plus Signal(), so fence sequencing can be run without an adapter,
+// e.g. on Linux. EmulatedQueue runs its commands in submission order on its
+// own thread like a GPU queue does: execute() runs a function (a render or a
+// copy, or just a sleep that stands in for one), Signal() sets a fence when
+// everything before it has run and Wait() holds back everything after it
+// until a fence value is reached. Signal() and Wait() take the same arguments
+// as on ID3D12CommandQueue.
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "FenceWaiter.hpp"
+
+class EmulatedFence
+{
+public:
+    explicit EmulatedFence(uint64_t initialValue = 0) :
+        m_value(initialValue)
+    {
+    }
+
+    EmulatedFence(const EmulatedFence&) = delete;
+    EmulatedFence& operator=(const EmulatedFence&) = delete;
+
+    uint64_t GetCompletedValue() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_value;
+    }
+
+    // The event is signalled right away if the value has already been reached
+    void SetEventOnCompletion(uint64_t value, NativeEvent event)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_value < value)
+            {
+                m_events.push_back({value, event});
+                return;
+            }
+        }
+        signalNativeEvent(event);
+    }
+
+    void Signal(uint64_t value)
+    {
+        std::vector<NativeEvent> reached;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_value = value;
+            for (size_t i = 0; i < m_events.size();)
+            {
+                if (m_events[i].first <= value)
+                {
+                    reached.push_back(m_events[i].second);
+                    m_events[i] = m_events.back();
+                    m_events.pop_back();
+                    continue;
+                }
+                ++i;
+            }
+        }
+        m_changed.notify_all();
+        for (NativeEvent event : reached)
+        {
+            signalNativeEvent(event);
+        }
+    }
+
+    // Blocks the calling thread, used for the queue side waits
+    void waitFor(uint64_t value) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&] { return m_value >= value; });
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_changed;
+    uint64_t m_value;
+    std::vector<std::pair<uint64_t, NativeEvent>> m_events;
+};
+
+class EmulatedQueue
+{
+public:
+    EmulatedQueue() :
+        m_thread([this] { run(); })
+    {
+    }
+
+    // Runs the commands that have already been submitted first
+    ~EmulatedQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    EmulatedQueue(const EmulatedQueue&) = delete;
+    EmulatedQueue& operator=(const EmulatedQueue&) = delete;
+
+    void execute(std::function<void()> work)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_commands.push_back(std::move(work));
+        }
+        m_changed.notify_all();
+    }
+
+    void Signal(EmulatedFence* fence, uint64_t value)
+    {
+        execute([fence, value] { fence->Signal(value); });
+    }
+
+    void Wait(EmulatedFence* fence, uint64_t value)
+    {
+        execute([fence, value] { fence->waitFor(value); });
+    }
+
+private:
+    void run()
+    {
+        while (true)
+        {
+            std::function<void()> command;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [this] { return m_stop || !m_commands.empty(); });
+                if (m_commands.empty())
+                {
+                    break;
+                }
+                command = std::move(m_commands.front());
+                m_commands.pop_front();
+            }
+            command();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<std::function<void()>> m_commands;
+    bool m_stop = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+// Composition order for a frame that several producers write one region each.
+//
+// Every producer signals its own fence once its region is ready. The consumer
+// composites each region as soon as its fence is reached instead of waiting
+// for the slowest producer first: takeReady() hands out the regions that can
+// be composited now, and pending() tells which fences to wait on (any of them)
+// when there are none.
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Bands.hpp"
+
+struct FanInRegion
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Splits the frame into horizontal bands, one per producer, the same way bands::bandRows() does
+inline std::vector<FanInRegion> splitRows(uint32_t width, uint32_t height, uint32_t count)
+{
+    std::vector<FanInRegion> regions;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const bands::Rows rows = bands::bandRows(i, count, height);
+        regions.push_back(FanInRegion{0, rows.y, width, rows.height});
+    }
+    return regions;
+}
+
+class FanInFrame
+{
+public:
+    // Tells whether a producer's fence has reached a value
+    using ReachedFunction = std::function<bool(uint32_t producer, uint64_t value)>;
+
+    explicit FanInFrame(uint32_t producerCount) :
+        m_readyValues(producerCount, 0),
+        m_composited(producerCount, true)
+    {
+    }
+
+    uint32_t producerCount() const
+    {
+        return static_cast<uint32_t>(m_readyValues.size());
+    }
+
+    // readyValues holds the fence value of every producer's region in this frame
+    void begin(const std::vector<uint64_t>& readyValues)
+    {
+        m_readyValues = readyValues;
+        m_composited.assign(m_readyValues.size(), false);
+        m_compositedCount = 0;
+        m_earlyCount = 0;
+    }
+
+    bool done() const
+    {
+        return m_compositedCount == producerCount();
+    }
+
+    uint64_t readyValue(uint32_t producer) const
+    {
+        return m_readyValues[producer];
+    }
+
+    // Producers whose regions have not been composited yet
+    std::vector<uint32_t> pending() const
+    {
+        std::vector<uint32_t> producers;
+        for (uint32_t i = 0; i < producerCount(); ++i)
+        {
+            if (!m_composited[i])
+            {
+                producers.push_back(i);
+            }
+        }
+        return producers;
+    }
+
+    // Marks the regions whose fences are reached as composited and returns them
+    std::vector<uint32_t> takeReady(const ReachedFunction& reached)
+    {
+        std::vector<uint32_t> ready;
+        for (uint32_t i = 0; i < producerCount(); ++i)
+        {
+            if (!m_composited[i] && reached(i, m_readyValues[i]))
+            {
+                m_composited[i] = true;
+                ready.push_back(i);
+            }
+        }
+        m_compositedCount += static_cast<uint32_t>(ready.size());
+        if (!done())
+        {
+            m_earlyCount = m_compositedCount;
+        }
+        return ready;
+    }
+
+    // Regions composited while at least one other producer was still rendering
+    uint32_t earlyCount() const
+    {
+        return m_earlyCount;
+    }
+
+private:
+    std::vector<uint64_t> m_readyValues;
+    std::vector<bool> m_composited;
+    uint32_t m_compositedCount = 0;
+    uint32_t m_earlyCount = 0;
+};
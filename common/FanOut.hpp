@@ -0,0 +1,231 @@
+#pragma once
+
+// Slot reuse for one producer that broadcasts every frame to several consumers.
+//
+// The producer writes a slot once and publishes it to all consumers. Each
+// consumer takes the newest published frame, frames it did not get to in time
+// are skipped so a slow consumer never holds back the others. A slot can be
+// written again once every consumer has released or skipped it. A release
+// carries the consumer's own fence value after it finished reading the slot,
+// the producer waits for those values before it writes the slot again.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+struct FanOutFrame
+{
+    uint32_t slot;
+    uint64_t frameNumber; // 1-based, consecutive over published frames
+    uint64_t readyValue; // Producer's fence value after the slot was written
+};
+
+class FanOutSlots
+{
+public:
+    // Tells whether a consumer's fence has reached a value
+    using ReachedFunction = std::function<bool(uint32_t consumer, uint64_t value)>;
+
+    FanOutSlots(uint32_t slotCount, uint32_t consumerCount) :
+        m_slots(slotCount, Slot{0, 0, 0, false, std::vector<uint64_t>(consumerCount, 0)}),
+        m_consumers(consumerCount)
+    {
+    }
+
+    FanOutSlots(const FanOutSlots&) = delete;
+    FanOutSlots& operator=(const FanOutSlots&) = delete;
+
+    uint32_t consumerCount() const
+    {
+        return static_cast<uint32_t>(m_consumers.size());
+    }
+
+    // Producer. Blocks until a slot is free and returns false after stop().
+    // releaseValues gets the fence value of every consumer that has to be reached
+    // before the slot is written, 0 for consumers that never read it.
+    bool acquire(uint32_t& slot, std::vector<uint64_t>& releaseValues, const ReachedFunction& reached = nullptr)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        int free = -1;
+        m_producerCondition.wait(lock, [&] { return m_stopped || (free = findFreeSlot(reached)) >= 0; });
+        if (m_stopped)
+        {
+            return false;
+        }
+        claim(static_cast<uint32_t>(free), slot, releaseValues);
+        return true;
+    }
+
+    // Producer. Like acquire() but also returns false when no slot was freed within the timeout.
+    bool acquireFor(uint32_t& slot, std::vector<uint64_t>& releaseValues, std::chrono::milliseconds timeout, const ReachedFunction& reached = nullptr)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        int free = -1;
+        if (!m_producerCondition.wait_for(lock, timeout, [&] { return m_stopped || (free = findFreeSlot(reached)) >= 0; }) || m_stopped)
+        {
+            return false;
+        }
+        claim(static_cast<uint32_t>(free), slot, releaseValues);
+        return true;
+    }
+
+    // Producer. Returns false immediately when every slot is still referenced.
+    bool tryAcquire(uint32_t& slot, std::vector<uint64_t>& releaseValues, const ReachedFunction& reached = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const int free = findFreeSlot(reached);
+        if (m_stopped || free < 0)
+        {
+            return false;
+        }
+        claim(static_cast<uint32_t>(free), slot, releaseValues);
+        return true;
+    }
+
+    // Producer. Hands a written slot to all consumers. Consumers that have not
+    // taken the previous frame yet skip it.
+    void publish(uint32_t slot, uint64_t readyValue)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Slot& published = m_slots[slot];
+            published.writing = false;
+            published.frameNumber = ++m_frameNumber;
+            published.readyValue = readyValue;
+            published.references = static_cast<uint32_t>(m_consumers.size());
+
+            for (Consumer& consumer : m_consumers)
+            {
+                if (consumer.pending >= 0)
+                {
+                    --m_slots[consumer.pending].references;
+                    ++consumer.skipped;
+                }
+                consumer.pending = static_cast<int>(slot);
+            }
+        }
+        m_consumerCondition.notify_all();
+        m_producerCondition.notify_one();
+    }
+
+    // Consumer. Blocks until a frame newer than the last taken one is published,
+    // returns false after stop().
+    bool take(uint32_t consumer, FanOutFrame& frame)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Consumer& state = m_consumers[consumer];
+        m_consumerCondition.wait(lock, [&] { return m_stopped || state.pending >= 0; });
+        if (m_stopped)
+        {
+            return false;
+        }
+        const Slot& slot = m_slots[state.pending];
+        frame = FanOutFrame{static_cast<uint32_t>(state.pending), slot.frameNumber, slot.readyValue};
+        state.pending = -1;
+        return true;
+    }
+
+    // Consumer. fenceValue is reached once the consumer no longer reads the slot.
+    void release(uint32_t consumer, uint32_t slot, uint64_t fenceValue)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_slots[slot].releaseValues[consumer] = fenceValue;
+            --m_slots[slot].references;
+        }
+        m_producerCondition.notify_one();
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_consumerCondition.notify_all();
+        m_producerCondition.notify_all();
+    }
+
+    uint64_t publishedFrames() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_frameNumber;
+    }
+
+    uint64_t skippedFrames(uint32_t consumer) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_consumers[consumer].skipped;
+    }
+
+private:
+    struct Slot
+    {
+        uint32_t references; // Consumers that have not released or skipped the slot
+        uint64_t frameNumber;
+        uint64_t readyValue;
+        bool writing;
+        std::vector<uint64_t> releaseValues; // Per consumer
+    };
+
+    struct Consumer
+    {
+        int pending = -1; // Newest published slot that has not been taken
+        uint64_t skipped = 0;
+    };
+
+    // Prefers the oldest slot that every consumer's fence is already done with,
+    // so a display that is behind only delays the producer when it has to.
+    int findFreeSlot(const ReachedFunction& reached) const
+    {
+        int oldest = -1;
+        int oldestReached = -1;
+        for (size_t i = 0; i < m_slots.size(); ++i)
+        {
+            const Slot& slot = m_slots[i];
+            if (slot.references > 0 || slot.writing)
+            {
+                continue;
+            }
+            if (oldest < 0 || slot.frameNumber < m_slots[oldest].frameNumber)
+            {
+                oldest = static_cast<int>(i);
+            }
+            if (reached && isReached(slot, reached) && (oldestReached < 0 || slot.frameNumber < m_slots[oldestReached].frameNumber))
+            {
+                oldestReached = static_cast<int>(i);
+            }
+        }
+        return oldestReached >= 0 ? oldestReached : oldest;
+    }
+
+    static bool isReached(const Slot& slot, const ReachedFunction& reached)
+    {
+        for (size_t consumer = 0; consumer < slot.releaseValues.size(); ++consumer)
+        {
+            if (!reached(static_cast<uint32_t>(consumer), slot.releaseValues[consumer]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void claim(uint32_t free, uint32_t& slot, std::vector<uint64_t>& releaseValues)
+    {
+        m_slots[free].writing = true;
+        slot = free;
+        releaseValues = m_slots[free].releaseValues;
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_producerCondition;
+    std::condition_variable m_consumerCondition;
+    std::vector<Slot> m_slots;
+    std::vector<Consumer> m_consumers;
+    uint64_t m_frameNumber = 0;
+    bool m_stopped = false;
+};
@@ -0,0 +1,410 @@
+#pragma once
+
+// One thread that waits on many (fence, value) pairs at once.
+//
+// A request is a list of fence waits, possibly on fences of different adapters,
+// that completes when any or all of them have been reached. Its callback runs
+// on the waiter thread, so it should only hand work over to another thread.
+//
+// Fence is anything with GetCompletedValue() and
+// SetEventOnCompletion(value, NativeEvent), e.g. ID3D12Fence. On Windows the
+// native event is an event HANDLE, elsewhere it is an eventfd that an emulated
+// fence writes to when the value is reached.
+//
+// Every fence gets one event, however many requests wait on it. Windows waits
+// on at most 64 handles at a time, so the pending requests can wait on at most
+// c_maxFences different fences, waitAsync() rejects a request beyond that. The
+// eventfd version keeps the same limit so it runs into it where Windows would.
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+using NativeEvent = HANDLE;
+
+inline NativeEvent createNativeEvent()
+{
+    return CreateEvent(nullptr, FALSE, FALSE, nullptr);
+}
+
+inline void signalNativeEvent(NativeEvent event)
+{
+    SetEvent(event);
+}
+
+inline void destroyNativeEvent(NativeEvent event)
+{
+    CloseHandle(event);
+}
+
+// Blocks until any of the events is signalled. Auto-reset events clear themselves.
+inline void waitAnyNativeEvent(const std::vector<NativeEvent>& events)
+{
+    WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, INFINITE);
+}
+
+const size_t c_maxNativeEvents = MAXIMUM_WAIT_OBJECTS;
+#else
+using NativeEvent = int;
+
+inline NativeEvent createNativeEvent()
+{
+    return eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+inline void signalNativeEvent(NativeEvent event)
+{
+    const uint64_t one = 1;
+    (void)write(event, &one, sizeof(one));
+}
+
+inline void destroyNativeEvent(NativeEvent event)
+{
+    close(event);
+}
+
+// Blocks until any of the events is signalled and resets the signalled ones.
+inline void waitAnyNativeEvent(const std::vector<NativeEvent>& events)
+{
+    std::vector<pollfd> fds;
+    fds.reserve(events.size());
+    for (NativeEvent event : events)
+    {
+        fds.push_back(pollfd{event, POLLIN, 0});
+    }
+    while (poll(fds.data(), fds.size(), -1) < 0)
+    {
+    }
+    for (const pollfd& fd : fds)
+    {
+        if (fd.revents & POLLIN)
+        {
+            uint64_t count = 0;
+            (void)read(fd.fd, &count, sizeof(count));
+        }
+    }
+}
+
+const size_t c_maxNativeEvents = 64;
+#endif
+
+enum class WaitMode
+{
+    Any,
+    All
+};
+
+template<typename Fence>
+struct FenceWait
+{
+    Fence* fence;
+    uint64_t value;
+};
+
+template<typename Fence>
+class FenceWaiter
+{
+public:
+    using Callback = std::function<void()>;
+
+    // One event per fence plus the one that wakes the thread for new requests
+    static const size_t c_maxFences = c_maxNativeEvents - 1;
+
+    FenceWaiter() :
+        m_wakeEvent(createNativeEvent()),
+        m_thread([this] { run(); })
+    {
+    }
+
+    ~FenceWaiter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        signalNativeEvent(m_wakeEvent);
+        m_thread.join();
+
+        for (const auto& armed : m_armed)
+        {
+            destroyNativeEvent(armed.second.event);
+        }
+        for (NativeEvent event : m_eventPool)
+        {
+            destroyNativeEvent(event);
+        }
+        destroyNativeEvent(m_wakeEvent);
+    }
+
+    FenceWaiter(const FenceWaiter&) = delete;
+    FenceWaiter& operator=(const FenceWaiter&) = delete;
+
+    // The callback runs on the waiter thread, or on the calling thread if the
+    // request is already satisfied. Returns false without queueing the request
+    // if the pending requests would then wait on more than c_maxFences fences.
+    bool waitAsync(const std::vector<FenceWait<Fence>>& waits, WaitMode mode, Callback callback)
+    {
+        if (isSatisfied(waits, mode))
+        {
+            callback();
+            return true;
+        }
+
+        std::unique_ptr<Request> request = std::make_unique<Request>();
+        request->waits = waits;
+        request->mode = mode;
+        request->callback = std::move(callback);
+        for (const FenceWait<Fence>& wait : waits)
+        {
+            if (std::find(request->fences.begin(), request->fences.end(), wait.fence) == request->fences.end())
+            {
+                request->fences.push_back(wait.fence);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t newFences = 0;
+            for (Fence* fence : request->fences)
+            {
+                newFences += m_fenceRequests.count(fence) == 0 ? 1 : 0;
+            }
+            if (m_fenceRequests.size() + newFences > c_maxFences)
+            {
+                return false;
+            }
+            for (Fence* fence : request->fences)
+            {
+                ++m_fenceRequests[fence];
+            }
+            m_incoming.push_back(std::move(request));
+        }
+        signalNativeEvent(m_wakeEvent);
+        return true;
+    }
+
+    // Returns false right away if the request can not be queued, see waitAsync()
+    bool wait(const std::vector<FenceWait<Fence>>& waits, WaitMode mode = WaitMode::All)
+    {
+        if (isSatisfied(waits, mode))
+        {
+            return true;
+        }
+        std::promise<void> done;
+        std::future<void> future = done.get_future();
+        if (!waitAsync(waits, mode, [&done] { done.set_value(); }))
+        {
+            return false;
+        }
+        future.wait();
+        return true;
+    }
+
+    bool wait(Fence* fence, uint64_t value)
+    {
+        return wait({FenceWait<Fence>{fence, value}});
+    }
+
+private:
+    struct Request
+    {
+        std::vector<FenceWait<Fence>> waits;
+        std::vector<Fence*> fences; // Distinct
+        WaitMode mode;
+        Callback callback;
+    };
+
+    // The event of a fence is armed for the smallest value a pending request
+    // still waits for. It stays armed until that changes, a registration that
+    // is no longer needed only causes a spurious wake.
+    struct ArmedFence
+    {
+        NativeEvent event;
+        uint64_t value; // 0 when not armed
+    };
+
+    static bool isReached(const FenceWait<Fence>& wait)
+    {
+        return wait.fence->GetCompletedValue() >= wait.value;
+    }
+
+    static bool isSatisfied(const std::vector<FenceWait<Fence>>& waits, WaitMode mode)
+    {
+        size_t reached = 0;
+        for (const FenceWait<Fence>& wait : waits)
+        {
+            reached += isReached(wait) ? 1 : 0;
+        }
+        return mode == WaitMode::Any ? reached > 0 || waits.empty() : reached == waits.size();
+    }
+
+    NativeEvent acquireEvent()
+    {
+        if (m_eventPool.empty())
+        {
+            return createNativeEvent();
+        }
+        NativeEvent event = m_eventPool.back();
+        m_eventPool.pop_back();
+        return event;
+    }
+
+    // Returns true when the request is complete, otherwise adds the values it
+    // still waits for to pending. Every fence is read once, a value that is
+    // reached after the read fires its event as soon as it is armed.
+    static bool update(const Request& request, std::unordered_map<Fence*, uint64_t>& pending)
+    {
+        size_t reached = 0;
+        std::vector<const FenceWait<Fence>*> unreached;
+        for (const FenceWait<Fence>& wait : request.waits)
+        {
+            if (isReached(wait))
+            {
+                ++reached;
+            }
+            else
+            {
+                unreached.push_back(&wait);
+            }
+        }
+        if (request.mode == WaitMode::Any ? reached > 0 : reached == request.waits.size())
+        {
+            return true;
+        }
+        for (const FenceWait<Fence>* wait : unreached)
+        {
+            auto found = pending.find(wait->fence);
+            if (found == pending.end())
+            {
+                pending.emplace(wait->fence, wait->value);
+            }
+            else
+            {
+                found->second = (std::min)(found->second, wait->value);
+            }
+        }
+        return false;
+    }
+
+    void run()
+    {
+        std::vector<std::unique_ptr<Request>> active;
+        std::vector<std::unique_ptr<Request>> completed;
+        std::unordered_map<Fence*, uint64_t> pending;
+        std::vector<NativeEvent> events;
+
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_stop)
+                {
+                    break;
+                }
+                for (std::unique_ptr<Request>& request : m_incoming)
+                {
+                    active.push_back(std::move(request));
+                }
+                m_incoming.clear();
+            }
+
+            // Requests complete in the order they were made, e.g. frames that
+            // await one fence are resumed oldest first
+            completed.clear();
+            pending.clear();
+            size_t kept = 0;
+            for (size_t i = 0; i < active.size(); ++i)
+            {
+                if (update(*active[i], pending))
+                {
+                    completed.push_back(std::move(active[i]));
+                    continue;
+                }
+                active[kept++] = std::move(active[i]);
+            }
+            active.resize(kept);
+
+            if (!completed.empty())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    for (const std::unique_ptr<Request>& request : completed)
+                    {
+                        for (Fence* fence : request->fences)
+                        {
+                            if (--m_fenceRequests[fence] == 0)
+                            {
+                                m_fenceRequests.erase(fence);
+                            }
+                        }
+                    }
+                }
+                for (const std::unique_ptr<Request>& request : completed)
+                {
+                    request->callback();
+                }
+                // Callbacks may have queued new requests or completed others
+                continue;
+            }
+
+            // Fences that no pending request waits on give their events back
+            for (auto it = m_armed.begin(); it != m_armed.end();)
+            {
+                if (pending.count(it->first) == 0)
+                {
+                    m_eventPool.push_back(it->second.event);
+                    it = m_armed.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+
+            // The fences pending here belong to queued requests, so there are never more than c_maxFences
+            events.clear();
+            events.push_back(m_wakeEvent);
+            for (const auto& wait : pending)
+            {
+                auto found = m_armed.find(wait.first);
+                if (found == m_armed.end())
+                {
+                    found = m_armed.emplace(wait.first, ArmedFence{acquireEvent(), 0}).first;
+                }
+                ArmedFence& armed = found->second;
+                if (armed.value != wait.second)
+                {
+                    armed.value = wait.second;
+                    wait.first->SetEventOnCompletion(wait.second, armed.event);
+                }
+                events.push_back(armed.event);
+            }
+            waitAnyNativeEvent(events);
+        }
+    }
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Request>> m_incoming;
+    std::unordered_map<Fence*, size_t> m_fenceRequests; // Queued or active requests per fence
+    bool m_stop = false;
+
+    // Only touched by the waiter thread
+    std::unordered_map<Fence*, ArmedFence> m_armed;
+    std::vector<NativeEvent> m_eventPool;
+
+    NativeEvent m_wakeEvent;
+    std::thread m_thread;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+// Region of interest transfer.
+//
+// Only a rectangle of the frame, e.g. where an operator is looking, is sent
+// at full resolution every frame, the periphery is sent downscaled by an
+// integer factor (downscaleBox() in Upscale.hpp). The receiver upscales the
+// periphery and puts the rectangle on top. The rectangle keeps its size but
+// may move every frame, its edges are aligned to the scale so they fall on
+// periphery pixel boundaries.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Upscale.hpp"
+
+namespace foveation
+{
+struct Rect
+{
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// "x,y,width,height"
+inline bool parseRect(const std::string& text, Rect& rect)
+{
+    return std::sscanf(text.c_str(), "%u,%u,%u,%u", &rect.x, &rect.y, &rect.width, &rect.height) == 4 && rect.width > 0 && rect.height > 0;
+}
+
+// Shrunk and moved to lie inside the frame with every edge on a multiple of alignment
+inline Rect alignRect(Rect rect, uint32_t frameWidth, uint32_t frameHeight, uint32_t alignment)
+{
+    rect.width = (std::max)(alignment, (std::min)(rect.width, frameWidth) / alignment * alignment);
+    rect.height = (std::max)(alignment, (std::min)(rect.height, frameHeight) / alignment * alignment);
+    rect.x = (std::min)(rect.x / alignment * alignment, frameWidth - rect.width);
+    rect.y = (std::min)(rect.y / alignment * alignment, frameHeight - rect.height);
+    return rect;
+}
+
+// Moves the rectangle over the whole frame on a Lissajous path, standing in for a gaze tracker
+inline Rect sweepRect(const Rect& rect, uint64_t frame, uint32_t frameWidth, uint32_t frameHeight, uint32_t alignment)
+{
+    const double rangeX = frameWidth > rect.width ? (frameWidth - rect.width) / 2.0 : 0.0;
+    const double rangeY = frameHeight > rect.height ? (frameHeight - rect.height) / 2.0 : 0.0;
+    Rect moved = rect;
+    moved.x = static_cast<uint32_t>(rangeX * (1.0 + std::sin(frame * 0.021)));
+    moved.y = static_cast<uint32_t>(rangeY * (1.0 + std::sin(frame * 0.034)));
+    return alignRect(moved, frameWidth, frameHeight, alignment);
+}
+
+struct TransferBytes
+{
+    size_t full = 0; // The whole frame at full resolution
+    size_t periphery = 0;
+    size_t roi = 0;
+
+    double savedFraction() const
+    {
+        return full > 0 ? 1.0 - static_cast<double>(periphery + roi) / full : 0.0;
+    }
+};
+
+inline TransferBytes transferBytes(const Rect& roi, uint32_t frameWidth, uint32_t frameHeight, uint32_t scale, uint32_t bytesPerPixel)
+{
+    TransferBytes bytes;
+    bytes.full = static_cast<size_t>(frameWidth) * frameHeight * bytesPerPixel;
+    bytes.periphery = static_cast<size_t>(frameWidth / scale) * (frameHeight / scale) * bytesPerPixel;
+    bytes.roi = static_cast<size_t>(roi.width) * roi.height * bytesPerPixel;
+    return bytes;
+}
+
+// Copies the rectangle out of a frame, rows of bytesPerPixel * rect.width bytes
+inline void copyRect(const uint8_t* source, uint32_t sourcePitch, const Rect& rect, uint32_t bytesPerPixel, uint8_t* destination, uint32_t destinationPitch)
+{
+    for (uint32_t row = 0; row < rect.height; ++row)
+    {
+        std::memcpy(destination + static_cast<size_t>(row) * destinationPitch, source + static_cast<size_t>(rect.y + row) * sourcePitch + static_cast<size_t>(rect.x) * bytesPerPixel,
+                    static_cast<size_t>(rect.width) * bytesPerPixel);
+    }
+}
+
+// Full RGBA8 frame from the periphery (1/scale of the frame size per axis) and the rectangle
+inline void reconstruct(const uint8_t* periphery, uint32_t peripheryPitch, const uint8_t* roi, uint32_t roiPitch, const Rect& rect, uint32_t frameWidth, uint32_t frameHeight,
+                        uint32_t scale, uint8_t* destination, uint32_t destinationPitch)
+{
+    upscale::upscaleLanczos2(periphery, peripheryPitch, frameWidth / scale, frameHeight / scale, scale, destination, destinationPitch);
+    for (uint32_t row = 0; row < rect.height; ++row)
+    {
+        std::memcpy(destination + static_cast<size_t>(rect.y + row) * destinationPitch + static_cast<size_t>(rect.x) * 4, roi + static_cast<size_t>(row) * roiPitch, static_cast<size_t>(rect.width) * 4);
+    }
+}
+} // namespace foveation
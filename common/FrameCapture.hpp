@@ -0,0 +1,667 @@
+#pragma once
+
+// Frame capture to disk.
+//
+// CaptureWriter keeps a fixed number of page aligned frame buffers and writes
+// them with unbuffered I/O: io_uring with registered buffers on Linux,
+// overlapped WriteFile with FILE_FLAG_NO_BUFFERING on Windows. write() copies
+// the frame into the next buffer and returns as soon as the write is queued,
+// it only blocks when every buffer is still being written, i.e. when the disk
+// is slower than the frames arrive.
+//
+// The file starts with a CaptureFileHeader padded to c_captureAlignment. Frame
+// i of the file starts at c_captureAlignment + i * frameStride and holds the
+// packed rows. The index after the last frame maps every frame to the frame
+// number it was captured from, since a capture that can not keep up skips
+// frames. The header and the index are written when the capture is finished.
+// The file is grown ahead of the writes, c_captureReserveFrames frames at a
+// time, since a write that extends the file is synchronous on Windows, and is
+// cut back to the frames that were written when the capture is finished.
+//
+// CaptureReader maps a finished capture into memory, so a frame can be handed
+// to an upload as is. prefetch() starts reading the next frames in the
+// background (MADV_WILLNEED, PrefetchVirtualMemory on Windows) so a replay does
+// not wait for the disk.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "HostMemory.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+const uint64_t c_captureAlignment = 4096;
+const char c_captureMagic[8] = {'M', 'G', 'P', 'U', 'C', 'A', 'P', '\0'};
+const uint32_t c_captureVersion = 1;
+const uint64_t c_captureReserveFrames = 32;
+
+struct CaptureFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowBytes; // Rows are packed
+    uint64_t frameStride; // Multiple of c_captureAlignment
+    uint64_t frameCount;
+    uint64_t indexOffset;
+};
+
+struct CaptureIndexEntry
+{
+    uint64_t frameNumber; // Of the captured stream, not consecutive when frames were skipped
+    uint64_t offset;
+    int64_t captureTime; // Steady clock in nanoseconds when the frame was handed to the writer
+};
+
+class CaptureWriter
+{
+public:
+    CaptureWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t queueDepth) :
+        m_path(path),
+        m_slots(queueDepth)
+    {
+        m_header = CaptureFileHeader{};
+        std::memcpy(m_header.magic, c_captureMagic, sizeof(c_captureMagic));
+        m_header.version = c_captureVersion;
+        m_header.width = width;
+        m_header.height = height;
+        m_header.rowBytes = width * bytesPerPixel;
+        m_header.frameStride = (static_cast<uint64_t>(m_header.rowBytes) * height + c_captureAlignment - 1) / c_captureAlignment * c_captureAlignment;
+
+        for (Slot& slot : m_slots)
+        {
+            slot.buffer = HostBuffer(static_cast<size_t>(m_header.frameStride));
+            if (slot.buffer.data() == nullptr)
+            {
+                return;
+            }
+        }
+        open();
+    }
+
+    ~CaptureWriter()
+    {
+        finish();
+    }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    bool isOpen() const
+    {
+        return m_open;
+    }
+
+    // Copies the frame's rows into the next free buffer and queues its write.
+    // Returns false when the capture is not open or the write could not be queued.
+    bool write(uint64_t frameNumber, const void* data, uint32_t rowPitch)
+    {
+        if (!m_open)
+        {
+            return false;
+        }
+        if (m_submitCount == 0)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        const uint32_t slotIndex = static_cast<uint32_t>(m_submitCount % m_slots.size());
+        Slot& slot = m_slots[slotIndex];
+        if (slot.busy)
+        {
+            waitForSlot(slotIndex);
+        }
+
+        const uint8_t* rows = static_cast<const uint8_t*>(data);
+        for (uint32_t row = 0; row < m_header.height; ++row)
+        {
+            std::memcpy(slot.buffer.data() + static_cast<size_t>(row) * m_header.rowBytes, rows + static_cast<size_t>(row) * rowPitch, m_header.rowBytes);
+        }
+
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        slot.entry = CaptureIndexEntry{frameNumber, c_captureAlignment + m_submitCount * m_header.frameStride, now};
+        const uint64_t end = slot.entry.offset + m_header.frameStride;
+        if (end > m_reservedSize)
+        {
+            m_reservedSize = end + (c_captureReserveFrames - 1) * m_header.frameStride;
+            reserve(m_reservedSize);
+        }
+        if (!submit(slotIndex))
+        {
+            ++m_failedWrites;
+            return false;
+        }
+        slot.busy = true;
+        ++m_submitCount;
+        return true;
+    }
+
+    // Waits for the queued writes and writes the index and the header
+    void finish()
+    {
+        if (!m_open)
+        {
+            return;
+        }
+        for (uint32_t i = 0; i < m_slots.size(); ++i)
+        {
+            if (m_slots[i].busy)
+            {
+                waitForSlot(i);
+            }
+        }
+        m_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        // The index follows the last frame, the rest of the reserved space goes
+        m_header.indexOffset = c_captureAlignment + m_submitCount * m_header.frameStride;
+        truncate(m_header.indexOffset);
+        close();
+        m_open = false;
+
+        // Writes complete out of order, the index goes by the position in the file
+        std::sort(m_index.begin(), m_index.end(), [](const CaptureIndexEntry& a, const CaptureIndexEntry& b) { return a.offset < b.offset; });
+        m_header.frameCount = m_index.size();
+
+        std::fstream file(m_path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(m_header.indexOffset));
+        file.write(reinterpret_cast<const char*>(m_index.data()), static_cast<std::streamsize>(m_index.size() * sizeof(CaptureIndexEntry)));
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    }
+
+    uint64_t framesWritten() const
+    {
+        return m_index.size();
+    }
+
+    uint64_t failedWrites() const
+    {
+        return m_failedWrites;
+    }
+
+    // Bytes per second from the first write until every write had completed, valid after finish()
+    double throughput() const
+    {
+        return m_elapsed > 0.0 ? m_index.size() * static_cast<double>(m_header.frameStride) / m_elapsed : 0.0;
+    }
+
+    const char* backendName() const
+    {
+        return m_backendName;
+    }
+
+private:
+    struct Slot
+    {
+        HostBuffer buffer;
+        bool busy = false;
+        CaptureIndexEntry entry{};
+#if defined(_WIN32)
+        OVERLAPPED overlapped{};
+#else
+        bool pwriteSucceeded = false;
+#endif
+    };
+
+    void completed(uint32_t slotIndex, bool succeeded)
+    {
+        Slot& slot = m_slots[slotIndex];
+        slot.busy = false;
+        if (succeeded)
+        {
+            m_index.push_back(slot.entry);
+        }
+        else
+        {
+            ++m_failedWrites;
+        }
+    }
+
+#if defined(_WIN32)
+    void open()
+    {
+        // The frame buffers are page aligned and the stride is a multiple of the sector size
+        m_file = CreateFileA(m_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+        for (Slot& slot : m_slots)
+        {
+            slot.overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        }
+        m_validDataAllowed = enableManageVolumePrivilege();
+        m_backendName = m_validDataAllowed ? "overlapped unbuffered WriteFile, valid data set ahead" : "overlapped unbuffered WriteFile";
+        m_open = true;
+    }
+
+    // Without SetFileValidData the system zero fills the reserved space ahead
+    // of the writes, which still saves extending the file on every write
+    void reserve(uint64_t size)
+    {
+        if (setEndOfFile(size) && m_validDataAllowed)
+        {
+            SetFileValidData(m_file, static_cast<LONGLONG>(size));
+        }
+    }
+
+    bool truncate(uint64_t size)
+    {
+        return setEndOfFile(size);
+    }
+
+    bool setEndOfFile(uint64_t size)
+    {
+        LARGE_INTEGER end{};
+        end.QuadPart = static_cast<LONGLONG>(size);
+        return SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN) && SetEndOfFile(m_file);
+    }
+
+    // SetFileValidData needs the "Perform volume maintenance tasks" privilege
+    static bool enableManageVolumePrivilege()
+    {
+        HANDLE token = nullptr;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        {
+            return false;
+        }
+        TOKEN_PRIVILEGES privileges{};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool enabled = LookupPrivilegeValue(nullptr, SE_MANAGE_VOLUME_NAME, &privileges.Privileges[0].Luid) &&
+                       AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                       GetLastError() == ERROR_SUCCESS; // Not ERROR_NOT_ALL_ASSIGNED
+        CloseHandle(token);
+        return enabled;
+    }
+
+    bool submit(uint32_t slotIndex)
+    {
+        Slot& slot = m_slots[slotIndex];
+        slot.overlapped.Offset = static_cast<DWORD>(slot.entry.offset);
+        slot.overlapped.OffsetHigh = static_cast<DWORD>(slot.entry.offset >> 32);
+        ResetEvent(slot.overlapped.hEvent);
+        return WriteFile(m_file, slot.buffer.data(), static_cast<DWORD>(m_header.frameStride), nullptr, &slot.overlapped) || GetLastError() == ERROR_IO_PENDING;
+    }
+
+    void waitForSlot(uint32_t slotIndex)
+    {
+        DWORD written = 0;
+        const bool succeeded = GetOverlappedResult(m_file, &m_slots[slotIndex].overlapped, &written, TRUE) && written == m_header.frameStride;
+        completed(slotIndex, succeeded);
+    }
+
+    void close()
+    {
+        for (Slot& slot : m_slots)
+        {
+            CloseHandle(slot.overlapped.hEvent);
+        }
+        CloseHandle(m_file);
+    }
+
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    bool m_validDataAllowed = false;
+#else
+    void open()
+    {
+        // Not every file system takes O_DIRECT, e.g. tmpfs
+        m_file = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (m_file < 0)
+        {
+            m_file = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (m_file < 0)
+            {
+                return;
+            }
+        }
+        m_open = true;
+        m_backendName = "pwrite";
+        if (!setupRing())
+        {
+            return;
+        }
+        m_backendName = "io_uring";
+
+        // Registered buffers are pinned once instead of on every write
+        std::vector<iovec> buffers;
+        for (Slot& slot : m_slots)
+        {
+            buffers.push_back(iovec{slot.buffer.data(), slot.buffer.size()});
+        }
+        if (syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0)
+        {
+            m_fixedBuffers = true;
+            m_backendName = "io_uring with registered buffers";
+        }
+    }
+
+    // Not every file system supports fallocate, the writes extend the file then
+    void reserve(uint64_t size)
+    {
+        fallocate(m_file, 0, 0, static_cast<off_t>(size));
+    }
+
+    bool truncate(uint64_t size)
+    {
+        return ftruncate(m_file, static_cast<off_t>(size)) == 0;
+    }
+
+    bool setupRing()
+    {
+        io_uring_params params{};
+        const int ring = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(m_slots.size()), &params));
+        if (ring < 0)
+        {
+            return false;
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap)
+        {
+            m_sqRingSize = m_cqRingSize = (std::max)(m_sqRingSize, m_cqRingSize);
+        }
+        void* sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+        void* cqRing = singleMap ? sqRing : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            ::close(ring);
+            return false;
+        }
+
+        m_ring = ring;
+        m_sqRing = static_cast<uint8_t*>(sqRing);
+        m_cqRing = static_cast<uint8_t*>(cqRing);
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+        m_sqTail = reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.array);
+        m_cqHead = reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(m_cqRing + params.cq_off.cqes);
+        return true;
+    }
+
+    bool submit(uint32_t slotIndex)
+    {
+        Slot& slot = m_slots[slotIndex];
+        if (m_ring < 0)
+        {
+            // Completes right away, the slot is reaped by the next waitForSlot()
+            const ssize_t written = pwrite(m_file, slot.buffer.data(), static_cast<size_t>(m_header.frameStride), static_cast<off_t>(slot.entry.offset));
+            slot.pwriteSucceeded = written == static_cast<ssize_t>(m_header.frameStride);
+            return true;
+        }
+
+        // At most queueDepth writes are in flight, so the submission queue never overflows
+        const unsigned tail = *m_sqTail;
+        const unsigned index = tail & m_sqMask;
+        io_uring_sqe& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = m_fixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = m_file;
+        sqe.addr = reinterpret_cast<uint64_t>(slot.buffer.data());
+        sqe.len = static_cast<uint32_t>(m_header.frameStride);
+        sqe.off = slot.entry.offset;
+        sqe.buf_index = static_cast<uint16_t>(slotIndex);
+        sqe.user_data = slotIndex;
+        m_sqArray[index] = index;
+        __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+        return syscall(__NR_io_uring_enter, m_ring, 1, 0, 0, nullptr, 0) == 1;
+    }
+
+    // Reaps completions until the slot's write has completed
+    void waitForSlot(uint32_t slotIndex)
+    {
+        if (m_ring < 0)
+        {
+            completed(slotIndex, m_slots[slotIndex].pwriteSucceeded);
+            return;
+        }
+        while (m_slots[slotIndex].busy)
+        {
+            const unsigned head = *m_cqHead;
+            if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+            {
+                syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                continue;
+            }
+            const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            const uint32_t completedSlot = static_cast<uint32_t>(cqe.user_data);
+            const bool succeeded = cqe.res == static_cast<int32_t>(m_header.frameStride);
+            __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+            completed(completedSlot, succeeded);
+        }
+    }
+
+    void close()
+    {
+        if (m_ring >= 0)
+        {
+            munmap(m_sqes, m_sqesSize);
+            if (m_cqRing != m_sqRing)
+            {
+                munmap(m_cqRing, m_cqRingSize);
+            }
+            munmap(m_sqRing, m_sqRingSize);
+            ::close(m_ring); // Also unregisters the buffers
+            m_ring = -1;
+        }
+        ::close(m_file);
+    }
+
+    int m_file = -1;
+    int m_ring = -1;
+    bool m_fixedBuffers = false;
+    uint8_t* m_sqRing = nullptr;
+    uint8_t* m_cqRing = nullptr;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    size_t m_sqesSize = 0;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned* m_sqArray = nullptr;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+#endif
+
+    std::string m_path;
+    CaptureFileHeader m_header;
+    std::vector<Slot> m_slots;
+    std::vector<CaptureIndexEntry> m_index;
+    uint64_t m_submitCount = 0;
+    uint64_t m_reservedSize = 0;
+    uint64_t m_failedWrites = 0;
+    bool m_open = false;
+    const char* m_backendName = "none";
+    std::chrono::steady_clock::time_point m_start;
+    double m_elapsed = 0.0;
+};
+
+class CaptureReader
+{
+public:
+    explicit CaptureReader(const std::string& path)
+    {
+        if (!map(path))
+        {
+            return;
+        }
+        if (m_size < sizeof(CaptureFileHeader))
+        {
+            return;
+        }
+        const CaptureFileHeader& header = *reinterpret_cast<const CaptureFileHeader*>(m_data);
+        const uint64_t frameSize = static_cast<uint64_t>(header.rowBytes) * header.height;
+        if (std::memcmp(header.magic, c_captureMagic, sizeof(c_captureMagic)) != 0 || header.version != c_captureVersion ||
+            header.indexOffset > m_size || header.frameCount > (m_size - header.indexOffset) / sizeof(CaptureIndexEntry))
+        {
+            return;
+        }
+        const CaptureIndexEntry* index = reinterpret_cast<const CaptureIndexEntry*>(m_data + header.indexOffset);
+        for (uint64_t i = 0; i < header.frameCount; ++i)
+        {
+            if (index[i].offset > m_size || frameSize > m_size - index[i].offset)
+            {
+                return;
+            }
+        }
+        m_header = &header;
+        m_index = index;
+    }
+
+    ~CaptureReader()
+    {
+        unmap();
+    }
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    // False when the file could not be mapped or is not a finished capture
+    bool isOpen() const
+    {
+        return m_header != nullptr;
+    }
+
+    const CaptureFileHeader& header() const
+    {
+        return *m_header;
+    }
+
+    uint64_t frameCount() const
+    {
+        return m_header->frameCount;
+    }
+
+    // Packed rows, header().rowBytes apart
+    const uint8_t* frame(uint64_t i) const
+    {
+        return m_data + m_index[i].offset;
+    }
+
+    uint64_t frameNumber(uint64_t i) const
+    {
+        return m_index[i].frameNumber;
+    }
+
+    // Starts reading count frames from first on, wrapping around at the end
+    void prefetch(uint64_t first, uint64_t count) const
+    {
+        const size_t frameSize = static_cast<size_t>(m_header->rowBytes) * m_header->height;
+        count = (std::min)(count, frameCount());
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            const uint8_t* data = frame((first + i) % frameCount());
+#if defined(_WIN32)
+            WIN32_MEMORY_RANGE_ENTRY range{const_cast<uint8_t*>(data), frameSize};
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+            // Linux reads at most one readahead window per call, so a frame is
+            // advised in chunks no larger than the usual 128 KB window
+            for (size_t offset = 0; offset < frameSize; offset += c_prefetchChunkSize)
+            {
+                madvise(const_cast<uint8_t*>(data) + offset, (std::min)(c_prefetchChunkSize, frameSize - offset), MADV_WILLNEED);
+            }
+#endif
+        }
+    }
+
+private:
+#if defined(_WIN32)
+    bool map(const std::string& path)
+    {
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER size{};
+        GetFileSizeEx(m_file, &size);
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping == nullptr)
+        {
+            return false;
+        }
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        m_size = m_data != nullptr ? static_cast<size_t>(size.QuadPart) : 0;
+        return m_data != nullptr;
+    }
+
+    void unmap()
+    {
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+    }
+
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    static constexpr size_t c_prefetchChunkSize = 128 * 1024;
+
+    bool map(const std::string& path)
+    {
+        const int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+        const off_t size = lseek(file, 0, SEEK_END);
+        void* data = size > 0 ? mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+        // The mapping keeps the file open
+        ::close(file);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        m_data = static_cast<const uint8_t*>(data);
+        m_size = static_cast<size_t>(size);
+        return true;
+    }
+
+    void unmap()
+    {
+        if (m_data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+    }
+#endif
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    const CaptureFileHeader* m_header = nullptr;
+    const CaptureIndexEntry* m_index = nullptr;
+};
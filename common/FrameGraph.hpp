@@ -0,0 +1,360 @@
+#pragma once
+
+// Small frame graph for the cross-adapter programs.
+//
+// Resources and queues are registered once. Every frame the passes are added
+// in submission order with the state they need each resource in, and compile()
+// works out the resource barriers and the cross-queue fence signals and waits.
+// Resource states carry over from frame to frame, so the first use of a
+// resource needs no special casing.
+//
+// Resources on different adapters that alias the same cross-adapter memory
+// share a memory id. Hazards are tracked per memory, states per resource. A
+// read after a read needs no wait unless the resource changes state in
+// between, then the queue that transitions it waits for the other readers.
+//
+// compile() is plain C++, the backend maps ResourceState to its own states and
+// the signal indices to its own fences.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace framegraph
+{
+using QueueId = uint32_t;
+using ResourceId = uint32_t;
+using MemoryId = uint32_t;
+using PassId = uint32_t;
+
+enum class QueueType
+{
+    Direct,
+    Copy // Only accesses resources in the common state, no barriers are recorded on it
+};
+
+enum ResourceState : uint32_t
+{
+    Common = 0,
+    Present = 0,
+    RenderTarget = 1 << 0,
+    CopySource = 1 << 1,
+    CopyDest = 1 << 2,
+    ShaderResource = 1 << 3,
+    UnorderedAccess = 1 << 4,
+};
+
+const uint32_t c_readOnlyStates = CopySource | ShaderResource;
+
+inline bool isReadOnly(uint32_t state)
+{
+    return state != Common && (state & ~c_readOnlyStates) == 0;
+}
+
+struct Access
+{
+    ResourceId resource;
+    uint32_t state;
+    bool write;
+};
+
+inline Access read(ResourceId resource, uint32_t state)
+{
+    return Access{resource, state, false};
+}
+
+inline Access write(ResourceId resource, uint32_t state)
+{
+    return Access{resource, state, true};
+}
+
+struct Barrier
+{
+    ResourceId resource;
+    uint32_t before;
+    uint32_t after;
+};
+
+// Wait for the signalIndex:th signal of the queue in this frame
+struct QueueWait
+{
+    QueueId queue;
+    uint32_t signalIndex;
+};
+
+struct CompiledPass
+{
+    std::vector<QueueWait> waits; // Before the pass is submitted
+    std::vector<Barrier> barriersBefore; // One batch
+    std::vector<Barrier> barriersAfter; // One batch, leaves resources ready for other queues or the final state
+    uint32_t signalIndex = 0; // 1-based signal of the pass' queue after it, 0 when nobody waits for it
+};
+
+struct CompiledFrame
+{
+    std::vector<CompiledPass> passes;
+    std::vector<uint32_t> signalCounts; // Per queue
+    std::vector<std::string> errors;
+    uint32_t barrierCount = 0;
+    uint32_t barrierBatchCount = 0;
+    uint32_t waitCount = 0;
+};
+
+class FrameGraph
+{
+public:
+    QueueId addQueue(uint32_t adapter, QueueType type)
+    {
+        m_queues.push_back(Queue{adapter, type});
+        return static_cast<QueueId>(m_queues.size() - 1);
+    }
+
+    MemoryId addMemory()
+    {
+        return m_memoryCount++;
+    }
+
+    ResourceId addResource(uint32_t initialState = Common)
+    {
+        return addResource(addMemory(), initialState);
+    }
+
+    // A view of memory that is shared with resources on other adapters
+    ResourceId addResource(MemoryId memory, uint32_t initialState)
+    {
+        m_resources.push_back(Resource{memory, initialState});
+        return static_cast<ResourceId>(m_resources.size() - 1);
+    }
+
+    uint32_t state(ResourceId resource) const
+    {
+        return m_resources[resource].state;
+    }
+
+    void beginFrame()
+    {
+        m_passes.clear();
+        m_finalStates.clear();
+    }
+
+    PassId addPass(QueueId queue, std::vector<Access> accesses)
+    {
+        m_passes.push_back(Pass{queue, std::move(accesses)});
+        return static_cast<PassId>(m_passes.size() - 1);
+    }
+
+    // The resource is transitioned to the state after its last pass of the frame
+    void setFinalState(ResourceId resource, uint32_t state)
+    {
+        m_finalStates.push_back(Access{resource, state, false});
+    }
+
+    CompiledFrame compile()
+    {
+        const size_t passCount = m_passes.size();
+        const size_t queueCount = m_queues.size();
+
+        CompiledFrame frame;
+        frame.passes.resize(passCount);
+        frame.signalCounts.assign(queueCount, 0);
+
+        std::vector<Hazard> hazards(m_memoryCount, Hazard{-1, std::vector<int>(queueCount, -1)});
+        // Latest pass of each other queue that a queue has already waited for
+        std::vector<std::vector<int>> waited(queueCount, std::vector<int>(queueCount, -1));
+        std::vector<std::vector<int>> producers(passCount);
+        std::vector<bool> signals(passCount, false);
+        std::vector<int> lastAccess(m_resources.size(), -1);
+
+        for (size_t p = 0; p < passCount; ++p)
+        {
+            const Pass& pass = m_passes[p];
+            const QueueId queue = pass.queue;
+
+            auto requireWait = [&](int producer) {
+                if (producer < 0)
+                {
+                    return;
+                }
+                const QueueId producerQueue = m_passes[producer].queue;
+                if (producerQueue == queue || waited[queue][producerQueue] >= producer)
+                {
+                    return;
+                }
+                waited[queue][producerQueue] = producer;
+                producers[p].push_back(producer);
+                signals[producer] = true;
+            };
+
+            for (const Access& access : pass.accesses)
+            {
+                const Hazard& hazard = hazards[m_resources[access.resource].memory];
+                requireWait(hazard.lastWriter);
+                if (access.write)
+                {
+                    for (int reader : hazard.readers)
+                    {
+                        requireWait(reader);
+                    }
+                }
+            }
+
+            for (const Access& access : pass.accesses)
+            {
+                Hazard& hazard = hazards[m_resources[access.resource].memory];
+                if (access.write)
+                {
+                    hazard.lastWriter = static_cast<int>(p);
+                    hazard.readers.assign(queueCount, -1);
+                }
+                else
+                {
+                    hazard.readers[queue] = static_cast<int>(p);
+                }
+            }
+
+            for (const Access& access : pass.accesses)
+            {
+                Resource& resource = m_resources[access.resource];
+                if (m_queues[queue].type == QueueType::Copy)
+                {
+                    // The previous user on a direct queue leaves the resource in the common state
+                    if (resource.state != Common)
+                    {
+                        const int previous = lastAccess[access.resource];
+                        if (previous < 0 || m_queues[m_passes[previous].queue].type == QueueType::Copy)
+                        {
+                            frame.errors.push_back("Resource " + std::to_string(access.resource) + " is not in the common state for the copy queue");
+                        }
+                        else
+                        {
+                            // Even after a read, the copy must not start before the transition has run
+                            frame.passes[previous].barriersAfter.push_back(Barrier{access.resource, resource.state, Common});
+                            requireWait(previous);
+                        }
+                        resource.state = Common;
+                    }
+                }
+                else
+                {
+                    uint32_t target = access.state;
+                    if (!access.write && isReadOnly(resource.state) && (resource.state & access.state) == access.state)
+                    {
+                        target = resource.state;
+                    }
+                    else if (!access.write && isReadOnly(access.state))
+                    {
+                        target = combinedReadState(p, access.resource);
+                    }
+
+                    if (resource.state != target)
+                    {
+                        // Other queues that read the resource since its last write still use the old state
+                        for (int reader : hazards[resource.memory].readers)
+                        {
+                            requireWait(reader);
+                        }
+                        frame.passes[p].barriersBefore.push_back(Barrier{access.resource, resource.state, target});
+                        resource.state = target;
+                    }
+                }
+                lastAccess[access.resource] = static_cast<int>(p);
+            }
+        }
+
+        for (const Access& finalState : m_finalStates)
+        {
+            Resource& resource = m_resources[finalState.resource];
+            const int last = lastAccess[finalState.resource];
+            if (resource.state == finalState.state || last < 0)
+            {
+                continue;
+            }
+            if (m_queues[m_passes[last].queue].type == QueueType::Copy)
+            {
+                frame.errors.push_back("Final state of resource " + std::to_string(finalState.resource) + " can not be set on a copy queue");
+                continue;
+            }
+            frame.passes[last].barriersAfter.push_back(Barrier{finalState.resource, resource.state, finalState.state});
+            resource.state = finalState.state;
+        }
+
+        for (size_t p = 0; p < passCount; ++p)
+        {
+            if (signals[p])
+            {
+                frame.passes[p].signalIndex = ++frame.signalCounts[m_passes[p].queue];
+            }
+        }
+
+        for (size_t p = 0; p < passCount; ++p)
+        {
+            CompiledPass& compiled = frame.passes[p];
+            for (int producer : producers[p])
+            {
+                compiled.waits.push_back(QueueWait{m_passes[producer].queue, frame.passes[producer].signalIndex});
+            }
+            frame.waitCount += static_cast<uint32_t>(compiled.waits.size());
+            frame.barrierCount += static_cast<uint32_t>(compiled.barriersBefore.size() + compiled.barriersAfter.size());
+            frame.barrierBatchCount += (compiled.barriersBefore.empty() ? 0 : 1) + (compiled.barriersAfter.empty() ? 0 : 1);
+        }
+
+        return frame;
+    }
+
+private:
+    struct Queue
+    {
+        uint32_t adapter;
+        QueueType type;
+    };
+
+    struct Resource
+    {
+        MemoryId memory;
+        uint32_t state;
+    };
+
+    struct Pass
+    {
+        QueueId queue;
+        std::vector<Access> accesses;
+    };
+
+    struct Hazard
+    {
+        int lastWriter;
+        std::vector<int> readers; // Latest reading pass per queue since the last write
+    };
+
+    // Union of the read states that the following passes on the same queue need
+    // before the resource is written or used elsewhere, so one barrier serves them all.
+    uint32_t combinedReadState(size_t firstPass, ResourceId resource) const
+    {
+        const QueueId queue = m_passes[firstPass].queue;
+        uint32_t state = 0;
+        for (size_t p = firstPass; p < m_passes.size(); ++p)
+        {
+            for (const Access& access : m_passes[p].accesses)
+            {
+                if (access.resource != resource)
+                {
+                    continue;
+                }
+                if (access.write || m_passes[p].queue != queue || !isReadOnly(access.state))
+                {
+                    return state;
+                }
+                state |= access.state;
+            }
+        }
+        return state;
+    }
+
+    std::vector<Queue> m_queues;
+    std::vector<Resource> m_resources;
+    MemoryId m_memoryCount = 0;
+
+    std::vector<Pass> m_passes;
+    std::vector<Access> m_finalStates;
+};
+} // namespace framegraph
@@ -0,0 +1,193 @@
+#pragma once
+
+// Frame hashes for checking transfers between adapters.
+//
+// crc32c() uses the SSE4.2 CRC32 instruction (or the ARMv8 one) when the CPU
+// has it and a slice-by-8 table otherwise, both give the same values. Only a
+// few rows of a frame are hashed to keep the cost bounded: sampleRows() spreads
+// them over the frame and moves them by one row every frame, so over enough
+// frames every row is checked.
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FRAMEHASH_X64 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define FRAMEHASH_ARM_CRC 1
+#include <arm_acle.h>
+#endif
+
+namespace framehash
+{
+// Castagnoli polynomial, reflected
+const uint32_t c_crc32cPolynomial = 0x82f63b78;
+
+struct Crc32cTables
+{
+    uint32_t table[8][256];
+
+    Crc32cTables()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? c_crc32cPolynomial : 0);
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            for (int slice = 1; slice < 8; ++slice)
+            {
+                table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+inline const Crc32cTables& crc32cTables()
+{
+    static const Crc32cTables tables;
+    return tables;
+}
+
+// Without the inversions, see crc32c()
+inline uint32_t crc32cSoftware(uint32_t crc, const uint8_t* data, size_t size)
+{
+    const Crc32cTables& tables = crc32cTables();
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = tables.table[7][word & 0xff] ^ tables.table[6][(word >> 8) & 0xff] ^ tables.table[5][(word >> 16) & 0xff] ^ tables.table[4][(word >> 24) & 0xff] ^
+              tables.table[3][(word >> 32) & 0xff] ^ tables.table[2][(word >> 40) & 0xff] ^ tables.table[1][(word >> 48) & 0xff] ^ tables.table[0][word >> 56];
+    }
+    for (; size > 0; --size, ++data)
+    {
+        crc = (crc >> 8) ^ tables.table[0][(crc ^ *data) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(FRAMEHASH_X64)
+#if !defined(_MSC_VER)
+__attribute__((target("sse4.2")))
+#endif
+inline uint32_t crc32cHardware(uint32_t crc, const uint8_t* data, size_t size)
+{
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; --size, ++data)
+    {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+inline bool hasHardwareCrc32c()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#elif defined(FRAMEHASH_ARM_CRC)
+inline uint32_t crc32cHardware(uint32_t crc, const uint8_t* data, size_t size)
+{
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; --size, ++data)
+    {
+        crc = __crc32cb(crc, *data);
+    }
+    return crc;
+}
+
+inline bool hasHardwareCrc32c()
+{
+    return true;
+}
+#else
+inline uint32_t crc32cHardware(uint32_t crc, const uint8_t* data, size_t size)
+{
+    return crc32cSoftware(crc, data, size);
+}
+
+inline bool hasHardwareCrc32c()
+{
+    return false;
+}
+#endif
+
+// CRC-32C of the data. Pass the result of a previous call as crc to continue it.
+inline uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0)
+{
+    static const bool hardware = hasHardwareCrc32c();
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    return ~(hardware ? crc32cHardware(~crc, bytes, size) : crc32cSoftware(~crc, bytes, size));
+}
+
+// rowCount rows spread over the whole height, shifted by one row every frame.
+// Row i starts at i * height / rowCount and walks the ceil(height / rowCount)
+// rows up to the next start, so after that many frames every row, the last
+// ones too, has been sampled.
+inline std::vector<uint32_t> sampleRows(uint64_t frame, uint32_t height, uint32_t rowCount)
+{
+    std::vector<uint32_t> rows;
+    if (height == 0 || rowCount == 0)
+    {
+        return rows;
+    }
+    rowCount = rowCount < height ? rowCount : height;
+    const uint32_t period = (height + rowCount - 1) / rowCount;
+    const uint32_t offset = static_cast<uint32_t>(frame % period);
+    for (uint32_t i = 0; i < rowCount; ++i)
+    {
+        const uint32_t row = static_cast<uint32_t>(static_cast<uint64_t>(i) * height / rowCount) + offset;
+        rows.push_back(row < height ? row : height - 1);
+    }
+    return rows;
+}
+
+// Rows that fit in a budget of bytes per frame, at least one
+inline uint32_t rowsForBudget(size_t budgetBytes, uint32_t rowBytes, uint32_t height)
+{
+    const size_t rows = rowBytes > 0 ? budgetBytes / rowBytes : 0;
+    return rows < 1 ? 1 : (rows > height ? height : static_cast<uint32_t>(rows));
+}
+
+// One hash per sampled row. rowPitch is the distance between the rows in data.
+inline std::vector<uint32_t> hashRows(const void* data, uint32_t rowPitch, uint32_t rowBytes, const std::vector<uint32_t>& rows)
+{
+    std::vector<uint32_t> hashes;
+    hashes.reserve(rows.size());
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (uint32_t row : rows)
+    {
+        hashes.push_back(crc32c(bytes + static_cast<size_t>(row) * rowPitch, rowBytes));
+    }
+    return hashes;
+}
+} // namespace framehash
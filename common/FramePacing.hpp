@@ -0,0 +1,194 @@
+#pragma once
+
+// Frame pacing analysis from present statistics.
+//
+// One PresentSample is taken after every Present. The analysis only needs the
+// samples and the QPC frequency, so recorded traces (see writeTrace/readTrace)
+// can be analysed again offline on any platform.
+
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#if defined(_WIN32)
+#include <dxgi.h>
+#endif
+
+namespace pacing
+{
+struct PresentSample
+{
+    uint32_t presentId; // Presents issued by the application so far
+    uint32_t presentCount; // Present that was on screen when the statistics were sampled
+    uint32_t presentRefreshCount; // Vblank at which that present was displayed
+    uint32_t syncRefreshCount; // Vblank at which the statistics were sampled
+    int64_t syncQpcTime; // QPC time of syncRefreshCount
+};
+
+struct PacingStats
+{
+    size_t sampleCount = 0;
+    size_t intervalCount = 0;
+    double refreshPeriod = 0.0; // Seconds
+    double meanInterval = 0.0; // Seconds between displayed presents
+    double jitter = 0.0; // Standard deviation of the intervals
+    double maxInterval = 0.0;
+    uint64_t missedVblanks = 0;
+    uint64_t framesWithMissedVblanks = 0;
+    double meanQueueDepth = 0.0;
+    uint32_t maxQueueDepth = 0;
+};
+
+// Estimated QPC time at which the sampled present hit the screen.
+inline double displayTime(const PresentSample& sample, double refreshPeriodTicks)
+{
+    const double refreshesSinceDisplay = static_cast<double>(sample.syncRefreshCount - sample.presentRefreshCount);
+    return static_cast<double>(sample.syncQpcTime) - refreshesSinceDisplay * refreshPeriodTicks;
+}
+
+inline PacingStats analyze(const std::vector<PresentSample>& samples, double qpcFrequency, uint32_t syncInterval = 1)
+{
+    PacingStats stats;
+    stats.sampleCount = samples.size();
+    if (samples.empty() || qpcFrequency <= 0.0)
+    {
+        return stats;
+    }
+
+    uint64_t queueDepthTotal = 0;
+    for (const PresentSample& sample : samples)
+    {
+        const uint32_t depth = sample.presentId - sample.presentCount;
+        queueDepthTotal += depth;
+        stats.maxQueueDepth = depth > stats.maxQueueDepth ? depth : stats.maxQueueDepth;
+    }
+    stats.meanQueueDepth = static_cast<double>(queueDepthTotal) / samples.size();
+
+    const PresentSample& firstSample = samples.front();
+    const PresentSample& lastSample = samples.back();
+    const uint32_t refreshSpan = lastSample.syncRefreshCount - firstSample.syncRefreshCount;
+    if (refreshSpan == 0)
+    {
+        return stats;
+    }
+    const double refreshPeriodTicks = static_cast<double>(lastSample.syncQpcTime - firstSample.syncQpcTime) / refreshSpan;
+    stats.refreshPeriod = refreshPeriodTicks / qpcFrequency;
+
+    std::vector<double> intervals;
+    const PresentSample* previous = &firstSample;
+    for (size_t i = 1; i < samples.size(); ++i)
+    {
+        const PresentSample& sample = samples[i];
+        const uint32_t presentDelta = sample.presentCount - previous->presentCount;
+        if (presentDelta == 0)
+        {
+            // Nothing new reached the screen since the previous sample
+            continue;
+        }
+
+        const uint32_t refreshDelta = sample.presentRefreshCount - previous->presentRefreshCount;
+        const uint32_t expectedRefreshes = presentDelta * syncInterval;
+        if (refreshDelta > expectedRefreshes)
+        {
+            stats.missedVblanks += refreshDelta - expectedRefreshes;
+            ++stats.framesWithMissedVblanks;
+        }
+
+        const double elapsed = (displayTime(sample, refreshPeriodTicks) - displayTime(*previous, refreshPeriodTicks)) / qpcFrequency;
+        intervals.push_back(elapsed / presentDelta);
+        previous = &sample;
+    }
+
+    stats.intervalCount = intervals.size();
+    if (intervals.empty())
+    {
+        return stats;
+    }
+
+    double total = 0.0;
+    for (double interval : intervals)
+    {
+        total += interval;
+        stats.maxInterval = interval > stats.maxInterval ? interval : stats.maxInterval;
+    }
+    stats.meanInterval = total / intervals.size();
+
+    double variance = 0.0;
+    for (double interval : intervals)
+    {
+        variance += (interval - stats.meanInterval) * (interval - stats.meanInterval);
+    }
+    stats.jitter = std::sqrt(variance / intervals.size());
+
+    return stats;
+}
+
+inline void writeReport(std::ostream& out, const PacingStats& stats)
+{
+    out << "Frame pacing" << std::endl
+        << "Samples: " << stats.sampleCount << std::endl
+        << "Refresh period: " << (stats.refreshPeriod * 1000.0) << "ms" << std::endl
+        << "Present interval: " << (stats.meanInterval * 1000.0) << "ms (max " << (stats.maxInterval * 1000.0) << "ms)" << std::endl
+        << "Jitter: " << (stats.jitter * 1000.0) << "ms" << std::endl
+        << "Missed vblanks: " << stats.missedVblanks << " in " << stats.framesWithMissedVblanks << " frames" << std::endl
+        << "Queue depth: " << stats.meanQueueDepth << " (max " << stats.maxQueueDepth << ")" << std::endl;
+}
+
+// Trace format: first line is the QPC frequency, then one sample per line.
+// The frequency is written with all the digits a double needs to read back
+// the same, the default six would round e.g. 2.99e9 ticks per second.
+inline void writeTrace(std::ostream& out, const std::vector<PresentSample>& samples, double qpcFrequency)
+{
+    const std::streamsize precision = out.precision(17);
+    out << qpcFrequency << "\n";
+    out.precision(precision);
+    for (const PresentSample& s : samples)
+    {
+        out << s.presentId << " " << s.presentCount << " " << s.presentRefreshCount << " " << s.syncRefreshCount << " " << s.syncQpcTime << "\n";
+    }
+}
+
+inline std::vector<PresentSample> readTrace(std::istream& in, double& qpcFrequency)
+{
+    std::vector<PresentSample> samples;
+    qpcFrequency = 0.0;
+    in >> qpcFrequency;
+
+    PresentSample s{};
+    while (in >> s.presentId >> s.presentCount >> s.presentRefreshCount >> s.syncRefreshCount >> s.syncQpcTime)
+    {
+        samples.push_back(s);
+    }
+    return samples;
+}
+
+#if defined(_WIN32)
+// Returns false when the statistics are not available, e.g. before the first
+// present reached the screen or after a mode change.
+inline bool sampleSwapChain(IDXGISwapChain* swapChain, PresentSample& sample)
+{
+    DXGI_FRAME_STATISTICS frameStatistics{};
+    UINT lastPresentCount = 0;
+    if (FAILED(swapChain->GetFrameStatistics(&frameStatistics)) || FAILED(swapChain->GetLastPresentCount(&lastPresentCount)))
+    {
+        return false;
+    }
+    sample.presentId = lastPresentCount;
+    sample.presentCount = frameStatistics.PresentCount;
+    sample.presentRefreshCount = frameStatistics.PresentRefreshCount;
+    sample.syncRefreshCount = frameStatistics.SyncRefreshCount;
+    sample.syncQpcTime = frameStatistics.SyncQPCTime.QuadPart;
+    return true;
+}
+
+inline double qpcFrequency()
+{
+    LARGE_INTEGER frequency{};
+    QueryPerformanceFrequency(&frequency);
+    return static_cast<double>(frequency.QuadPart);
+}
+#endif
+} // namespace pacing
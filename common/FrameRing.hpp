@@ -0,0 +1,60 @@
+#pragma once
+
+// Ring of per-frame resource slots with its own depth.
+//
+// The producer and transfer stages cycle through their command allocators,
+// textures and shared slots with a FrameRing instead of the swap chain's back
+// buffer index, so the number of frames they keep in flight does not depend on
+// the number of back buffers. Every slot remembers the fence value of the last
+// frame that used it, which has to be reached before the slot is reused.
+
+#include <cstdint>
+#include <vector>
+
+class FrameRing
+{
+public:
+    explicit FrameRing(uint32_t depth) :
+        m_fenceValues(depth, 0)
+    {
+    }
+
+    uint32_t depth() const
+    {
+        return static_cast<uint32_t>(m_fenceValues.size());
+    }
+
+    // Moves to the slot of the next frame and returns it.
+    uint32_t advance()
+    {
+        m_current = m_frameCount % depth();
+        ++m_frameCount;
+        return m_current;
+    }
+
+    uint32_t current() const
+    {
+        return m_current;
+    }
+
+    uint64_t frameCount() const
+    {
+        return m_frameCount;
+    }
+
+    // Fence value of the last frame that used the slot, 0 if it has not been used yet.
+    uint64_t fenceValue(uint32_t slot) const
+    {
+        return m_fenceValues[slot];
+    }
+
+    void setFenceValue(uint32_t slot, uint64_t value)
+    {
+        m_fenceValues[slot] = value;
+    }
+
+private:
+    std::vector<uint64_t> m_fenceValues;
+    uint32_t m_current = 0;
+    uint64_t m_frameCount = 0;
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+// Coroutine executor for frames that co_await GPU fence values.
+//
+// Every frame is a FrameTask coroutine. It runs on the thread that drives the
+// scheduler until it awaits a fence value that has not been reached yet. The
+// fence waiter then posts it back and the next poll() resumes it, so many
+// frames can be in flight without a thread blocking on any of them.
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "FenceWaiter.hpp"
+
+class FrameTask
+{
+public:
+    struct promise_type
+    {
+        FrameTask get_return_object()
+        {
+            return FrameTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    FrameTask(FrameTask&& other) noexcept :
+        m_handle(std::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    FrameTask& operator=(FrameTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    FrameTask(const FrameTask&) = delete;
+    FrameTask& operator=(const FrameTask&) = delete;
+
+    ~FrameTask()
+    {
+        destroy();
+    }
+
+    std::coroutine_handle<> handle() const
+    {
+        return m_handle;
+    }
+
+    bool done() const
+    {
+        return !m_handle || m_handle.done();
+    }
+
+private:
+    explicit FrameTask(std::coroutine_handle<promise_type> handle) :
+        m_handle(handle)
+    {
+    }
+
+    void destroy()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template<typename Fence>
+class FrameScheduler
+{
+public:
+    class FenceAwaitable
+    {
+    public:
+        FenceAwaitable(FrameScheduler& scheduler, std::vector<FenceWait<Fence>> waits, WaitMode mode) :
+            m_scheduler(scheduler),
+            m_waits(std::move(waits)),
+            m_mode(mode)
+        {
+        }
+
+        bool await_ready() const
+        {
+            size_t reached = 0;
+            for (const FenceWait<Fence>& wait : m_waits)
+            {
+                reached += wait.fence->GetCompletedValue() >= wait.value ? 1 : 0;
+            }
+            return m_mode == WaitMode::Any ? reached > 0 : reached == m_waits.size();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            FrameScheduler& scheduler = m_scheduler;
+            if (!scheduler.m_waiter.waitAsync(m_waits, m_mode, [&scheduler, handle] { scheduler.post(handle); }))
+            {
+                // The frame could never be resumed, the waiter has too many fences pending
+                std::terminate();
+            }
+        }
+
+        void await_resume() const {}
+
+    private:
+        FrameScheduler& m_scheduler;
+        std::vector<FenceWait<Fence>> m_waits;
+        WaitMode m_mode;
+    };
+
+    explicit FrameScheduler(FenceWaiter<Fence>& waiter) :
+        m_waiter(waiter)
+    {
+    }
+
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    FenceAwaitable fence(Fence* fence, uint64_t value)
+    {
+        return FenceAwaitable(*this, {FenceWait<Fence>{fence, value}}, WaitMode::All);
+    }
+
+    FenceAwaitable fences(std::vector<FenceWait<Fence>> waits, WaitMode mode)
+    {
+        return FenceAwaitable(*this, std::move(waits), mode);
+    }
+
+    // Runs the frame on the calling thread until its first unsatisfied await.
+    void spawn(FrameTask task)
+    {
+        std::coroutine_handle<> handle = task.handle();
+        m_tasks.push_back(std::move(task));
+        handle.resume();
+        collect();
+    }
+
+    size_t inFlight() const
+    {
+        return m_tasks.size();
+    }
+
+    // Resumes every frame whose fences have been reached, without blocking.
+    void poll()
+    {
+        std::deque<std::coroutine_handle<>> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ready.swap(m_ready);
+        }
+        for (std::coroutine_handle<> handle : ready)
+        {
+            handle.resume();
+        }
+        collect();
+    }
+
+    // Blocks until at least one frame can be resumed and resumes the ready ones.
+    void waitForProgress()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_readyCondition.wait(lock, [this] { return !m_ready.empty(); });
+        }
+        poll();
+    }
+
+    void runUntilIdle()
+    {
+        while (!m_tasks.empty())
+        {
+            waitForProgress();
+        }
+    }
+
+private:
+    void post(std::coroutine_handle<> handle)
+    {
+        // Notify under the lock, the scheduler may be destroyed as soon as the last frame resumes
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready.push_back(handle);
+        m_readyCondition.notify_one();
+    }
+
+    void collect()
+    {
+        for (size_t i = 0; i < m_tasks.size();)
+        {
+            if (m_tasks[i].done())
+            {
+                m_tasks.erase(m_tasks.begin() + i);
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    FenceWaiter<Fence>& m_waiter;
+    std::vector<FrameTask> m_tasks; // Only touched by the driving thread
+
+    std::mutex m_mutex;
+    std::condition_variable m_readyCondition;
+    std::deque<std::coroutine_handle<>> m_ready;
+};
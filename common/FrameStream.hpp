@@ -0,0 +1,462 @@
+#pragma once
+
+// Frame streaming over TCP.
+//
+// Every frame is a fixed size header followed by the packed rows of the image.
+// The sender gathers the header and the rows straight from the caller's memory,
+// e.g. a mapped staging texture with its own row pitch, with writev (WSASend on
+// Windows), so nothing is copied in user space. Frames are pipelined, the
+// sender never waits for the receiver to acknowledge anything. When the link
+// is saturated the send blocks on the socket buffer, which is the backpressure
+// that makes the caller drop frames upstream.
+//
+// The header carries the frame's size and a caller defined format id. The
+// receiver checks both against the format it expects before it takes the
+// payload; a frame it cannot use is read off the socket into a scratch buffer
+// and counted as dropped, the stream itself stays usable.
+//
+// On Windows the socket is a Winsock SOCKET and winsock2.h has to be included
+// before windows.h, elsewhere it is a file descriptor.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+using StreamSocket = SOCKET;
+const StreamSocket c_invalidStreamSocket = INVALID_SOCKET;
+
+struct StreamBuffer
+{
+    WSABUF buffer;
+
+    StreamBuffer(const void* data, size_t size) :
+        buffer{static_cast<ULONG>(size), static_cast<CHAR*>(const_cast<void*>(data))}
+    {
+    }
+    char* data() const
+    {
+        return buffer.buf;
+    }
+    size_t size() const
+    {
+        return buffer.len;
+    }
+    void advance(size_t bytes)
+    {
+        buffer.buf += bytes;
+        buffer.len -= static_cast<ULONG>(bytes);
+    }
+};
+
+inline bool initStreamSockets()
+{
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+}
+
+inline void cleanupStreamSockets()
+{
+    WSACleanup();
+}
+
+inline void closeStreamSocket(StreamSocket socket)
+{
+    closesocket(socket);
+}
+
+// Wakes up a thread that is blocked sending or receiving on the socket
+inline void shutdownStream(StreamSocket socket)
+{
+    shutdown(socket, SD_BOTH);
+}
+
+// Gathers as many of the buffers as the socket takes, returns the number of bytes or -1
+inline int64_t gatherSend(StreamSocket socket, StreamBuffer* buffers, size_t count)
+{
+    DWORD sent = 0;
+    if (WSASend(socket, reinterpret_cast<WSABUF*>(buffers), static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) != 0)
+    {
+        return -1;
+    }
+    return sent;
+}
+
+inline int64_t receiveSome(StreamSocket socket, void* data, size_t size)
+{
+    return recv(socket, static_cast<char*>(data), static_cast<int>(size), 0);
+}
+#else
+using StreamSocket = int;
+const StreamSocket c_invalidStreamSocket = -1;
+
+struct StreamBuffer
+{
+    iovec buffer;
+
+    StreamBuffer(const void* data, size_t size) :
+        buffer{const_cast<void*>(data), size}
+    {
+    }
+    char* data() const
+    {
+        return static_cast<char*>(buffer.iov_base);
+    }
+    size_t size() const
+    {
+        return buffer.iov_len;
+    }
+    void advance(size_t bytes)
+    {
+        buffer.iov_base = data() + bytes;
+        buffer.iov_len -= bytes;
+    }
+};
+
+inline bool initStreamSockets()
+{
+    return true;
+}
+
+inline void cleanupStreamSockets()
+{
+}
+
+inline void closeStreamSocket(StreamSocket socket)
+{
+    close(socket);
+}
+
+inline void shutdownStream(StreamSocket socket)
+{
+    shutdown(socket, SHUT_RDWR);
+}
+
+inline int64_t gatherSend(StreamSocket socket, StreamBuffer* buffers, size_t count)
+{
+    msghdr header{};
+    header.msg_iov = reinterpret_cast<iovec*>(buffers);
+    header.msg_iovlen = count;
+    return sendmsg(socket, &header, MSG_NOSIGNAL);
+}
+
+inline int64_t receiveSome(StreamSocket socket, void* data, size_t size)
+{
+    return recv(socket, data, size, 0);
+}
+#endif
+
+static_assert(sizeof(StreamBuffer) == sizeof(StreamBuffer::buffer), "StreamBuffer must be layout compatible with the native gather buffer");
+
+const uint32_t c_streamMagic = 0x4d475055; // "MGPU"
+
+struct StreamFrameHeader
+{
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowBytes; // Rows are packed on the wire
+    uint32_t format; // Caller defined, e.g. a pixelformat::Format
+    uint32_t reserved;
+    uint64_t frameNumber;
+    int64_t sendTime; // Sender's steady clock in nanoseconds, only comparable on the same machine
+};
+
+// The frames a receiver accepts
+struct StreamFormat
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowBytes;
+    uint32_t format;
+};
+
+inline int64_t streamNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void configureStreamSocket(StreamSocket socket)
+{
+    // Frames are large and sent as a whole, Nagle would only delay the last segment
+    int noDelay = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    int bufferSize = 8 * 1024 * 1024;
+    setsockopt(socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+}
+
+// Blocks until one sender has connected to the port
+inline StreamSocket acceptStream(uint16_t port)
+{
+    StreamSocket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == c_invalidStreamSocket)
+    {
+        return c_invalidStreamSocket;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    StreamSocket connection = c_invalidStreamSocket;
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0 && listen(listener, 1) == 0)
+    {
+        connection = accept(listener, nullptr, nullptr);
+    }
+    closeStreamSocket(listener);
+    if (connection != c_invalidStreamSocket)
+    {
+        configureStreamSocket(connection);
+    }
+    return connection;
+}
+
+inline StreamSocket connectStream(const std::string& host, uint16_t port)
+{
+    StreamSocket connection = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (connection == c_invalidStreamSocket)
+    {
+        return c_invalidStreamSocket;
+    }
+    configureStreamSocket(connection);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 || connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        closeStreamSocket(connection);
+        return c_invalidStreamSocket;
+    }
+    return connection;
+}
+
+class StreamSender
+{
+public:
+    // The sender does not own the socket
+    explicit StreamSender(StreamSocket socket) :
+        m_socket(socket)
+    {
+    }
+
+    // Sends one frame straight from the caller's rows. Blocks while the link is
+    // saturated, returns false once the connection is gone.
+    bool send(uint64_t frameNumber, const void* data, uint32_t rowPitch, uint32_t width, uint32_t height, uint32_t format, uint32_t bytesPerPixel)
+    {
+        const int64_t start = streamNow();
+        const uint32_t rowBytes = width * bytesPerPixel;
+        const StreamFrameHeader header{c_streamMagic, width, height, rowBytes, format, 0, frameNumber, start};
+
+        m_buffers.clear();
+        m_buffers.emplace_back(&header, sizeof(header));
+        const char* rows = static_cast<const char*>(data);
+        if (rowPitch == rowBytes)
+        {
+            m_buffers.emplace_back(rows, static_cast<size_t>(rowBytes) * height);
+        }
+        else
+        {
+            for (uint32_t row = 0; row < height; ++row)
+            {
+                m_buffers.emplace_back(rows + static_cast<size_t>(row) * rowPitch, rowBytes);
+            }
+        }
+
+        // A send may stop anywhere, continue from the first buffer that was not finished
+        size_t first = 0;
+        while (first < m_buffers.size())
+        {
+            const size_t count = (std::min)(m_buffers.size() - first, c_maxGatherBuffers);
+            int64_t sent = gatherSend(m_socket, m_buffers.data() + first, count);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            while (sent > 0)
+            {
+                const size_t taken = (std::min)(static_cast<size_t>(sent), m_buffers[first].size());
+                m_buffers[first].advance(taken);
+                sent -= static_cast<int64_t>(taken);
+                if (m_buffers[first].size() == 0)
+                {
+                    ++first;
+                }
+            }
+        }
+
+        m_sendTimeTotal += streamNow() - start;
+        m_bytesSent += sizeof(header) + static_cast<uint64_t>(rowBytes) * height;
+        ++m_framesSent;
+        return true;
+    }
+
+    uint64_t framesSent() const
+    {
+        return m_framesSent;
+    }
+
+    uint64_t bytesSent() const
+    {
+        return m_bytesSent;
+    }
+
+    // Seconds per frame spent in send(), including the time blocked on a saturated link
+    double averageSendTime() const
+    {
+        return m_framesSent > 0 ? m_sendTimeTotal * 1e-9 / m_framesSent : 0.0;
+    }
+
+private:
+    // Below IOV_MAX on Linux
+    static constexpr size_t c_maxGatherBuffers = 512;
+
+    StreamSocket m_socket;
+    std::vector<StreamBuffer> m_buffers;
+    int64_t m_sendTimeTotal = 0;
+    uint64_t m_bytesSent = 0;
+    uint64_t m_framesSent = 0;
+};
+
+class StreamReceiver
+{
+public:
+    // The receiver does not own the socket
+    StreamReceiver(StreamSocket socket, const StreamFormat& format) :
+        m_socket(socket),
+        m_format(format)
+    {
+    }
+
+    // Blocks until the next frame in the expected format has arrived, pixels
+    // gets the packed rows. Frames in another format or larger than capacity
+    // bytes are skipped and counted in framesDropped(). Returns false when the
+    // connection is gone or the stream is corrupt.
+    bool receive(StreamFrameHeader& header, uint8_t* pixels, size_t capacity)
+    {
+        while (true)
+        {
+            if (!receiveAll(&header, sizeof(header)) || header.magic != c_streamMagic)
+            {
+                return false;
+            }
+            countMissed(header.frameNumber);
+            const size_t size = static_cast<size_t>(header.rowBytes) * header.height;
+            if (accepts(header) && size <= capacity)
+            {
+                if (!receiveAll(pixels, size))
+                {
+                    return false;
+                }
+                m_latencyTotal += streamNow() - header.sendTime;
+                ++m_framesReceived;
+                return true;
+            }
+            if (!skip(size))
+            {
+                return false;
+            }
+            ++m_framesDropped;
+        }
+    }
+
+    uint64_t framesReceived() const
+    {
+        return m_framesReceived;
+    }
+
+    // Frames the sender dropped before they reached the link
+    uint64_t framesMissed() const
+    {
+        return m_framesMissed;
+    }
+
+    // Frames that arrived in a format the receiver does not accept
+    uint64_t framesDropped() const
+    {
+        return m_framesDropped;
+    }
+
+    // Seconds from the start of the send to the end of the receive, only meaningful on loopback
+    double averageLatency() const
+    {
+        return m_framesReceived > 0 ? m_latencyTotal * 1e-9 / m_framesReceived : 0.0;
+    }
+
+private:
+    bool receiveAll(void* data, size_t size)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            const int64_t received = receiveSome(m_socket, bytes, size);
+            if (received <= 0)
+            {
+                return false;
+            }
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    // Reads the payload of a frame that is not used
+    bool skip(size_t size)
+    {
+        m_scratch.resize(c_scratchSize);
+        while (size > 0)
+        {
+            const size_t chunk = (std::min)(size, c_scratchSize);
+            if (!receiveAll(m_scratch.data(), chunk))
+            {
+                return false;
+            }
+            size -= chunk;
+        }
+        return true;
+    }
+
+    bool accepts(const StreamFrameHeader& header) const
+    {
+        return header.width == m_format.width && header.height == m_format.height && header.rowBytes == m_format.rowBytes && header.format == m_format.format;
+    }
+
+    void countMissed(uint64_t frameNumber)
+    {
+        if (m_anyFrame && frameNumber > m_lastFrameNumber + 1)
+        {
+            m_framesMissed += frameNumber - m_lastFrameNumber - 1;
+        }
+        m_lastFrameNumber = frameNumber;
+        m_anyFrame = true;
+    }
+
+    static constexpr size_t c_scratchSize = 64 * 1024;
+
+    StreamSocket m_socket;
+    StreamFormat m_format;
+    std::vector<char> m_scratch;
+    int64_t m_latencyTotal = 0;
+    uint64_t m_framesReceived = 0;
+    uint64_t m_framesMissed = 0;
+    uint64_t m_framesDropped = 0;
+    uint64_t m_lastFrameNumber = 0;
+    bool m_anyFrame = false;
+};
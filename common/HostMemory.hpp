@@ -0,0 +1,286 @@
+#pragma once
+
+// Host memory for whole frames.
+//
+// A frame is around a hundred megabytes, with 4 KB pages that is tens of
+// thousands of TLB entries and a page fault on the first touch of every page.
+// HostBuffer asks for huge pages first (MAP_HUGETLB, large pages on Windows,
+// which need the "Lock pages in memory" privilege). When there are none it
+// falls back to ordinary pages, on Linux with transparent huge pages advised.
+// Either way every page is faulted in and locked when the buffer is created,
+// so the frames that reuse the buffer never fault. The pages can be placed on
+// a NUMA node, e.g. the one local to the GPU that reads them.
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum class HostPages
+{
+    Huge, // Locked by the system
+    Locked, // Ordinary pages, faulted in and locked
+    Pageable // Ordinary pages, faulted in but the lock failed
+};
+
+inline const char* hostPagesName(HostPages pages)
+{
+    switch (pages)
+    {
+    case HostPages::Huge:
+        return "huge pages";
+    case HostPages::Locked:
+        return "locked pages";
+    default:
+        return "pageable pages";
+    }
+}
+
+// Minor and major faults of the whole process so far
+inline uint64_t pageFaultCount()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    counters.cb = sizeof(counters);
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PageFaultCount : 0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_minflt) + static_cast<uint64_t>(usage.ru_majflt);
+#endif
+}
+
+class HostBuffer
+{
+public:
+    HostBuffer() = default;
+
+    // node -1 leaves the placement to the system
+    explicit HostBuffer(size_t size, int node = -1) :
+        m_size(size),
+        m_node(node)
+    {
+        allocate();
+    }
+
+    ~HostBuffer()
+    {
+        free();
+    }
+
+    HostBuffer(const HostBuffer&) = delete;
+    HostBuffer& operator=(const HostBuffer&) = delete;
+
+    HostBuffer(HostBuffer&& other) noexcept
+    {
+        swap(other);
+    }
+
+    HostBuffer& operator=(HostBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            free();
+            swap(other);
+        }
+        return *this;
+    }
+
+    // nullptr when even ordinary pages could not be allocated
+    uint8_t* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    HostPages pages() const
+    {
+        return m_pages;
+    }
+
+private:
+#if defined(_WIN32)
+    void allocate()
+    {
+        const SIZE_T largePageSize = GetLargePageMinimum();
+        if (largePageSize > 0 && enableLockMemoryPrivilege())
+        {
+            m_allocatedSize = roundUp(m_size, largePageSize);
+            m_data = static_cast<uint8_t*>(virtualAlloc(MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES));
+            if (m_data != nullptr)
+            {
+                m_pages = HostPages::Huge;
+                return;
+            }
+        }
+
+        SYSTEM_INFO systemInfo{};
+        GetSystemInfo(&systemInfo);
+        m_allocatedSize = roundUp(m_size, systemInfo.dwPageSize);
+        m_data = static_cast<uint8_t*>(virtualAlloc(MEM_RESERVE | MEM_COMMIT));
+        if (m_data == nullptr)
+        {
+            return;
+        }
+        prefault(systemInfo.dwPageSize);
+
+        // VirtualLock is limited by the minimum working set, grow it by the buffer first
+        SIZE_T minimumSize = 0;
+        SIZE_T maximumSize = 0;
+        GetProcessWorkingSetSize(GetCurrentProcess(), &minimumSize, &maximumSize);
+        SetProcessWorkingSetSize(GetCurrentProcess(), minimumSize + m_allocatedSize, maximumSize + m_allocatedSize);
+        m_pages = VirtualLock(m_data, m_allocatedSize) ? HostPages::Locked : HostPages::Pageable;
+    }
+
+    void free()
+    {
+        if (m_data == nullptr)
+        {
+            return;
+        }
+        if (m_pages == HostPages::Locked)
+        {
+            VirtualUnlock(m_data, m_allocatedSize);
+        }
+        VirtualFree(m_data, 0, MEM_RELEASE);
+        m_data = nullptr;
+    }
+
+    void* virtualAlloc(DWORD type) const
+    {
+        if (m_node < 0)
+        {
+            return VirtualAlloc(nullptr, m_allocatedSize, type, PAGE_READWRITE);
+        }
+        return VirtualAllocExNuma(GetCurrentProcess(), nullptr, m_allocatedSize, type, PAGE_READWRITE, static_cast<DWORD>(m_node));
+    }
+
+    static bool enableLockMemoryPrivilege()
+    {
+        HANDLE token = nullptr;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        {
+            return false;
+        }
+        TOKEN_PRIVILEGES privileges{};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                       AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                       GetLastError() == ERROR_SUCCESS; // Not ERROR_NOT_ALL_ASSIGNED
+        CloseHandle(token);
+        return enabled;
+    }
+#else
+    void allocate()
+    {
+        // 1 GB pages only pay off for buffers that fill them
+        if (m_size >= c_gigaPageSize && allocateHuge(c_gigaPageSize, 30 << MAP_HUGE_SHIFT))
+        {
+            return;
+        }
+        if (allocateHuge(c_hugePageSize, 21 << MAP_HUGE_SHIFT))
+        {
+            return;
+        }
+
+        m_allocatedSize = roundUp(m_size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        void* data = mmap(nullptr, m_allocatedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            return;
+        }
+        m_data = static_cast<uint8_t*>(data);
+        // Transparent huge pages if the system allows them, before the pages are faulted in
+        madvise(m_data, m_allocatedSize, MADV_HUGEPAGE);
+        bindToNode();
+        prefault(static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        m_pages = mlock(m_data, m_allocatedSize) == 0 ? HostPages::Locked : HostPages::Pageable;
+    }
+
+    bool allocateHuge(size_t pageSize, int sizeFlag)
+    {
+        const size_t size = roundUp(m_size, pageSize);
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        m_data = static_cast<uint8_t*>(data);
+        m_allocatedSize = size;
+        bindToNode();
+        // Huge pages are reserved up front, the faults only fail when another process took them meanwhile
+        prefault(pageSize);
+        m_pages = HostPages::Huge;
+        return true;
+    }
+
+    // Applies to the pages faulted in after this, without a dependency on libnuma
+    void bindToNode() const
+    {
+        if (m_node < 0 || m_node >= 64)
+        {
+            return;
+        }
+        const unsigned long nodeMask = 1ul << m_node;
+        syscall(SYS_mbind, m_data, m_allocatedSize, c_mpolPreferred, &nodeMask, sizeof(nodeMask) * 8, 0);
+    }
+
+    void free()
+    {
+        if (m_data == nullptr)
+        {
+            return;
+        }
+        // munmap drops a lock taken with mlock
+        munmap(m_data, m_allocatedSize);
+        m_data = nullptr;
+    }
+
+    static const int c_mpolPreferred = 1; // MPOL_PREFERRED in numaif.h
+    static const size_t c_hugePageSize = size_t(2) << 20;
+    static const size_t c_gigaPageSize = size_t(1) << 30;
+#endif
+
+    // Touches every page so the first frame does not pay for the faults
+    void prefault(size_t pageSize)
+    {
+        for (size_t offset = 0; offset < m_allocatedSize; offset += pageSize)
+        {
+            m_data[offset] = 0;
+        }
+    }
+
+    static size_t roundUp(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    void swap(HostBuffer& other)
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_allocatedSize, other.m_allocatedSize);
+        std::swap(m_pages, other.m_pages);
+        std::swap(m_node, other.m_node);
+    }
+
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_allocatedSize = 0;
+    HostPages m_pages = HostPages::Pageable;
+    int m_node = -1;
+};
@@ -0,0 +1,372 @@
+#pragma once
+
+// Control channel between a producer and a consumer process.
+//
+// The channel carries fixed size messages and native handles. On Windows it is
+// a named pipe and a handle is duplicated into the peer process with
+// DuplicateHandle, the message carries its value in the peer. Elsewhere it is a
+// Unix domain socket and the handle is a file descriptor (e.g. a memfd or an
+// eventfd of an emulated backend) passed with SCM_RIGHTS.
+//
+// Every message is stamped with the sender's steady clock, which is shared by
+// the processes of one machine, so the receiver can measure the handoff.
+//
+// IpcSlotOwnership keeps track of which side owns each shared slot. The
+// producer hands a written slot over with FrameReady and gets it back with
+// SlotReleased, which carries the consumer's fence value after its last read.
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+enum class IpcMessageType : uint32_t
+{
+    Handle, // index = which handle, value = the handle in the receiving process on Windows
+    FrameReady, // index = slot, value = producer's fence value after the slot was written
+    SlotReleased, // index = slot, value = consumer's fence value after its last read of the slot
+    Stop
+};
+
+struct IpcMessage
+{
+    IpcMessageType type;
+    uint32_t index;
+    uint64_t value;
+    int64_t sendTime; // Sender's steady clock in nanoseconds
+};
+
+inline int64_t ipcNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if defined(_WIN32)
+using IpcNativeHandle = HANDLE;
+
+// Server end of a named pipe, blocks until the client has connected
+inline HANDLE createIpcPipe(const std::wstring& name)
+{
+    HANDLE pipe = CreateNamedPipeW(name.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 4096, 4096, 0, nullptr);
+    if (pipe == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+    return pipe;
+}
+
+inline bool acceptIpcPipe(HANDLE pipe)
+{
+    return ConnectNamedPipe(pipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED;
+}
+
+inline HANDLE connectIpcPipe(const std::wstring& name)
+{
+    while (!WaitNamedPipeW(name.c_str(), NMPWAIT_WAIT_FOREVER))
+    {
+        if (GetLastError() != ERROR_FILE_NOT_FOUND)
+        {
+            return nullptr;
+        }
+        Sleep(1);
+    }
+    HANDLE pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    return pipe == INVALID_HANDLE_VALUE ? nullptr : pipe;
+}
+#else
+using IpcNativeHandle = int;
+#endif
+
+class IpcChannel
+{
+public:
+#if defined(_WIN32)
+    // peerProcess needs PROCESS_DUP_HANDLE access, the channel owns neither handle
+    IpcChannel(HANDLE pipe, HANDLE peerProcess) :
+        m_pipe(pipe),
+        m_peerProcess(peerProcess)
+    {
+    }
+#else
+    // A connected Unix domain stream socket, e.g. from socketpair(), the channel does not own it
+    explicit IpcChannel(int socket) :
+        m_socket(socket)
+    {
+    }
+#endif
+
+    IpcChannel(const IpcChannel&) = delete;
+    IpcChannel& operator=(const IpcChannel&) = delete;
+
+    bool send(IpcMessageType type, uint32_t index, uint64_t value)
+    {
+        const int64_t start = ipcNow();
+        const IpcMessage message{type, index, value, start};
+        const bool sent = write(&message, sizeof(message), -1);
+        m_sendTime += ipcNow() - start;
+        ++m_sendCount;
+        return sent;
+    }
+
+    // Blocks until a message arrives, false when the peer has gone away
+    bool receive(IpcMessage& message)
+    {
+        if (!read(&message, sizeof(message), nullptr))
+        {
+            return false;
+        }
+        m_latencyTotal += ipcNow() - message.sendTime;
+        ++m_receiveCount;
+        return true;
+    }
+
+    // True when receive() would not block
+    bool available() const
+    {
+#if defined(_WIN32)
+        DWORD bytes = 0;
+        return PeekNamedPipe(m_pipe, nullptr, 0, nullptr, &bytes, nullptr) && bytes >= sizeof(IpcMessage);
+#else
+        pollfd fd{m_socket, POLLIN, 0};
+        return poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN);
+#endif
+    }
+
+    // The peer gets its own handle to the same object, the sender keeps its handle
+    bool sendHandle(uint32_t index, IpcNativeHandle handle)
+    {
+#if defined(_WIN32)
+        HANDLE peerHandle = nullptr;
+        if (!DuplicateHandle(GetCurrentProcess(), handle, m_peerProcess, &peerHandle, 0, FALSE, DUPLICATE_SAME_ACCESS))
+        {
+            return false;
+        }
+        return send(IpcMessageType::Handle, index, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(peerHandle)));
+#else
+        const IpcMessage message{IpcMessageType::Handle, index, 0, ipcNow()};
+        return write(&message, sizeof(message), handle);
+#endif
+    }
+
+    // Receives a handle sent with sendHandle(), false when anything else arrives
+    bool receiveHandle(uint32_t& index, IpcNativeHandle& handle)
+    {
+        IpcMessage message{};
+#if defined(_WIN32)
+        if (!receive(message) || message.type != IpcMessageType::Handle)
+        {
+            return false;
+        }
+        handle = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(message.value));
+#else
+        if (!read(&message, sizeof(message), &handle) || message.type != IpcMessageType::Handle)
+        {
+            return false;
+        }
+#endif
+        index = message.index;
+        return true;
+    }
+
+    // Seconds spent in send() per message
+    double averageSendTime() const
+    {
+        return m_sendCount > 0 ? m_sendTime * 1e-9 / m_sendCount : 0.0;
+    }
+
+    // Seconds from send() in the peer to the end of receive() here
+    double averageLatency() const
+    {
+        return m_receiveCount > 0 ? m_latencyTotal * 1e-9 / m_receiveCount : 0.0;
+    }
+
+private:
+#if defined(_WIN32)
+    bool write(const void* data, size_t size, int)
+    {
+        DWORD written = 0;
+        return WriteFile(m_pipe, data, static_cast<DWORD>(size), &written, nullptr) && written == size;
+    }
+
+    bool read(void* data, size_t size, HANDLE*)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            DWORD bytesRead = 0;
+            if (!ReadFile(m_pipe, bytes, static_cast<DWORD>(size), &bytesRead, nullptr) || bytesRead == 0)
+            {
+                return false;
+            }
+            bytes += bytesRead;
+            size -= bytesRead;
+        }
+        return true;
+    }
+
+    HANDLE m_pipe;
+    HANDLE m_peerProcess;
+#else
+    // A descriptor goes along with the first byte of the message
+    bool write(const void* data, size_t size, int fd)
+    {
+        iovec io{const_cast<void*>(data), size};
+        msghdr header{};
+        header.msg_iov = &io;
+        header.msg_iovlen = 1;
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        if (fd >= 0)
+        {
+            header.msg_control = control;
+            header.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            const ssize_t sent = sendmsg(m_socket, &header, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+            io = iovec{const_cast<char*>(bytes), size};
+            header.msg_control = nullptr;
+            header.msg_controllen = 0;
+        }
+        return true;
+    }
+
+    bool read(void* data, size_t size, int* fd)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            iovec io{bytes, size};
+            msghdr header{};
+            header.msg_iov = &io;
+            header.msg_iovlen = 1;
+            char control[CMSG_SPACE(sizeof(int))] = {};
+            header.msg_control = control;
+            header.msg_controllen = sizeof(control);
+            const ssize_t received = recvmsg(m_socket, &header, MSG_CMSG_CLOEXEC);
+            if (received <= 0)
+            {
+                return false;
+            }
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+            if (fd != nullptr && cmsg != nullptr && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                std::memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+            }
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    int m_socket;
+#endif
+    int64_t m_sendTime = 0;
+    uint64_t m_sendCount = 0;
+    int64_t m_latencyTotal = 0;
+    uint64_t m_receiveCount = 0;
+};
+
+// Both processes keep one of these and update it from the messages they send
+// and receive, so a message for a slot the sender does not own is caught.
+class IpcSlotOwnership
+{
+public:
+    explicit IpcSlotOwnership(uint32_t slotCount) :
+        m_slots(slotCount, Slot{State::Free, 0, 0})
+    {
+    }
+
+    // Producer. The slot it has owned the longest and the consumer's fence
+    // value to wait for before writing it, 0 if the consumer never read it.
+    bool acquire(uint32_t& slot, uint64_t& releaseValue)
+    {
+        int oldest = -1;
+        for (size_t i = 0; i < m_slots.size(); ++i)
+        {
+            if (m_slots[i].state == State::Free && (oldest < 0 || m_slots[i].freedAt < m_slots[oldest].freedAt))
+            {
+                oldest = static_cast<int>(i);
+            }
+        }
+        if (oldest < 0)
+        {
+            return false;
+        }
+        slot = static_cast<uint32_t>(oldest);
+        m_slots[slot].state = State::Writing;
+        releaseValue = m_slots[slot].releaseValue;
+        return true;
+    }
+
+    // FrameReady
+    bool handOver(uint32_t slot)
+    {
+        if (slot >= m_slots.size() || m_slots[slot].state == State::WithConsumer)
+        {
+            return false;
+        }
+        m_slots[slot].state = State::WithConsumer;
+        return true;
+    }
+
+    // SlotReleased
+    bool release(uint32_t slot, uint64_t releaseValue)
+    {
+        if (slot >= m_slots.size() || m_slots[slot].state != State::WithConsumer)
+        {
+            return false;
+        }
+        m_slots[slot] = Slot{State::Free, releaseValue, ++m_releaseCount};
+        return true;
+    }
+
+    uint32_t withConsumer() const
+    {
+        uint32_t count = 0;
+        for (const Slot& slot : m_slots)
+        {
+            count += slot.state == State::WithConsumer ? 1 : 0;
+        }
+        return count;
+    }
+
+private:
+    enum class State
+    {
+        Free,
+        Writing, // Acquired by the producer, only seen by the producer
+        WithConsumer
+    };
+
+    struct Slot
+    {
+        State state;
+        uint64_t releaseValue;
+        uint64_t freedAt;
+    };
+
+    std::vector<Slot> m_slots;
+    uint64_t m_releaseCount = 0;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+// NUMA topology and placement.
+//
+// On a multi-socket machine every GPU hangs off one socket. Host memory and
+// threads that feed a GPU should be on that socket's node, otherwise every
+// frame crosses the inter-socket link on its way. A GPU's node is found from
+// its PCI bus, device and function, so identical GPUs are told apart by where
+// they sit and not by the order they are enumerated in: sysfs on Linux, on
+// Windows the adapter's address from D3DKMTQueryAdapterInfo matched against
+// the display devices' SPDRP_BUSNUMBER and SPDRP_ADDRESS, whose
+// DEVPKEY_Numa_Node is the node.
+//
+// On Windows include this in one translation unit only, it defines the GUIDs
+// of the device property keys it uses, and link gdi32 for the D3DKMT calls.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <winternl.h> // NTSTATUS for d3dkmthk.h
+#include <d3dkmthk.h>
+#include <initguid.h>
+#include <devguid.h>
+#include <devpkey.h>
+#include <setupapi.h>
+#else
+#include <dirent.h>
+#include <sched.h>
+#endif
+
+const int c_anyNumaNode = -1;
+
+// Where a device sits on PCI. Windows reports no segment, there it is always 0
+// and only the bus, device and function are compared.
+struct PciAddress
+{
+    uint32_t domain;
+    uint32_t bus;
+    uint32_t device;
+    uint32_t function;
+};
+
+#if defined(_WIN32)
+inline uint32_t numaNodeCount()
+{
+    ULONG highestNode = 0;
+    return GetNumaHighestNodeNumber(&highestNode) ? highestNode + 1 : 1;
+}
+
+// The PCI address of the adapter with the LUID, e.g. DXGI_ADAPTER_DESC::AdapterLuid
+inline bool adapterPciAddress(LUID luid, PciAddress& address)
+{
+    D3DKMT_OPENADAPTERFROMLUID open{};
+    open.AdapterLuid = luid;
+    // NTSTATUS codes below zero are errors
+    if (D3DKMTOpenAdapterFromLuid(&open) < 0)
+    {
+        return false;
+    }
+    D3DKMT_ADAPTERADDRESS adapterAddress{};
+    D3DKMT_QUERYADAPTERINFO query{};
+    query.hAdapter = open.hAdapter;
+    query.Type = KMTQAITYPE_ADAPTERADDRESS;
+    query.pPrivateDriverData = &adapterAddress;
+    query.PrivateDriverDataSize = sizeof(adapterAddress);
+    const bool queried = D3DKMTQueryAdapterInfo(&query) >= 0;
+    D3DKMT_CLOSEADAPTER close{};
+    close.hAdapter = open.hAdapter;
+    D3DKMTCloseAdapter(&close);
+    if (!queried)
+    {
+        return false;
+    }
+    address = PciAddress{0, adapterAddress.BusNumber, adapterAddress.DeviceNumber, adapterAddress.FunctionNumber};
+    return true;
+}
+
+// c_anyNumaNode when the device is not found or its node is unknown
+inline int pciDeviceNumaNode(const PciAddress& address)
+{
+    HDEVINFO devices = SetupDiGetClassDevsW(&GUID_DEVCLASS_DISPLAY, nullptr, nullptr, DIGCF_PRESENT);
+    if (devices == INVALID_HANDLE_VALUE)
+    {
+        return c_anyNumaNode;
+    }
+
+    int node = c_anyNumaNode;
+    SP_DEVINFO_DATA info{};
+    info.cbSize = sizeof(info);
+    for (DWORD i = 0; SetupDiEnumDeviceInfo(devices, i, &info); ++i)
+    {
+        // On PCI the address is the device in the high word and the function in the low word
+        DWORD bus = 0;
+        DWORD deviceFunction = 0;
+        if (!SetupDiGetDeviceRegistryPropertyW(devices, &info, SPDRP_BUSNUMBER, nullptr, reinterpret_cast<PBYTE>(&bus), sizeof(bus), nullptr) ||
+            !SetupDiGetDeviceRegistryPropertyW(devices, &info, SPDRP_ADDRESS, nullptr, reinterpret_cast<PBYTE>(&deviceFunction), sizeof(deviceFunction), nullptr) ||
+            bus != address.bus || (deviceFunction >> 16) != address.device || (deviceFunction & 0xffff) != address.function)
+        {
+            continue;
+        }
+        DEVPROPTYPE type = 0;
+        INT32 deviceNode = 0;
+        if (SetupDiGetDevicePropertyW(devices, &info, &DEVPKEY_Numa_Node, &type, reinterpret_cast<PBYTE>(&deviceNode), sizeof(deviceNode), nullptr, 0) && type == DEVPROP_TYPE_INT32)
+        {
+            node = deviceNode;
+        }
+        break;
+    }
+    SetupDiDestroyDeviceInfoList(devices);
+    return node;
+}
+
+// Restricts the calling thread to the node's processors
+inline bool bindThreadToNumaNode(int node)
+{
+    GROUP_AFFINITY affinity{};
+    if (node == c_anyNumaNode || !GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) || affinity.Mask == 0)
+    {
+        return false;
+    }
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+}
+#else
+inline uint32_t numaNodeCount()
+{
+    uint32_t count = 0;
+    if (DIR* nodes = opendir("/sys/devices/system/node"))
+    {
+        while (dirent* entry = readdir(nodes))
+        {
+            int node = 0;
+            if (std::sscanf(entry->d_name, "node%d", &node) == 1)
+            {
+                ++count;
+            }
+        }
+        closedir(nodes);
+    }
+    return count > 0 ? count : 1;
+}
+
+inline bool readSysfsNumber(const std::string& path, long& value)
+{
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    const bool read = std::fscanf(file, "%li", &value) == 1;
+    std::fclose(file);
+    return read;
+}
+
+// Reads a sysfs device name, e.g. "0000:3b:00.0"
+inline bool parsePciAddress(const char* name, PciAddress& address)
+{
+    char end = 0;
+    return std::sscanf(name, "%x:%x:%x.%x%c", &address.domain, &address.bus, &address.device, &address.function, &end) == 4;
+}
+
+// devicesPath is only ever changed by the tests
+inline int pciDeviceNumaNode(const PciAddress& address, const std::string& devicesPath = "/sys/bus/pci/devices")
+{
+    DIR* devices = opendir(devicesPath.c_str());
+    if (devices == nullptr)
+    {
+        return c_anyNumaNode;
+    }
+
+    int node = c_anyNumaNode;
+    while (dirent* entry = readdir(devices))
+    {
+        PciAddress entryAddress{};
+        if (!parsePciAddress(entry->d_name, entryAddress) || entryAddress.domain != address.domain || entryAddress.bus != address.bus ||
+            entryAddress.device != address.device || entryAddress.function != address.function)
+        {
+            continue;
+        }
+        long deviceNode = c_anyNumaNode;
+        readSysfsNumber(devicesPath + "/" + entry->d_name + "/numa_node", deviceNode);
+        node = deviceNode >= 0 ? static_cast<int>(deviceNode) : c_anyNumaNode;
+        break;
+    }
+    closedir(devices);
+    return node;
+}
+
+inline bool bindThreadToNumaNode(int node)
+{
+    if (node == c_anyNumaNode)
+    {
+        return false;
+    }
+    FILE* file = std::fopen(("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist").c_str(), "r");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    // e.g. "0-15,32-47"
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int first = 0;
+    while (std::fscanf(file, "%d", &first) == 1)
+    {
+        int last = first;
+        const int separator = std::fgetc(file);
+        if (separator == '-')
+        {
+            if (std::fscanf(file, "%d", &last) != 1)
+            {
+                break;
+            }
+            std::fgetc(file);
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+        {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+    std::fclose(file);
+    return CPU_COUNT(&cpus) > 0 && sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+#endif
+
+// A node that is not the given one, to measure what remote placement costs.
+// The same node when there is only one.
+inline int remoteNumaNode(int node)
+{
+    const uint32_t count = numaNodeCount();
+    return node == c_anyNumaNode ? c_anyNumaNode : static_cast<int>((static_cast<uint32_t>(node) + 1) % count);
+}
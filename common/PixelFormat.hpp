@@ -0,0 +1,181 @@
+#pragma once
+
+// Pixel formats of the transferred frames and the conversion between them.
+//
+// Besides RGBA8 the frames can be R10G10B10A2 or RGBA16F for HDR displays.
+// RGBA16F takes twice the bytes of the other two, packRgba16fToRgb10a2()
+// halves that on the way through host memory. The values are clamped to
+// [0, 1] and rounded to the nearest 10 (alpha 2) bit step, there is no tone
+// mapping or transfer function, so this only fits content that is already
+// in the displayable range. The conversion uses the F16C instructions when
+// the CPU has them and a scalar path otherwise, both give the same values.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PIXELFORMAT_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace pixelformat
+{
+enum class Format
+{
+    Rgba8,
+    Rgb10a2,
+    Rgba16f
+};
+
+inline uint32_t bytesPerPixel(Format format)
+{
+    return format == Format::Rgba16f ? 8 : 4;
+}
+
+inline const char* formatName(Format format)
+{
+    switch (format)
+    {
+    case Format::Rgb10a2:
+        return "rgb10a2";
+    case Format::Rgba16f:
+        return "rgba16f";
+    default:
+        return "rgba8";
+    }
+}
+
+// rgba8 for anything it does not know
+inline Format parseFormat(const std::string& name)
+{
+    return name == "rgb10a2" ? Format::Rgb10a2 : (name == "rgba16f" ? Format::Rgba16f : Format::Rgba8);
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits = 0;
+    if (exponent == 0x1f)
+    {
+        // Infinity or NaN
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else if (mantissa != 0)
+    {
+        // Subnormal, normalize it
+        uint32_t shift = 0;
+        while ((mantissa & 0x400) == 0)
+        {
+            mantissa <<= 1;
+            ++shift;
+        }
+        bits = sign | ((113 - shift) << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    else
+    {
+        bits = sign;
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Clamped to [0, 1], NaN to 0, rounded to nearest even like the SSE conversion
+inline uint32_t quantizeUnorm(float value, float maximum)
+{
+    const float clamped = value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+    return static_cast<uint32_t>(std::nearbyint(clamped * maximum));
+}
+
+inline void packRgba16fToRgb10a2Software(const uint16_t* source, uint32_t* destination, uint32_t pixelCount)
+{
+    for (uint32_t i = 0; i < pixelCount; ++i, source += 4)
+    {
+        destination[i] = quantizeUnorm(halfToFloat(source[0]), 1023.0f) | quantizeUnorm(halfToFloat(source[1]), 1023.0f) << 10 |
+                         quantizeUnorm(halfToFloat(source[2]), 1023.0f) << 20 | quantizeUnorm(halfToFloat(source[3]), 3.0f) << 30;
+    }
+}
+
+#if defined(PIXELFORMAT_X64)
+#if !defined(_MSC_VER)
+__attribute__((target("f16c")))
+#endif
+inline void packRgba16fToRgb10a2Hardware(const uint16_t* source, uint32_t* destination, uint32_t pixelCount)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 colorScale = _mm_set1_ps(1023.0f);
+    const __m128 alphaScale = _mm_set1_ps(3.0f);
+    uint32_t i = 0;
+    for (; i + 4 <= pixelCount; i += 4, source += 16)
+    {
+        // One pixel per register, transposed to one channel of four pixels per register
+        __m128 r = _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)));
+        __m128 g = _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + 4)));
+        __m128 b = _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + 8)));
+        __m128 a = _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + 12)));
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        // max() returns its second operand for NaN, so NaN becomes 0 like in the scalar path
+        const __m128i red = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), colorScale));
+        const __m128i green = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), colorScale));
+        const __m128i blue = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), colorScale));
+        const __m128i alpha = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(a, zero), one), alphaScale));
+        const __m128i packed = _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 10)), _mm_or_si128(_mm_slli_epi32(blue, 20), _mm_slli_epi32(alpha, 30)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), packed);
+    }
+    packRgba16fToRgb10a2Software(source, destination + i, pixelCount - i);
+}
+
+inline bool hasF16c()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 29)) != 0;
+#else
+    return __builtin_cpu_supports("f16c");
+#endif
+}
+#else
+inline void packRgba16fToRgb10a2Hardware(const uint16_t* source, uint32_t* destination, uint32_t pixelCount)
+{
+    packRgba16fToRgb10a2Software(source, destination, pixelCount);
+}
+
+inline bool hasF16c()
+{
+    return false;
+}
+#endif
+
+// Converts a frame of width x height pixels, the pitches are in bytes
+inline void packRgba16fToRgb10a2(const void* source, uint32_t sourcePitch, void* destination, uint32_t destinationPitch, uint32_t width, uint32_t height)
+{
+    static const bool hardware = hasF16c();
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        const uint16_t* sourceRow = reinterpret_cast<const uint16_t*>(static_cast<const uint8_t*>(source) + static_cast<size_t>(row) * sourcePitch);
+        uint32_t* destinationRow = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(destination) + static_cast<size_t>(row) * destinationPitch);
+        if (hardware)
+        {
+            packRgba16fToRgb10a2Hardware(sourceRow, destinationRow, width);
+        }
+        else
+        {
+            packRgba16fToRgb10a2Software(sourceRow, destinationRow, width);
+        }
+    }
+}
+} // namespace pixelformat
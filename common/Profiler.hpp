@@ -0,0 +1,278 @@
+#pragma once
+
+// Scoped CPU stage markers for the frame loops.
+//
+// A marker takes two timestamps and appends one sample to a buffer owned by the
+// calling thread, so recording never takes a lock. The buffer is a list of
+// fixed-size chunks: a full chunk is followed by a new one instead of being
+// reallocated, so recorded samples never move and a marker never copies them.
+// Buffers are registered once per thread and aggregated per stage when the
+// report is written, which should happen after the worker threads have been
+// joined.
+//
+// A marker costs two timestamps plus a store, tests/ProfilerBenchmark prints
+// what that comes to on the machine it runs on. The aim of 20 ns per marker
+// does not hold everywhere: in a virtual machine where one TSC read takes
+// about 20 ns a marker measured about 60 ns, with steady_clock it is slower
+// still.
+//
+// Build with MGPU_PROFILE=0 to compile the markers out completely.
+
+#ifndef MGPU_PROFILE
+#define MGPU_PROFILE 1
+#endif
+
+#if MGPU_PROFILE
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MGPU_PROFILE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MGPU_PROFILE_TSC 1
+#else
+#define MGPU_PROFILE_TSC 0
+#endif
+
+namespace profiler
+{
+enum class Stage
+{
+    Reset,
+    Record,
+    Execute,
+    Present,
+    Wait,
+    Count
+};
+
+inline const char* stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Reset:
+        return "Reset";
+    case Stage::Record:
+        return "Record";
+    case Stage::Execute:
+        return "Execute";
+    case Stage::Present:
+        return "Present";
+    case Stage::Wait:
+        return "Wait";
+    default:
+        return "Unknown";
+    }
+}
+
+const size_t c_stageCount = static_cast<size_t>(Stage::Count);
+const size_t c_chunkSampleCount = 1 << 14;
+
+// Invariant TSC is assumed where available, it is converted to seconds with a
+// one-off calibration against steady_clock when the report is written.
+inline uint64_t now()
+{
+#if MGPU_PROFILE_TSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+inline double ticksPerSecond()
+{
+#if MGPU_PROFILE_TSC
+    static const double frequency = [] {
+        const auto clockStart = std::chrono::steady_clock::now();
+        const uint64_t tickStart = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const uint64_t tickEnd = now();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - clockStart;
+        return static_cast<double>(tickEnd - tickStart) / elapsed.count();
+    }();
+    return frequency;
+#else
+    return static_cast<double>(std::chrono::steady_clock::period::den) / std::chrono::steady_clock::period::num;
+#endif
+}
+
+struct Sample
+{
+    Stage stage;
+    uint64_t begin;
+    uint64_t end;
+};
+
+struct ThreadBuffer
+{
+    using Chunk = std::array<Sample, c_chunkSampleCount>;
+
+    ThreadBuffer()
+    {
+        addChunk();
+    }
+
+    void record(const Sample& sample)
+    {
+        if (next == c_chunkSampleCount)
+        {
+            addChunk();
+        }
+        (*chunks.back())[next++] = sample;
+    }
+
+    template<typename Function>
+    void forEach(Function&& function) const
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            const size_t count = i + 1 == chunks.size() ? next : c_chunkSampleCount;
+            for (size_t j = 0; j < count; ++j)
+            {
+                function((*chunks[i])[j]);
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return (chunks.size() - 1) * c_chunkSampleCount + next;
+    }
+
+    void addChunk()
+    {
+        chunks.push_back(std::make_unique<Chunk>());
+        next = 0;
+    }
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    size_t next = 0; // In the last chunk
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+inline Registry& registry()
+{
+    static Registry r;
+    return r;
+}
+
+inline ThreadBuffer* registerThreadBuffer()
+{
+    std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.buffers.push_back(buffer);
+    return buffer.get();
+}
+
+// The registry keeps the buffer, the thread only caches a pointer to it. A
+// constant initialized pointer needs no guard, so the lookup is one TLS read.
+inline ThreadBuffer& threadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        buffer = registerThreadBuffer();
+    }
+    return *buffer;
+}
+
+class ScopedMarker
+{
+public:
+    explicit ScopedMarker(Stage stage) :
+        m_buffer(threadBuffer()),
+        m_stage(stage),
+        m_begin(now())
+    {
+    }
+
+    ~ScopedMarker()
+    {
+        m_buffer.record(Sample{m_stage, m_begin, now()});
+    }
+
+    ScopedMarker(const ScopedMarker&) = delete;
+    ScopedMarker& operator=(const ScopedMarker&) = delete;
+
+private:
+    ThreadBuffer& m_buffer;
+    Stage m_stage;
+    uint64_t m_begin;
+};
+
+struct StageStats
+{
+    uint64_t count = 0;
+    double total = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+};
+
+inline std::array<StageStats, c_stageCount> aggregate()
+{
+    std::array<StageStats, c_stageCount> stats{};
+    const double secondsPerTick = 1.0 / ticksPerSecond();
+
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const std::shared_ptr<ThreadBuffer>& buffer : r.buffers)
+    {
+        buffer->forEach([&](const Sample& sample) {
+            StageStats& s = stats[static_cast<size_t>(sample.stage)];
+            const double duration = static_cast<double>(sample.end - sample.begin) * secondsPerTick;
+            s.min = s.count == 0 ? duration : (std::min)(s.min, duration);
+            s.max = s.count == 0 ? duration : (std::max)(s.max, duration);
+            s.total += duration;
+            ++s.count;
+        });
+    }
+    return stats;
+}
+
+inline void writeReport(std::ostream& out)
+{
+    const std::array<StageStats, c_stageCount> stats = aggregate();
+    out << "CPU stage times (avg / min / max)" << std::endl;
+    for (size_t i = 0; i < c_stageCount; ++i)
+    {
+        const StageStats& s = stats[i];
+        if (s.count == 0)
+        {
+            continue;
+        }
+        out << stageName(static_cast<Stage>(i)) << ": "
+            << (s.total / s.count * 1000.0) << "ms / "
+            << (s.min * 1000.0) << "ms / "
+            << (s.max * 1000.0) << "ms"
+            << " (" << s.count << " samples)" << std::endl;
+    }
+}
+} // namespace profiler
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(stage) profiler::ScopedMarker PROFILE_CONCAT(profileMarker, __LINE__)(profiler::Stage::stage)
+#define PROFILE_REPORT(out) profiler::writeReport(out)
+
+#else
+
+#define PROFILE_SCOPE(stage) ((void)0)
+#define PROFILE_REPORT(out) ((void)0)
+
+#endif
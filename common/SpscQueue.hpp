@@ -0,0 +1,124 @@
+#pragma once
+
+// Bounded lock-free single-producer single-consumer queue.
+//
+// Exactly one thread may call tryPush and exactly one other thread may call
+// tryPop or pop. The head and tail indices live on separate cache lines so the
+// two threads only share a line when the queue is nearly empty or full.
+//
+// pop() blocks the consumer until a value is pushed or cancel() is called,
+// e.g. when the program shuts down. Every push counts up m_pushes, the
+// consumer sleeps on that counter with an atomic wait instead of spinning.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) :
+        m_slots(capacity + 1)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool tryPush(const T& value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t next = increment(tail);
+        if (next == m_cachedHead)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (next == m_cachedHead)
+            {
+                return false;
+            }
+        }
+        m_slots[tail] = value;
+        m_tail.store(next, std::memory_order_release);
+        m_pushes.fetch_add(1);
+        m_pushes.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+            {
+                return false;
+            }
+        }
+        value = m_slots[head];
+        m_head.store(increment(head), std::memory_order_release);
+        return true;
+    }
+
+    // Returns false once the queue is empty and cancelled, the values pushed
+    // before cancel() are still popped.
+    bool pop(T& value)
+    {
+        while (true)
+        {
+            // Read before trying, so a push that the try misses changes the counter the wait compares
+            const uint32_t pushes = m_pushes.load();
+            if (tryPop(value))
+            {
+                return true;
+            }
+            if (m_cancelled.load())
+            {
+                return false;
+            }
+            m_pushes.wait(pushes);
+        }
+    }
+
+    // Wakes a consumer blocked in pop() for good, may be called from any thread
+    void cancel()
+    {
+        m_cancelled.store(true);
+        m_pushes.fetch_add(1);
+        m_pushes.notify_all();
+    }
+
+    // Only a hint when called while the other side is running.
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return m_slots.size() - 1;
+    }
+
+private:
+    size_t increment(size_t index) const
+    {
+        return index + 1 == m_slots.size() ? 0 : index + 1;
+    }
+
+    static const size_t c_cacheLineSize = 64;
+
+    std::vector<T> m_slots;
+
+    // Written by the consumer
+    alignas(c_cacheLineSize) std::atomic<size_t> m_head{0};
+    size_t m_cachedTail = 0;
+
+    // Written by the producer
+    alignas(c_cacheLineSize) std::atomic<size_t> m_tail{0};
+    size_t m_cachedHead = 0;
+
+    alignas(c_cacheLineSize) std::atomic<uint32_t> m_pushes{0};
+    std::atomic<bool> m_cancelled{false};
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+// The producer side of a ring of staging slots that are copied into on the GPU
+// and read by the consumers of a FanOutSlots once the copy has landed.
+//
+// A slot is Free, Copying (the copy into it has been issued) or Mapped
+// (published to the consumers). Copies land in the order they were issued, so
+// the copying slots are published oldest first. The producer asks acquire()
+// for the next slot to copy into; when every slot the consumers do not hold
+// is still being copied it is told to finish the oldest copy first, and when
+// the consumers hold every slot it blocks until one of them releases a slot.
+// Mapping and unmapping are left to the caller, e.g. ID3D11DeviceContext::Map
+// on the render thread, so this runs just as well with an emulated device.
+//
+// Only the producer thread may call the members, the consumers only talk to
+// the FanOutSlots.
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "FanOut.hpp"
+
+class StagingRing
+{
+public:
+    enum class SlotState
+    {
+        Free,
+        Copying,
+        Mapped
+    };
+
+    enum class Acquire
+    {
+        Acquired,
+        PublishOldest, // Nothing to acquire until the oldest copying slot has been published
+        Busy // The consumers held every slot until the timeout
+    };
+
+    explicit StagingRing(FanOutSlots& fanOut, uint32_t slotCount) :
+        m_fanOut(fanOut),
+        m_states(slotCount, SlotState::Free)
+    {
+    }
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    SlotState state(uint32_t slot) const
+    {
+        return m_states[slot];
+    }
+
+    bool hasCopying() const
+    {
+        return !m_copying.empty();
+    }
+
+    // The slot that publishOldest() publishes next, only valid with hasCopying()
+    uint32_t oldestCopying() const
+    {
+        return m_copying.front();
+    }
+
+    // previousState tells whether the slot is still mapped from the last time it
+    // was published. The timeout bounds the wait for a release, so the caller
+    // gets to handle e.g. window messages while a consumer is stuck.
+    Acquire acquire(uint32_t& slot, SlotState& previousState, std::chrono::milliseconds timeout)
+    {
+        if (!m_fanOut.tryAcquire(slot, m_releaseValues))
+        {
+            if (!m_copying.empty())
+            {
+                return Acquire::PublishOldest;
+            }
+            if (!m_fanOut.acquireFor(slot, m_releaseValues, timeout))
+            {
+                return Acquire::Busy;
+            }
+        }
+        previousState = m_states[slot];
+        m_states[slot] = SlotState::Free;
+        return Acquire::Acquired;
+    }
+
+    // The copy into an acquired slot has been issued
+    void copyIssued(uint32_t slot)
+    {
+        m_states[slot] = SlotState::Copying;
+        m_copying.push_back(slot);
+    }
+
+    // The copy into the oldest copying slot has landed and the slot is mapped
+    void publishOldest()
+    {
+        const uint32_t slot = m_copying.front();
+        m_copying.pop_front();
+        m_states[slot] = SlotState::Mapped;
+        m_fanOut.publish(slot, 0);
+    }
+
+private:
+    FanOutSlots& m_fanOut;
+    std::vector<SlotState> m_states;
+    std::deque<uint32_t> m_copying;
+    std::vector<uint64_t> m_releaseValues;
+};
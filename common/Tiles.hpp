@@ -0,0 +1,164 @@
+#pragma once
+
+// Tiled output: one frame split over several windows and swap chains.
+//
+// planTiles() cuts the frame into a grid and assigns neighbouring tiles to the
+// same display adapter. PresentSync lines up the presents of the tiles: the
+// thread that submits the copies calls presentAll() once every tile's copy is
+// queued, which releases all tile threads to Present at the same time and
+// returns when every tile has presented. The spread between the tiles'
+// presents is kept as the frame's skew.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct Tile
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t adapter; // Adapter that drives the tile's window
+};
+
+// Row-major grid, the last column and row take the remainder. The tiles are
+// split into contiguous runs, one per adapter.
+inline std::vector<Tile> planTiles(uint32_t width, uint32_t height, uint32_t columns, uint32_t rows, const std::vector<uint32_t>& adapters)
+{
+    std::vector<Tile> tiles;
+    const uint32_t tileWidth = width / columns;
+    const uint32_t tileHeight = height / rows;
+    const uint32_t tileCount = columns * rows;
+    for (uint32_t row = 0; row < rows; ++row)
+    {
+        for (uint32_t column = 0; column < columns; ++column)
+        {
+            Tile tile{};
+            tile.x = column * tileWidth;
+            tile.y = row * tileHeight;
+            tile.width = column + 1 == columns ? width - tile.x : tileWidth;
+            tile.height = row + 1 == rows ? height - tile.y : tileHeight;
+            tile.adapter = adapters[static_cast<uint32_t>(tiles.size()) * static_cast<uint32_t>(adapters.size()) / tileCount];
+            tiles.push_back(tile);
+        }
+    }
+    return tiles;
+}
+
+class PresentSync
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PresentSync(uint32_t tileCount) :
+        m_taken(tileCount, 0),
+        m_presented(tileCount, 0),
+        m_presentTimes(tileCount)
+    {
+    }
+
+    PresentSync(const PresentSync&) = delete;
+    PresentSync& operator=(const PresentSync&) = delete;
+
+    // Submitting thread. Releases every tile to present and waits until all of them have.
+    void presentAll()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_frame;
+        m_tileCondition.notify_all();
+        m_doneCondition.wait(lock, [&] { return m_stopped || allPresented(); });
+        if (m_stopped)
+        {
+            return;
+        }
+
+        Clock::time_point first = m_presentTimes[0];
+        Clock::time_point last = m_presentTimes[0];
+        for (const Clock::time_point& time : m_presentTimes)
+        {
+            first = (std::min)(first, time);
+            last = (std::max)(last, time);
+        }
+        const double skew = std::chrono::duration<double>(last - first).count();
+        m_skewTotal += skew;
+        m_skewMax = (std::max)(m_skewMax, skew);
+        ++m_frameCount;
+    }
+
+    // Tile thread. Blocks until the next frame may be presented, returns false after stop().
+    bool waitForPresent(uint32_t tile)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_tileCondition.wait(lock, [&] { return m_stopped || m_frame > m_taken[tile]; });
+        if (m_stopped)
+        {
+            return false;
+        }
+        m_taken[tile] = m_frame;
+        return true;
+    }
+
+    // Tile thread. Called right after the tile's Present returns.
+    void presented(uint32_t tile)
+    {
+        const Clock::time_point now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_presentTimes[tile] = now;
+            m_presented[tile] = m_taken[tile];
+        }
+        m_doneCondition.notify_one();
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_tileCondition.notify_all();
+        m_doneCondition.notify_all();
+    }
+
+    // Seconds between the first and the last tile's present, averaged over the frames
+    double averageSkew() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_frameCount > 0 ? m_skewTotal / m_frameCount : 0.0;
+    }
+
+    double maxSkew() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_skewMax;
+    }
+
+private:
+    bool allPresented() const
+    {
+        for (uint64_t presented : m_presented)
+        {
+            if (presented != m_frame)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_tileCondition;
+    std::condition_variable m_doneCondition;
+    uint64_t m_frame = 0;
+    std::vector<uint64_t> m_taken;
+    std::vector<uint64_t> m_presented;
+    std::vector<Clock::time_point> m_presentTimes;
+    double m_skewTotal = 0.0;
+    double m_skewMax = 0.0;
+    uint64_t m_frameCount = 0;
+    bool m_stopped = false;
+};
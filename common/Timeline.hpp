@@ -0,0 +1,252 @@
+#pragma once
+
+// A fence together with the values signalled on it.
+//
+// Timeline hands out the fence values itself, one per signal(), so the values
+// of a fence can not skip, repeat or fall out of step with where they are
+// signalled. A SyncPoint is a value of one timeline. The queue that is to
+// signal it is recorded with it, the last c_historySize signals can be looked
+// up when something goes wrong.
+//
+// Every wait is checked before it is submitted or blocks the CPU. A wait on a
+// value that has not been handed out yet is reported as a deadlock: in these
+// programs a wait is always submitted after its signal, one that comes first
+// waits on its own queue or on a signal that depends on it. check() records
+// the error and returns false, the caller decides what to do with it. check()
+// is called on the timeline the caller expects to wait on, so a point of
+// another timeline is reported too instead of waiting on the wrong fence.
+//
+// Fence is anything FenceWaiter takes, e.g. ID3D12Fence or EmulatedFence. The
+// fence itself stays owned by whoever created it and has to outlive the
+// timeline.
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "FenceWaiter.hpp"
+
+template<typename Fence>
+class Timeline;
+
+template<typename Fence>
+class SyncPoint
+{
+public:
+    // A point that is always reached, e.g. of a frame slot that has not been used yet
+    SyncPoint() = default;
+
+    explicit operator bool() const
+    {
+        return m_timeline != nullptr;
+    }
+
+    Timeline<Fence>* timeline() const
+    {
+        return m_timeline;
+    }
+
+    Fence* fence() const
+    {
+        return m_timeline ? m_timeline->fence() : nullptr;
+    }
+
+    uint64_t value() const
+    {
+        return m_value;
+    }
+
+private:
+    friend class Timeline<Fence>;
+
+    SyncPoint(Timeline<Fence>* timeline, uint64_t value) :
+        m_timeline(timeline),
+        m_value(value)
+    {
+    }
+
+    Timeline<Fence>* m_timeline = nullptr;
+    uint64_t m_value = 0;
+};
+
+template<typename Fence>
+class Timeline
+{
+public:
+    static constexpr size_t c_historySize = 64;
+
+    struct Signal
+    {
+        uint64_t value;
+        std::string queue;
+    };
+
+    // initialValue is the value the fence was created with, the first signal() is one past it
+    Timeline(Fence* fence, uint64_t initialValue, std::string name) :
+        m_fence(fence),
+        m_name(std::move(name)),
+        m_lastValue(initialValue)
+    {
+    }
+
+    Timeline(const Timeline&) = delete;
+    Timeline& operator=(const Timeline&) = delete;
+
+    Fence* fence() const
+    {
+        return m_fence;
+    }
+
+    const std::string& name() const
+    {
+        return m_name;
+    }
+
+    // The next value, to be signalled by the queue right after this call
+    SyncPoint<Fence> signal(const std::string& queue)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_lastValue;
+        m_history.push_back(Signal{m_lastValue, queue});
+        if (m_history.size() > c_historySize)
+        {
+            m_history.pop_front();
+        }
+        return SyncPoint<Fence>(this, m_lastValue);
+    }
+
+    // The point of a value that was handed out as a number, e.g. one of several consecutive signals
+    SyncPoint<Fence> at(uint64_t value)
+    {
+        return SyncPoint<Fence>(this, value);
+    }
+
+    // The most recently handed out point, reached right away if there was none
+    SyncPoint<Fence> last()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return SyncPoint<Fence>(this, m_lastValue);
+    }
+
+    bool isReached(const SyncPoint<Fence>& point) const
+    {
+        return m_fence->GetCompletedValue() >= point.value();
+    }
+
+    // Returns false and records an error if the point will never be signalled.
+    // waiter names the queue, or the CPU thread, that is about to wait.
+    bool check(const SyncPoint<Fence>& point, const std::string& waiter)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (point.timeline() != this)
+        {
+            m_errors.push_back(waiter + " checks a point of another timeline against " + m_name);
+            return false;
+        }
+        if (point.value() > m_lastValue)
+        {
+            std::string error = waiter + " waits on " + m_name + " " + std::to_string(point.value()) + " but only " + std::to_string(m_lastValue) + " has been handed out";
+            if (!m_history.empty())
+            {
+                error += ", the last one by " + m_history.back().queue;
+            }
+            m_errors.push_back(error);
+            return false;
+        }
+        return true;
+    }
+
+    // The queue that signals the value, empty for the initial value and for values older than the history
+    std::string signalledBy(uint64_t value) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Signal& signal : m_history)
+        {
+            if (signal.value == value)
+            {
+                return signal.queue;
+            }
+        }
+        return std::string();
+    }
+
+    std::vector<Signal> history() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::vector<Signal>(m_history.begin(), m_history.end());
+    }
+
+    std::vector<std::string> errors() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_errors;
+    }
+
+private:
+    Fence* m_fence;
+    std::string m_name;
+
+    mutable std::mutex m_mutex;
+    uint64_t m_lastValue;
+    std::deque<Signal> m_history;
+    std::vector<std::string> m_errors;
+};
+
+// Checks the points, possibly of different timelines, each against its own
+// timeline, and blocks until they are reached with one request to the waiter,
+// which waits for all of their events at once. Returns false without blocking
+// if any of them would never be reached or the waiter rejects the request.
+template<typename Fence>
+bool waitSyncPoints(FenceWaiter<Fence>& waiter, const std::vector<SyncPoint<Fence>>& points, const std::string& thread, WaitMode mode = WaitMode::All)
+{
+    std::vector<FenceWait<Fence>> waits;
+    waits.reserve(points.size());
+    for (const SyncPoint<Fence>& point : points)
+    {
+        if (!point)
+        {
+            if (mode == WaitMode::Any)
+            {
+                return true;
+            }
+            continue;
+        }
+        if (!point.timeline()->check(point, thread))
+        {
+            return false;
+        }
+        waits.push_back(FenceWait<Fence>{point.fence(), point.value()});
+    }
+    return waits.empty() || waiter.wait(waits, mode);
+}
+
+// Like waitSyncPoints() but runs the callback once the points are reached instead of blocking
+template<typename Fence>
+bool notifySyncPoints(FenceWaiter<Fence>& waiter, const std::vector<SyncPoint<Fence>>& points, const std::string& thread, std::function<void()> callback,
+                      WaitMode mode = WaitMode::All)
+{
+    std::vector<FenceWait<Fence>> waits;
+    waits.reserve(points.size());
+    for (const SyncPoint<Fence>& point : points)
+    {
+        if (!point)
+        {
+            if (mode == WaitMode::Any)
+            {
+                callback();
+                return true;
+            }
+            continue;
+        }
+        if (!point.timeline()->check(point, thread))
+        {
+            return false;
+        }
+        waits.push_back(FenceWait<Fence>{point.fence(), point.value()});
+    }
+    return waiter.waitAsync(waits, mode, std::move(callback));
+}
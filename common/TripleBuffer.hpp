@@ -0,0 +1,107 @@
+#pragma once
+
+// Lock-free triple buffering of three slot indices.
+//
+// The producer always owns the back slot and the consumer the front slot, the
+// third one is parked in between. publish() swaps the written back slot with
+// the parked one, so the producer never waits for the consumer. acquire()
+// swaps the front slot with the parked one if it holds a frame that has not
+// been consumed yet, so the consumer always gets the newest frame. A frame
+// that is still parked when the next one is published is dropped.
+//
+// Exactly one thread may call back/publish and exactly one other thread may
+// call front/acquire/acquireBlocking. Writes to a slot's data before publish()
+// are visible to the consumer after acquire(), and the other way around.
+//
+// acquireBlocking() puts the consumer to sleep until a frame is published or
+// cancel() is called, every publish() counts up m_publishes for it to wait on.
+
+#include <atomic>
+#include <cstdint>
+
+class TripleBuffer
+{
+public:
+    static const uint32_t c_slotCount = 3;
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    TripleBuffer() = default;
+
+    uint32_t back() const
+    {
+        return m_back;
+    }
+
+    // Returns true when the previously published frame was never acquired.
+    bool publish()
+    {
+        const uint32_t previous = m_middle.exchange(m_back | c_freshBit, std::memory_order_acq_rel);
+        m_back = previous & c_indexMask;
+        m_publishes.fetch_add(1);
+        m_publishes.notify_one();
+        return (previous & c_freshBit) != 0;
+    }
+
+    uint32_t front() const
+    {
+        return m_front;
+    }
+
+    // Returns false and keeps the current front slot when nothing new has been published.
+    bool acquire()
+    {
+        // Only the consumer clears the fresh bit, so it can not disappear before the exchange
+        if ((m_middle.load(std::memory_order_relaxed) & c_freshBit) == 0)
+        {
+            return false;
+        }
+        const uint32_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & c_indexMask;
+        return true;
+    }
+
+    // Returns false without a new front slot once nothing new has been published and cancel() has been called
+    bool acquireBlocking()
+    {
+        while (true)
+        {
+            // Read before trying, so a publish that the try misses changes the counter the wait compares
+            const uint32_t publishes = m_publishes.load();
+            if (acquire())
+            {
+                return true;
+            }
+            if (m_cancelled.load())
+            {
+                return false;
+            }
+            m_publishes.wait(publishes);
+        }
+    }
+
+    // Wakes a consumer blocked in acquireBlocking() for good, may be called from any thread
+    void cancel()
+    {
+        m_cancelled.store(true);
+        m_publishes.fetch_add(1);
+        m_publishes.notify_all();
+    }
+
+private:
+    static const uint32_t c_freshBit = 0x4;
+    static const uint32_t c_indexMask = 0x3;
+    static const size_t c_cacheLineSize = 64;
+
+    // Written by the producer
+    alignas(c_cacheLineSize) uint32_t m_back = 0;
+
+    alignas(c_cacheLineSize) std::atomic<uint32_t> m_middle{1};
+
+    // Written by the consumer
+    alignas(c_cacheLineSize) uint32_t m_front = 2;
+
+    alignas(c_cacheLineSize) std::atomic<uint32_t> m_publishes{0};
+    std::atomic<bool> m_cancelled{false};
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+// Integer factor downscaling and Lanczos upscaling of RGBA8 frames.
+//
+// A frame transferred at 1/scale of the resolution per axis is scale^2 times
+// smaller. The producer averages scale x scale blocks (downscaleBox()) and the
+// display scales back up with a 2 lobe Lanczos filter: every output pixel is
+// a weighted sum of the 4x4 source pixels around its center, source
+// coordinates are clamped at the edges. The dx11 shaders do the same on the
+// GPU. upscaleLanczos2Reference() is the plain definition, upscaleLanczos2()
+// runs the filter as two separable passes with SSE2 and gives the same values
+// up to a rounding step.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define UPSCALE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace upscale
+{
+const double c_pi = 3.14159265358979323846;
+
+inline double lanczos2(double x)
+{
+    if (x == 0.0)
+    {
+        return 1.0;
+    }
+    if (x <= -2.0 || x >= 2.0)
+    {
+        return 0.0;
+    }
+    const double px = c_pi * x;
+    return 2.0 * std::sin(px) * std::sin(px / 2.0) / (px * px);
+}
+
+// With an integer scale the taps repeat every scale output pixels. For the
+// output pixel x the taps start at source pixel x / scale + offsets[x % scale].
+struct Lanczos2Taps
+{
+    explicit Lanczos2Taps(uint32_t scale)
+    {
+        for (uint32_t phase = 0; phase < scale; ++phase)
+        {
+            // Output pixel centers mapped back to the source
+            const double position = (phase + 0.5) / scale - 0.5;
+            const double base = std::floor(position);
+            offsets.push_back(static_cast<int>(base) - 1);
+            double tapWeights[4];
+            double sum = 0.0;
+            for (int tap = 0; tap < 4; ++tap)
+            {
+                tapWeights[tap] = lanczos2(position - (base - 1 + tap));
+                sum += tapWeights[tap];
+            }
+            for (int tap = 0; tap < 4; ++tap)
+            {
+                weights.push_back(static_cast<float>(tapWeights[tap] / sum));
+            }
+        }
+    }
+
+    std::vector<int> offsets; // Of the first tap, relative to x / scale
+    std::vector<float> weights; // 4 per phase, normalized
+};
+
+inline uint8_t toUnorm8(float value)
+{
+    return static_cast<uint8_t>(std::lround((std::min)(255.0f, (std::max)(0.0f, value))));
+}
+
+// Averages scale x scale blocks. width and height are those of the source and multiples of scale.
+inline void downscaleBox(const uint8_t* source, uint32_t sourcePitch, uint32_t width, uint32_t height, uint32_t scale, uint8_t* destination, uint32_t destinationPitch)
+{
+    const uint32_t area = scale * scale;
+    for (uint32_t y = 0; y < height / scale; ++y)
+    {
+        for (uint32_t x = 0; x < width / scale; ++x)
+        {
+            uint32_t sums[4] = {};
+            for (uint32_t sy = 0; sy < scale; ++sy)
+            {
+                const uint8_t* row = source + static_cast<size_t>(y * scale + sy) * sourcePitch + static_cast<size_t>(x) * scale * 4;
+                for (uint32_t sx = 0; sx < scale * 4; ++sx)
+                {
+                    sums[sx % 4] += row[sx];
+                }
+            }
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                destination[static_cast<size_t>(y) * destinationPitch + x * 4 + channel] = static_cast<uint8_t>((sums[channel] + area / 2) / area);
+            }
+        }
+    }
+}
+
+// width and height are those of the source, the destination is scale times larger on both axes
+inline void upscaleLanczos2Reference(const uint8_t* source, uint32_t sourcePitch, uint32_t width, uint32_t height, uint32_t scale, uint8_t* destination, uint32_t destinationPitch)
+{
+    const Lanczos2Taps taps(scale);
+    for (uint32_t y = 0; y < height * scale; ++y)
+    {
+        const int firstRow = static_cast<int>(y / scale) + taps.offsets[y % scale];
+        const float* rowWeights = &taps.weights[(y % scale) * 4];
+        for (uint32_t x = 0; x < width * scale; ++x)
+        {
+            const int firstColumn = static_cast<int>(x / scale) + taps.offsets[x % scale];
+            const float* columnWeights = &taps.weights[(x % scale) * 4];
+            float sums[4] = {};
+            for (int tapY = 0; tapY < 4; ++tapY)
+            {
+                const int sourceY = (std::min)((std::max)(firstRow + tapY, 0), static_cast<int>(height) - 1);
+                for (int tapX = 0; tapX < 4; ++tapX)
+                {
+                    const int sourceX = (std::min)((std::max)(firstColumn + tapX, 0), static_cast<int>(width) - 1);
+                    const uint8_t* pixel = source + static_cast<size_t>(sourceY) * sourcePitch + static_cast<size_t>(sourceX) * 4;
+                    const float weight = rowWeights[tapY] * columnWeights[tapX];
+                    for (int channel = 0; channel < 4; ++channel)
+                    {
+                        sums[channel] += weight * pixel[channel];
+                    }
+                }
+            }
+            for (int channel = 0; channel < 4; ++channel)
+            {
+                destination[static_cast<size_t>(y) * destinationPitch + static_cast<size_t>(x) * 4 + channel] = toUnorm8(sums[channel]);
+            }
+        }
+    }
+}
+
+// Horizontal pass of one source row into floats, 4 channels per output pixel
+inline void upscaleRowLanczos2(const uint8_t* source, uint32_t width, uint32_t scale, const Lanczos2Taps& taps, float* output)
+{
+    for (uint32_t x = 0; x < width * scale; ++x)
+    {
+        const int firstColumn = static_cast<int>(x / scale) + taps.offsets[x % scale];
+        const float* weights = &taps.weights[(x % scale) * 4];
+#if defined(UPSCALE_SSE2)
+        __m128 sum = _mm_setzero_ps();
+        for (int tap = 0; tap < 4; ++tap)
+        {
+            const int sourceX = (std::min)((std::max)(firstColumn + tap, 0), static_cast<int>(width) - 1);
+            int pixel;
+            std::memcpy(&pixel, source + static_cast<size_t>(sourceX) * 4, 4);
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(channels), _mm_set1_ps(weights[tap])));
+        }
+        _mm_storeu_ps(output + static_cast<size_t>(x) * 4, sum);
+#else
+        float sums[4] = {};
+        for (int tap = 0; tap < 4; ++tap)
+        {
+            const int sourceX = (std::min)((std::max)(firstColumn + tap, 0), static_cast<int>(width) - 1);
+            for (int channel = 0; channel < 4; ++channel)
+            {
+                sums[channel] += weights[tap] * source[static_cast<size_t>(sourceX) * 4 + channel];
+            }
+        }
+        std::copy(sums, sums + 4, output + static_cast<size_t>(x) * 4);
+#endif
+    }
+}
+
+// Same result as upscaleLanczos2Reference(), each source row is filtered horizontally once
+inline void upscaleLanczos2(const uint8_t* source, uint32_t sourcePitch, uint32_t width, uint32_t height, uint32_t scale, uint8_t* destination, uint32_t destinationPitch)
+{
+    const Lanczos2Taps taps(scale);
+    const uint32_t outputFloats = width * scale * 4;
+
+    // Horizontally filtered source rows, the 4 that the current output row reads. Row r is kept in slot r % 4.
+    std::vector<float> rows(4 * static_cast<size_t>(outputFloats));
+    int cachedRows[4] = {-1, -1, -1, -1};
+
+    for (uint32_t y = 0; y < height * scale; ++y)
+    {
+        const int firstRow = static_cast<int>(y / scale) + taps.offsets[y % scale];
+        const float* weights = &taps.weights[(y % scale) * 4];
+        const float* tapRows[4];
+        for (int tap = 0; tap < 4; ++tap)
+        {
+            const int sourceY = (std::min)((std::max)(firstRow + tap, 0), static_cast<int>(height) - 1);
+            float* row = rows.data() + static_cast<size_t>(sourceY % 4) * outputFloats;
+            if (cachedRows[sourceY % 4] != sourceY)
+            {
+                upscaleRowLanczos2(source + static_cast<size_t>(sourceY) * sourcePitch, width, scale, taps, row);
+                cachedRows[sourceY % 4] = sourceY;
+            }
+            tapRows[tap] = row;
+        }
+        uint8_t* output = destination + static_cast<size_t>(y) * destinationPitch;
+        uint32_t i = 0;
+#if defined(UPSCALE_SSE2)
+        const __m128 maximum = _mm_set1_ps(255.0f);
+        const __m128 minimum = _mm_setzero_ps();
+        for (; i + 16 <= outputFloats; i += 16)
+        {
+            __m128i packed[4];
+            for (int part = 0; part < 4; ++part)
+            {
+                __m128 sum = _mm_mul_ps(_mm_loadu_ps(tapRows[0] + i + part * 4), _mm_set1_ps(weights[0]));
+                for (int tap = 1; tap < 4; ++tap)
+                {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(tapRows[tap] + i + part * 4), _mm_set1_ps(weights[tap])));
+                }
+                packed[part] = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(sum, minimum), maximum));
+            }
+            const __m128i words = _mm_packs_epi32(packed[0], packed[1]);
+            const __m128i moreWords = _mm_packs_epi32(packed[2], packed[3]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(words, moreWords));
+        }
+#endif
+        for (; i < outputFloats; ++i)
+        {
+            float sum = 0.0f;
+            for (int tap = 0; tap < 4; ++tap)
+            {
+                sum += weights[tap] * tapRows[tap][i];
+            }
+            output[i] = toUnorm8(sum);
+        }
+    }
+}
+
+// Peak signal-to-noise ratio of the color channels in dB, infinite for identical frames
+inline double psnr(const uint8_t* a, const uint8_t* b, uint32_t pitch, uint32_t width, uint32_t height)
+{
+    double squaredError = 0.0;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            for (uint32_t channel = 0; channel < 3; ++channel)
+            {
+                const size_t index = static_cast<size_t>(y) * pitch + x * 4 + channel;
+                const double difference = static_cast<double>(a[index]) - b[index];
+                squaredError += difference * difference;
+            }
+        }
+    }
+    const double meanSquaredError = squaredError / (static_cast<double>(width) * height * 3);
+    return meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : INFINITY;
+}
+} // namespace upscale
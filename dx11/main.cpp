@@ -1,10 +1,32 @@
+#include <winsock2.h> // Before windows.h, which would pull in the old winsock.h
 #include <d3d11_1.h>
+#include <d3dcompiler.h>
 #include <comdef.h>
 #include <windows.h>
 
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#include "BlockCompression.hpp"
+#include "FanOut.hpp"
+#include "Foveation.hpp"
+#include "FrameCapture.hpp"
+#include "FrameHash.hpp"
+#include "FramePacing.hpp"
+#include "FrameStream.hpp"
+#include "HostMemory.hpp"
+#include "Numa.hpp"
+#include "PixelFormat.hpp"
+#include "StagingRing.hpp"
+#include "TripleBuffer.hpp"
 
 #define CHECK(f)                                                                                      \
     do                                                                                                \
@@ -59,6 +81,89 @@ void releaseDXPtr(T*& ptr)
 
 const int c_width = 7680;
 const int c_height = 3744;
+// Captured frames read ahead of the replayed one
+const uint64_t c_replayPrefetchFrames = 3;
+// Longest wait of the render thread for a display to release a staging texture before it handles the window messages again
+const std::chrono::milliseconds c_stagingWaitTimeout(16);
+
+// Full screen draws between textures of different sizes or formats. SCALE is
+// defined when the shaders are compiled.
+const char c_shaderSource[] = R"(
+Texture2D<float4> frameTexture : register(t0);
+
+float4 vsMain(uint vertexId : SV_VertexID) : SV_Position
+{
+    // One triangle that covers the whole viewport
+    const float2 uv = float2((vertexId << 1) & 2, vertexId & 2);
+    return float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+}
+
+// Same size, e.g. a compressed frame whose blocks the texture unit decodes on the way
+float4 psCopy(float4 position : SV_Position) : SV_Target
+{
+    return frameTexture.Load(int3(position.xy, 0));
+}
+
+// Average of the SCALE x SCALE source pixels under the target pixel
+float4 psDownscale(float4 position : SV_Position) : SV_Target
+{
+    const int2 first = int2(position.xy) * SCALE;
+    float4 sum = 0.0;
+    for (int y = 0; y < SCALE; ++y)
+    {
+        for (int x = 0; x < SCALE; ++x)
+        {
+            sum += frameTexture.Load(int3(first + int2(x, y), 0));
+        }
+    }
+    return sum / (SCALE * SCALE);
+}
+
+float lanczos2(float x)
+{
+    if (abs(x) < 1e-5)
+    {
+        return 1.0;
+    }
+    if (abs(x) >= 2.0)
+    {
+        return 0.0;
+    }
+    const float px = 3.14159265 * x;
+    return 2.0 * sin(px) * sin(px * 0.5) / (px * px);
+}
+
+// 2 lobe Lanczos over the 4x4 source pixels around the target pixel, see upscaleLanczos2Reference() in Upscale.hpp
+float4 psUpscale(float4 position : SV_Position) : SV_Target
+{
+    uint width;
+    uint height;
+    frameTexture.GetDimensions(width, height);
+    const float2 center = position.xy / SCALE - 0.5;
+    const float2 base = floor(center);
+
+    float4 weightsX;
+    float4 weightsY;
+    for (int tap = 0; tap < 4; ++tap)
+    {
+        weightsX[tap] = lanczos2(center.x - (base.x - 1.0 + tap));
+        weightsY[tap] = lanczos2(center.y - (base.y - 1.0 + tap));
+    }
+    weightsX /= dot(weightsX, 1.0);
+    weightsY /= dot(weightsY, 1.0);
+
+    float4 sum = 0.0;
+    for (int y = 0; y < 4; ++y)
+    {
+        for (int x = 0; x < 4; ++x)
+        {
+            const int2 source = clamp(int2(base) + int2(x - 1, y - 1), int2(0, 0), int2(width, height) - 1);
+            sum += weightsX[x] * weightsY[y] * frameTexture.Load(int3(source, 0));
+        }
+    }
+    return sum;
+}
+)";
 
 const D3D11_VIEWPORT c_viewport{
     0.0f,
@@ -88,6 +193,40 @@ struct QueryData
     ID3D11Query* disjointQuery = nullptr;
 };
 
+// One display adapter with its own window and upload thread
+struct DisplayEnv
+{
+    UINT adapterIndex = 0;
+    AdapterEnv adapterEnv;
+    HWND hwnd = nullptr;
+    IDXGISwapChain* swapChain = nullptr;
+    ID3D11RenderTargetView* windowRtv = nullptr;
+    ID3D11Texture2D* backBuffer = nullptr;
+    QueryData queryData;
+    std::vector<double> copyTimes;
+    std::vector<pacing::PresentSample> presentSamples;
+    int numaNode = c_anyNumaNode; // Of the upload thread and the hop buffer
+    HostBuffer hopBuffer; // Only with --two-hop
+    std::vector<double> hopTimes;
+    ID3D11Texture2D* verifyTexture = nullptr; // Sampled rows of the back buffer, only with --verify
+    ID3D11Texture2D* uploadTexture = nullptr; // Only with --compress or --scale, drawn into the back buffer, like the view and the shaders
+    ID3D11Texture2D* roiTexture = nullptr; // Only with --roi, copied over the upscaled frame
+    HostBuffer roiHopBuffer; // Only with --roi and --two-hop
+    ID3D11ShaderResourceView* uploadSrv = nullptr;
+    ID3D11VertexShader* drawVertexShader = nullptr;
+    ID3D11PixelShader* drawPixelShader = nullptr;
+    uint64_t verifiedFrames = 0;
+    uint64_t mismatchedFrames = 0;
+    std::vector<double> verifyTimes;
+};
+
+// Rows of a published frame that the displays check, hashed on adapter 1's side
+struct RowSamples
+{
+    std::vector<uint32_t> rows;
+    std::vector<uint32_t> hashes;
+};
+
 void enableConsole()
 {
     AllocConsole();
@@ -102,21 +241,24 @@ void enableConsole()
     std::cin.clear();
 }
 
-HWND createRenderWindow(HINSTANCE hInstance, int nCmdShow)
+HWND createRenderWindow(HINSTANCE hInstance, int nCmdShow, const std::string& windowTitle)
 {
     const LPCSTR windowClassName = "DX11WindowClass";
-    const LPCSTR windowTitle = "DirectX 11 Window";
 
+    // Every display has its own window, the class is registered by the first one
     WNDCLASSEX wc{};
     wc.cbSize = sizeof(WNDCLASSEX);
-    wc.style = CS_HREDRAW | CS_VREDRAW;
-    wc.lpfnWndProc = windowProc;
-    wc.hInstance = hInstance;
-    wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
-    wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
-    wc.lpszClassName = windowClassName;
-
-    CHECK(RegisterClassEx(&wc));
+    if (!GetClassInfoEx(hInstance, windowClassName, &wc))
+    {
+        wc.style = CS_HREDRAW | CS_VREDRAW;
+        wc.lpfnWndProc = windowProc;
+        wc.hInstance = hInstance;
+        wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+        wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+        wc.lpszClassName = windowClassName;
+
+        CHECK(RegisterClassEx(&wc));
+    }
 
     RECT rect = {0, 0, c_width, c_height};
     AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW, FALSE);
@@ -124,7 +266,7 @@ HWND createRenderWindow(HINSTANCE hInstance, int nCmdShow)
     HWND hwnd = CreateWindowEx(
         0, // Optional window styles
         windowClassName, // Window class name
-        windowTitle, // Window title
+        windowTitle.c_str(), // Window title
         WS_OVERLAPPEDWINDOW, // Window style
         CW_USEDEFAULT,
         CW_USEDEFAULT, // Position
@@ -178,6 +320,33 @@ void printAdapters(std::vector<IDXGIAdapter*>& adapters)
     }
 }
 
+// NUMA node the adapter hangs off, found by its PCI address
+int getAdapterNumaNode(const std::vector<IDXGIAdapter*>& adapters, UINT adapterIndex)
+{
+    DXGI_ADAPTER_DESC desc;
+    adapters[adapterIndex]->GetDesc(&desc);
+    PciAddress address{};
+    if (!adapterPciAddress(desc.AdapterLuid, address))
+    {
+        return c_anyNumaNode;
+    }
+    return pciDeviceNumaNode(address);
+}
+
+// --numa=local places host memory and threads on the adapter's node, --numa=remote on another node for comparison
+int getPlacementNumaNode(const std::vector<IDXGIAdapter*>& adapters, UINT adapterIndex, const std::string& numaMode)
+{
+    if (numaMode == "local")
+    {
+        return getAdapterNumaNode(adapters, adapterIndex);
+    }
+    if (numaMode == "remote")
+    {
+        return remoteNumaNode(getAdapterNumaNode(adapters, adapterIndex));
+    }
+    return c_anyNumaNode;
+}
+
 AdapterEnv createAdapterEnv(IDXGIAdapter* adapter)
 {
     const UINT flags =
@@ -192,17 +361,30 @@ AdapterEnv createAdapterEnv(IDXGIAdapter* adapter)
     return AdapterEnv{device, context};
 }
 
-ID3D11Texture2D* createTexture(ID3D11Device* device)
+DXGI_FORMAT dxgiFormat(pixelformat::Format format)
+{
+    switch (format)
+    {
+    case pixelformat::Format::Rgb10a2:
+        return DXGI_FORMAT_R10G10B10A2_UNORM;
+    case pixelformat::Format::Rgba16f:
+        return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    default:
+        return DXGI_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+ID3D11Texture2D* createTexture(ID3D11Device* device, DXGI_FORMAT format, UINT width, UINT height)
 {
     D3D11_TEXTURE2D_DESC textureDesc{};
-    textureDesc.Width = c_width;
-    textureDesc.Height = c_height;
+    textureDesc.Width = width;
+    textureDesc.Height = height;
     textureDesc.MipLevels = 1;
     textureDesc.ArraySize = 1;
-    textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    textureDesc.Format = format;
     textureDesc.SampleDesc.Count = 1;
     textureDesc.Usage = D3D11_USAGE_DEFAULT;
-    textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+    textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
 
     ID3D11Texture2D* texture = nullptr;
     CHECK_HR(device->CreateTexture2D(&textureDesc, nullptr, &texture));
@@ -230,7 +412,87 @@ ID3D11Texture2D* createStagingTexture(ID3D11Device* device, ID3D11Texture2D* ori
     return stagingTexture;
 }
 
-IDXGISwapChain* createSwapChain(HWND hwnd, ID3D11Device* device)
+ID3D11Texture2D* createStagingTexture(ID3D11Device* device, DXGI_FORMAT format, UINT width, UINT height)
+{
+    D3D11_TEXTURE2D_DESC desc{};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+    ID3D11Texture2D* stagingTexture = nullptr;
+    CHECK_HR(device->CreateTexture2D(&desc, nullptr, &stagingTexture));
+    return stagingTexture;
+}
+
+// Receives the sampled rows of the back buffer, one after the other
+ID3D11Texture2D* createVerifyTexture(ID3D11Device* device, UINT rowCount, DXGI_FORMAT format)
+{
+    D3D11_TEXTURE2D_DESC desc{};
+    desc.Width = c_width;
+    desc.Height = rowCount;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+    ID3D11Texture2D* texture = nullptr;
+    CHECK_HR(device->CreateTexture2D(&desc, nullptr, &texture));
+    return texture;
+}
+
+// Frame that the upload threads write when it cannot go straight to the back buffer, read by a draw
+ID3D11Texture2D* createUploadTexture(ID3D11Device* device, DXGI_FORMAT format, UINT width, UINT height)
+{
+    D3D11_TEXTURE2D_DESC desc{};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    ID3D11Texture2D* texture = nullptr;
+    CHECK_HR(device->CreateTexture2D(&desc, nullptr, &texture));
+    return texture;
+}
+
+ID3DBlob* compileShader(const char* entryPoint, const char* target, UINT scale)
+{
+    const std::string scaleValue = std::to_string(scale);
+    const D3D_SHADER_MACRO defines[] = {{"SCALE", scaleValue.c_str()}, {nullptr, nullptr}};
+    ID3DBlob* code = nullptr;
+    ID3DBlob* errors = nullptr;
+    const HRESULT hr = D3DCompile(c_shaderSource, sizeof(c_shaderSource) - 1, "draw", defines, nullptr, entryPoint, target, D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code, &errors);
+    if (errors != nullptr)
+    {
+        std::cerr << static_cast<const char*>(errors->GetBufferPointer()) << "\n";
+        errors->Release();
+    }
+    CHECK_HR(hr);
+    return code;
+}
+
+void createDrawShaders(ID3D11Device* device, const char* pixelEntryPoint, UINT scale, ID3D11VertexShader*& vertexShader, ID3D11PixelShader*& pixelShader)
+{
+    ID3DBlob* vertexCode = compileShader("vsMain", "vs_5_0", scale);
+    CHECK_HR(device->CreateVertexShader(vertexCode->GetBufferPointer(), vertexCode->GetBufferSize(), nullptr, &vertexShader));
+    vertexCode->Release();
+
+    ID3DBlob* pixelCode = compileShader(pixelEntryPoint, "ps_5_0", scale);
+    CHECK_HR(device->CreatePixelShader(pixelCode->GetBufferPointer(), pixelCode->GetBufferSize(), nullptr, &pixelShader));
+    pixelCode->Release();
+}
+
+IDXGISwapChain* createSwapChain(HWND hwnd, ID3D11Device* device, DXGI_FORMAT format)
 {
     IDXGIDevice* dxgiDevice = nullptr;
     CHECK_HR(device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice));
@@ -245,7 +507,7 @@ IDXGISwapChain* createSwapChain(HWND hwnd, ID3D11Device* device)
     swapChainDesc.BufferCount = 1;
     swapChainDesc.BufferDesc.Width = c_width;
     swapChainDesc.BufferDesc.Height = c_height;
-    swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    swapChainDesc.BufferDesc.Format = format;
     swapChainDesc.BufferDesc.RefreshRate.Numerator = 60;
     swapChainDesc.BufferDesc.RefreshRate.Denominator = 1;
     swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
@@ -293,56 +555,687 @@ QueryData createQueryData(ID3D11Device* device)
     return QueryData{startQuery, endQuery, disjointQuery};
 }
 
+// Reads a positive count given as e.g. --displays=2 on the command line
+UINT parseCountOption(const std::wstring& commandLine, const std::wstring& name, UINT defaultValue)
+{
+    const size_t position = commandLine.find(name);
+    if (position == std::wstring::npos)
+    {
+        return defaultValue;
+    }
+    const UINT value = static_cast<UINT>(wcstoul(commandLine.c_str() + position + name.size(), nullptr, 10));
+    return value > 0 ? value : defaultValue;
+}
+
+// Reads a value given as e.g. --stream-host=192.168.0.2 on the command line, up to the next space
+std::string parseStringOption(const std::wstring& commandLine, const std::wstring& name, const std::string& defaultValue)
+{
+    const size_t position = commandLine.find(name);
+    if (position == std::wstring::npos)
+    {
+        return defaultValue;
+    }
+    const size_t start = position + name.size();
+    const size_t end = (std::min)(commandLine.find(L' ', start), commandLine.size());
+    std::string value;
+    for (size_t i = start; i < end; ++i)
+    {
+        value.push_back(static_cast<char>(commandLine[i]));
+    }
+    return value.empty() ? defaultValue : value;
+}
+
+// Remote display node, shows frames streamed by another dx11 instance started with --stream=PORT
+int runReceiver(HINSTANCE hInstance, int nCmdShow, uint16_t port, const std::string& numaMode, pixelformat::Format format)
+{
+    /*
+    - receive frames from the sender over TCP into pinned host memory
+    - copy the newest received frame from host memory to adapter 0
+    - present it on adapter 0
+
+    The network thread receives into three host buffers and never waits for the
+    display, a frame that has not been uploaded by the time the next one has
+    arrived is dropped. A saturated link blocks the sender, which then skips
+    frames before they are sent.
+    */
+
+    IDXGIFactory1* factory = createFactory();
+    std::vector<IDXGIAdapter*> adapters = getAdapters(factory);
+    printAdapters(adapters);
+    CHECK(!adapters.empty());
+    const int numaNode = getPlacementNumaNode(adapters, 0, numaMode);
+    bindThreadToNumaNode(numaNode);
+
+    CHECK(initStreamSockets());
+    std::cout << "Waiting for a sender on port " << port << "\n";
+    const StreamSocket streamSocket = acceptStream(port);
+    CHECK(streamSocket != c_invalidStreamSocket);
+
+    DisplayEnv display;
+    display.adapterEnv = createAdapterEnv(adapters[0]);
+    display.hwnd = createRenderWindow(hInstance, nCmdShow, "DirectX 11 Receiver");
+    display.swapChain = createSwapChain(display.hwnd, display.adapterEnv.device, dxgiFormat(format));
+    display.windowRtv = createWindowRtv(display.swapChain, display.adapterEnv.device);
+    CHECK_HR(display.swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&display.backBuffer));
+    display.queryData = createQueryData(display.adapterEnv.device);
+    ID3D11DeviceContext* context = display.adapterEnv.context;
+
+    // Allocated once on huge pages if possible and faulted in up front, every frame reuses them
+    TripleBuffer frames;
+    StreamFrameHeader headers[TripleBuffer::c_slotCount]{};
+    HostBuffer pixels[TripleBuffer::c_slotCount];
+    for (HostBuffer& buffer : pixels)
+    {
+        buffer = HostBuffer(static_cast<size_t>(c_width) * c_height * pixelformat::bytesPerPixel(format), numaNode);
+        CHECK(buffer.data() != nullptr);
+    }
+    // The sender has to use the same --format, frames in any other format are skipped
+    const StreamFormat streamFormat{c_width, c_height, c_width * pixelformat::bytesPerPixel(format), static_cast<uint32_t>(format)};
+    StreamReceiver receiver(streamSocket, streamFormat);
+    std::atomic<uint64_t> droppedFrames{0};
+    std::atomic<bool> connected{true};
+    // Wakes up the display loop when a frame has been published or the sender has gone away
+    HANDLE frameEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    CHECK(frameEvent != nullptr);
+
+    std::thread networkThread([&] {
+        bindThreadToNumaNode(numaNode);
+        while (receiver.receive(headers[frames.back()], pixels[frames.back()].data(), pixels[frames.back()].size()))
+        {
+            if (frames.publish())
+            {
+                ++droppedFrames;
+            }
+            SetEvent(frameEvent);
+        }
+        connected = false;
+        SetEvent(frameEvent);
+    });
+
+    const uint64_t startPageFaults = pageFaultCount();
+    int64_t presentLatencyTotal = 0;
+    uint64_t presentedFrames = 0;
+    bool running = true;
+    while (running)
+    {
+        MSG msg = {};
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT)
+            {
+                running = false;
+                break;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+
+        if (!frames.acquire())
+        {
+            if (!connected)
+            {
+                // The sender has gone away
+                break;
+            }
+            // Sleeps until the next frame or window message
+            MsgWaitForMultipleObjects(1, &frameEvent, FALSE, INFINITE, QS_ALLINPUT);
+            continue;
+        }
+
+        const StreamFrameHeader& header = headers[frames.front()];
+
+        // Copy from host memory to the display adapter
+        context->Begin(display.queryData.disjointQuery);
+        context->End(display.queryData.startQuery);
+        context->UpdateSubresource(display.backBuffer, 0, nullptr, pixels[frames.front()].data(), header.rowBytes, 0);
+        context->End(display.queryData.endQuery);
+        context->End(display.queryData.disjointQuery);
+
+        UINT64 startTime = 0, endTime = 0;
+        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+
+        while (context->GetData(display.queryData.disjointQuery, &disjointData, sizeof(disjointData), 0) != S_OK)
+            ;
+        while (context->GetData(display.queryData.startQuery, &startTime, sizeof(startTime), 0) != S_OK)
+            ;
+        while (context->GetData(display.queryData.endQuery, &endTime, sizeof(endTime), 0) != S_OK)
+            ;
+
+        if (!disjointData.Disjoint)
+        {
+            double duration = static_cast<double>(endTime - startTime) / disjointData.Frequency;
+            display.copyTimes.push_back(duration);
+        }
+
+        display.swapChain->Present(1, 0);
+
+        // The sender's clock is only comparable on the same machine, e.g. on loopback
+        presentLatencyTotal += streamNow() - header.sendTime;
+        ++presentedFrames;
+
+        pacing::PresentSample presentSample{};
+        if (pacing::sampleSwapChain(display.swapChain, presentSample))
+        {
+            display.presentSamples.push_back(presentSample);
+        }
+    }
+
+    shutdownStream(streamSocket);
+    networkThread.join();
+    CloseHandle(frameEvent);
+    const uint64_t pageFaults = pageFaultCount() - startPageFaults;
+    closeStreamSocket(streamSocket);
+    cleanupStreamSockets();
+
+    display.queryData.release();
+    releaseDXPtr(display.backBuffer);
+    releaseDXPtr(display.windowRtv);
+    releaseDXPtr(display.swapChain);
+    releaseDXPtr(display.adapterEnv.context);
+    releaseDXPtr(display.adapterEnv.device);
+    for (IDXGIAdapter* adapter : adapters)
+    {
+        releaseDXPtr(adapter);
+    }
+    releaseDXPtr(factory);
+
+    double copyTimeTotal = 0.0;
+    for (double t : display.copyTimes)
+    {
+        copyTimeTotal += t;
+    }
+
+    const double qpcFrequency = pacing::qpcFrequency();
+
+    std::ofstream myfile;
+    myfile.open("dx11receiveout.txt");
+    myfile << "Received frames: " << receiver.framesReceived() << ", presented: " << presentedFrames << ", dropped before upload: " << droppedFrames
+           << ", skipped by the sender: " << receiver.framesMissed() << ", dropped in another format: " << receiver.framesDropped() << std::endl
+           << "Average send to receive latency: " << (receiver.averageLatency() * 1000.0) << "ms" << std::endl
+           << "Average send to present latency: " << (presentedFrames > 0 ? presentLatencyTotal * 1e-6 / presentedFrames : 0.0) << "ms" << std::endl
+           << "Host buffers: " << hostPagesName(pixels[0].pages()) << ", page faults while streaming: " << pageFaults << std::endl
+           << "Average copy time" << std::endl
+           << "0: " << (copyTimeTotal / display.copyTimes.size() * 1000.0) << "ms" << std::endl;
+    pacing::writeReport(myfile, pacing::analyze(display.presentSamples, qpcFrequency));
+    myfile.close();
+
+    std::ofstream traceFile("dx11receivepresent.txt");
+    pacing::writeTrace(traceFile, display.presentSamples, qpcFrequency);
+
+    return 0;
+}
+
 IDXGIFactory1* m_factory = nullptr;
-AdapterEnv m_adapterEnv0;
 AdapterEnv m_adapterEnv1;
 ID3D11Texture2D* m_texture = nullptr;
 ID3D11RenderTargetView* m_rtv = nullptr;
-ID3D11Texture2D* m_stagingTexture = nullptr;
-IDXGISwapChain* m_swapChain = nullptr;
-ID3D11RenderTargetView* m_windowRtv = nullptr;
-QueryData m_queryData0;
-QueryData m_queryData1;
+// Only with --scale, the render target is downscaled into the texture that is transferred
+ID3D11ShaderResourceView* m_textureSrv = nullptr;
+ID3D11Texture2D* m_scaledTexture = nullptr;
+ID3D11RenderTargetView* m_scaledRtv = nullptr;
+ID3D11VertexShader* m_downscaleVertexShader = nullptr;
+ID3D11PixelShader* m_downscalePixelShader = nullptr;
+std::vector<ID3D11Texture2D*> m_stagingTextures;
+std::vector<ID3D11Texture2D*> m_roiStagingTextures; // Only with --roi
+std::vector<QueryData> m_stagingQueryData;
+std::vector<DisplayEnv> m_displays;
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
 {
     /*
-    - render on adapter (gpu) 1
+    - render on adapter (gpu) 1, or with --replay=PATH upload the frames of a capture file
     - copy the result from adapter 1 to host memory
-    - copy the result from host memory to adapter 0 
-    - present the result on adapter 0
+    - copy the result from host memory to every display adapter (0, 2, 3, ...)
+    - present the result on every display adapter
+    - with --stream=PORT also send the result from host memory to a remote display node
+    - with --capture=PATH also write the result from host memory to a capture file
+    - with --verify=KB hash a few rows on both sides of the transfer and compare them
+    - with --compress=bc1|bc7 send block compressed frames to the displays, which decode them in a draw
+    - with --format=rgb10a2|rgba16f transfer HDR frames, with --pack-hdr packed from RGBA16F to R10G10B10A2 on the host
+    - with --scale=N transfer at 1/N of the resolution per axis, the displays upscale while drawing into the back buffer
+    - with --roi=X,Y,W,H also transfer that rectangle at full resolution, the displays copy it over the upscaled frame
+
+    The render thread only renders and copies into a ring of staging textures.
+    Mapped staging textures are published to one upload thread per display that
+    owns the display's context, so rendering and the host transfers overlap.
+    A display that falls behind skips frames instead of holding back the others.
+
+    With --numa=local every thread runs on the NUMA node of the adapter it
+    feeds. With --two-hop each upload thread first copies the frame into host
+    memory on its own node, so the move between the sockets is an explicit CPU
+    copy and the upload reads local memory.
     */
 
     enableConsole();
-    HWND hwnd = createRenderWindow(hInstance, nCmdShow);
+
+    const std::wstring commandLine(pCmdLine);
+    const pixelformat::Format frameFormat = pixelformat::parseFormat(parseStringOption(commandLine, L"--format=", "rgba8"));
+    const UINT receivePort = parseCountOption(commandLine, L"--receive=", 0);
+    if (receivePort > 0)
+    {
+        return runReceiver(hInstance, nCmdShow, static_cast<uint16_t>(receivePort), parseStringOption(commandLine, L"--numa=", ""), frameFormat);
+    }
 
     m_factory = createFactory();
     std::vector<IDXGIAdapter*> adapters = getAdapters(m_factory);
     printAdapters(adapters);
     CHECK(adapters.size() >= 2);
 
-    m_adapterEnv0 = createAdapterEnv(adapters[0]);
+    // Adapter 1 renders, by default every other adapter drives a display
+    const UINT maxDisplayCount = static_cast<UINT>(adapters.size()) - 1;
+    const UINT displayCount = (std::min)(parseCountOption(commandLine, L"--displays=", 1), maxDisplayCount);
+    // The stream to a remote display node is one more consumer after the displays
+    const UINT streamPort = parseCountOption(commandLine, L"--stream=", 0);
+    const UINT streamIndex = displayCount;
+    // The capture is the last consumer
+    const std::string capturePath = parseStringOption(commandLine, L"--capture=", "");
+    const UINT captureIndex = streamIndex + (streamPort > 0 ? 1 : 0);
+    const UINT consumerCount = captureIndex + (capturePath.empty() ? 0 : 1);
+    // Every consumer may be reading one slot while another waits to be taken and one is being copied
+    const UINT stagingSlotCount = consumerCount + 2;
+    const std::string numaMode = parseStringOption(commandLine, L"--numa=", "");
+    const bool twoHop = commandLine.find(L"--two-hop") != std::wstring::npos;
+    // RGBA16F frames converted to R10G10B10A2 while they are copied into each display's hop buffer
+    const bool packHdr = commandLine.find(L"--pack-hdr") != std::wstring::npos;
+    CHECK(!packHdr || frameFormat == pixelformat::Format::Rgba16f);
+    const pixelformat::Format displayFormat = packHdr ? pixelformat::Format::Rgb10a2 : frameFormat;
+    const bool hostHop = twoHop || packHdr;
+    // Adapter 1 downscales its frames by this factor per axis before they are read back
+    const UINT scale = parseCountOption(commandLine, L"--scale=", 1);
+    CHECK(c_width % scale == 0 && c_height % scale == 0);
+    CHECK(scale == 1 || streamPort == 0); // The receiver expects full size frames
+    const UINT transferWidth = c_width / scale;
+    const UINT transferHeight = c_height / scale;
+    const UINT frameRowBytes = transferWidth * pixelformat::bytesPerPixel(frameFormat);
+    const UINT displayRowBytes = transferWidth * pixelformat::bytesPerPixel(displayFormat);
+    // Bytes per frame and display that are read back and hashed, the rows move every frame
+    const UINT verifyBudget = parseCountOption(commandLine, L"--verify=", 0) * 1024;
+    const std::string compressMode = parseStringOption(commandLine, L"--compress=", "");
+    const bool compress = !compressMode.empty();
+    CHECK(!compress || compressMode == "bc1" || compressMode == "bc7");
+    CHECK(!compress || frameFormat == pixelformat::Format::Rgba8);
+    CHECK(!compress || (transferWidth % 4 == 0 && transferHeight % 4 == 0));
+    const blockcompression::Format compressFormat = compressMode == "bc7" ? blockcompression::Format::Bc7 : blockcompression::Format::Bc1;
+    const UINT compressedRowPitch = blockcompression::blockRowPitch(compressFormat, transferWidth);
+    // Full resolution rectangle next to the downscaled frame, moved every frame with --roi-sweep
+    foveation::Rect roiRect;
+    const bool roi = foveation::parseRect(parseStringOption(commandLine, L"--roi=", ""), roiRect);
+    CHECK(!roi || (scale > 1 && !compress && !packHdr));
+    roiRect = foveation::alignRect(roiRect, c_width, c_height, scale);
+    const bool roiSweep = commandLine.find(L"--roi-sweep") != std::wstring::npos;
+    const UINT roiRowBytes = roiRect.width * pixelformat::bytesPerPixel(frameFormat);
+    // Compression, packing and scaling are lossy, the displays would not see the bytes that adapter 1 hashed
+    const UINT verifyRowCount = verifyBudget > 0 && !compress && !packHdr && scale == 1 ? framehash::rowsForBudget(verifyBudget, frameRowBytes, c_height) : 0;
+    // The render thread issues the copies into the staging textures of adapter 1
+    const int renderNumaNode = getPlacementNumaNode(adapters, 1, numaMode);
+    bindThreadToNumaNode(renderNumaNode);
+
     m_adapterEnv1 = createAdapterEnv(adapters[1]);
 
-    m_texture = createTexture(m_adapterEnv1.device);
+    m_texture = createTexture(m_adapterEnv1.device, dxgiFormat(frameFormat), c_width, c_height);
     m_rtv = createRtv(m_adapterEnv1.device, m_texture);
-    m_stagingTexture = createStagingTexture(m_adapterEnv1.device, m_texture);
+    if (scale > 1)
+    {
+        CHECK_HR(m_adapterEnv1.device->CreateShaderResourceView(m_texture, nullptr, &m_textureSrv));
+        m_scaledTexture = createTexture(m_adapterEnv1.device, dxgiFormat(frameFormat), transferWidth, transferHeight);
+        m_scaledRtv = createRtv(m_adapterEnv1.device, m_scaledTexture);
+        createDrawShaders(m_adapterEnv1.device, "psDownscale", scale, m_downscaleVertexShader, m_downscalePixelShader);
+    }
+    // The texture whose contents go to the displays
+    ID3D11Texture2D* const transferTexture = scale > 1 ? m_scaledTexture : m_texture;
+    const D3D11_VIEWPORT transferViewport{0.0f, 0.0f, static_cast<float>(transferWidth), static_cast<float>(transferHeight), 0.0f, 1.0f};
+    for (UINT i = 0; i < stagingSlotCount; ++i)
+    {
+        m_stagingTextures.push_back(createStagingTexture(m_adapterEnv1.device, transferTexture));
+        if (roi)
+        {
+            m_roiStagingTextures.push_back(createStagingTexture(m_adapterEnv1.device, dxgiFormat(frameFormat), roiRect.width, roiRect.height));
+        }
+        m_stagingQueryData.push_back(createQueryData(m_adapterEnv1.device));
+    }
 
-    m_swapChain = createSwapChain(hwnd, m_adapterEnv0.device);
-    m_windowRtv = createWindowRtv(m_swapChain, m_adapterEnv0.device);
+    m_displays.resize(displayCount);
+    for (UINT i = 0; i < displayCount; ++i)
+    {
+        DisplayEnv& display = m_displays[i];
+        display.adapterIndex = i == 0 ? 0 : i + 1;
+        display.adapterEnv = createAdapterEnv(adapters[display.adapterIndex]);
+        display.hwnd = createRenderWindow(hInstance, nCmdShow, "DirectX 11 Window " + std::to_string(display.adapterIndex));
+        display.swapChain = createSwapChain(display.hwnd, display.adapterEnv.device, dxgiFormat(displayFormat));
+        display.windowRtv = createWindowRtv(display.swapChain, display.adapterEnv.device);
+        CHECK_HR(display.swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&display.backBuffer));
+        display.queryData = createQueryData(display.adapterEnv.device);
+        display.numaNode = getPlacementNumaNode(adapters, display.adapterIndex, numaMode);
+        if (hostHop)
+        {
+            display.hopBuffer = HostBuffer(static_cast<size_t>(displayRowBytes) * transferHeight, display.numaNode);
+            CHECK(display.hopBuffer.data() != nullptr);
+        }
+        if (verifyRowCount > 0)
+        {
+            display.verifyTexture = createVerifyTexture(display.adapterEnv.device, verifyRowCount, dxgiFormat(displayFormat));
+        }
+        if (compress || scale > 1)
+        {
+            const DXGI_FORMAT uploadFormat = !compress ? dxgiFormat(displayFormat) : (compressFormat == blockcompression::Format::Bc1 ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_BC7_UNORM);
+            display.uploadTexture = createUploadTexture(display.adapterEnv.device, uploadFormat, transferWidth, transferHeight);
+            CHECK_HR(display.adapterEnv.device->CreateShaderResourceView(display.uploadTexture, nullptr, &display.uploadSrv));
+            createDrawShaders(display.adapterEnv.device, scale > 1 ? "psUpscale" : "psCopy", scale, display.drawVertexShader, display.drawPixelShader);
+        }
+        if (roi)
+        {
+            display.roiTexture = createUploadTexture(display.adapterEnv.device, dxgiFormat(displayFormat), roiRect.width, roiRect.height);
+            if (hostHop)
+            {
+                display.roiHopBuffer = HostBuffer(static_cast<size_t>(roiRowBytes) * roiRect.height, display.numaNode);
+                CHECK(display.roiHopBuffer.data() != nullptr);
+            }
+        }
+    }
 
-    m_queryData0 = createQueryData(m_adapterEnv0.device);
-    m_queryData1 = createQueryData(m_adapterEnv1.device);
+    // One compressed frame per staging slot, written by the render thread before the slot is published.
+    // The render thread waits for the encoder, so it gets every core that is not feeding a display.
+    std::vector<HostBuffer> compressedFrames;
+    std::unique_ptr<blockcompression::BlockEncoder> blockEncoder;
+    std::vector<double> encodeTimes;
+    if (compress)
+    {
+        for (UINT i = 0; i < stagingSlotCount; ++i)
+        {
+            compressedFrames.emplace_back(static_cast<size_t>(compressedRowPitch) * (transferHeight / 4), renderNumaNode);
+            CHECK(compressedFrames.back().data() != nullptr);
+        }
+        const UINT coreCount = std::thread::hardware_concurrency();
+        const UINT encodeThreadCount = parseCountOption(commandLine, L"--compress-threads=", coreCount > displayCount ? coreCount - displayCount : 1);
+        blockEncoder = std::make_unique<blockcompression::BlockEncoder>(encodeThreadCount);
+    }
 
-    bool running = true;
     float blue = 0.0f;
 
-    ID3D11Texture2D* backBuffer = nullptr;
-    CHECK_HR(m_swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&backBuffer));
+    std::unique_ptr<CaptureReader> replay;
+    uint64_t replayedFrames = 0;
+    std::vector<double> replayUploadTimes;
+    const std::string replayPath = parseStringOption(commandLine, L"--replay=", "");
+    // Frames per second, as fast as the displays take them when not given
+    const UINT replayRate = parseCountOption(commandLine, L"--replay-rate=", 0);
+    const std::chrono::steady_clock::duration replayPeriod =
+        replayRate > 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / replayRate)) : std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::time_point nextReplayTime = std::chrono::steady_clock::now();
+    if (!replayPath.empty())
+    {
+        replay = std::make_unique<CaptureReader>(replayPath);
+        CHECK(replay->isOpen() && replay->frameCount() > 0);
+        CHECK(replay->header().width == c_width && replay->header().height == c_height && replay->header().rowBytes == c_width * pixelformat::bytesPerPixel(frameFormat));
+        replay->prefetch(0, c_replayPrefetchFrames);
+    }
 
-    std::vector<double> copyTimes0;
     std::vector<double> copyTimes1;
 
+    FanOutSlots fanOut(stagingSlotCount, consumerCount);
+    // Written by the render thread before a slot is published
+    std::vector<D3D11_MAPPED_SUBRESOURCE> mappedResources(stagingSlotCount);
+    std::vector<RowSamples> rowSamples(stagingSlotCount);
+    std::vector<D3D11_MAPPED_SUBRESOURCE> roiMappedResources(stagingSlotCount);
+    std::vector<foveation::Rect> roiRects(stagingSlotCount);
+    uint64_t roiFrame = 0;
+    std::atomic<bool> running{true};
+
+    std::vector<std::thread> uploadThreads;
+    for (UINT displayIndex = 0; displayIndex < displayCount; ++displayIndex)
+    {
+        uploadThreads.emplace_back([&, displayIndex] {
+            DisplayEnv& display = m_displays[displayIndex];
+            ID3D11DeviceContext* context = display.adapterEnv.context;
+            bindThreadToNumaNode(display.numaNode);
+
+            FanOutFrame frame{};
+            while (fanOut.take(displayIndex, frame))
+            {
+                const D3D11_MAPPED_SUBRESOURCE& mapped = mappedResources[frame.slot];
+                const void* uploadData = compress ? compressedFrames[frame.slot].data() : mapped.pData;
+                UINT uploadRowPitch = compress ? compressedRowPitch : mapped.RowPitch;
+                // The slot may be written again once it is released
+                RowSamples samples;
+                if (verifyRowCount > 0)
+                {
+                    samples = rowSamples[frame.slot];
+                }
+                const foveation::Rect rect = roiRects[frame.slot];
+                const void* roiData = roi ? roiMappedResources[frame.slot].pData : nullptr;
+                UINT roiRowPitch = roi ? roiMappedResources[frame.slot].RowPitch : 0;
+
+                if (hostHop)
+                {
+                    // Copy from the staging texture (or the compressed frame) to host memory on this display's node
+                    const auto hopStart = std::chrono::steady_clock::now();
+                    const UINT rowBytes = compress ? compressedRowPitch : displayRowBytes;
+                    const UINT rowCount = compress ? transferHeight / 4 : transferHeight;
+                    if (packHdr)
+                    {
+                        pixelformat::packRgba16fToRgb10a2(uploadData, uploadRowPitch, display.hopBuffer.data(), rowBytes, transferWidth, transferHeight);
+                    }
+                    else
+                    {
+                        for (UINT row = 0; row < rowCount; ++row)
+                        {
+                            std::memcpy(display.hopBuffer.data() + static_cast<size_t>(row) * rowBytes, static_cast<const uint8_t*>(uploadData) + static_cast<size_t>(row) * uploadRowPitch, rowBytes);
+                        }
+                    }
+                    if (roi)
+                    {
+                        for (UINT row = 0; row < rect.height; ++row)
+                        {
+                            std::memcpy(display.roiHopBuffer.data() + static_cast<size_t>(row) * roiRowBytes, static_cast<const uint8_t*>(roiData) + static_cast<size_t>(row) * roiRowPitch, roiRowBytes);
+                        }
+                        roiData = display.roiHopBuffer.data();
+                        roiRowPitch = roiRowBytes;
+                    }
+                    display.hopTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - hopStart).count());
+
+                    // The staging texture is no longer read
+                    fanOut.release(displayIndex, frame.slot, 0);
+                    uploadData = display.hopBuffer.data();
+                    uploadRowPitch = rowBytes;
+                }
+
+                // Copy from host memory to the display adapter
+                context->Begin(display.queryData.disjointQuery);
+                context->End(display.queryData.startQuery);
+                // The row pitch of a compressed texture is that of a row of blocks
+                context->UpdateSubresource(display.uploadTexture != nullptr ? display.uploadTexture : display.backBuffer, 0, nullptr, uploadData, uploadRowPitch, 0);
+                if (roi)
+                {
+                    context->UpdateSubresource(display.roiTexture, 0, nullptr, roiData, roiRowPitch, 0);
+                }
+                context->End(display.queryData.endQuery);
+                context->End(display.queryData.disjointQuery);
+
+                if (display.uploadTexture != nullptr)
+                {
+                    // Decode and/or upscale into the back buffer
+                    context->IASetInputLayout(nullptr);
+                    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                    context->VSSetShader(display.drawVertexShader, nullptr, 0);
+                    context->PSSetShader(display.drawPixelShader, nullptr, 0);
+                    context->PSSetShaderResources(0, 1, &display.uploadSrv);
+                    context->RSSetViewports(1, &c_viewport);
+                    context->OMSetRenderTargets(1, &display.windowRtv, nullptr);
+                    context->Draw(3, 0);
+                }
+                if (roi)
+                {
+                    // The full resolution rectangle over the upscaled periphery
+                    context->CopySubresourceRegion(display.backBuffer, 0, rect.x, rect.y, 0, display.roiTexture, 0, nullptr);
+                }
+
+                if (!hostHop)
+                {
+                    // UpdateSubresource has consumed the host memory when it returns, so there is no fence to wait for
+                    fanOut.release(displayIndex, frame.slot, 0);
+                }
+
+                if (verifyRowCount > 0)
+                {
+                    // Read the same rows back from the back buffer before Present discards it
+                    const auto verifyStart = std::chrono::steady_clock::now();
+                    for (UINT i = 0; i < samples.rows.size(); ++i)
+                    {
+                        const D3D11_BOX box{0, samples.rows[i], 0, c_width, samples.rows[i] + 1, 1};
+                        context->CopySubresourceRegion(display.verifyTexture, 0, 0, i, 0, display.backBuffer, 0, &box);
+                    }
+                    D3D11_MAPPED_SUBRESOURCE verifyMapped;
+                    CHECK_HR(context->Map(display.verifyTexture, 0, D3D11_MAP_READ, 0, &verifyMapped));
+                    UINT mismatchedRows = 0;
+                    for (UINT i = 0; i < samples.rows.size(); ++i)
+                    {
+                        const uint8_t* row = static_cast<const uint8_t*>(verifyMapped.pData) + static_cast<size_t>(i) * verifyMapped.RowPitch;
+                        mismatchedRows += framehash::crc32c(row, frameRowBytes) != samples.hashes[i] ? 1 : 0;
+                    }
+                    context->Unmap(display.verifyTexture, 0);
+                    display.verifyTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - verifyStart).count());
+
+                    ++display.verifiedFrames;
+                    if (mismatchedRows > 0)
+                    {
+                        ++display.mismatchedFrames;
+                        std::cerr << "Frame " << frame.frameNumber << " on adapter " << display.adapterIndex << ": " << mismatchedRows << " of " << samples.rows.size() << " sampled rows differ\n";
+                    }
+                }
+
+                UINT64 startTime = 0, endTime = 0;
+                D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+
+                while (context->GetData(display.queryData.disjointQuery, &disjointData, sizeof(disjointData), 0) != S_OK)
+                    ;
+                while (context->GetData(display.queryData.startQuery, &startTime, sizeof(startTime), 0) != S_OK)
+                    ;
+                while (context->GetData(display.queryData.endQuery, &endTime, sizeof(endTime), 0) != S_OK)
+                    ;
+
+                if (!disjointData.Disjoint)
+                {
+                    double duration = static_cast<double>(endTime - startTime) / disjointData.Frequency;
+                    display.copyTimes.push_back(duration);
+                }
+
+                display.swapChain->Present(1, 0);
+
+                pacing::PresentSample presentSample{};
+                if (pacing::sampleSwapChain(display.swapChain, presentSample))
+                {
+                    display.presentSamples.push_back(presentSample);
+                }
+            }
+        });
+    }
+
+    StreamSocket streamSocket = c_invalidStreamSocket;
+    StreamSender streamSender(streamSocket);
+    std::thread streamThread;
+    if (streamPort > 0)
+    {
+        CHECK(initStreamSockets());
+        streamSocket = connectStream(parseStringOption(commandLine, L"--stream-host=", "127.0.0.1"), static_cast<uint16_t>(streamPort));
+        CHECK(streamSocket != c_invalidStreamSocket);
+        streamSender = StreamSender(streamSocket);
+
+        streamThread = std::thread([&] {
+            bindThreadToNumaNode(renderNumaNode);
+            bool connected = true;
+
+            FanOutFrame frame{};
+            while (fanOut.take(streamIndex, frame))
+            {
+                // Sent straight from the mapped staging texture. While the link is
+                // saturated the send blocks and the frames published meanwhile are skipped.
+                const D3D11_MAPPED_SUBRESOURCE& mapped = mappedResources[frame.slot];
+                if (connected)
+                {
+                    connected = streamSender.send(frame.frameNumber, mapped.pData, mapped.RowPitch, transferWidth, transferHeight, static_cast<uint32_t>(frameFormat),
+                                                    pixelformat::bytesPerPixel(frameFormat));
+                }
+                fanOut.release(streamIndex, frame.slot, 0);
+            }
+        });
+    }
+
+    std::unique_ptr<CaptureWriter> captureWriter;
+    std::thread captureThread;
+    if (!capturePath.empty())
+    {
+        captureWriter = std::make_unique<CaptureWriter>(capturePath, transferWidth, transferHeight, pixelformat::bytesPerPixel(frameFormat), parseCountOption(commandLine, L"--capture-depth=", 4));
+        CHECK(captureWriter->isOpen());
+
+        captureThread = std::thread([&] {
+            bindThreadToNumaNode(renderNumaNode);
+
+            FanOutFrame frame{};
+            while (fanOut.take(captureIndex, frame))
+            {
+                // The rows are copied into one of the writer's buffers, the write itself is
+                // asynchronous. Frames published while every buffer is being written are skipped.
+                const D3D11_MAPPED_SUBRESOURCE& mapped = mappedResources[frame.slot];
+                captureWriter->write(frame.frameNumber, mapped.pData, mapped.RowPitch);
+                fanOut.release(captureIndex, frame.slot, 0);
+            }
+            captureWriter->finish();
+        });
+    }
+
+    // A mapped staging texture is unmapped when its slot is acquired again
+    StagingRing staging(fanOut, stagingSlotCount);
+
+    // Maps the oldest staging texture whose copy has landed and publishes it to the upload threads
+    auto publishCopiedSlot = [&](bool wait) {
+        const UINT slot = staging.oldestCopying();
+        D3D11_MAPPED_SUBRESOURCE mappedResource;
+        const HRESULT hr = m_adapterEnv1.context->Map(m_stagingTextures[slot], 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+        if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+        {
+            return false;
+        }
+        CHECK_HR(hr);
+
+        const QueryData& queryData = m_stagingQueryData[slot];
+        UINT64 startTime = 0, endTime = 0;
+        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+
+        while (m_adapterEnv1.context->GetData(queryData.disjointQuery, &disjointData, sizeof(disjointData), 0) != S_OK)
+            ;
+        while (m_adapterEnv1.context->GetData(queryData.startQuery, &startTime, sizeof(startTime), 0) != S_OK)
+            ;
+        while (m_adapterEnv1.context->GetData(queryData.endQuery, &endTime, sizeof(endTime), 0) != S_OK)
+            ;
+
+        if (!disjointData.Disjoint)
+        {
+            double duration = static_cast<double>(endTime - startTime) / disjointData.Frequency;
+            copyTimes1.push_back(duration);
+        }
+
+        mappedResources[slot] = mappedResource;
+        if (roi)
+        {
+            // Copied right after the periphery, so this does not wait long
+            CHECK_HR(m_adapterEnv1.context->Map(m_roiStagingTextures[slot], 0, D3D11_MAP_READ, 0, &roiMappedResources[slot]));
+        }
+        if (compress)
+        {
+            const auto encodeStart = std::chrono::steady_clock::now();
+            blockEncoder->encode(compressFormat, mappedResource.pData, mappedResource.RowPitch, transferWidth, transferHeight, compressedFrames[slot].data());
+            encodeTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count());
+        }
+        if (verifyRowCount > 0)
+        {
+            // Frames are published in order, so the number of the frame is known here
+            RowSamples& samples = rowSamples[slot];
+            samples.rows = framehash::sampleRows(fanOut.publishedFrames() + 1, c_height, verifyRowCount);
+            samples.hashes = framehash::hashRows(mappedResource.pData, mappedResource.RowPitch, frameRowBytes, samples.rows);
+        }
+        staging.publishOldest();
+        return true;
+    };
+
     while (running)
     {
         MSG msg = {};
@@ -357,75 +1250,175 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
             DispatchMessage(&msg);
         }
 
-        // "Rendering", here only the render target is cleared though
-        blue = blue > 1.0f ? 0.0f : blue + 0.01f;
-        float clearColor[4] = {0.0f, 0.2f, blue, 1.0f};
-        m_adapterEnv1.context->RSSetViewports(1, &c_viewport);
-        m_adapterEnv1.context->OMSetRenderTargets(1, &m_rtv, nullptr);
-        m_adapterEnv1.context->ClearRenderTargetView(m_rtv, clearColor);
+        while (staging.hasCopying())
+        {
+            if (!publishCopiedSlot(false))
+            {
+                break;
+            }
+        }
+
+        if (replay && std::chrono::steady_clock::now() < nextReplayTime)
+        {
+            // The next frame is not due yet, finish the copies that are in flight or sleep until it is
+            if (staging.hasCopying())
+            {
+                publishCopiedSlot(true);
+            }
+            else
+            {
+                std::this_thread::sleep_until(nextReplayTime);
+            }
+            continue;
+        }
+
+        UINT slot = 0;
+        StagingRing::SlotState previousState = StagingRing::SlotState::Free;
+        const StagingRing::Acquire acquired = staging.acquire(slot, previousState, c_stagingWaitTimeout);
+        if (acquired == StagingRing::Acquire::PublishOldest)
+        {
+            // Only block on a copy when every other staging texture is still read by a display
+            publishCopiedSlot(true);
+            continue;
+        }
+        if (acquired == StagingRing::Acquire::Busy)
+        {
+            continue;
+        }
+
+        if (previousState == StagingRing::SlotState::Mapped)
+        {
+            // Every display has released or skipped the slot
+            m_adapterEnv1.context->Unmap(m_stagingTextures[slot], 0);
+            if (roi)
+            {
+                m_adapterEnv1.context->Unmap(m_roiStagingTextures[slot], 0);
+            }
+        }
+
+        if (replay)
+        {
+            // The captured frames in order, looping at the end, so every run produces the same frames
+            const uint64_t replayFrame = replayedFrames % replay->frameCount();
+            const auto uploadStart = std::chrono::steady_clock::now();
+            m_adapterEnv1.context->UpdateSubresource(m_texture, 0, nullptr, replay->frame(replayFrame), replay->header().rowBytes, 0);
+            replayUploadTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - uploadStart).count());
+            replay->prefetch(replayFrame + 1, c_replayPrefetchFrames);
+            ++replayedFrames;
+
+            // A late frame does not make the following ones come in a burst
+            nextReplayTime = (std::max)(nextReplayTime + replayPeriod, std::chrono::steady_clock::now());
+        }
+        else
+        {
+            // "Rendering", here only the render target is cleared though
+            blue = blue > 1.0f ? 0.0f : blue + 0.01f;
+            float clearColor[4] = {0.0f, 0.2f, blue, 1.0f};
+            m_adapterEnv1.context->RSSetViewports(1, &c_viewport);
+            m_adapterEnv1.context->OMSetRenderTargets(1, &m_rtv, nullptr);
+            m_adapterEnv1.context->ClearRenderTargetView(m_rtv, clearColor);
+        }
+
+        if (scale > 1)
+        {
+            ID3D11ShaderResourceView* const noSrv = nullptr;
+            m_adapterEnv1.context->IASetInputLayout(nullptr);
+            m_adapterEnv1.context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            m_adapterEnv1.context->VSSetShader(m_downscaleVertexShader, nullptr, 0);
+            m_adapterEnv1.context->PSSetShader(m_downscalePixelShader, nullptr, 0);
+            m_adapterEnv1.context->PSSetShaderResources(0, 1, &m_textureSrv);
+            m_adapterEnv1.context->RSSetViewports(1, &transferViewport);
+            m_adapterEnv1.context->OMSetRenderTargets(1, &m_scaledRtv, nullptr);
+            m_adapterEnv1.context->Draw(3, 0);
+            // The render target is written again next frame
+            m_adapterEnv1.context->PSSetShaderResources(0, 1, &noSrv);
+        }
 
         {
             // Copy from adapter 1 to host memory
-            m_adapterEnv1.context->Begin(m_queryData1.disjointQuery);
-            m_adapterEnv1.context->End(m_queryData1.startQuery);
-            m_adapterEnv1.context->CopyResource(m_stagingTexture, m_texture);
-            m_adapterEnv1.context->End(m_queryData1.endQuery);
-            m_adapterEnv1.context->End(m_queryData1.disjointQuery);
-            UINT64 startTime = 0, endTime = 0;
-            D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
-
-            while (m_adapterEnv1.context->GetData(m_queryData1.disjointQuery, &disjointData, sizeof(disjointData), 0) != S_OK)
-                ;
-            while (m_adapterEnv1.context->GetData(m_queryData1.startQuery, &startTime, sizeof(startTime), 0) != S_OK)
-                ;
-            while (m_adapterEnv1.context->GetData(m_queryData1.endQuery, &endTime, sizeof(endTime), 0) != S_OK)
-                ;
-
-            if (!disjointData.Disjoint)
+            const QueryData& queryData = m_stagingQueryData[slot];
+            m_adapterEnv1.context->Begin(queryData.disjointQuery);
+            m_adapterEnv1.context->End(queryData.startQuery);
+            m_adapterEnv1.context->CopyResource(m_stagingTextures[slot], transferTexture);
+            if (roi)
             {
-                double duration = static_cast<double>(endTime - startTime) / disjointData.Frequency;
-                copyTimes1.push_back(duration);
+                const foveation::Rect rect = roiSweep ? foveation::sweepRect(roiRect, roiFrame++, c_width, c_height, scale) : roiRect;
+                const D3D11_BOX box{rect.x, rect.y, 0, rect.x + rect.width, rect.y + rect.height, 1};
+                m_adapterEnv1.context->CopySubresourceRegion(m_roiStagingTextures[slot], 0, 0, 0, 0, m_texture, 0, &box);
+                roiRects[slot] = rect;
             }
+            m_adapterEnv1.context->End(queryData.endQuery);
+            m_adapterEnv1.context->End(queryData.disjointQuery);
+            m_adapterEnv1.context->Flush();
         }
 
-        D3D11_MAPPED_SUBRESOURCE mappedResource;
-        m_adapterEnv1.context->Map(m_stagingTexture, 0, D3D11_MAP_READ, 0, &mappedResource);
-        {
-            // Copy from host memory to adapter 0
-            m_adapterEnv0.context->Begin(m_queryData0.disjointQuery);
-            m_adapterEnv0.context->End(m_queryData0.startQuery);
-            m_adapterEnv0.context->UpdateSubresource(backBuffer, 0, nullptr, mappedResource.pData, mappedResource.RowPitch, 0);
-            m_adapterEnv0.context->End(m_queryData0.endQuery);
-            m_adapterEnv0.context->End(m_queryData0.disjointQuery);
-            UINT64 startTime = 0, endTime = 0;
-            D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
-
-            while (m_adapterEnv0.context->GetData(m_queryData0.disjointQuery, &disjointData, sizeof(disjointData), 0) != S_OK)
-                ;
-            while (m_adapterEnv0.context->GetData(m_queryData0.startQuery, &startTime, sizeof(startTime), 0) != S_OK)
-                ;
-            while (m_adapterEnv0.context->GetData(m_queryData0.endQuery, &endTime, sizeof(endTime), 0) != S_OK)
-                ;
-
-            if (!disjointData.Disjoint)
+        staging.copyIssued(slot);
+    }
+
+    fanOut.stop();
+    for (std::thread& uploadThread : uploadThreads)
+    {
+        uploadThread.join();
+    }
+    if (streamThread.joinable())
+    {
+        // Wakes up a send that is blocked on a stalled receiver
+        shutdownStream(streamSocket);
+        streamThread.join();
+        closeStreamSocket(streamSocket);
+        cleanupStreamSockets();
+    }
+    if (captureThread.joinable())
+    {
+        captureThread.join();
+    }
+
+    for (UINT i = 0; i < stagingSlotCount; ++i)
+    {
+        if (staging.state(i) == StagingRing::SlotState::Mapped)
+        {
+            m_adapterEnv1.context->Unmap(m_stagingTextures[i], 0);
+            if (roi)
             {
-                double duration = static_cast<double>(endTime - startTime) / disjointData.Frequency;
-                copyTimes0.push_back(duration);
+                m_adapterEnv1.context->Unmap(m_roiStagingTextures[i], 0);
             }
         }
-        m_adapterEnv1.context->Unmap(m_stagingTexture, 0);
-        m_swapChain->Present(1, 0);
     }
 
-    m_queryData0.release();
-    m_queryData1.release();
-    releaseDXPtr(m_windowRtv);
-    releaseDXPtr(m_swapChain);
-    releaseDXPtr(m_stagingTexture);
+    for (DisplayEnv& display : m_displays)
+    {
+        display.queryData.release();
+        releaseDXPtr(display.verifyTexture);
+        releaseDXPtr(display.drawPixelShader);
+        releaseDXPtr(display.drawVertexShader);
+        releaseDXPtr(display.uploadSrv);
+        releaseDXPtr(display.uploadTexture);
+        releaseDXPtr(display.roiTexture);
+        releaseDXPtr(display.backBuffer);
+        releaseDXPtr(display.windowRtv);
+        releaseDXPtr(display.swapChain);
+        releaseDXPtr(display.adapterEnv.context);
+        releaseDXPtr(display.adapterEnv.device);
+    }
+    for (QueryData& queryData : m_stagingQueryData)
+    {
+        queryData.release();
+    }
+    for (ID3D11Texture2D*& stagingTexture : m_stagingTextures)
+    {
+        releaseDXPtr(stagingTexture);
+    }
+    for (ID3D11Texture2D*& stagingTexture : m_roiStagingTextures)
+    {
+        releaseDXPtr(stagingTexture);
+    }
+    releaseDXPtr(m_downscalePixelShader);
+    releaseDXPtr(m_downscaleVertexShader);
+    releaseDXPtr(m_scaledRtv);
+    releaseDXPtr(m_scaledTexture);
+    releaseDXPtr(m_textureSrv);
     releaseDXPtr(m_rtv);
     releaseDXPtr(m_texture);
-    releaseDXPtr(m_adapterEnv0.context);
-    releaseDXPtr(m_adapterEnv0.device);
     releaseDXPtr(m_adapterEnv1.context);
     releaseDXPtr(m_adapterEnv1.device);
     for (IDXGIAdapter* adapter : adapters)
@@ -440,17 +1433,116 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
         copyTimeTotal1 += t;
     }
 
-    double copyTimeTotal0 = 0.0;
-    for (double t : copyTimes0)
-    {
-        copyTimeTotal0 += t;
-    }
+    const double qpcFrequency = pacing::qpcFrequency();
 
     std::ofstream myfile;
     myfile.open("dx11out.txt");
-    myfile << "Average copy times" << std::endl
-           << "0: " << (copyTimeTotal0 / copyTimes0.size() * 1000.0) << "ms" << std::endl
-           << "1: " << (copyTimeTotal1 / copyTimes1.size() * 1000.0) << "ms" << std::endl;
+    myfile << "Displays: " << displayCount << ", published frames: " << fanOut.publishedFrames() << std::endl
+           << "Average copy times" << std::endl;
+    for (UINT i = 0; i < displayCount; ++i)
+    {
+        const DisplayEnv& display = m_displays[i];
+        double copyTimeTotal = 0.0;
+        for (double t : display.copyTimes)
+        {
+            copyTimeTotal += t;
+        }
+        myfile << display.adapterIndex << ": " << (copyTimeTotal / display.copyTimes.size() * 1000.0) << "ms, skipped frames: " << fanOut.skippedFrames(i) << std::endl;
+    }
+    myfile << "1: " << (copyTimeTotal1 / copyTimes1.size() * 1000.0) << "ms" << std::endl;
+    myfile << "Format: " << pixelformat::formatName(frameFormat);
+    if (packHdr)
+    {
+        myfile << ", packed to " << pixelformat::formatName(displayFormat) << " for the displays (" << (pixelformat::hasF16c() ? "F16C" : "scalar") << ")";
+    }
+    myfile << std::endl;
+    if (scale > 1)
+    {
+        myfile << "Scale: 1/" << scale << " per axis, transferred " << transferWidth << "x" << transferHeight << " (" << frameRowBytes * transferHeight << " bytes per frame), Lanczos upscale on the displays" << std::endl;
+    }
+    if (roi)
+    {
+        const foveation::TransferBytes roiBytes = foveation::transferBytes(roiRect, c_width, c_height, scale, pixelformat::bytesPerPixel(frameFormat));
+        myfile << "ROI: " << roiRect.width << "x" << roiRect.height << (roiSweep ? " sweeping" : " at " + std::to_string(roiRect.x) + "," + std::to_string(roiRect.y))
+               << ", bytes per frame: " << roiBytes.periphery << " periphery + " << roiBytes.roi << " ROI of " << roiBytes.full << " (" << (roiBytes.savedFraction() * 100.0) << "% saved)" << std::endl;
+    }
+    if (!numaMode.empty() || hostHop)
+    {
+        myfile << "NUMA placement: " << (numaMode.empty() ? "system" : numaMode) << ", nodes: " << numaNodeCount() << ", adapter 1 node: " << renderNumaNode << std::endl;
+        for (const DisplayEnv& display : m_displays)
+        {
+            double hopTimeTotal = 0.0;
+            for (double t : display.hopTimes)
+            {
+                hopTimeTotal += t;
+            }
+            myfile << display.adapterIndex << ": node " << display.numaNode;
+            if (hostHop)
+            {
+                myfile << ", average host hop: " << (hopTimeTotal / display.hopTimes.size() * 1000.0) << "ms";
+            }
+            myfile << std::endl;
+        }
+    }
+    if (streamPort > 0)
+    {
+        myfile << "Stream: sent frames: " << streamSender.framesSent() << ", skipped frames: " << fanOut.skippedFrames(streamIndex)
+               << ", average send time: " << (streamSender.averageSendTime() * 1000.0) << "ms" << std::endl;
+    }
+    if (verifyRowCount > 0)
+    {
+        myfile << "Verification: " << verifyRowCount << " rows per frame (" << (framehash::hasHardwareCrc32c() ? "hardware" : "software") << " CRC-32C)" << std::endl;
+        for (const DisplayEnv& display : m_displays)
+        {
+            double verifyTimeTotal = 0.0;
+            for (double t : display.verifyTimes)
+            {
+                verifyTimeTotal += t;
+            }
+            myfile << display.adapterIndex << ": verified frames: " << display.verifiedFrames << ", mismatched frames: " << display.mismatchedFrames
+                   << ", average check: " << (verifyTimeTotal / display.verifyTimes.size() * 1000.0) << "ms" << std::endl;
+        }
+    }
+    if (compress)
+    {
+        double encodeTimeTotal = 0.0;
+        for (double t : encodeTimes)
+        {
+            encodeTimeTotal += t;
+        }
+        const size_t compressedBytes = compressedFrames.front().size();
+        myfile << "Compression: " << (compressFormat == blockcompression::Format::Bc1 ? "BC1" : "BC7") << ", encoder threads: " << blockEncoder->threadCount()
+               << ", bytes per frame: " << compressedBytes << " (" << (static_cast<double>(transferWidth) * transferHeight * 4 / compressedBytes) << ":1)"
+               << ", average encode: " << (encodeTimeTotal / encodeTimes.size() * 1000.0) << "ms" << std::endl;
+    }
+    if (replay)
+    {
+        double replayUploadTimeTotal = 0.0;
+        for (double t : replayUploadTimes)
+        {
+            replayUploadTimeTotal += t;
+        }
+        myfile << "Replay: frames in the capture: " << replay->frameCount() << ", replayed frames: " << replayedFrames
+               << ", average upload: " << (replayUploadTimeTotal / replayUploadTimes.size() * 1000.0) << "ms" << std::endl;
+    }
+    if (captureWriter)
+    {
+        myfile << "Capture (" << captureWriter->backendName() << "): written frames: " << captureWriter->framesWritten() << ", skipped frames: " << fanOut.skippedFrames(captureIndex)
+               << ", failed writes: " << captureWriter->failedWrites() << ", throughput: " << (captureWriter->throughput() / (1024.0 * 1024.0)) << "MB/s" << std::endl;
+    }
+    for (const DisplayEnv& display : m_displays)
+    {
+        if (displayCount > 1)
+        {
+            myfile << "Display " << display.adapterIndex << std::endl;
+        }
+        pacing::writeReport(myfile, pacing::analyze(display.presentSamples, qpcFrequency));
+
+        // The single display keeps the original trace file name
+        const std::string traceName = displayCount > 1 ? "dx11present" + std::to_string(display.adapterIndex) + ".txt" : "dx11present.txt";
+        std::ofstream traceFile(traceName);
+        pacing::writeTrace(traceFile, display.presentSamples, qpcFrequency);
+    }
     myfile.close();
 
     return 0;
@@ -8,6 +8,18 @@
 #include <thread>
 #include <chrono>
 #include <fstream>
+#include <atomic>
+#include <algorithm>
+
+#include "Bands.hpp"
+#include "FenceWaiter.hpp"
+#include "FrameGraph.hpp"
+#include "FramePacing.hpp"
+#include "FrameRing.hpp"
+#include "Profiler.hpp"
+#include "SpscQueue.hpp"
+#include "Timeline.hpp"
+#include "TripleBuffer.hpp"
 
 using Microsoft::WRL::ComPtr;
 
@@ -36,6 +48,7 @@ using Microsoft::WRL::ComPtr;
 const int c_width = 7680;
 const int c_height = 3744;
 const UINT c_swapChainFrameCount = 3;
+const UINT c_framesInFlight = 3; // Producer and transfer slots, independent of the back buffers
 DXGI_FORMAT c_format = DXGI_FORMAT_R8G8B8A8_UNORM;
 const int c_gpuCount = 2;
 
@@ -57,6 +70,29 @@ struct QueryData
     UINT64 end;
 };
 
+struct FrameHandoff
+{
+    UINT slot;
+    SyncPoint<ID3D12Fence> syncPoint; // Of the copy into the slot, or of the copy out of it on the way back
+    std::chrono::steady_clock::time_point submitTime; // When the copy to the shared heap was submitted
+    UINT64 frame;
+};
+
+// GPU timestamp of one frame, for matching the two adapters' timestamps after the run
+struct FrameTimestamp
+{
+    UINT64 frame;
+    UINT64 timestamp;
+};
+
+// A queue's timestamp and the QueryPerformanceCounter value taken at the same time
+struct ClockCalibration
+{
+    UINT64 gpuTimestamp;
+    UINT64 cpuTimestamp;
+    UINT64 gpuFrequency;
+};
+
 UINT align(UINT size, UINT alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
 {
     return (size + alignment - 1) & ~(alignment - 1);
@@ -208,10 +244,10 @@ ComPtr<ID3D12CommandQueue> createCommandQueue(ComPtr<ID3D12Device> device, D3D12
     return queue;
 }
 
-ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID3D12CommandQueue> queue, HWND hwnd)
+ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID3D12CommandQueue> queue, HWND hwnd, UINT bufferCount)
 {
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-    swapChainDesc.BufferCount = c_swapChainFrameCount;
+    swapChainDesc.BufferCount = bufferCount;
     swapChainDesc.Width = c_width;
     swapChainDesc.Height = c_height;
     swapChainDesc.Format = c_format;
@@ -233,20 +269,20 @@ ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID
     return swapChain3;
 }
 
-std::vector<ComPtr<ID3D12Resource>> getBackBuffers(ComPtr<IDXGISwapChain3> swapChain)
+std::vector<ComPtr<ID3D12Resource>> getBackBuffers(ComPtr<IDXGISwapChain3> swapChain, UINT count)
 {
-    std::vector<ComPtr<ID3D12Resource>> backBuffers(c_swapChainFrameCount);
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    std::vector<ComPtr<ID3D12Resource>> backBuffers(count);
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(swapChain->GetBuffer(i, IID_PPV_ARGS(&backBuffers[i])));
     }
     return backBuffers;
 }
 
-ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device)
+ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device, UINT count)
 {
     D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{};
-    rtvHeapDesc.NumDescriptors = c_swapChainFrameCount;
+    rtvHeapDesc.NumDescriptors = count;
     rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
     rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 
@@ -255,15 +291,18 @@ ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device)
     return heap;
 }
 
-std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device)
+std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device, UINT count, D3D12_RESOURCE_FLAGS extraFlags = D3D12_RESOURCE_FLAG_NONE)
 {
-    std::vector<ComPtr<ID3D12Resource>> textures(c_swapChainFrameCount);
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    D3D12_RESOURCE_DESC textureDesc = c_textureDesc;
+    textureDesc.Flags |= extraFlags;
+
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(device->CreateCommittedResource(
             &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
             D3D12_HEAP_FLAG_NONE,
-            &c_textureDesc,
+            &textureDesc,
             D3D12_RESOURCE_STATE_COMMON,
             nullptr,
             IID_PPV_ARGS(&textures[i])));
@@ -276,17 +315,17 @@ void createRtvs(ComPtr<ID3D12Device> device, ComPtr<ID3D12DescriptorHeap> heap,
     CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(heap->GetCPUDescriptorHandleForHeapStart());
     const UINT rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    for (size_t i = 0; i < textures.size(); ++i)
     {
         device->CreateRenderTargetView(textures[i].Get(), nullptr, rtvHandle);
         rtvHandle.Offset(1, rtvDescriptorSize);
     }
 }
 
-std::vector<ComPtr<ID3D12CommandAllocator>> createCommandAllocators(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, const std::wstring& name = L"")
+std::vector<ComPtr<ID3D12CommandAllocator>> createCommandAllocators(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, UINT count, const std::wstring& name = L"")
 {
-    std::vector<ComPtr<ID3D12CommandAllocator>> allocators(c_swapChainFrameCount);
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    std::vector<ComPtr<ID3D12CommandAllocator>> allocators(count);
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(device->CreateCommandAllocator(type, IID_PPV_ARGS(&allocators[i])));
         if (!name.empty())
@@ -309,14 +348,14 @@ ComPtr<ID3D12GraphicsCommandList> createCommandList(ComPtr<ID3D12Device> device,
     return list;
 }
 
-ComPtr<ID3D12Heap> createSharedHeap(ComPtr<ID3D12Device> device)
+ComPtr<ID3D12Heap> createSharedHeap(ComPtr<ID3D12Device> device, UINT count)
 {
     D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
     device->GetCopyableFootprints(&c_textureDesc, 0, 1, 0, &layout, nullptr, nullptr, nullptr);
     UINT textureSize = align(layout.Footprint.RowPitch * layout.Footprint.Height);
 
     CD3DX12_HEAP_DESC heapDesc(
-        textureSize * c_swapChainFrameCount,
+        textureSize * count,
         D3D12_HEAP_TYPE_DEFAULT,
         0,
         D3D12_HEAP_FLAG_SHARED | D3D12_HEAP_FLAG_SHARED_CROSS_ADAPTER);
@@ -346,16 +385,16 @@ ComPtr<ID3D12Heap> openSharedHeapHandle(ComPtr<ID3D12Device> device, HANDLE hand
     return sharedHeap;
 }
 
-std::vector<ComPtr<ID3D12Resource>> createSharedHeapTexture(ComPtr<ID3D12Device> device, ComPtr<ID3D12Heap> heap)
+std::vector<ComPtr<ID3D12Resource>> createSharedHeapTexture(ComPtr<ID3D12Device> device, ComPtr<ID3D12Heap> heap, UINT count)
 {
     D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
     device->GetCopyableFootprints(&c_textureDesc, 0, 1, 0, &layout, nullptr, nullptr, nullptr);
     UINT textureSize = align(layout.Footprint.RowPitch * layout.Footprint.Height);
     D3D12_RESOURCE_DESC crossAdapterDesc = CD3DX12_RESOURCE_DESC::Buffer(textureSize, D3D12_RESOURCE_FLAG_ALLOW_CROSS_ADAPTER | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
 
-    std::vector<ComPtr<ID3D12Resource>> resources(c_swapChainFrameCount);
+    std::vector<ComPtr<ID3D12Resource>> resources(count);
 
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(device->CreatePlacedResource(
             heap.Get(),
@@ -396,10 +435,10 @@ ComPtr<ID3D12Fence> openSharedFenceHandle(ComPtr<ID3D12Device> device, HANDLE ha
     return sharedFence;
 }
 
-ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY_HEAP_TYPE type)
+ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY_HEAP_TYPE type, UINT count)
 {
     D3D12_QUERY_HEAP_DESC queryHeapDesc{};
-    queryHeapDesc.Count = 2; // One for the start timestamp, one for the end timestamp
+    queryHeapDesc.Count = count; // Start and end timestamp pairs
     queryHeapDesc.Type = type;
 
     ComPtr<ID3D12QueryHeap> queryHeap;
@@ -407,10 +446,10 @@ ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY
     return queryHeap;
 }
 
-ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device)
+ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device, UINT count)
 {
     CD3DX12_HEAP_PROPERTIES readbackHeapProps(D3D12_HEAP_TYPE_READBACK);
-    CD3DX12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * 2);
+    CD3DX12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * count);
 
     ComPtr<ID3D12Resource> readbackBuffer;
     device->CreateCommittedResource(
@@ -423,6 +462,156 @@ ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device)
     return readbackBuffer;
 }
 
+QueryData readQueryData(ComPtr<ID3D12Resource> readbackBuffer, UINT slot)
+{
+    const D3D12_RANGE range{slot * 2 * sizeof(UINT64), (slot + 1) * 2 * sizeof(UINT64)};
+    UINT64* mappedData = nullptr;
+    CHECK_HR(readbackBuffer->Map(0, &range, reinterpret_cast<void**>(&mappedData)));
+    QueryData queryData{};
+    queryData.start = mappedData[slot * 2];
+    queryData.end = mappedData[slot * 2 + 1];
+    const D3D12_RANGE writtenRange{0, 0};
+    readbackBuffer->Unmap(0, &writtenRange);
+    return queryData;
+}
+
+UINT64 readTimestamp(ComPtr<ID3D12Resource> readbackBuffer, UINT index)
+{
+    const D3D12_RANGE range{index * sizeof(UINT64), (index + 1) * sizeof(UINT64)};
+    UINT64* mappedData = nullptr;
+    CHECK_HR(readbackBuffer->Map(0, &range, reinterpret_cast<void**>(&mappedData)));
+    const UINT64 timestamp = mappedData[index];
+    const D3D12_RANGE writtenRange{0, 0};
+    readbackBuffer->Unmap(0, &writtenRange);
+    return timestamp;
+}
+
+ClockCalibration calibrateClock(ComPtr<ID3D12CommandQueue> queue)
+{
+    ClockCalibration calibration{};
+    CHECK_HR(queue->GetTimestampFrequency(&calibration.gpuFrequency));
+    CHECK_HR(queue->GetClockCalibration(&calibration.gpuTimestamp, &calibration.cpuTimestamp));
+    return calibration;
+}
+
+// Seconds from a timestamp on one queue to a timestamp on another queue, possibly of another adapter
+double timestampDistance(const ClockCalibration& from, UINT64 start, const ClockCalibration& to, UINT64 end, double qpcFrequency)
+{
+    const double calibrationDistance = (static_cast<double>(to.cpuTimestamp) - static_cast<double>(from.cpuTimestamp)) / qpcFrequency;
+    const double startOffset = (static_cast<double>(start) - static_cast<double>(from.gpuTimestamp)) / from.gpuFrequency;
+    const double endOffset = (static_cast<double>(end) - static_cast<double>(to.gpuTimestamp)) / to.gpuFrequency;
+    return calibrationDistance + endOffset - startOffset;
+}
+
+// Reads a positive count given as e.g. --frames-in-flight=4 on the command line
+UINT parseCountOption(const std::wstring& commandLine, const std::wstring& name, UINT defaultValue)
+{
+    const size_t position = commandLine.find(name);
+    if (position == std::wstring::npos)
+    {
+        return defaultValue;
+    }
+    const UINT value = static_cast<UINT>(wcstoul(commandLine.c_str() + position + name.size(), nullptr, 10));
+    return value > 0 ? value : defaultValue;
+}
+
+void terminateOnTimelineErrors(const Timeline<ID3D12Fence>& timeline)
+{
+    const std::vector<std::string> errors = timeline.errors();
+    if (errors.empty())
+    {
+        return;
+    }
+    for (const std::string& error : errors)
+    {
+        std::cerr << "Terminate. " << error << "\n";
+    }
+    std::terminate();
+}
+
+// Hands out the next value of the timeline and signals it on the queue
+SyncPoint<ID3D12Fence> queueSignal(ComPtr<ID3D12CommandQueue> queue, Timeline<ID3D12Fence>& timeline, const std::string& queueName)
+{
+    const SyncPoint<ID3D12Fence> point = timeline.signal(queueName);
+    CHECK_HR(queue->Signal(timeline.fence(), point.value()));
+    return point;
+}
+
+// The point has to be of the timeline the queue is meant to wait on. fence is
+// the timeline's fence as opened on the queue's adapter, if it is shared.
+void queueWait(ComPtr<ID3D12CommandQueue> queue, Timeline<ID3D12Fence>& timeline, const SyncPoint<ID3D12Fence>& point, const std::string& queueName,
+               ID3D12Fence* fence = nullptr)
+{
+    if (!point)
+    {
+        return;
+    }
+    if (!timeline.check(point, queueName))
+    {
+        terminateOnTimelineErrors(timeline);
+    }
+    CHECK_HR(queue->Wait(fence ? fence : timeline.fence(), point.value()));
+}
+
+// Blocks the thread until all of the points are reached, with a single wait for all of them
+void cpuWait(FenceWaiter<ID3D12Fence>& waiter, const std::vector<SyncPoint<ID3D12Fence>>& points, const std::string& threadName)
+{
+    if (!waitSyncPoints(waiter, points, threadName))
+    {
+        for (const SyncPoint<ID3D12Fence>& point : points)
+        {
+            if (point)
+            {
+                terminateOnTimelineErrors(*point.timeline());
+            }
+        }
+        std::cerr << "Terminate. The fence waiter rejected the wait of " << threadName << "\n";
+        std::terminate();
+    }
+}
+
+D3D12_RESOURCE_STATES toD3D12State(uint32_t state)
+{
+    D3D12_RESOURCE_STATES d3d12State = D3D12_RESOURCE_STATE_COMMON;
+    if (state & framegraph::RenderTarget)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_RENDER_TARGET;
+    }
+    if (state & framegraph::CopySource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_SOURCE;
+    }
+    if (state & framegraph::CopyDest)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_DEST;
+    }
+    if (state & framegraph::ShaderResource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    }
+    if (state & framegraph::UnorderedAccess)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    }
+    return d3d12State;
+}
+
+// Records one batch of frame graph barriers with a single ResourceBarrier call
+void recordBarriers(ComPtr<ID3D12GraphicsCommandList> list, const std::vector<framegraph::Barrier>& barriers, const std::vector<ID3D12Resource*>& resources)
+{
+    if (barriers.empty())
+    {
+        return;
+    }
+    std::vector<D3D12_RESOURCE_BARRIER> d3d12Barriers;
+    d3d12Barriers.reserve(barriers.size());
+    for (const framegraph::Barrier& barrier : barriers)
+    {
+        d3d12Barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resources[barrier.resource], toD3D12State(barrier.before), toD3D12State(barrier.after)));
+    }
+    list->ResourceBarrier(static_cast<UINT>(d3d12Barriers.size()), d3d12Barriers.data());
+}
+
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
 {
     /*
@@ -434,6 +623,22 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     enableConsole();
     HWND hwnd = createRenderWindow(hInstance, nCmdShow);
 
+    // In mailbox mode the producer never waits for the consumer and the consumer
+    // presents the newest frame, frames that are not picked up in time are dropped.
+    const std::wstring commandLine(pCmdLine);
+    const bool mailboxMode = commandLine.find(L"--mailbox") != std::wstring::npos;
+    // The back buffers only pace the consumer, the producer and the transfer
+    // through the shared heap have their own frames in flight. Mailbox mode
+    // triple buffers the shared heap slots.
+    // A flip model swap chain needs at least two buffers
+    const UINT backBufferCount = (std::max)(parseCountOption(commandLine, L"--back-buffers=", c_swapChainFrameCount), 2u);
+    const UINT framesInFlight = mailboxMode ? TripleBuffer::c_slotCount : parseCountOption(commandLine, L"--frames-in-flight=", c_framesInFlight);
+    // With more than one band the render, the copy to the shared heap and the
+    // copy to the back buffer are split into horizontal bands with a fence
+    // value each, so every stage starts as soon as the first band is done.
+    const UINT bandCount = (std::min)(parseCountOption(commandLine, L"--bands=", 1), static_cast<UINT>(c_height));
+    const bool banded = bandCount > 1;
+
     ComPtr<IDXGIFactory4> factory = createFactory();
     std::vector<ComPtr<IDXGIAdapter>> adapters = getAdapters(factory.Get());
     printAdapters(adapters);
@@ -448,20 +653,22 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     ComPtr<ID3D12CommandQueue> directQueue1 = createCommandQueue(device1, D3D12_COMMAND_LIST_TYPE_DIRECT);
     ComPtr<ID3D12CommandQueue> copyQueue1 = createCommandQueue(device1, D3D12_COMMAND_LIST_TYPE_COPY);
 
-    ComPtr<IDXGISwapChain3> swapChain = createSwapChain(factory, directQueue0, hwnd);
-    std::vector<ComPtr<ID3D12Resource>> backBuffers = getBackBuffers(swapChain);
-    int frameIndex = swapChain->GetCurrentBackBufferIndex();
+    ComPtr<IDXGISwapChain3> swapChain = createSwapChain(factory, directQueue0, hwnd, backBufferCount);
+    std::vector<ComPtr<ID3D12Resource>> backBuffers = getBackBuffers(swapChain, backBufferCount);
 
-    ComPtr<ID3D12DescriptorHeap> rtvHeap0 = createRtvHeap(device0);
+    ComPtr<ID3D12DescriptorHeap> rtvHeap0 = createRtvHeap(device0, backBufferCount);
     createRtvs(device0, rtvHeap0, backBuffers);
 
-    ComPtr<ID3D12DescriptorHeap> rtvHeap1 = createRtvHeap(device1);
-    std::vector<ComPtr<ID3D12Resource>> textures = createTextures(device1);
+    ComPtr<ID3D12DescriptorHeap> rtvHeap1 = createRtvHeap(device1, framesInFlight);
+    // The direct queue renders the later bands while the copy queue reads the
+    // earlier ones. Simultaneous access allows that, the textures then decay to
+    // the common state after every ExecuteCommandLists and need no barriers.
+    std::vector<ComPtr<ID3D12Resource>> textures = createTextures(device1, framesInFlight, banded ? D3D12_RESOURCE_FLAG_ALLOW_SIMULTANEOUS_ACCESS : D3D12_RESOURCE_FLAG_NONE);
     createRtvs(device1, rtvHeap1, textures);
 
-    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators0 = createCommandAllocators(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, L"allocator0_");
-    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, L"allocator1_");
-    std::vector<ComPtr<ID3D12CommandAllocator>> copyCommandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_COPY, L"copyAllocator_");
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators0 = createCommandAllocators(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, backBufferCount, L"allocator0_");
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, framesInFlight, L"allocator1_");
+    std::vector<ComPtr<ID3D12CommandAllocator>> copyCommandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_COPY, framesInFlight, L"copyAllocator_");
 
     ComPtr<ID3D12GraphicsCommandList> list0 = createCommandList(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators0[0], L"list0");
     ComPtr<ID3D12GraphicsCommandList> list1 = createCommandList(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators1[0], L"list1");
@@ -470,12 +677,12 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     // Create a shared heap that is accessible from both GPUs.
     // The heap is created on GPU 1 and then a shared handle is obtained for it
     // and the shared handle is openeed on GPU 0
-    ComPtr<ID3D12Heap> sharedHeap1 = createSharedHeap(device1);
+    ComPtr<ID3D12Heap> sharedHeap1 = createSharedHeap(device1, framesInFlight);
     HANDLE sharedHeapHandle = createSharedHeapHandle(device1, sharedHeap1);
     ComPtr<ID3D12Heap> sharedHeap0 = openSharedHeapHandle(device0, sharedHeapHandle);
 
-    std::vector<ComPtr<ID3D12Resource>> sharedHeapTextures0 = createSharedHeapTexture(device0, sharedHeap0);
-    std::vector<ComPtr<ID3D12Resource>> sharedHeapTextures1 = createSharedHeapTexture(device1, sharedHeap1);
+    std::vector<ComPtr<ID3D12Resource>> sharedHeapTextures0 = createSharedHeapTexture(device0, sharedHeap0, framesInFlight);
+    std::vector<ComPtr<ID3D12Resource>> sharedHeapTextures1 = createSharedHeapTexture(device1, sharedHeap1, framesInFlight);
 
     ComPtr<ID3D12Fence> frameFence = createFence(device0, D3D12_FENCE_FLAG_NONE);
     ComPtr<ID3D12Fence> renderFence = createFence(device1, D3D12_FENCE_FLAG_NONE);
@@ -483,31 +690,34 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     ComPtr<ID3D12Fence> sharedFence1 = createFence(device1, D3D12_FENCE_FLAG_SHARED | D3D12_FENCE_FLAG_SHARED_CROSS_ADAPTER);
     HANDLE sharedFenceHandle = createSharedFenceHandle(device1, sharedFence1);
     ComPtr<ID3D12Fence> sharedFence0 = openSharedFenceHandle(device0, sharedFenceHandle);
-    std::vector<UINT64> frameFenceValues(c_swapChainFrameCount, 0);
-    UINT64 presentFenceValue = 2;
-    UINT64 renderFenceValue = 2;
-    UINT64 sharedFenceValue = 2;
-    HANDLE frameFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-
-    ComPtr<ID3D12QueryHeap> queryHeap0 = createQueryHeap(device0, D3D12_QUERY_HEAP_TYPE_TIMESTAMP);
-    ComPtr<ID3D12QueryHeap> queryHeap1 = createQueryHeap(device1, D3D12_QUERY_HEAP_TYPE_COPY_QUEUE_TIMESTAMP);
-    ComPtr<ID3D12Resource> readBackBuffer0 = createReadbackBuffer(device0);
-    ComPtr<ID3D12Resource> readBackBuffer1 = createReadbackBuffer(device1);
-
-    const UINT rtvDescriptorSize0 = device0->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+    // The fences are created with 1, the timelines hand out the values from 2 on
+    Timeline<ID3D12Fence> presentTimeline(frameFence.Get(), 1, "present");
+    Timeline<ID3D12Fence> renderTimeline(renderFence.Get(), 1, "render");
+    Timeline<ID3D12Fence> sharedTimeline(sharedFence1.Get(), 1, "shared");
+    std::vector<SyncPoint<ID3D12Fence>> backBufferSyncPoints(backBufferCount);
+    // All CPU waits on GPU work go through this
+    FenceWaiter<ID3D12Fence> fenceWaiter;
+
+    // Two timestamps per frame slot so that in-flight frames do not overwrite each other's results
+    const UINT queryCount0 = backBufferCount * 2;
+    const UINT queryCount1 = framesInFlight * 2;
+    ComPtr<ID3D12QueryHeap> queryHeap0 = createQueryHeap(device0, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, queryCount0);
+    ComPtr<ID3D12QueryHeap> queryHeap1 = createQueryHeap(device1, D3D12_QUERY_HEAP_TYPE_COPY_QUEUE_TIMESTAMP, queryCount1);
+    ComPtr<ID3D12Resource> readBackBuffer0 = createReadbackBuffer(device0, queryCount0);
+    ComPtr<ID3D12Resource> readBackBuffer1 = createReadbackBuffer(device1, queryCount1);
+    // When adapter 1 starts rendering each frame slot
+    ComPtr<ID3D12QueryHeap> renderQueryHeap1 = createQueryHeap(device1, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, framesInFlight);
+    ComPtr<ID3D12Resource> renderReadBackBuffer1 = createReadbackBuffer(device1, framesInFlight);
+
     const UINT rtvDescriptorSize1 = device1->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
     UINT64 timestampFrequency0 = 0;
     directQueue0->GetTimestampFrequency(&timestampFrequency0);
-    UINT64 timestampFrequency1 = 0;
-    directQueue1->GetTimestampFrequency(&timestampFrequency1);
     UINT64 timestampFrequencyCopyQueue = 0;
     copyQueue1->GetTimestampFrequency(&timestampFrequencyCopyQueue);
-
-    bool running = true;
-    float blue = 0.0f;
-
-    bool first = true;
+    // Once at startup, the clocks drift apart by far less than a frame during a run
+    const ClockCalibration renderClock1 = calibrateClock(directQueue1);
+    const ClockCalibration directClock0 = calibrateClock(directQueue0);
 
     CHECK_HR(list0->Close());
     CHECK_HR(list1->Close());
@@ -515,182 +725,438 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
 
     std::vector<QueryData> queryData0;
     std::vector<QueryData> queryData1;
-
-    while (running)
-    {
-        MSG msg = {};
-        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+    std::vector<FrameTimestamp> renderStarts1;
+    std::vector<FrameTimestamp> copyEnds0;
+    std::vector<pacing::PresentSample> presentSamples;
+
+    // Each adapter is driven by its own thread. Shared heap slots travel to the
+    // consumer through readySlots once the copy has been submitted and come back
+    // through freeSlots once adapter 0 has been told to copy them out.
+    SpscQueue<FrameHandoff> readySlots(framesInFlight);
+    SpscQueue<FrameHandoff> freeSlots(framesInFlight);
+    std::atomic<bool> running{true};
+
+    // Mailbox mode hands the slots over through the triple buffer instead. The
+    // slot data is owned by whichever side currently owns the slot.
+    TripleBuffer mailbox;
+    std::vector<FrameHandoff> mailboxFrames(framesInFlight, FrameHandoff{});
+    std::vector<SyncPoint<ID3D12Fence>> mailboxReleases(framesInFlight);
+
+    uint64_t droppedFrames = 0;
+    uint64_t presentedFrames = 0;
+    double latencyTotal = 0.0;
+    double latencyMax = 0.0;
+
+    std::thread producerThread([&] {
+        // Render (=clear) on GPU 1 and copy the result to the shared heap
+        FrameRing ring(framesInFlight);
+
+        // The copy queue can only use the textures in the common state, the graph
+        // hands them over from the direct queue and orders the two queues.
+        framegraph::FrameGraph graph;
+        const framegraph::QueueId graphDirectQueue = graph.addQueue(1, framegraph::QueueType::Direct);
+        const framegraph::QueueId graphCopyQueue = graph.addQueue(1, framegraph::QueueType::Copy);
+        std::vector<ID3D12Resource*> graphResources;
+        std::vector<framegraph::ResourceId> textureIds;
+        std::vector<framegraph::ResourceId> sharedHeapTextureIds;
+        for (UINT i = 0; i < framesInFlight; ++i)
         {
-            if (msg.message == WM_QUIT)
-            {
-                running = false;
-                break;
-            }
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+            graphResources.push_back(textures[i].Get());
+            textureIds.push_back(graph.addResource(framegraph::Common));
+            graphResources.push_back(sharedHeapTextures1[i].Get());
+            sharedHeapTextureIds.push_back(graph.addResource(framegraph::Common));
         }
 
-        {
-            // Render (=clear) on GPU 1
-            CHECK_HR(commandAllocators1[frameIndex]->Reset());
-            CHECK_HR(list1->Reset(commandAllocators1[frameIndex].Get(), nullptr));
-
-            ID3D12Resource* tex = textures[frameIndex].Get();
-            list1->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tex, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
-            blue = blue > 1.0f ? 0.0f : blue + 0.01f;
-            float clearColor[4] = {0.0f, 0.2f, blue, 1.0f};
-            CD3DX12_CPU_DESCRIPTOR_HANDLE textureRtv = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap1->GetCPUDescriptorHandleForHeapStart(), frameIndex, rtvDescriptorSize1);
-
-            list1->ClearRenderTargetView(textureRtv, clearColor, 0, nullptr);
-            list1->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tex, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COMMON));
-
-            CHECK_HR(list1->Close());
-
-            ID3D12CommandList* commandLists[] = {list1.Get()};
-            directQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
-            CHECK_HR(directQueue1->Signal(renderFence.Get(), renderFenceValue));
-        }
+        float blue = 0.0f;
+        UINT slot = 0;
+        UINT64 frame = 0;
+        std::vector<UINT64> slotFrames(framesInFlight, 0);
 
+        while (running)
         {
-            // Wait for the render to be completed
-            CHECK_HR(copyQueue1->Wait(renderFence.Get(), renderFenceValue));
-            ++renderFenceValue;
-
-            // Copy the result the shared heap
-            CHECK_HR(copyCommandAllocators1[frameIndex]->Reset());
-            CHECK_HR(copyList1->Reset(copyCommandAllocators1[frameIndex].Get(), nullptr));
-
-            copyList1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0);
-
-            D3D12_RESOURCE_DESC textureDesc = textures[frameIndex]->GetDesc();
-            D3D12_PLACED_SUBRESOURCE_FOOTPRINT renderTargetLayout;
-            device1->GetCopyableFootprints(&textureDesc, 0, 1, 0, &renderTargetLayout, nullptr, nullptr, nullptr);
+            if (mailboxMode)
+            {
+                slot = mailbox.back();
+                const FrameHandoff& previous = mailboxFrames[slot];
+                if (previous.syncPoint)
+                {
+                    {
+                        // Adapter 0 may still copy out of the slot, or a dropped frame may still be copied into it
+                        PROFILE_SCOPE(Wait);
+                        cpuWait(fenceWaiter, {mailboxReleases[slot], previous.syncPoint}, "producer");
+                    }
+                    queryData1.push_back(readQueryData(readBackBuffer1, slot));
+                    renderStarts1.push_back({slotFrames[slot], readTimestamp(renderReadBackBuffer1, slot)});
+                }
+            }
+            else
+            {
+                slot = ring.advance();
+                if (ring.fenceValue(slot) != 0)
+                {
+                    // The slot is reusable once adapter 0 has finished copying out of it
+                    FrameHandoff released{};
+                    if (!freeSlots.pop(released))
+                    {
+                        break;
+                    }
+                    CHECK(released.slot == slot);
+                    {
+                        PROFILE_SCOPE(Wait);
+                        cpuWait(fenceWaiter, {released.syncPoint}, "producer");
+                    }
+                    queryData1.push_back(readQueryData(readBackBuffer1, slot));
+                    renderStarts1.push_back({slotFrames[slot], readTimestamp(renderReadBackBuffer1, slot)});
+                }
+            }
 
-            CD3DX12_TEXTURE_COPY_LOCATION dest(sharedHeapTextures1[frameIndex].Get(), renderTargetLayout);
-            CD3DX12_TEXTURE_COPY_LOCATION src(textures[frameIndex].Get(), 0);
-            CD3DX12_BOX box(0, 0, c_width, c_height);
+            graph.beginFrame();
+            const framegraph::PassId renderPassId = graph.addPass(graphDirectQueue, {framegraph::write(textureIds[slot], framegraph::RenderTarget)});
+            const framegraph::PassId copyPassId = graph.addPass(graphCopyQueue, {framegraph::read(textureIds[slot], framegraph::CopySource), framegraph::write(sharedHeapTextureIds[slot], framegraph::CopyDest)});
+            const framegraph::CompiledFrame compiled = graph.compile();
+            CHECK(compiled.errors.empty());
+            const framegraph::CompiledPass& renderPass = compiled.passes[renderPassId];
+            const framegraph::CompiledPass& copyPass = compiled.passes[copyPassId];
 
-            copyList1->CopyTextureRegion(&dest, 0, 0, 0, &src, &box);
+            blue = blue > 1.0f ? 0.0f : blue + 0.01f;
+            // In the order of the signal indices of the graph, or one per band
+            std::vector<SyncPoint<ID3D12Fence>> renderSyncPoints;
 
-            copyList1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 1);
-            copyList1->ResolveQueryData(
-                queryHeap1.Get(),
-                D3D12_QUERY_TYPE_TIMESTAMP,
-                0, // Start index
-                2, // Number of queries
-                readBackBuffer1.Get(),
-                0); // Destination buffer offset
+            for (UINT band = 0; band < bandCount; ++band)
+            {
+                const bands::Rows rows = bands::bandRows(band, bandCount, c_height);
+                {
+                    PROFILE_SCOPE(Reset);
+                    if (band == 0)
+                    {
+                        CHECK_HR(commandAllocators1[slot]->Reset());
+                    }
+                    CHECK_HR(list1->Reset(commandAllocators1[slot].Get(), nullptr));
+                }
+
+                {
+                    PROFILE_SCOPE(Record);
+                    if (band == 0)
+                    {
+                        list1->EndQuery(renderQueryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, slot);
+                    }
+                    if (!banded)
+                    {
+                        recordBarriers(list1, renderPass.barriersBefore, graphResources);
+                    }
+
+                    float clearColor[4] = {0.0f, 0.2f, blue, 1.0f};
+                    CD3DX12_CPU_DESCRIPTOR_HANDLE textureRtv = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap1->GetCPUDescriptorHandleForHeapStart(), slot, rtvDescriptorSize1);
+                    const D3D12_RECT bandRect{0, static_cast<LONG>(rows.y), c_width, static_cast<LONG>(rows.y + rows.height)};
+
+                    list1->ClearRenderTargetView(textureRtv, clearColor, 1, &bandRect);
+                    if (!banded)
+                    {
+                        recordBarriers(list1, renderPass.barriersAfter, graphResources);
+                    }
+                    if (band + 1 == bandCount)
+                    {
+                        list1->ResolveQueryData(renderQueryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, slot, 1, renderReadBackBuffer1.Get(), slot * sizeof(UINT64));
+                    }
+
+                    CHECK_HR(list1->Close());
+                }
+
+                {
+                    PROFILE_SCOPE(Execute);
+                    ID3D12CommandList* commandLists[] = {list1.Get()};
+                    directQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
+                    if (banded || renderPass.signalIndex > 0)
+                    {
+                        renderSyncPoints.push_back(queueSignal(directQueue1, renderTimeline, "direct1"));
+                    }
+                }
+            }
+            CHECK(banded || renderSyncPoints.size() == compiled.signalCounts[graphDirectQueue]);
 
-            CHECK_HR(copyList1->Close());
+            // Copy the result the shared heap, each band as soon as it has been rendered
+            SyncPoint<ID3D12Fence> copySyncPoint;
+            for (UINT band = 0; band < bandCount; ++band)
+            {
+                const bands::Rows rows = bands::bandRows(band, bandCount, c_height);
+                if (banded)
+                {
+                    queueWait(copyQueue1, renderTimeline, renderSyncPoints[band], "copy1");
+                }
+                else
+                {
+                    for (const framegraph::QueueWait& wait : copyPass.waits)
+                    {
+                        CHECK(wait.queue == graphDirectQueue);
+                        queueWait(copyQueue1, renderTimeline, renderSyncPoints[wait.signalIndex - 1], "copy1");
+                    }
+                }
+
+                {
+                    PROFILE_SCOPE(Reset);
+                    if (band == 0)
+                    {
+                        CHECK_HR(copyCommandAllocators1[slot]->Reset());
+                    }
+                    CHECK_HR(copyList1->Reset(copyCommandAllocators1[slot].Get(), nullptr));
+                }
+
+                {
+                    PROFILE_SCOPE(Record);
+                    const UINT queryIndex = slot * 2;
+                    if (band == 0)
+                    {
+                        copyList1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+                    }
+
+                    D3D12_RESOURCE_DESC textureDesc = textures[slot]->GetDesc();
+                    D3D12_PLACED_SUBRESOURCE_FOOTPRINT renderTargetLayout;
+                    device1->GetCopyableFootprints(&textureDesc, 0, 1, 0, &renderTargetLayout, nullptr, nullptr, nullptr);
+
+                    CD3DX12_TEXTURE_COPY_LOCATION dest(sharedHeapTextures1[slot].Get(), renderTargetLayout);
+                    CD3DX12_TEXTURE_COPY_LOCATION src(textures[slot].Get(), 0);
+                    CD3DX12_BOX box(0, rows.y, c_width, rows.y + rows.height);
+
+                    copyList1->CopyTextureRegion(&dest, 0, rows.y, 0, &src, &box);
+
+                    if (band + 1 == bandCount)
+                    {
+                        copyList1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+                        copyList1->ResolveQueryData(
+                            queryHeap1.Get(),
+                            D3D12_QUERY_TYPE_TIMESTAMP,
+                            queryIndex, // Start index
+                            2, // Number of queries
+                            readBackBuffer1.Get(),
+                            queryIndex * sizeof(UINT64)); // Destination buffer offset
+                    }
+
+                    CHECK_HR(copyList1->Close());
+                }
+
+                {
+                    PROFILE_SCOPE(Execute);
+                    ID3D12CommandList* commandLists[] = {copyList1.Get()};
+                    copyQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
+
+                    copySyncPoint = queueSignal(copyQueue1, sharedTimeline, "copy1");
+                }
+            }
 
-            ID3D12CommandList* commandLists[] = {copyList1.Get()};
-            copyQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
+            // The point of the last band, the consumer derives the others from it
+            const FrameHandoff handoff{slot, copySyncPoint, std::chrono::steady_clock::now(), frame};
+            slotFrames[slot] = frame;
+            ++frame;
 
-            CHECK_HR(copyQueue1->Signal(sharedFence1.Get(), sharedFenceValue));
+            if (mailboxMode)
+            {
+                mailboxFrames[slot] = handoff;
+                if (mailbox.publish())
+                {
+                    ++droppedFrames;
+                }
+            }
+            else
+            {
+                // There are never more slots in flight than the queue can hold
+                CHECK(readySlots.tryPush(handoff));
+                ring.setFenceValue(slot, handoff.syncPoint.value());
+            }
         }
+    });
+
+    std::thread consumerThread([&] {
+        // Copy ready slots from the shared heap to the back buffer and present on GPU 0
+        framegraph::FrameGraph graph;
+        const framegraph::QueueId graphDirectQueue = graph.addQueue(0, framegraph::QueueType::Direct);
+        std::vector<ID3D12Resource*> graphResources;
+        std::vector<framegraph::ResourceId> backBufferIds;
+        for (UINT i = 0; i < backBufferCount; ++i)
         {
-            // Wait for the copy to be completed
-            CHECK_HR(directQueue0->Wait(sharedFence0.Get(), sharedFenceValue));
-            ++sharedFenceValue;
+            graphResources.push_back(backBuffers[i].Get());
+            backBufferIds.push_back(graph.addResource(framegraph::Present));
+        }
+        std::vector<UINT64> backBufferFrames(backBufferCount, 0);
 
+        while (running)
+        {
+            FrameHandoff handoff{};
+            if (mailboxMode)
             {
-                // Copy the timestamp results after the copy queue is completed
-                UINT64* mappedData = nullptr;
-                readBackBuffer1->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
-                QueryData queryData{};
-                queryData.start = mappedData[0];
-                queryData.end = mappedData[1];
-                readBackBuffer1->Unmap(0, nullptr);
-                queryData1.push_back(queryData);
+                if (!mailbox.acquireBlocking())
+                {
+                    break;
+                }
+                handoff = mailboxFrames[mailbox.front()];
+            }
+            else if (!readySlots.pop(handoff))
+            {
+                break;
             }
 
-            // Copy the result from shared heap to back buffer
-            // Todo: would it be better to use a copy queue?
-            CHECK_HR(commandAllocators0[frameIndex]->Reset());
-            CHECK_HR(list0->Reset(commandAllocators0[frameIndex].Get(), nullptr));
-
-            ID3D12Resource* backBuffer = backBuffers[frameIndex].Get();
-            D3D12_RESOURCE_STATES state = first ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_PRESENT;
-            list0->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, state, D3D12_RESOURCE_STATE_COPY_DEST));
+            const UINT frameIndex = swapChain->GetCurrentBackBufferIndex();
+            if (backBufferSyncPoints[frameIndex])
+            {
+                {
+                    PROFILE_SCOPE(Wait);
+                    cpuWait(fenceWaiter, {backBufferSyncPoints[frameIndex]}, "consumer");
+                }
+                queryData0.push_back(readQueryData(readBackBuffer0, frameIndex));
+                copyEnds0.push_back({backBufferFrames[frameIndex], queryData0.back().end});
+            }
 
-            D3D12_RESOURCE_DESC backBufferTextureDesc = backBuffer->GetDesc();
-            D3D12_PLACED_SUBRESOURCE_FOOTPRINT textureLayout;
-            device0->GetCopyableFootprints(&backBufferTextureDesc, 0, 1, 0, &textureLayout, nullptr, nullptr, nullptr);
+            graph.beginFrame();
+            const framegraph::PassId copyPassId = graph.addPass(graphDirectQueue, {framegraph::write(backBufferIds[frameIndex], framegraph::CopyDest)});
+            graph.setFinalState(backBufferIds[frameIndex], framegraph::Present);
+            const framegraph::CompiledFrame compiled = graph.compile();
+            CHECK(compiled.errors.empty());
+            const framegraph::CompiledPass& copyPass = compiled.passes[copyPassId];
 
-            CD3DX12_TEXTURE_COPY_LOCATION dest(backBuffer, 0);
-            CD3DX12_TEXTURE_COPY_LOCATION src(sharedHeapTextures0[frameIndex].Get(), textureLayout);
-            CD3DX12_BOX box(0, 0, c_width, c_height);
-            list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0);
+            // Copy the result from shared heap to back buffer, each band as soon as it is in the shared heap
+            // Todo: would it be better to use a copy queue?
+            for (UINT band = 0; band < bandCount; ++band)
+            {
+                const bands::Rows rows = bands::bandRows(band, bandCount, c_height);
+                {
+                    PROFILE_SCOPE(Reset);
+                    if (band == 0)
+                    {
+                        CHECK_HR(commandAllocators0[frameIndex]->Reset());
+                    }
+                    CHECK_HR(list0->Reset(commandAllocators0[frameIndex].Get(), nullptr));
+                }
+
+                {
+                    PROFILE_SCOPE(Record);
+                    ID3D12Resource* backBuffer = backBuffers[frameIndex].Get();
+                    const UINT queryIndex = frameIndex * 2;
+                    if (band == 0)
+                    {
+                        recordBarriers(list0, copyPass.barriersBefore, graphResources);
+                        list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+                    }
+
+                    D3D12_RESOURCE_DESC backBufferTextureDesc = backBuffer->GetDesc();
+                    D3D12_PLACED_SUBRESOURCE_FOOTPRINT textureLayout;
+                    device0->GetCopyableFootprints(&backBufferTextureDesc, 0, 1, 0, &textureLayout, nullptr, nullptr, nullptr);
+
+                    CD3DX12_TEXTURE_COPY_LOCATION dest(backBuffer, 0);
+                    CD3DX12_TEXTURE_COPY_LOCATION src(sharedHeapTextures0[handoff.slot].Get(), textureLayout);
+                    CD3DX12_BOX box(0, rows.y, c_width, rows.y + rows.height);
+
+                    list0->CopyTextureRegion(&dest, 0, rows.y, 0, &src, &box);
+
+                    if (band + 1 == bandCount)
+                    {
+                        list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+
+                        recordBarriers(list0, copyPass.barriersAfter, graphResources);
+
+                        list0->ResolveQueryData(
+                            queryHeap0.Get(),
+                            D3D12_QUERY_TYPE_TIMESTAMP,
+                            queryIndex, // Start index
+                            2, // Number of queries
+                            readBackBuffer0.Get(),
+                            queryIndex * sizeof(UINT64)); // Destination buffer offset
+                    }
+
+                    CHECK_HR(list0->Close());
+                }
+
+                {
+                    PROFILE_SCOPE(Execute);
+                    // Wait for the copy of the band to the shared heap to be completed
+                    queueWait(directQueue0, sharedTimeline, sharedTimeline.at(bands::bandFenceValue(handoff.syncPoint.value(), band, bandCount)), "direct0", sharedFence0.Get());
+                    ID3D12CommandList* commandLists[] = {list0.Get()};
+                    directQueue0->ExecuteCommandLists(_countof(commandLists), commandLists);
+                }
+            }
+            backBufferFrames[frameIndex] = handoff.frame;
 
-            list0->CopyTextureRegion(&dest, 0, 0, 0, &src, &box);
+            {
+                PROFILE_SCOPE(Present);
+                swapChain->Present(1, 0);
+            }
 
-            list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 1);
+            const double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - handoff.submitTime).count();
+            latencyTotal += latency;
+            latencyMax = latency > latencyMax ? latency : latencyMax;
+            ++presentedFrames;
 
-            list0->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT));
+            pacing::PresentSample presentSample{};
+            if (pacing::sampleSwapChain(swapChain.Get(), presentSample))
+            {
+                presentSamples.push_back(presentSample);
+            }
 
-            list0->ResolveQueryData(
-                queryHeap0.Get(),
-                D3D12_QUERY_TYPE_TIMESTAMP,
-                0, // Start index
-                2, // Number of queries
-                readBackBuffer0.Get(),
-                0); // Destination buffer offset
+            const SyncPoint<ID3D12Fence> presentSyncPoint = queueSignal(directQueue0, presentTimeline, "direct0");
+            backBufferSyncPoints[frameIndex] = presentSyncPoint;
+            if (mailboxMode)
+            {
+                // Published to the producer when the consumer acquires its next frame
+                mailboxReleases[handoff.slot] = presentSyncPoint;
+            }
+            else
+            {
+                CHECK(freeSlots.tryPush(FrameHandoff{handoff.slot, presentSyncPoint}));
+            }
+        }
+    });
 
-            CHECK_HR(list0->Close());
+    MSG msg = {};
+    while (GetMessage(&msg, nullptr, 0, 0) > 0)
+    {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
 
-            ID3D12CommandList* commandLists[] = {list0.Get()};
-            directQueue0->ExecuteCommandLists(_countof(commandLists), commandLists);
-        }
+    running = false;
+    readySlots.cancel();
+    freeSlots.cancel();
+    mailbox.cancel();
+    producerThread.join();
+    consumerThread.join();
 
-        swapChain->Present(1, 0);
+    // Wait for both adapters, including frames that were copied to the shared heap but never consumed
+    std::vector<SyncPoint<ID3D12Fence>> idleSyncPoints = backBufferSyncPoints;
+    idleSyncPoints.push_back(sharedTimeline.last());
+    idleSyncPoints.push_back(renderTimeline.last());
+    cpuWait(fenceWaiter, idleSyncPoints, "main");
 
-        CHECK_HR(directQueue0->Signal(frameFence.Get(), presentFenceValue));
-        CHECK_HR(directQueue0->Wait(frameFence.Get(), presentFenceValue));
-        frameFenceValues[frameIndex] = presentFenceValue;
+    double copyTimeTotal1 = 0.0;
+    for (const QueryData& q : queryData1)
+    {
+        double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / timestampFrequencyCopyQueue;
+        copyTimeTotal1 += elapsedTimeInSeconds;
+    }
 
+    // Adapter 1 starting to render a frame to adapter 0 having copied all of it to the back buffer
+    double renderToCopyTotal = 0.0;
+    double renderToCopyMax = 0.0;
+    size_t renderToCopyCount = 0;
+    const double qpcFrequency = pacing::qpcFrequency();
+    for (size_t i = 0, j = 0; i < renderStarts1.size() && j < copyEnds0.size();)
+    {
+        if (renderStarts1[i].frame < copyEnds0[j].frame)
         {
-            // Copy the timestamp results after queue is completed
-            UINT64* mappedData = nullptr;
-            readBackBuffer0->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
-            QueryData queryData{};
-            queryData.start = mappedData[0];
-            queryData.end = mappedData[1];
-            readBackBuffer0->Unmap(0, nullptr);
-            queryData0.push_back(queryData);
+            ++i;
         }
-
-        ++presentFenceValue;
-
-        frameIndex = swapChain->GetCurrentBackBufferIndex();
-
-        const UINT64 completedFenceValue = frameFence->GetCompletedValue();
-        if (completedFenceValue < frameFenceValues[frameIndex])
+        else if (copyEnds0[j].frame < renderStarts1[i].frame)
         {
-            CHECK_HR(frameFence->SetEventOnCompletion(frameFenceValues[frameIndex], frameFenceEvent));
-            WaitForSingleObject(frameFenceEvent, INFINITE);
+            ++j;
         }
-
-        first = false;
-    }
-
-    UINT64 completedFenceValue = frameFence->GetCompletedValue();
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
-    {
-        while (completedFenceValue < frameFenceValues[i])
+        else
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            completedFenceValue = frameFence->GetCompletedValue();
+            const double latency = timestampDistance(renderClock1, renderStarts1[i].timestamp, directClock0, copyEnds0[j].timestamp, qpcFrequency);
+            renderToCopyTotal += latency;
+            renderToCopyMax = latency > renderToCopyMax ? latency : renderToCopyMax;
+            ++renderToCopyCount;
+            ++i;
+            ++j;
         }
     }
 
-    double copyTimeTotal1 = 0.0;
-    for (const QueryData& q : queryData1)
-    {
-        double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / timestampFrequencyCopyQueue;
-        copyTimeTotal1 += elapsedTimeInSeconds;
-    }
-
     double copyTimeTotal0 = 0.0;
     for (const QueryData& q : queryData0)
     {
@@ -703,7 +1169,22 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     myfile << "Average copy times" << std::endl
            << "0: " << (copyTimeTotal0 / queryData0.size() * 1000.0) << "ms" << std::endl
            << "1: " << (copyTimeTotal1 / queryData1.size() * 1000.0) << "ms" << std::endl;
+    myfile << "Mode: " << (mailboxMode ? "mailbox" : "queue") << ", back buffers: " << backBufferCount << ", frames in flight: " << framesInFlight << ", bands: " << bandCount << std::endl
+           << "Presented frames: " << presentedFrames << ", dropped frames: " << droppedFrames << std::endl;
+    if (presentedFrames > 0)
+    {
+        myfile << "Submit to present latency: " << (latencyTotal / presentedFrames * 1000.0) << "ms (max " << (latencyMax * 1000.0) << "ms)" << std::endl;
+    }
+    if (renderToCopyCount > 0)
+    {
+        myfile << "Render start to back buffer latency: " << (renderToCopyTotal / renderToCopyCount * 1000.0) << "ms (max " << (renderToCopyMax * 1000.0) << "ms)" << std::endl;
+    }
+    pacing::writeReport(myfile, pacing::analyze(presentSamples, qpcFrequency));
+    PROFILE_REPORT(myfile);
     myfile.close();
 
+    std::ofstream traceFile("dx12present.txt");
+    pacing::writeTrace(traceFile, presentSamples, qpcFrequency);
+
     return 0;
 }
\ No newline at end of file
@@ -9,6 +9,12 @@
 #include <chrono>
 #include <fstream>
 
+#include "FenceWaiter.hpp"
+#include "FrameGraph.hpp"
+#include "FramePacing.hpp"
+#include "FrameRing.hpp"
+#include "FrameScheduler.hpp"
+
 using Microsoft::WRL::ComPtr;
 
 #define CHECK(f)                                                                                      \
@@ -36,6 +42,7 @@ using Microsoft::WRL::ComPtr;
 const int c_width = 7680;
 const int c_height = 3744;
 const UINT c_swapChainFrameCount = 3;
+const UINT c_framesInFlight = 3; // Render and transfer slots, independent of the back buffers
 DXGI_FORMAT c_format = DXGI_FORMAT_R8G8B8A8_UNORM;
 const int c_gpuCount = 2;
 
@@ -208,10 +215,10 @@ ComPtr<ID3D12CommandQueue> createCommandQueue(ComPtr<ID3D12Device> device, D3D12
     return queue;
 }
 
-ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID3D12CommandQueue> queue, HWND hwnd)
+ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID3D12CommandQueue> queue, HWND hwnd, UINT bufferCount)
 {
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-    swapChainDesc.BufferCount = c_swapChainFrameCount;
+    swapChainDesc.BufferCount = bufferCount;
     swapChainDesc.Width = c_width;
     swapChainDesc.Height = c_height;
     swapChainDesc.Format = c_format;
@@ -233,20 +240,20 @@ ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID
     return swapChain3;
 }
 
-std::vector<ComPtr<ID3D12Resource>> getBackBuffers(ComPtr<IDXGISwapChain3> swapChain)
+std::vector<ComPtr<ID3D12Resource>> getBackBuffers(ComPtr<IDXGISwapChain3> swapChain, UINT count)
 {
-    std::vector<ComPtr<ID3D12Resource>> backBuffers(c_swapChainFrameCount);
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    std::vector<ComPtr<ID3D12Resource>> backBuffers(count);
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(swapChain->GetBuffer(i, IID_PPV_ARGS(&backBuffers[i])));
     }
     return backBuffers;
 }
 
-ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device)
+ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device, UINT count)
 {
     D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{};
-    rtvHeapDesc.NumDescriptors = c_swapChainFrameCount;
+    rtvHeapDesc.NumDescriptors = count;
     rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
     rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 
@@ -255,10 +262,10 @@ ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device)
     return heap;
 }
 
-std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device)
+std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device, UINT count)
 {
-    std::vector<ComPtr<ID3D12Resource>> textures(c_swapChainFrameCount);
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(device->CreateCommittedResource(
             &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
@@ -271,14 +278,14 @@ std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device)
     return textures;
 }
 
-std::vector<ComPtr<ID3D12Resource>> createSharedTextures(ComPtr<ID3D12Device> device)
+std::vector<ComPtr<ID3D12Resource>> createSharedTextures(ComPtr<ID3D12Device> device, UINT count)
 {
     CD3DX12_RESOURCE_DESC textureDesc = c_textureDesc;
     textureDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_CROSS_ADAPTER;
     textureDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
 
-    std::vector<ComPtr<ID3D12Resource>> textures(c_swapChainFrameCount);
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(device->CreateCommittedResource(
             &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
@@ -296,7 +303,7 @@ void createRtvs(ComPtr<ID3D12Device> device, ComPtr<ID3D12DescriptorHeap> heap,
     CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(heap->GetCPUDescriptorHandleForHeapStart());
     const UINT rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    for (size_t i = 0; i < textures.size(); ++i)
     {
         device->CreateRenderTargetView(textures[i].Get(), nullptr, rtvHandle);
         rtvHandle.Offset(1, rtvDescriptorSize);
@@ -333,10 +340,10 @@ std::vector<ComPtr<ID3D12Resource>> openSharedTextureHandles(ComPtr<ID3D12Device
     return sharedTextures;
 }
 
-std::vector<ComPtr<ID3D12CommandAllocator>> createCommandAllocators(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, const std::wstring& name = L"")
+std::vector<ComPtr<ID3D12CommandAllocator>> createCommandAllocators(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, UINT count, const std::wstring& name = L"")
 {
-    std::vector<ComPtr<ID3D12CommandAllocator>> allocators(c_swapChainFrameCount);
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    std::vector<ComPtr<ID3D12CommandAllocator>> allocators(count);
+    for (UINT i = 0; i < count; ++i)
     {
         CHECK_HR(device->CreateCommandAllocator(type, IID_PPV_ARGS(&allocators[i])));
         if (!name.empty())
@@ -446,10 +453,10 @@ ComPtr<ID3D12Fence> openSharedFenceHandle(ComPtr<ID3D12Device> device, HANDLE ha
     return sharedFence;
 }
 
-ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY_HEAP_TYPE type)
+ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY_HEAP_TYPE type, UINT count)
 {
     D3D12_QUERY_HEAP_DESC queryHeapDesc{};
-    queryHeapDesc.Count = 2; // One for the start timestamp, one for the end timestamp
+    queryHeapDesc.Count = count; // Start and end timestamp pairs
     queryHeapDesc.Type = type;
 
     ComPtr<ID3D12QueryHeap> queryHeap;
@@ -457,10 +464,10 @@ ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY
     return queryHeap;
 }
 
-ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device)
+ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device, UINT count)
 {
     CD3DX12_HEAP_PROPERTIES readbackHeapProps(D3D12_HEAP_TYPE_READBACK);
-    CD3DX12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * 2);
+    CD3DX12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * count);
 
     ComPtr<ID3D12Resource> readbackBuffer;
     device->CreateCommittedResource(
@@ -473,6 +480,73 @@ ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device)
     return readbackBuffer;
 }
 
+QueryData readQueryData(ComPtr<ID3D12Resource> readbackBuffer, UINT slot)
+{
+    const D3D12_RANGE range{slot * 2 * sizeof(UINT64), (slot + 1) * 2 * sizeof(UINT64)};
+    UINT64* mappedData = nullptr;
+    CHECK_HR(readbackBuffer->Map(0, &range, reinterpret_cast<void**>(&mappedData)));
+    QueryData queryData{};
+    queryData.start = mappedData[slot * 2];
+    queryData.end = mappedData[slot * 2 + 1];
+    const D3D12_RANGE writtenRange{0, 0};
+    readbackBuffer->Unmap(0, &writtenRange);
+    return queryData;
+}
+
+// Reads a positive count given as e.g. --frames-in-flight=4 on the command line
+UINT parseCountOption(const std::wstring& commandLine, const std::wstring& name, UINT defaultValue)
+{
+    const size_t position = commandLine.find(name);
+    if (position == std::wstring::npos)
+    {
+        return defaultValue;
+    }
+    const UINT value = static_cast<UINT>(wcstoul(commandLine.c_str() + position + name.size(), nullptr, 10));
+    return value > 0 ? value : defaultValue;
+}
+
+D3D12_RESOURCE_STATES toD3D12State(uint32_t state)
+{
+    D3D12_RESOURCE_STATES d3d12State = D3D12_RESOURCE_STATE_COMMON;
+    if (state & framegraph::RenderTarget)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_RENDER_TARGET;
+    }
+    if (state & framegraph::CopySource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_SOURCE;
+    }
+    if (state & framegraph::CopyDest)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_DEST;
+    }
+    if (state & framegraph::ShaderResource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    }
+    if (state & framegraph::UnorderedAccess)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    }
+    return d3d12State;
+}
+
+// Records one batch of frame graph barriers with a single ResourceBarrier call
+void recordBarriers(ComPtr<ID3D12GraphicsCommandList> list, const std::vector<framegraph::Barrier>& barriers, const std::vector<ID3D12Resource*>& resources)
+{
+    if (barriers.empty())
+    {
+        return;
+    }
+    std::vector<D3D12_RESOURCE_BARRIER> d3d12Barriers;
+    d3d12Barriers.reserve(barriers.size());
+    for (const framegraph::Barrier& barrier : barriers)
+    {
+        d3d12Barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resources[barrier.resource], toD3D12State(barrier.before), toD3D12State(barrier.after)));
+    }
+    list->ResourceBarrier(static_cast<UINT>(d3d12Barriers.size()), d3d12Barriers.data());
+}
+
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
 {
     /*
@@ -483,6 +557,12 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     enableConsole();
     HWND hwnd = createRenderWindow(hInstance, nCmdShow);
 
+    // The render textures and shared textures of GPU 1 are cycled independently of the back buffers
+    const std::wstring commandLine(pCmdLine);
+    // A flip model swap chain needs at least two buffers
+    const UINT backBufferCount = (std::max)(parseCountOption(commandLine, L"--back-buffers=", c_swapChainFrameCount), 2u);
+    const UINT framesInFlight = parseCountOption(commandLine, L"--frames-in-flight=", c_framesInFlight);
+
     ComPtr<IDXGIFactory4> factory = createFactory();
     std::vector<ComPtr<IDXGIAdapter>> adapters = getAdapters(factory.Get());
     printAdapters(adapters);
@@ -496,20 +576,19 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     ComPtr<ID3D12CommandQueue> directQueue0 = createCommandQueue(device0, D3D12_COMMAND_LIST_TYPE_DIRECT);
     ComPtr<ID3D12CommandQueue> directQueue1 = createCommandQueue(device1, D3D12_COMMAND_LIST_TYPE_DIRECT);
 
-    ComPtr<IDXGISwapChain3> swapChain = createSwapChain(factory, directQueue0, hwnd);
-    std::vector<ComPtr<ID3D12Resource>> backBuffers = getBackBuffers(swapChain);
-    int frameIndex = swapChain->GetCurrentBackBufferIndex();
+    ComPtr<IDXGISwapChain3> swapChain = createSwapChain(factory, directQueue0, hwnd, backBufferCount);
+    std::vector<ComPtr<ID3D12Resource>> backBuffers = getBackBuffers(swapChain, backBufferCount);
 
-    std::vector<ComPtr<ID3D12Resource>> textures1 = createTextures(device1);
-    ComPtr<ID3D12DescriptorHeap> rtvHeap1 = createRtvHeap(device1);
+    std::vector<ComPtr<ID3D12Resource>> textures1 = createTextures(device1, framesInFlight);
+    ComPtr<ID3D12DescriptorHeap> rtvHeap1 = createRtvHeap(device1, framesInFlight);
     createRtvs(device1, rtvHeap1, textures1);
 
-    std::vector<ComPtr<ID3D12Resource>> sharedTextures1 = createSharedTextures(device1);
+    std::vector<ComPtr<ID3D12Resource>> sharedTextures1 = createSharedTextures(device1, framesInFlight);
     std::vector<HANDLE> sharedTextureHandles = createSharedTextureHandles(device1, sharedTextures1);
     std::vector<ComPtr<ID3D12Resource>> sharedTextures0 = openSharedTextureHandles(device0, sharedTextureHandles);
 
-    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators0 = createCommandAllocators(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, L"allocator0_");
-    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, L"allocator1_");
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators0 = createCommandAllocators(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, backBufferCount, L"allocator0_");
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, framesInFlight, L"allocator1_");
 
     ComPtr<ID3D12GraphicsCommandList> list0 = createCommandList(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators0[0], L"list0");
     ComPtr<ID3D12GraphicsCommandList> list1 = createCommandList(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators1[0], L"list1");
@@ -519,15 +598,19 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     ComPtr<ID3D12Fence> sharedFence1 = createFence(device1, D3D12_FENCE_FLAG_SHARED | D3D12_FENCE_FLAG_SHARED_CROSS_ADAPTER);
     HANDLE sharedFenceHandle = createSharedFenceHandle(device1, sharedFence1);
     ComPtr<ID3D12Fence> sharedFence0 = openSharedFenceHandle(device0, sharedFenceHandle);
-    std::vector<UINT64> frameFenceValues(c_swapChainFrameCount, 0);
+    std::vector<UINT64> frameFenceValues(backBufferCount, 0);
     UINT64 presentFenceValue = 2;
     UINT64 sharedFenceValue = 2;
-    HANDLE frameFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    // All CPU waits on GPU work go through this
+    FenceWaiter<ID3D12Fence> fenceWaiter;
 
-    ComPtr<ID3D12QueryHeap> queryHeap0 = createQueryHeap(device0, D3D12_QUERY_HEAP_TYPE_TIMESTAMP);
-    ComPtr<ID3D12QueryHeap> queryHeap1 = createQueryHeap(device1, D3D12_QUERY_HEAP_TYPE_TIMESTAMP);
-    ComPtr<ID3D12Resource> readBackBuffer0 = createReadbackBuffer(device0);
-    ComPtr<ID3D12Resource> readBackBuffer1 = createReadbackBuffer(device1);
+    // Two timestamps per frame slot so that in-flight frames do not overwrite each other's results
+    const UINT queryCount0 = backBufferCount * 2;
+    const UINT queryCount1 = framesInFlight * 2;
+    ComPtr<ID3D12QueryHeap> queryHeap0 = createQueryHeap(device0, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, queryCount0);
+    ComPtr<ID3D12QueryHeap> queryHeap1 = createQueryHeap(device1, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, queryCount1);
+    ComPtr<ID3D12Resource> readBackBuffer0 = createReadbackBuffer(device0, queryCount0);
+    ComPtr<ID3D12Resource> readBackBuffer1 = createReadbackBuffer(device1, queryCount1);
 
     const UINT rtvDescriptorSize1 = device1->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
@@ -539,101 +622,152 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     bool running = true;
     float blue = 0.0f;
 
-    bool first = true;
+    // Every texture is tracked by the frame graph from its creation state. The
+    // shared texture has a resource on both adapters that alias the same memory.
+    framegraph::FrameGraph graph;
+    const framegraph::QueueId graphQueue1 = graph.addQueue(1, framegraph::QueueType::Direct);
+    const framegraph::QueueId graphQueue0 = graph.addQueue(0, framegraph::QueueType::Direct);
+    std::vector<ID3D12Resource*> graphResources;
+    std::vector<framegraph::ResourceId> textureIds1;
+    std::vector<framegraph::ResourceId> sharedTextureIds1;
+    std::vector<framegraph::ResourceId> sharedTextureIds0;
+    std::vector<framegraph::ResourceId> backBufferIds;
+    auto addGraphResource = [&](ID3D12Resource* resource, framegraph::MemoryId memory) {
+        graphResources.push_back(resource);
+        return graph.addResource(memory, framegraph::Common);
+    };
+    for (UINT i = 0; i < framesInFlight; ++i)
+    {
+        textureIds1.push_back(addGraphResource(textures1[i].Get(), graph.addMemory()));
+        const framegraph::MemoryId sharedMemory = graph.addMemory();
+        sharedTextureIds1.push_back(addGraphResource(sharedTextures1[i].Get(), sharedMemory));
+        sharedTextureIds0.push_back(addGraphResource(sharedTextures0[i].Get(), sharedMemory));
+    }
+    for (UINT i = 0; i < backBufferCount; ++i)
+    {
+        backBufferIds.push_back(addGraphResource(backBuffers[i].Get(), graph.addMemory()));
+    }
+
+    struct FramePlan
+    {
+        framegraph::CompiledFrame compiled;
+        framegraph::PassId renderPass;
+        framegraph::PassId copyPass;
+        framegraph::PassId presentPass;
+    };
+
+    // Passes are added in submission order, so frames must be planned in the order they are submitted
+    auto planFrame = [&](UINT slot, UINT backBufferIndex) {
+        graph.beginFrame();
+        FramePlan plan{};
+        plan.renderPass = graph.addPass(graphQueue1, {framegraph::write(textureIds1[slot], framegraph::RenderTarget)});
+        plan.copyPass = graph.addPass(graphQueue1, {framegraph::read(textureIds1[slot], framegraph::CopySource), framegraph::write(sharedTextureIds1[slot], framegraph::CopyDest)});
+        plan.presentPass = graph.addPass(graphQueue0, {framegraph::read(sharedTextureIds0[slot], framegraph::CopySource), framegraph::write(backBufferIds[backBufferIndex], framegraph::CopyDest)});
+        graph.setFinalState(backBufferIds[backBufferIndex], framegraph::Present);
+        plan.compiled = graph.compile();
+        CHECK(plan.compiled.errors.empty());
+        return plan;
+    };
+
+    uint64_t graphBarrierCount = 0;
+    uint64_t graphBarrierBatchCount = 0;
+    uint64_t graphFrameCount = 0;
 
     CHECK_HR(list0->Close());
     CHECK_HR(list1->Close());
 
     std::vector<QueryData> queryData0;
     std::vector<QueryData> queryData1;
-
-    while (running)
-    {
-        MSG msg = {};
-        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
-        {
-            if (msg.message == WM_QUIT)
-            {
-                running = false;
-                break;
-            }
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
+    std::vector<pacing::PresentSample> presentSamples;
+
+    FrameScheduler<ID3D12Fence> scheduler(fenceWaiter);
+
+    // Cleared by a frame once both GPUs are done with it, the frame's timestamps have been read by then too
+    FrameRing ring(framesInFlight);
+    std::vector<bool> slotInFlight(framesInFlight, false);
+    std::vector<bool> backBufferInFlight(backBufferCount, false);
+
+    // One frame from render to present. Everything up to Present is recorded and
+    // submitted without suspending so that frames reach the swap chain in order,
+    // the timestamps are read back once the fences say the GPUs are done.
+    auto renderFrame = [&](UINT slot, UINT backBufferIndex, FramePlan plan, UINT64 sharedValue, UINT64 presentValue, float frameBlue) -> FrameTask {
+        const framegraph::CompiledPass& renderPass = plan.compiled.passes[plan.renderPass];
+        const framegraph::CompiledPass& copyPass = plan.compiled.passes[plan.copyPass];
+        const framegraph::CompiledPass& presentPass = plan.compiled.passes[plan.presentPass];
+        // Signals of the graph queue 1 map to consecutive values of the shared fence.
+        // The frame itself awaits the copy, so when no queue waits for it the copy
+        // gets a value of its own after the graph's signals, see sharedSignalCount.
+        const UINT64 copySignalValue = copyPass.signalIndex > 0 ? sharedValue + copyPass.signalIndex - 1 : sharedValue + plan.compiled.signalCounts[graphQueue1];
 
         {
             // Render (=clear) on GPU 1
-            CHECK_HR(commandAllocators1[frameIndex]->Reset());
-            CHECK_HR(list1->Reset(commandAllocators1[frameIndex].Get(), nullptr));
+            CHECK_HR(commandAllocators1[slot]->Reset());
+            CHECK_HR(list1->Reset(commandAllocators1[slot].Get(), nullptr));
 
-            ID3D12Resource* tex1 = textures1[frameIndex].Get();
-            {
-                D3D12_RESOURCE_STATES state = first ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_COPY_SOURCE;
-                list1->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tex1, state, D3D12_RESOURCE_STATE_RENDER_TARGET));
-            }
+            ID3D12Resource* tex1 = textures1[slot].Get();
+            recordBarriers(list1, renderPass.barriersBefore, graphResources);
 
-            blue = blue > 1.0f ? 0.0f : blue + 0.01f;
-            float clearColor[4] = {0.0f, 0.2f, blue, 1.0f};
-            CD3DX12_CPU_DESCRIPTOR_HANDLE textureRtv = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap1->GetCPUDescriptorHandleForHeapStart(), frameIndex, rtvDescriptorSize1);
+            float clearColor[4] = {0.0f, 0.2f, frameBlue, 1.0f};
+            CD3DX12_CPU_DESCRIPTOR_HANDLE textureRtv = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap1->GetCPUDescriptorHandleForHeapStart(), slot, rtvDescriptorSize1);
             list1->ClearRenderTargetView(textureRtv, clearColor, 0, nullptr);
 
-            list1->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tex1, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE));
+            recordBarriers(list1, renderPass.barriersAfter, graphResources);
 
-            ID3D12Resource* sharedTex1 = sharedTextures1[frameIndex].Get();
-            {
-                D3D12_RESOURCE_STATES state = first ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_COPY_SOURCE;
-                list1->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(sharedTex1, state, D3D12_RESOURCE_STATE_COPY_DEST));
-            }
+            ID3D12Resource* sharedTex1 = sharedTextures1[slot].Get();
+            recordBarriers(list1, copyPass.barriersBefore, graphResources);
 
-            list1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0);
+            const UINT queryIndex = slot * 2;
+            list1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
 
             list1->CopyResource(sharedTex1, tex1);
 
-            list1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 1);
+            list1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+            recordBarriers(list1, copyPass.barriersAfter, graphResources);
 
             list1->ResolveQueryData(
                 queryHeap1.Get(),
                 D3D12_QUERY_TYPE_TIMESTAMP,
-                0, // Start index
+                queryIndex, // Start index
                 2, // Number of queries
                 readBackBuffer1.Get(),
-                0); // Destination buffer offset
+                queryIndex * sizeof(UINT64)); // Destination buffer offset
 
             CHECK_HR(list1->Close());
 
             ID3D12CommandList* commandLists[] = {list1.Get()};
             directQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
-            CHECK_HR(directQueue1->Signal(sharedFence1.Get(), sharedFenceValue));
+            CHECK_HR(directQueue1->Signal(sharedFence1.Get(), copySignalValue));
         }
         {
-            // Wait for the copy to be completed
-            CHECK_HR(directQueue0->Wait(sharedFence0.Get(), sharedFenceValue));
-            ++sharedFenceValue;
-
-            CHECK_HR(commandAllocators0[frameIndex]->Reset());
-            CHECK_HR(list0->Reset(commandAllocators0[frameIndex].Get(), nullptr));
+            // Wait for the passes of GPU 1 the graph says the copy depends on
+            for (const framegraph::QueueWait& wait : presentPass.waits)
+            {
+                CHECK(wait.queue == graphQueue1);
+                CHECK_HR(directQueue0->Wait(sharedFence0.Get(), sharedValue + wait.signalIndex - 1));
+            }
 
-            ID3D12Resource* sharedTex0 = sharedTextures0[frameIndex].Get();
-            list0->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(sharedTex0, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE));
+            CHECK_HR(commandAllocators0[backBufferIndex]->Reset());
+            CHECK_HR(list0->Reset(commandAllocators0[backBufferIndex].Get(), nullptr));
 
-            ID3D12Resource* backBuffer = backBuffers[frameIndex].Get();
-            D3D12_RESOURCE_STATES backBufferState = first ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_PRESENT;
-            list0->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, backBufferState, D3D12_RESOURCE_STATE_COPY_DEST));
+            ID3D12Resource* sharedTex0 = sharedTextures0[slot].Get();
+            ID3D12Resource* backBuffer = backBuffers[backBufferIndex].Get();
+            recordBarriers(list0, presentPass.barriersBefore, graphResources);
 
-            list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0);
+            const UINT queryIndex = backBufferIndex * 2;
+            list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
 
             list0->CopyResource(backBuffer, sharedTex0);
-            list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 1);
+            list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
 
-            list0->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT));
+            recordBarriers(list0, presentPass.barriersAfter, graphResources);
 
             list0->ResolveQueryData(
                 queryHeap0.Get(),
                 D3D12_QUERY_TYPE_TIMESTAMP,
-                0, // Start index
+                queryIndex, // Start index
                 2, // Number of queries
                 readBackBuffer0.Get(),
-                0); // Destination buffer offset
+                queryIndex * sizeof(UINT64)); // Destination buffer offset
 
             CHECK_HR(list0->Close());
 
@@ -643,55 +777,72 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
 
         swapChain->Present(1, 0);
 
-        CHECK_HR(directQueue0->Signal(frameFence.Get(), presentFenceValue));
-        CHECK_HR(directQueue0->Wait(frameFence.Get(), presentFenceValue));
-        frameFenceValues[frameIndex] = presentFenceValue;
-
-        ++presentFenceValue;
-
+        pacing::PresentSample presentSample{};
+        if (pacing::sampleSwapChain(swapChain.Get(), presentSample))
         {
-            // Copy the timestamp results after queue is completed
-            UINT64* mappedData = nullptr;
-            readBackBuffer1->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
-            QueryData queryData{};
-            queryData.start = mappedData[0];
-            queryData.end = mappedData[1];
-            readBackBuffer1->Unmap(0, nullptr);
-            queryData1.push_back(queryData);
+            presentSamples.push_back(presentSample);
         }
 
+        CHECK_HR(directQueue0->Signal(frameFence.Get(), presentValue));
+        frameFenceValues[backBufferIndex] = presentValue;
+
+        co_await scheduler.fence(sharedFence1.Get(), copySignalValue);
+        queryData1.push_back(readQueryData(readBackBuffer1, slot));
+
+        co_await scheduler.fence(frameFence.Get(), presentValue);
+        queryData0.push_back(readQueryData(readBackBuffer0, backBufferIndex));
+
+        slotInFlight[slot] = false;
+        backBufferInFlight[backBufferIndex] = false;
+    };
+
+    while (running)
+    {
+        MSG msg = {};
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
         {
-            // Copy the timestamp results after queue is completed
-            UINT64* mappedData = nullptr;
-            readBackBuffer0->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
-            QueryData queryData{};
-            queryData.start = mappedData[0];
-            queryData.end = mappedData[1];
-            readBackBuffer0->Unmap(0, nullptr);
-            queryData0.push_back(queryData);
+            if (msg.message == WM_QUIT)
+            {
+                running = false;
+                break;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
         }
 
-        frameIndex = swapChain->GetCurrentBackBufferIndex();
+        scheduler.poll();
 
-        const UINT64 completedFenceValue = frameFence->GetCompletedValue();
-        if (completedFenceValue < frameFenceValues[frameIndex])
+        // Both the ring slot and the back buffer must be free. The frame that
+        // still holds either of them is in flight and resumes the scheduler.
+        const UINT slot = ring.advance();
+        const UINT backBufferIndex = swapChain->GetCurrentBackBufferIndex();
+        while (slotInFlight[slot] || backBufferInFlight[backBufferIndex])
         {
-            CHECK_HR(frameFence->SetEventOnCompletion(frameFenceValues[frameIndex], frameFenceEvent));
-            WaitForSingleObject(frameFenceEvent, INFINITE);
+            scheduler.waitForProgress();
         }
-
-        first = false;
+        slotInFlight[slot] = true;
+        backBufferInFlight[backBufferIndex] = true;
+
+        blue = blue > 1.0f ? 0.0f : blue + 0.01f;
+        FramePlan plan = planFrame(slot, backBufferIndex);
+        graphBarrierCount += plan.compiled.barrierCount;
+        graphBarrierBatchCount += plan.compiled.barrierBatchCount;
+        ++graphFrameCount;
+        const UINT64 sharedSignalCount = plan.compiled.signalCounts[graphQueue1] + (plan.compiled.passes[plan.copyPass].signalIndex == 0 ? 1 : 0);
+        scheduler.spawn(renderFrame(slot, backBufferIndex, std::move(plan), sharedFenceValue, presentFenceValue, blue));
+
+        sharedFenceValue += sharedSignalCount;
+        ++presentFenceValue;
     }
 
-    UINT64 completedFenceValue = frameFence->GetCompletedValue();
-    for (int i = 0; i < c_swapChainFrameCount; ++i)
+    scheduler.runUntilIdle();
+
+    std::vector<FenceWait<ID3D12Fence>> idleWaits;
+    for (UINT64 frameFenceValue : frameFenceValues)
     {
-        while (completedFenceValue < frameFenceValues[i])
-        {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            completedFenceValue = frameFence->GetCompletedValue();
-        }
+        idleWaits.push_back({frameFence.Get(), frameFenceValue});
     }
+    CHECK(fenceWaiter.wait(idleWaits, WaitMode::All));
 
     double copyTimeTotal1 = 0.0;
     for (const QueryData& q : queryData1)
@@ -707,11 +858,23 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
         copyTimeTotal0 += elapsedTimeInSeconds;
     }
 
+    const double qpcFrequency = pacing::qpcFrequency();
+
     std::ofstream myfile;
     myfile.open("dx12directout.txt");
-    myfile << "Average copy times: " << std::endl
+    myfile << "Back buffers: " << backBufferCount << ", frames in flight: " << framesInFlight << std::endl
+           << "Average copy times: " << std::endl
            << "1: " << (copyTimeTotal1 / queryData1.size() * 1000.0) << "ms" << std::endl
            << "0: " << (copyTimeTotal0 / queryData0.size() * 1000.0) << "ms" << std::endl;
+    if (graphFrameCount > 0)
+    {
+        myfile << "Barriers per frame: " << (static_cast<double>(graphBarrierCount) / graphFrameCount)
+               << " in " << (static_cast<double>(graphBarrierBatchCount) / graphFrameCount) << " batches" << std::endl;
+    }
+    pacing::writeReport(myfile, pacing::analyze(presentSamples, qpcFrequency));
     myfile.close();
+
+    std::ofstream traceFile("dx12directpresent.txt");
+    pacing::writeTrace(traceFile, presentSamples, qpcFrequency);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,874 @@
+#include <d3d12.h>
+#include <d3dx12.h>
+#include <dxgi1_4.h>
+#include <comdef.h>
+#include <wrl/client.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <algorithm>
+
+#include "FanIn.hpp"
+#include "FenceWaiter.hpp"
+#include "FrameGraph.hpp"
+#include "FramePacing.hpp"
+#include "FrameRing.hpp"
+
+using Microsoft::WRL::ComPtr;
+
+#define CHECK(f)                                                                                      \
+    do                                                                                                \
+    {                                                                                                 \
+        if (!(f))                                                                                     \
+        {                                                                                             \
+            std::cerr << "Terminate. " << #f << " failed at " << __FILE__ << ":" << __LINE__ << "\n"; \
+            std::terminate();                                                                         \
+        }                                                                                             \
+    } while (false)
+
+#define CHECK_HR(f)                                                                                   \
+    do                                                                                                \
+    {                                                                                                 \
+        HRESULT hr = f;                                                                               \
+        if (FAILED((hr)))                                                                             \
+        {                                                                                             \
+            std::cerr << "Terminate. " << #f << " failed at " << __FILE__ << ":" << __LINE__ << "\n"; \
+            std::cerr << _com_error(hr).ErrorMessage() << std::endl;                                  \
+            std::terminate();                                                                         \
+        }                                                                                             \
+    } while (false)
+
+const int c_width = 7680;
+const int c_height = 3744;
+const UINT c_swapChainFrameCount = 3;
+const UINT c_framesInFlight = 3; // Render and transfer slots, independent of the back buffers
+DXGI_FORMAT c_format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+const CD3DX12_RESOURCE_DESC c_textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+    c_format,
+    c_width,
+    c_height,
+    1u, // array size
+    1u, // mip
+    1, // count
+    0, // quality
+    D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+    D3D12_TEXTURE_LAYOUT_UNKNOWN,
+    0u);
+
+struct QueryData
+{
+    UINT64 start;
+    UINT64 end;
+};
+
+UINT align(UINT size, UINT alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+void enableConsole()
+{
+    AllocConsole();
+    FILE* dummy;
+    freopen_s(&dummy, "CONOUT$", "w", stdout);
+    freopen_s(&dummy, "CONOUT$", "w", stderr);
+    freopen_s(&dummy, "CONIN$", "r", stdin);
+
+    std::cout.clear();
+    std::clog.clear();
+    std::cerr.clear();
+    std::cin.clear();
+}
+
+LRESULT CALLBACK windowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    switch (uMsg)
+    {
+    case WM_KEYDOWN:
+        if (wParam == VK_ESCAPE)
+        {
+            PostQuitMessage(0);
+        }
+        return 0;
+    case WM_DESTROY:
+        PostQuitMessage(0);
+        return 0;
+
+    default:
+        return DefWindowProc(hwnd, uMsg, wParam, lParam);
+    }
+}
+
+HWND createRenderWindow(HINSTANCE hInstance, int nCmdShow)
+{
+    const LPCSTR windowClassName = "DX11WindowClass";
+    const LPCSTR windowTitle = "DirectX 11 Window";
+
+    WNDCLASSEX wc{};
+    wc.cbSize = sizeof(WNDCLASSEX);
+    wc.style = CS_HREDRAW | CS_VREDRAW;
+    wc.lpfnWndProc = windowProc;
+    wc.hInstance = hInstance;
+    wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+    wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+    wc.lpszClassName = windowClassName;
+
+    CHECK(RegisterClassEx(&wc));
+
+    RECT rect = {0, 0, c_width, c_height};
+    AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW, FALSE);
+
+    HWND hwnd = CreateWindowEx(
+        0, // Optional window styles
+        windowClassName, // Window class name
+        windowTitle, // Window title
+        WS_OVERLAPPEDWINDOW, // Window style
+        CW_USEDEFAULT,
+        CW_USEDEFAULT, // Position
+        rect.right - rect.left, // Width
+        rect.bottom - rect.top, // Height
+        nullptr, // Parent window
+        nullptr, // Menu
+        hInstance, // Instance handle
+        nullptr // Additional application data
+    );
+
+    CHECK(hwnd);
+
+    ShowWindow(hwnd, nCmdShow);
+    UpdateWindow(hwnd);
+
+    return hwnd;
+}
+
+ComPtr<IDXGIFactory4> createFactory()
+{
+    UINT dxgiFactoryFlags = 0;
+#if defined(_DEBUG)
+    { // Enable the debug layer (requires the Graphics Tools "optional feature").
+        ComPtr<ID3D12Debug> debugController;
+        if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+        {
+            debugController->EnableDebugLayer();
+            dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+        }
+    }
+#endif
+
+    ComPtr<IDXGIFactory4> factory;
+    CHECK_HR(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+    return factory;
+}
+
+std::vector<ComPtr<IDXGIAdapter>> getAdapters(IDXGIFactory4* factory)
+{
+    UINT i = 0;
+    IDXGIAdapter* adapter;
+    std::vector<ComPtr<IDXGIAdapter>> adapters;
+    while (factory->EnumAdapters(i, &adapter) != DXGI_ERROR_NOT_FOUND)
+    {
+        adapters.push_back(adapter);
+        ++i;
+    }
+    return adapters;
+}
+
+void printAdapters(std::vector<ComPtr<IDXGIAdapter>>& adapters)
+{
+    int i = 0;
+    for (ComPtr<IDXGIAdapter> adapter : adapters)
+    {
+        DXGI_ADAPTER_DESC desc;
+        adapter->GetDesc(&desc);
+
+        std::wcout << "Adapter " << i << ": " << desc.Description << "\n";
+        ++i;
+    }
+}
+
+ComPtr<ID3D12Device> createDevice(ComPtr<IDXGIAdapter> adapter)
+{
+    ComPtr<ID3D12Device> device;
+    CHECK_HR(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device)));
+    return device;
+}
+
+bool isCrossAdapterSupported(ComPtr<ID3D12Device> device)
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+    CHECK_HR(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, reinterpret_cast<void*>(&options), sizeof(options)));
+    return options.CrossAdapterRowMajorTextureSupported;
+}
+
+ComPtr<ID3D12CommandQueue> createCommandQueue(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc{};
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    queueDesc.Type = type;
+
+    ComPtr<ID3D12CommandQueue> queue;
+
+    CHECK_HR(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&queue)));
+    return queue;
+}
+
+ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID3D12CommandQueue> queue, HWND hwnd, UINT bufferCount)
+{
+    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+    swapChainDesc.BufferCount = bufferCount;
+    swapChainDesc.Width = c_width;
+    swapChainDesc.Height = c_height;
+    swapChainDesc.Format = c_format;
+    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+    swapChainDesc.SampleDesc.Count = 1;
+
+    ComPtr<IDXGISwapChain1> swapChain;
+    CHECK_HR(factory->CreateSwapChainForHwnd(
+        queue.Get(),
+        hwnd,
+        &swapChainDesc,
+        nullptr,
+        nullptr,
+        &swapChain));
+
+    ComPtr<IDXGISwapChain3> swapChain3;
+    CHECK_HR(swapChain.As(&swapChain3));
+    return swapChain3;
+}
+
+std::vector<ComPtr<ID3D12Resource>> getBackBuffers(ComPtr<IDXGISwapChain3> swapChain, UINT count)
+{
+    std::vector<ComPtr<ID3D12Resource>> backBuffers(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(swapChain->GetBuffer(i, IID_PPV_ARGS(&backBuffers[i])));
+    }
+    return backBuffers;
+}
+
+ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device, UINT count)
+{
+    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{};
+    rtvHeapDesc.NumDescriptors = count;
+    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+
+    ComPtr<ID3D12DescriptorHeap> heap;
+    CHECK_HR(device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&heap)));
+    return heap;
+}
+
+std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device, UINT count)
+{
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &c_textureDesc,
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&textures[i])));
+    }
+    return textures;
+}
+
+// Only as large as the region that goes through them, cross adapter memory is row major and slow to access
+std::vector<ComPtr<ID3D12Resource>> createSharedTextures(ComPtr<ID3D12Device> device, UINT count, UINT width, UINT height)
+{
+    CD3DX12_RESOURCE_DESC textureDesc = c_textureDesc;
+    textureDesc.Width = width;
+    textureDesc.Height = height;
+    textureDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_CROSS_ADAPTER;
+    textureDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_SHARED | D3D12_HEAP_FLAG_SHARED_CROSS_ADAPTER,
+            &textureDesc,
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&textures[i])));
+    }
+    return textures;
+}
+
+void createRtvs(ComPtr<ID3D12Device> device, ComPtr<ID3D12DescriptorHeap> heap, const std::vector<ComPtr<ID3D12Resource>>& textures)
+{
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(heap->GetCPUDescriptorHandleForHeapStart());
+    const UINT rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        device->CreateRenderTargetView(textures[i].Get(), nullptr, rtvHandle);
+        rtvHandle.Offset(1, rtvDescriptorSize);
+    }
+}
+
+std::vector<HANDLE> createSharedTextureHandles(ComPtr<ID3D12Device> device, std::vector<ComPtr<ID3D12Resource>> textures)
+{
+    std::vector<HANDLE> handles;
+    for (ComPtr<ID3D12Resource> texture : textures)
+    {
+        HANDLE handle = nullptr;
+        CHECK_HR(device->CreateSharedHandle(
+            texture.Get(),
+            nullptr,
+            GENERIC_ALL,
+            nullptr,
+            &handle));
+        handles.push_back(handle);
+    }
+    return handles;
+}
+
+std::vector<ComPtr<ID3D12Resource>> openSharedTextureHandles(ComPtr<ID3D12Device> device, std::vector<HANDLE> handles)
+{
+    std::vector<ComPtr<ID3D12Resource>> sharedTextures;
+    for (HANDLE handle : handles)
+    {
+        ComPtr<ID3D12Resource> tex;
+        CHECK_HR(device->OpenSharedHandle(handle, IID_PPV_ARGS(&tex)));
+        sharedTextures.push_back(tex);
+        CloseHandle(handle);
+    }
+    return sharedTextures;
+}
+
+std::vector<ComPtr<ID3D12CommandAllocator>> createCommandAllocators(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, UINT count, const std::wstring& name = L"")
+{
+    std::vector<ComPtr<ID3D12CommandAllocator>> allocators(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommandAllocator(type, IID_PPV_ARGS(&allocators[i])));
+        if (!name.empty())
+        {
+            std::wstring wn = name + std::to_wstring(i);
+            allocators[i]->SetName(wn.c_str());
+        }
+    }
+    return allocators;
+}
+
+ComPtr<ID3D12GraphicsCommandList> createCommandList(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, ComPtr<ID3D12CommandAllocator> allocator, const std::wstring& name = L"")
+{
+    ComPtr<ID3D12GraphicsCommandList> list;
+    CHECK_HR(device->CreateCommandList(0, type, allocator.Get(), nullptr, IID_PPV_ARGS(&list)));
+    if (!name.empty())
+    {
+        list->SetName(name.c_str());
+    }
+    return list;
+}
+
+
+ComPtr<ID3D12Fence> createFence(ComPtr<ID3D12Device> device, D3D12_FENCE_FLAGS flags)
+{
+    ComPtr<ID3D12Fence> fence;
+    CHECK_HR(device->CreateFence(1, flags, IID_PPV_ARGS(&fence)));
+    return fence;
+}
+
+HANDLE createSharedFenceHandle(ComPtr<ID3D12Device> device, ComPtr<ID3D12Fence> fence)
+{
+    HANDLE fenceHandle = nullptr;
+    CHECK_HR(device->CreateSharedHandle(
+        fence.Get(),
+        nullptr,
+        GENERIC_ALL,
+        nullptr,
+        &fenceHandle));
+
+    return fenceHandle;
+}
+
+ComPtr<ID3D12Fence> openSharedFenceHandle(ComPtr<ID3D12Device> device, HANDLE handle)
+{
+    ComPtr<ID3D12Fence> sharedFence;
+    CHECK_HR(device->OpenSharedHandle(handle, IID_PPV_ARGS(&sharedFence)));
+    return sharedFence;
+}
+
+ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY_HEAP_TYPE type, UINT count)
+{
+    D3D12_QUERY_HEAP_DESC queryHeapDesc{};
+    queryHeapDesc.Count = count; // Start and end timestamp pairs
+    queryHeapDesc.Type = type;
+
+    ComPtr<ID3D12QueryHeap> queryHeap;
+    device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap));
+    return queryHeap;
+}
+
+ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device, UINT count)
+{
+    CD3DX12_HEAP_PROPERTIES readbackHeapProps(D3D12_HEAP_TYPE_READBACK);
+    CD3DX12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * count);
+
+    ComPtr<ID3D12Resource> readbackBuffer;
+    device->CreateCommittedResource(
+        &readbackHeapProps,
+        D3D12_HEAP_FLAG_NONE,
+        &readbackBufferDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&readbackBuffer));
+    return readbackBuffer;
+}
+
+QueryData readQueryData(ComPtr<ID3D12Resource> readbackBuffer, UINT slot)
+{
+    const D3D12_RANGE range{slot * 2 * sizeof(UINT64), (slot + 1) * 2 * sizeof(UINT64)};
+    UINT64* mappedData = nullptr;
+    CHECK_HR(readbackBuffer->Map(0, &range, reinterpret_cast<void**>(&mappedData)));
+    QueryData queryData{};
+    queryData.start = mappedData[slot * 2];
+    queryData.end = mappedData[slot * 2 + 1];
+    const D3D12_RANGE writtenRange{0, 0};
+    readbackBuffer->Unmap(0, &writtenRange);
+    return queryData;
+}
+
+// Reads a positive count given as e.g. --frames-in-flight=4 on the command line
+UINT parseCountOption(const std::wstring& commandLine, const std::wstring& name, UINT defaultValue)
+{
+    const size_t position = commandLine.find(name);
+    if (position == std::wstring::npos)
+    {
+        return defaultValue;
+    }
+    const UINT value = static_cast<UINT>(wcstoul(commandLine.c_str() + position + name.size(), nullptr, 10));
+    return value > 0 ? value : defaultValue;
+}
+
+D3D12_RESOURCE_STATES toD3D12State(uint32_t state)
+{
+    D3D12_RESOURCE_STATES d3d12State = D3D12_RESOURCE_STATE_COMMON;
+    if (state & framegraph::RenderTarget)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_RENDER_TARGET;
+    }
+    if (state & framegraph::CopySource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_SOURCE;
+    }
+    if (state & framegraph::CopyDest)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_DEST;
+    }
+    if (state & framegraph::ShaderResource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    }
+    if (state & framegraph::UnorderedAccess)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    }
+    return d3d12State;
+}
+
+// Records one batch of frame graph barriers with a single ResourceBarrier call
+void recordBarriers(ComPtr<ID3D12GraphicsCommandList> list, const std::vector<framegraph::Barrier>& barriers, const std::vector<ID3D12Resource*>& resources)
+{
+    if (barriers.empty())
+    {
+        return;
+    }
+    std::vector<D3D12_RESOURCE_BARRIER> d3d12Barriers;
+    d3d12Barriers.reserve(barriers.size());
+    for (const framegraph::Barrier& barrier : barriers)
+    {
+        d3d12Barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resources[barrier.resource], toD3D12State(barrier.before), toD3D12State(barrier.after)));
+    }
+    list->ResourceBarrier(static_cast<UINT>(d3d12Barriers.size()), d3d12Barriers.data());
+}
+
+
+// One render adapter that writes its own region of the composited frame
+struct Producer
+{
+    UINT adapterIndex = 0;
+    FanInRegion region{};
+    ComPtr<ID3D12Device> device;
+    ComPtr<ID3D12CommandQueue> directQueue;
+    std::vector<ComPtr<ID3D12Resource>> textures;
+    ComPtr<ID3D12DescriptorHeap> rtvHeap;
+    std::vector<ComPtr<ID3D12Resource>> sharedTextures;
+    std::vector<ComPtr<ID3D12Resource>> sharedTextures0; // The shared textures opened on adapter 0
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators;
+    ComPtr<ID3D12GraphicsCommandList> list;
+    ComPtr<ID3D12Fence> sharedFence;
+    ComPtr<ID3D12Fence> sharedFence0; // The shared fence opened on adapter 0
+    ComPtr<ID3D12QueryHeap> queryHeap;
+    ComPtr<ID3D12Resource> readBackBuffer;
+    UINT64 timestampFrequency = 0;
+    std::vector<QueryData> queryData;
+    std::vector<QueryData> compositeQueryData; // Copies of this region on adapter 0
+    uint64_t lastReadyCount = 0; // Frames in which this region was the only one left to wait for
+    std::vector<framegraph::ResourceId> textureIds;
+    std::vector<framegraph::ResourceId> sharedTextureIds;
+    std::vector<framegraph::ResourceId> sharedTextureIds0;
+};
+
+int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
+{
+    /*
+    - every render adapter (1, 2, ...) renders (=clears) its own region to a texture
+    - copy the region to a cross adapter shared texture of the region's size
+    - adapter 0 copies each region to the back buffer as soon as its producer's fence is reached
+    - present on adapter 0
+    */
+    enableConsole();
+    HWND hwnd = createRenderWindow(hInstance, nCmdShow);
+
+    const std::wstring commandLine(pCmdLine);
+    // A flip model swap chain needs at least two buffers
+    const UINT backBufferCount = (std::max)(parseCountOption(commandLine, L"--back-buffers=", c_swapChainFrameCount), 2u);
+    const UINT framesInFlight = parseCountOption(commandLine, L"--frames-in-flight=", c_framesInFlight);
+
+    ComPtr<IDXGIFactory4> factory = createFactory();
+    std::vector<ComPtr<IDXGIAdapter>> adapters = getAdapters(factory.Get());
+    printAdapters(adapters);
+    CHECK(adapters.size() >= 2);
+
+    // By default every adapter except the display adapter renders a region
+    const UINT maxProducerCount = static_cast<UINT>(adapters.size()) - 1;
+    const UINT producerCount = (std::min)(parseCountOption(commandLine, L"--producers=", maxProducerCount), maxProducerCount);
+    const std::vector<FanInRegion> regions = splitRows(c_width, c_height, producerCount);
+
+    ComPtr<ID3D12Device> device0 = createDevice(adapters[0]);
+    std::cout << "0: isCrossAdapterSupported = " << isCrossAdapterSupported(device0) << std::endl;
+
+    ComPtr<ID3D12CommandQueue> directQueue0 = createCommandQueue(device0, D3D12_COMMAND_LIST_TYPE_DIRECT);
+    ComPtr<IDXGISwapChain3> swapChain = createSwapChain(factory, directQueue0, hwnd, backBufferCount);
+    std::vector<ComPtr<ID3D12Resource>> backBuffers = getBackBuffers(swapChain, backBufferCount);
+
+    // Every region of every back buffer is copied by its own command list
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators0 = createCommandAllocators(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, backBufferCount * producerCount, L"allocator0_");
+    ComPtr<ID3D12GraphicsCommandList> list0 = createCommandList(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators0[0], L"list0");
+    CHECK_HR(list0->Close());
+
+    ComPtr<ID3D12Fence> frameFence = createFence(device0, D3D12_FENCE_FLAG_NONE);
+    std::vector<UINT64> frameFenceValues(backBufferCount, 0);
+    UINT64 presentFenceValue = 2;
+    UINT64 sharedFenceValue = 2;
+
+    const UINT queryCount0 = backBufferCount * producerCount * 2;
+    ComPtr<ID3D12QueryHeap> queryHeap0 = createQueryHeap(device0, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, queryCount0);
+    ComPtr<ID3D12Resource> readBackBuffer0 = createReadbackBuffer(device0, queryCount0);
+    UINT64 timestampFrequency0 = 0;
+    directQueue0->GetTimestampFrequency(&timestampFrequency0);
+
+    // The producers' frames are planned together, the composition on adapter 0
+    // one region at a time since the order is only known when the fences are reached
+    framegraph::FrameGraph producerGraph;
+    std::vector<ID3D12Resource*> producerResources;
+    std::vector<framegraph::QueueId> producerQueues;
+    framegraph::FrameGraph compositeGraph;
+    const framegraph::QueueId compositeQueue = compositeGraph.addQueue(0, framegraph::QueueType::Direct);
+    std::vector<ID3D12Resource*> compositeResources;
+    std::vector<framegraph::ResourceId> backBufferIds;
+    for (UINT i = 0; i < backBufferCount; ++i)
+    {
+        compositeResources.push_back(backBuffers[i].Get());
+        backBufferIds.push_back(compositeGraph.addResource(framegraph::Present));
+    }
+
+    std::vector<Producer> producers(producerCount);
+    for (UINT p = 0; p < producerCount; ++p)
+    {
+        Producer& producer = producers[p];
+        producer.adapterIndex = p + 1;
+        producer.region = regions[p];
+        producer.device = createDevice(adapters[producer.adapterIndex]);
+        std::cout << producer.adapterIndex << ": isCrossAdapterSupported = " << isCrossAdapterSupported(producer.device) << std::endl;
+
+        producer.directQueue = createCommandQueue(producer.device, D3D12_COMMAND_LIST_TYPE_DIRECT);
+        producer.textures = createTextures(producer.device, framesInFlight);
+        producer.rtvHeap = createRtvHeap(producer.device, framesInFlight);
+        createRtvs(producer.device, producer.rtvHeap, producer.textures);
+
+        producer.sharedTextures = createSharedTextures(producer.device, framesInFlight, producer.region.width, producer.region.height);
+        std::vector<HANDLE> sharedTextureHandles = createSharedTextureHandles(producer.device, producer.sharedTextures);
+        producer.sharedTextures0 = openSharedTextureHandles(device0, sharedTextureHandles);
+
+        const std::wstring allocatorName = L"allocator" + std::to_wstring(producer.adapterIndex) + L"_";
+        producer.commandAllocators = createCommandAllocators(producer.device, D3D12_COMMAND_LIST_TYPE_DIRECT, framesInFlight, allocatorName);
+        producer.list = createCommandList(producer.device, D3D12_COMMAND_LIST_TYPE_DIRECT, producer.commandAllocators[0], L"list" + std::to_wstring(producer.adapterIndex));
+        CHECK_HR(producer.list->Close());
+
+        producer.sharedFence = createFence(producer.device, D3D12_FENCE_FLAG_SHARED | D3D12_FENCE_FLAG_SHARED_CROSS_ADAPTER);
+        HANDLE sharedFenceHandle = createSharedFenceHandle(producer.device, producer.sharedFence);
+        producer.sharedFence0 = openSharedFenceHandle(device0, sharedFenceHandle);
+
+        producer.queryHeap = createQueryHeap(producer.device, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, framesInFlight * 2);
+        producer.readBackBuffer = createReadbackBuffer(producer.device, framesInFlight * 2);
+        producer.directQueue->GetTimestampFrequency(&producer.timestampFrequency);
+
+        producerQueues.push_back(producerGraph.addQueue(producer.adapterIndex, framegraph::QueueType::Direct));
+        for (UINT i = 0; i < framesInFlight; ++i)
+        {
+            producerResources.push_back(producer.textures[i].Get());
+            producer.textureIds.push_back(producerGraph.addResource(framegraph::Common));
+            producerResources.push_back(producer.sharedTextures[i].Get());
+            producer.sharedTextureIds.push_back(producerGraph.addResource(framegraph::Common));
+            compositeResources.push_back(producer.sharedTextures0[i].Get());
+            producer.sharedTextureIds0.push_back(compositeGraph.addResource(framegraph::Common));
+        }
+    }
+
+    // All CPU waits on GPU work go through this
+    FenceWaiter<ID3D12Fence> fenceWaiter;
+
+    // Cleared by reaching the ring slot's fence value, adapter 0 has read the shared textures by then
+    FrameRing ring(framesInFlight);
+
+    // Render (=clear) the producer's region and copy it to the shared texture
+    auto renderRegion = [&](Producer& producer, UINT slot, const framegraph::CompiledPass& renderPass, const framegraph::CompiledPass& copyPass, float red, float blue) {
+        CHECK_HR(producer.commandAllocators[slot]->Reset());
+        CHECK_HR(producer.list->Reset(producer.commandAllocators[slot].Get(), nullptr));
+
+        recordBarriers(producer.list, renderPass.barriersBefore, producerResources);
+
+        const FanInRegion& region = producer.region;
+        const D3D12_RECT rect{static_cast<LONG>(region.x), static_cast<LONG>(region.y), static_cast<LONG>(region.x + region.width), static_cast<LONG>(region.y + region.height)};
+        float clearColor[4] = {red, 0.2f, blue, 1.0f};
+        const UINT rtvDescriptorSize = producer.device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+        CD3DX12_CPU_DESCRIPTOR_HANDLE textureRtv = CD3DX12_CPU_DESCRIPTOR_HANDLE(producer.rtvHeap->GetCPUDescriptorHandleForHeapStart(), slot, rtvDescriptorSize);
+        producer.list->ClearRenderTargetView(textureRtv, clearColor, 1, &rect);
+
+        recordBarriers(producer.list, renderPass.barriersAfter, producerResources);
+        recordBarriers(producer.list, copyPass.barriersBefore, producerResources);
+
+        const UINT queryIndex = slot * 2;
+        producer.list->EndQuery(producer.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+
+        CD3DX12_TEXTURE_COPY_LOCATION dest(producer.sharedTextures[slot].Get(), 0);
+        CD3DX12_TEXTURE_COPY_LOCATION src(producer.textures[slot].Get(), 0);
+        CD3DX12_BOX box(region.x, region.y, region.x + region.width, region.y + region.height);
+        producer.list->CopyTextureRegion(&dest, 0, 0, 0, &src, &box);
+
+        producer.list->EndQuery(producer.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+        recordBarriers(producer.list, copyPass.barriersAfter, producerResources);
+
+        producer.list->ResolveQueryData(
+            producer.queryHeap.Get(),
+            D3D12_QUERY_TYPE_TIMESTAMP,
+            queryIndex, // Start index
+            2, // Number of queries
+            producer.readBackBuffer.Get(),
+            queryIndex * sizeof(UINT64)); // Destination buffer offset
+        CHECK_HR(producer.list->Close());
+
+        ID3D12CommandList* commandLists[] = {producer.list.Get()};
+        producer.directQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
+        CHECK_HR(producer.directQueue->Signal(producer.sharedFence.Get(), sharedFenceValue));
+    };
+
+    // Copy one ready region from its shared texture to the back buffer on adapter 0
+    auto compositeRegion = [&](UINT producerIndex, UINT slot, UINT backBufferIndex, bool last) {
+        Producer& producer = producers[producerIndex];
+
+        compositeGraph.beginFrame();
+        const framegraph::PassId copyPassId = compositeGraph.addPass(compositeQueue, {framegraph::read(producer.sharedTextureIds0[slot], framegraph::CopySource), framegraph::write(backBufferIds[backBufferIndex], framegraph::CopyDest)});
+        // The producer writes the shared texture again in the common state
+        compositeGraph.setFinalState(producer.sharedTextureIds0[slot], framegraph::Common);
+        if (last)
+        {
+            compositeGraph.setFinalState(backBufferIds[backBufferIndex], framegraph::Present);
+        }
+        const framegraph::CompiledFrame compiled = compositeGraph.compile();
+        CHECK(compiled.errors.empty());
+        const framegraph::CompiledPass& copyPass = compiled.passes[copyPassId];
+
+        const UINT allocatorIndex = backBufferIndex * producerCount + producerIndex;
+        CHECK_HR(commandAllocators0[allocatorIndex]->Reset());
+        CHECK_HR(list0->Reset(commandAllocators0[allocatorIndex].Get(), nullptr));
+
+        recordBarriers(list0, copyPass.barriersBefore, compositeResources);
+
+        const UINT queryIndex = allocatorIndex * 2;
+        list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+
+        const FanInRegion& region = producer.region;
+        CD3DX12_TEXTURE_COPY_LOCATION dest(backBuffers[backBufferIndex].Get(), 0);
+        CD3DX12_TEXTURE_COPY_LOCATION src(producer.sharedTextures0[slot].Get(), 0);
+        CD3DX12_BOX box(0, 0, region.width, region.height);
+        list0->CopyTextureRegion(&dest, region.x, region.y, 0, &src, &box);
+
+        list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+        recordBarriers(list0, copyPass.barriersAfter, compositeResources);
+
+        list0->ResolveQueryData(
+            queryHeap0.Get(),
+            D3D12_QUERY_TYPE_TIMESTAMP,
+            queryIndex, // Start index
+            2, // Number of queries
+            readBackBuffer0.Get(),
+            queryIndex * sizeof(UINT64)); // Destination buffer offset
+        CHECK_HR(list0->Close());
+
+        // Already reached on the CPU, keeps the GPU ordering explicit
+        CHECK_HR(directQueue0->Wait(producer.sharedFence0.Get(), sharedFenceValue));
+        ID3D12CommandList* commandLists[] = {list0.Get()};
+        directQueue0->ExecuteCommandLists(_countof(commandLists), commandLists);
+    };
+
+    const FanInFrame::ReachedFunction reached = [&](uint32_t producer, uint64_t value) {
+        return producers[producer].sharedFence->GetCompletedValue() >= value;
+    };
+
+    FanInFrame fanIn(producerCount);
+    std::vector<pacing::PresentSample> presentSamples;
+    uint64_t earlyRegionCount = 0;
+    uint64_t frameCount = 0;
+    bool running = true;
+    float blue = 0.0f;
+
+    while (running)
+    {
+        MSG msg = {};
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT)
+            {
+                running = false;
+                break;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+
+        const UINT slot = ring.advance();
+        if (ring.fenceValue(slot) != 0)
+        {
+            CHECK(fenceWaiter.wait(frameFence.Get(), ring.fenceValue(slot)));
+            for (Producer& producer : producers)
+            {
+                producer.queryData.push_back(readQueryData(producer.readBackBuffer, slot));
+            }
+        }
+
+        producerGraph.beginFrame();
+        std::vector<framegraph::PassId> renderPassIds;
+        std::vector<framegraph::PassId> copyPassIds;
+        for (UINT p = 0; p < producerCount; ++p)
+        {
+            const Producer& producer = producers[p];
+            renderPassIds.push_back(producerGraph.addPass(producerQueues[p], {framegraph::write(producer.textureIds[slot], framegraph::RenderTarget)}));
+            copyPassIds.push_back(producerGraph.addPass(producerQueues[p], {framegraph::read(producer.textureIds[slot], framegraph::CopySource), framegraph::write(producer.sharedTextureIds[slot], framegraph::CopyDest)}));
+            // Adapter 0 reads the shared texture in the common state
+            producerGraph.setFinalState(producer.sharedTextureIds[slot], framegraph::Common);
+        }
+        const framegraph::CompiledFrame compiled = producerGraph.compile();
+        CHECK(compiled.errors.empty());
+
+        blue = blue > 1.0f ? 0.0f : blue + 0.01f;
+        for (UINT p = 0; p < producerCount; ++p)
+        {
+            const float red = static_cast<float>(p) / producerCount;
+            renderRegion(producers[p], slot, compiled.passes[renderPassIds[p]], compiled.passes[copyPassIds[p]], red, blue);
+        }
+
+        const UINT backBufferIndex = swapChain->GetCurrentBackBufferIndex();
+        if (frameFenceValues[backBufferIndex] != 0)
+        {
+            CHECK(fenceWaiter.wait(frameFence.Get(), frameFenceValues[backBufferIndex]));
+            for (UINT p = 0; p < producerCount; ++p)
+            {
+                producers[p].compositeQueryData.push_back(readQueryData(readBackBuffer0, backBufferIndex * producerCount + p));
+            }
+        }
+
+        // Composite the regions in the order their producers finish
+        fanIn.begin(std::vector<uint64_t>(producerCount, sharedFenceValue));
+        while (!fanIn.done())
+        {
+            const std::vector<uint32_t> ready = fanIn.takeReady(reached);
+            if (ready.empty())
+            {
+                std::vector<FenceWait<ID3D12Fence>> waits;
+                for (uint32_t p : fanIn.pending())
+                {
+                    waits.push_back({producers[p].sharedFence.Get(), fanIn.readyValue(p)});
+                }
+                CHECK(fenceWaiter.wait(waits, WaitMode::Any));
+                continue;
+            }
+            if (fanIn.done() && ready.size() == 1)
+            {
+                ++producers[ready[0]].lastReadyCount;
+            }
+            for (uint32_t p : ready)
+            {
+                compositeRegion(p, slot, backBufferIndex, fanIn.done() && p == ready.back());
+            }
+        }
+        earlyRegionCount += fanIn.earlyCount();
+        ++frameCount;
+
+        swapChain->Present(1, 0);
+
+        pacing::PresentSample presentSample{};
+        if (pacing::sampleSwapChain(swapChain.Get(), presentSample))
+        {
+            presentSamples.push_back(presentSample);
+        }
+
+        CHECK_HR(directQueue0->Signal(frameFence.Get(), presentFenceValue));
+        frameFenceValues[backBufferIndex] = presentFenceValue;
+        ring.setFenceValue(slot, presentFenceValue);
+        ++presentFenceValue;
+        ++sharedFenceValue;
+    }
+
+    std::vector<FenceWait<ID3D12Fence>> idleWaits;
+    for (UINT64 frameFenceValue : frameFenceValues)
+    {
+        idleWaits.push_back({frameFence.Get(), frameFenceValue});
+    }
+    CHECK(fenceWaiter.wait(idleWaits, WaitMode::All));
+
+    const double qpcFrequency = pacing::qpcFrequency();
+
+    std::ofstream myfile;
+    myfile.open("dx12faninout.txt");
+    myfile << "Producers: " << producerCount << ", back buffers: " << backBufferCount << ", frames in flight: " << framesInFlight << std::endl
+           << "Average copy times (producer, composite)" << std::endl;
+    for (const Producer& producer : producers)
+    {
+        double copyTimeTotal = 0.0;
+        for (const QueryData& q : producer.queryData)
+        {
+            double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / producer.timestampFrequency;
+            copyTimeTotal += elapsedTimeInSeconds;
+        }
+        double compositeTimeTotal = 0.0;
+        for (const QueryData& q : producer.compositeQueryData)
+        {
+            double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / timestampFrequency0;
+            compositeTimeTotal += elapsedTimeInSeconds;
+        }
+        myfile << producer.adapterIndex << ": " << (copyTimeTotal / producer.queryData.size() * 1000.0) << "ms, "
+               << (compositeTimeTotal / producer.compositeQueryData.size() * 1000.0) << "ms, last ready in " << producer.lastReadyCount << " frames" << std::endl;
+    }
+    if (frameCount > 0)
+    {
+        myfile << "Regions composited before the last producer was ready: " << (static_cast<double>(earlyRegionCount) / frameCount) << " per frame" << std::endl;
+    }
+    pacing::writeReport(myfile, pacing::analyze(presentSamples, qpcFrequency));
+    myfile.close();
+
+    std::ofstream traceFile("dx12faninpresent.txt");
+    pacing::writeTrace(traceFile, presentSamples, qpcFrequency);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,889 @@
+#include <d3d12.h>
+#include <d3dx12.h>
+#include <dxgi1_4.h>
+#include <comdef.h>
+#include <wrl/client.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <atomic>
+#include <string>
+#include <algorithm>
+
+#include "FanOut.hpp"
+#include "FenceWaiter.hpp"
+#include "FrameGraph.hpp"
+#include "FramePacing.hpp"
+
+using Microsoft::WRL::ComPtr;
+
+#define CHECK(f)                                                                                      \
+    do                                                                                                \
+    {                                                                                                 \
+        if (!(f))                                                                                     \
+        {                                                                                             \
+            std::cerr << "Terminate. " << #f << " failed at " << __FILE__ << ":" << __LINE__ << "\n"; \
+            std::terminate();                                                                         \
+        }                                                                                             \
+    } while (false)
+
+#define CHECK_HR(f)                                                                                   \
+    do                                                                                                \
+    {                                                                                                 \
+        HRESULT hr = f;                                                                               \
+        if (FAILED((hr)))                                                                             \
+        {                                                                                             \
+            std::cerr << "Terminate. " << #f << " failed at " << __FILE__ << ":" << __LINE__ << "\n"; \
+            std::cerr << _com_error(hr).ErrorMessage() << std::endl;                                  \
+            std::terminate();                                                                         \
+        }                                                                                             \
+    } while (false)
+
+const int c_width = 7680;
+const int c_height = 3744;
+const UINT c_swapChainFrameCount = 3;
+DXGI_FORMAT c_format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+const CD3DX12_RESOURCE_DESC c_textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+    c_format,
+    c_width,
+    c_height,
+    1u,
+    1u,
+    1,
+    1,
+    D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+    D3D12_TEXTURE_LAYOUT_UNKNOWN,
+    0u);
+
+struct QueryData
+{
+    UINT64 start;
+    UINT64 end;
+};
+
+UINT align(UINT size, UINT alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+void enableConsole()
+{
+    AllocConsole();
+    FILE* dummy;
+    freopen_s(&dummy, "CONOUT$", "w", stdout);
+    freopen_s(&dummy, "CONOUT$", "w", stderr);
+    freopen_s(&dummy, "CONIN$", "r", stdin);
+
+    std::cout.clear();
+    std::clog.clear();
+    std::cerr.clear();
+    std::cin.clear();
+}
+
+LRESULT CALLBACK windowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    switch (uMsg)
+    {
+    case WM_KEYDOWN:
+        if (wParam == VK_ESCAPE)
+        {
+            PostQuitMessage(0);
+        }
+        return 0;
+    case WM_DESTROY:
+        PostQuitMessage(0);
+        return 0;
+
+    default:
+        return DefWindowProc(hwnd, uMsg, wParam, lParam);
+    }
+}
+
+HWND createRenderWindow(HINSTANCE hInstance, int nCmdShow, const std::string& windowTitle)
+{
+    const LPCSTR windowClassName = "DX11WindowClass";
+
+    // Every display has its own window, the class is registered by the first one
+    WNDCLASSEX wc{};
+    wc.cbSize = sizeof(WNDCLASSEX);
+    if (!GetClassInfoEx(hInstance, windowClassName, &wc))
+    {
+        wc.style = CS_HREDRAW | CS_VREDRAW;
+        wc.lpfnWndProc = windowProc;
+        wc.hInstance = hInstance;
+        wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+        wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+        wc.lpszClassName = windowClassName;
+
+        CHECK(RegisterClassEx(&wc));
+    }
+
+    RECT rect = {0, 0, c_width, c_height};
+    AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW, FALSE);
+
+    HWND hwnd = CreateWindowEx(
+        0, // Optional window styles
+        windowClassName, // Window class name
+        windowTitle.c_str(), // Window title
+        WS_OVERLAPPEDWINDOW, // Window style
+        CW_USEDEFAULT,
+        CW_USEDEFAULT, // Position
+        rect.right - rect.left, // Width
+        rect.bottom - rect.top, // Height
+        nullptr, // Parent window
+        nullptr, // Menu
+        hInstance, // Instance handle
+        nullptr // Additional application data
+    );
+
+    CHECK(hwnd);
+
+    ShowWindow(hwnd, nCmdShow);
+    UpdateWindow(hwnd);
+
+    return hwnd;
+}
+
+ComPtr<IDXGIFactory4> createFactory()
+{
+    UINT dxgiFactoryFlags = 0;
+#if defined(_DEBUG)
+    { // Enable the debug layer (requires the Graphics Tools "optional feature").
+        ComPtr<ID3D12Debug> debugController;
+        if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+        {
+            debugController->EnableDebugLayer();
+            dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+        }
+    }
+#endif
+
+    ComPtr<IDXGIFactory4> factory;
+    CHECK_HR(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+    return factory;
+}
+
+std::vector<ComPtr<IDXGIAdapter>> getAdapters(IDXGIFactory4* factory)
+{
+    UINT i = 0;
+    IDXGIAdapter* adapter;
+    std::vector<ComPtr<IDXGIAdapter>> adapters;
+    while (factory->EnumAdapters(i, &adapter) != DXGI_ERROR_NOT_FOUND)
+    {
+        adapters.push_back(adapter);
+        ++i;
+    }
+    return adapters;
+}
+
+void printAdapters(std::vector<ComPtr<IDXGIAdapter>>& adapters)
+{
+    int i = 0;
+    for (ComPtr<IDXGIAdapter> adapter : adapters)
+    {
+        DXGI_ADAPTER_DESC desc;
+        adapter->GetDesc(&desc);
+
+        std::wcout << "Adapter " << i << ": " << desc.Description << "\n";
+        ++i;
+    }
+}
+
+ComPtr<ID3D12Device> createDevice(ComPtr<IDXGIAdapter> adapter)
+{
+    ComPtr<ID3D12Device> device;
+    CHECK_HR(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device)));
+    return device;
+}
+
+bool isCrossAdapterSupported(ComPtr<ID3D12Device> device)
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+    CHECK_HR(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, reinterpret_cast<void*>(&options), sizeof(options)));
+    return options.CrossAdapterRowMajorTextureSupported;
+}
+
+ComPtr<ID3D12CommandQueue> createCommandQueue(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc{};
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    queueDesc.Type = type;
+
+    ComPtr<ID3D12CommandQueue> queue;
+
+    CHECK_HR(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&queue)));
+    return queue;
+}
+
+ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID3D12CommandQueue> queue, HWND hwnd, UINT bufferCount)
+{
+    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+    swapChainDesc.BufferCount = bufferCount;
+    swapChainDesc.Width = c_width;
+    swapChainDesc.Height = c_height;
+    swapChainDesc.Format = c_format;
+    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+    swapChainDesc.SampleDesc.Count = 1;
+
+    ComPtr<IDXGISwapChain1> swapChain;
+    CHECK_HR(factory->CreateSwapChainForHwnd(
+        queue.Get(),
+        hwnd,
+        &swapChainDesc,
+        nullptr,
+        nullptr,
+        &swapChain));
+
+    ComPtr<IDXGISwapChain3> swapChain3;
+    CHECK_HR(swapChain.As(&swapChain3));
+    return swapChain3;
+}
+
+std::vector<ComPtr<ID3D12Resource>> getBackBuffers(ComPtr<IDXGISwapChain3> swapChain, UINT count)
+{
+    std::vector<ComPtr<ID3D12Resource>> backBuffers(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(swapChain->GetBuffer(i, IID_PPV_ARGS(&backBuffers[i])));
+    }
+    return backBuffers;
+}
+
+ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device, UINT count)
+{
+    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{};
+    rtvHeapDesc.NumDescriptors = count;
+    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+
+    ComPtr<ID3D12DescriptorHeap> heap;
+    CHECK_HR(device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&heap)));
+    return heap;
+}
+
+std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device, UINT count)
+{
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &c_textureDesc,
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&textures[i])));
+    }
+    return textures;
+}
+
+void createRtvs(ComPtr<ID3D12Device> device, ComPtr<ID3D12DescriptorHeap> heap, const std::vector<ComPtr<ID3D12Resource>>& textures)
+{
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(heap->GetCPUDescriptorHandleForHeapStart());
+    const UINT rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        device->CreateRenderTargetView(textures[i].Get(), nullptr, rtvHandle);
+        rtvHandle.Offset(1, rtvDescriptorSize);
+    }
+}
+
+std::vector<ComPtr<ID3D12CommandAllocator>> createCommandAllocators(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, UINT count, const std::wstring& name = L"")
+{
+    std::vector<ComPtr<ID3D12CommandAllocator>> allocators(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommandAllocator(type, IID_PPV_ARGS(&allocators[i])));
+        if (!name.empty())
+        {
+            std::wstring wn = name + std::to_wstring(i);
+            allocators[i]->SetName(wn.c_str());
+        }
+    }
+    return allocators;
+}
+
+ComPtr<ID3D12GraphicsCommandList> createCommandList(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, ComPtr<ID3D12CommandAllocator> allocator, const std::wstring& name = L"")
+{
+    ComPtr<ID3D12GraphicsCommandList> list;
+    CHECK_HR(device->CreateCommandList(0, type, allocator.Get(), nullptr, IID_PPV_ARGS(&list)));
+    if (!name.empty())
+    {
+        list->SetName(name.c_str());
+    }
+    return list;
+}
+
+ComPtr<ID3D12Heap> createSharedHeap(ComPtr<ID3D12Device> device, UINT count)
+{
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
+    device->GetCopyableFootprints(&c_textureDesc, 0, 1, 0, &layout, nullptr, nullptr, nullptr);
+    UINT textureSize = align(layout.Footprint.RowPitch * layout.Footprint.Height);
+
+    CD3DX12_HEAP_DESC heapDesc(
+        textureSize * count,
+        D3D12_HEAP_TYPE_DEFAULT,
+        0,
+        D3D12_HEAP_FLAG_SHARED | D3D12_HEAP_FLAG_SHARED_CROSS_ADAPTER);
+
+    ComPtr<ID3D12Heap> heap;
+    CHECK_HR(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+    return heap;
+}
+
+HANDLE createSharedHeapHandle(ComPtr<ID3D12Device> device, ComPtr<ID3D12Heap> heap)
+{
+    HANDLE heapHandle = nullptr;
+    CHECK_HR(device->CreateSharedHandle(
+        heap.Get(),
+        nullptr,
+        GENERIC_ALL,
+        nullptr,
+        &heapHandle));
+
+    return heapHandle;
+}
+
+ComPtr<ID3D12Heap> openSharedHeapHandle(ComPtr<ID3D12Device> device, HANDLE handle)
+{
+    ComPtr<ID3D12Heap> sharedHeap;
+    CHECK_HR(device->OpenSharedHandle(handle, IID_PPV_ARGS(&sharedHeap)));
+    return sharedHeap;
+}
+
+std::vector<ComPtr<ID3D12Resource>> createSharedHeapTexture(ComPtr<ID3D12Device> device, ComPtr<ID3D12Heap> heap, UINT count)
+{
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
+    device->GetCopyableFootprints(&c_textureDesc, 0, 1, 0, &layout, nullptr, nullptr, nullptr);
+    UINT textureSize = align(layout.Footprint.RowPitch * layout.Footprint.Height);
+    D3D12_RESOURCE_DESC crossAdapterDesc = CD3DX12_RESOURCE_DESC::Buffer(textureSize, D3D12_RESOURCE_FLAG_ALLOW_CROSS_ADAPTER | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+
+    std::vector<ComPtr<ID3D12Resource>> resources(count);
+
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreatePlacedResource(
+            heap.Get(),
+            textureSize * i,
+            &crossAdapterDesc,
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&resources[i])));
+    }
+
+    return resources;
+}
+
+ComPtr<ID3D12Fence> createFence(ComPtr<ID3D12Device> device, D3D12_FENCE_FLAGS flags)
+{
+    ComPtr<ID3D12Fence> fence;
+    CHECK_HR(device->CreateFence(1, flags, IID_PPV_ARGS(&fence)));
+    return fence;
+}
+
+HANDLE createSharedFenceHandle(ComPtr<ID3D12Device> device, ComPtr<ID3D12Fence> fence)
+{
+    HANDLE fenceHandle = nullptr;
+    CHECK_HR(device->CreateSharedHandle(
+        fence.Get(),
+        nullptr,
+        GENERIC_ALL,
+        nullptr,
+        &fenceHandle));
+
+    return fenceHandle;
+}
+
+ComPtr<ID3D12Fence> openSharedFenceHandle(ComPtr<ID3D12Device> device, HANDLE handle)
+{
+    ComPtr<ID3D12Fence> sharedFence;
+    CHECK_HR(device->OpenSharedHandle(handle, IID_PPV_ARGS(&sharedFence)));
+    return sharedFence;
+}
+
+ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY_HEAP_TYPE type, UINT count)
+{
+    D3D12_QUERY_HEAP_DESC queryHeapDesc{};
+    queryHeapDesc.Count = count; // Start and end timestamp pairs
+    queryHeapDesc.Type = type;
+
+    ComPtr<ID3D12QueryHeap> queryHeap;
+    device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap));
+    return queryHeap;
+}
+
+ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device, UINT count)
+{
+    CD3DX12_HEAP_PROPERTIES readbackHeapProps(D3D12_HEAP_TYPE_READBACK);
+    CD3DX12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * count);
+
+    ComPtr<ID3D12Resource> readbackBuffer;
+    device->CreateCommittedResource(
+        &readbackHeapProps,
+        D3D12_HEAP_FLAG_NONE,
+        &readbackBufferDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&readbackBuffer));
+    return readbackBuffer;
+}
+
+QueryData readQueryData(ComPtr<ID3D12Resource> readbackBuffer, UINT slot)
+{
+    const D3D12_RANGE range{slot * 2 * sizeof(UINT64), (slot + 1) * 2 * sizeof(UINT64)};
+    UINT64* mappedData = nullptr;
+    CHECK_HR(readbackBuffer->Map(0, &range, reinterpret_cast<void**>(&mappedData)));
+    QueryData queryData{};
+    queryData.start = mappedData[slot * 2];
+    queryData.end = mappedData[slot * 2 + 1];
+    const D3D12_RANGE writtenRange{0, 0};
+    readbackBuffer->Unmap(0, &writtenRange);
+    return queryData;
+}
+
+// Reads a positive count given as e.g. --frames-in-flight=4 on the command line
+UINT parseCountOption(const std::wstring& commandLine, const std::wstring& name, UINT defaultValue)
+{
+    const size_t position = commandLine.find(name);
+    if (position == std::wstring::npos)
+    {
+        return defaultValue;
+    }
+    const UINT value = static_cast<UINT>(wcstoul(commandLine.c_str() + position + name.size(), nullptr, 10));
+    return value > 0 ? value : defaultValue;
+}
+
+D3D12_RESOURCE_STATES toD3D12State(uint32_t state)
+{
+    D3D12_RESOURCE_STATES d3d12State = D3D12_RESOURCE_STATE_COMMON;
+    if (state & framegraph::RenderTarget)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_RENDER_TARGET;
+    }
+    if (state & framegraph::CopySource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_SOURCE;
+    }
+    if (state & framegraph::CopyDest)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_DEST;
+    }
+    if (state & framegraph::ShaderResource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    }
+    if (state & framegraph::UnorderedAccess)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    }
+    return d3d12State;
+}
+
+// Records one batch of frame graph barriers with a single ResourceBarrier call
+void recordBarriers(ComPtr<ID3D12GraphicsCommandList> list, const std::vector<framegraph::Barrier>& barriers, const std::vector<ID3D12Resource*>& resources)
+{
+    if (barriers.empty())
+    {
+        return;
+    }
+    std::vector<D3D12_RESOURCE_BARRIER> d3d12Barriers;
+    d3d12Barriers.reserve(barriers.size());
+    for (const framegraph::Barrier& barrier : barriers)
+    {
+        d3d12Barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resources[barrier.resource], toD3D12State(barrier.before), toD3D12State(barrier.after)));
+    }
+    list->ResourceBarrier(static_cast<UINT>(d3d12Barriers.size()), d3d12Barriers.data());
+}
+
+// Everything one display adapter needs to show the broadcast frames
+struct Display
+{
+    UINT adapterIndex = 0;
+    ComPtr<ID3D12Device> device;
+    ComPtr<ID3D12CommandQueue> directQueue;
+    HWND hwnd = nullptr;
+    ComPtr<IDXGISwapChain3> swapChain;
+    std::vector<ComPtr<ID3D12Resource>> backBuffers;
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators;
+    ComPtr<ID3D12GraphicsCommandList> list;
+    ComPtr<ID3D12Heap> sharedHeap;
+    std::vector<ComPtr<ID3D12Resource>> sharedHeapTextures;
+    ComPtr<ID3D12Fence> sharedFence; // The producer's shared fence opened on this device
+    ComPtr<ID3D12Fence> frameFence; // Signalled by this display only, so a slow display does not hold back the others
+    std::vector<UINT64> frameFenceValues;
+    UINT64 presentFenceValue = 2;
+    ComPtr<ID3D12QueryHeap> queryHeap;
+    ComPtr<ID3D12Resource> readBackBuffer;
+    UINT64 timestampFrequency = 0;
+    std::vector<QueryData> queryData;
+    std::vector<pacing::PresentSample> presentSamples;
+};
+
+int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
+{
+    /*
+    - render (=clear) to a texture on adapter 1
+    - copy the result once to a shared heap
+    - every display adapter (0, 2, 3, ...) opens the same shared heap, copies
+      the newest frame to its own swapchain backbuffer and presents it
+    */
+    enableConsole();
+
+    ComPtr<IDXGIFactory4> factory = createFactory();
+    std::vector<ComPtr<IDXGIAdapter>> adapters = getAdapters(factory.Get());
+    printAdapters(adapters);
+    CHECK(adapters.size() >= 2);
+
+    // Adapter 1 renders, by default every other adapter drives a display
+    const UINT maxDisplayCount = static_cast<UINT>(adapters.size()) - 1;
+    const UINT displayCount = (std::min)(parseCountOption(std::wstring(pCmdLine), L"--displays=", maxDisplayCount), maxDisplayCount);
+    // Every display may be reading one slot while another waits to be taken and the producer writes one
+    const UINT slotCount = displayCount + 2;
+
+    ComPtr<ID3D12Device> device1 = createDevice(adapters[1]);
+    std::cout << "1: isCrossAdapterSupported = " << isCrossAdapterSupported(device1) << std::endl;
+
+    ComPtr<ID3D12CommandQueue> directQueue1 = createCommandQueue(device1, D3D12_COMMAND_LIST_TYPE_DIRECT);
+    ComPtr<ID3D12CommandQueue> copyQueue1 = createCommandQueue(device1, D3D12_COMMAND_LIST_TYPE_COPY);
+
+    ComPtr<ID3D12DescriptorHeap> rtvHeap1 = createRtvHeap(device1, slotCount);
+    std::vector<ComPtr<ID3D12Resource>> textures = createTextures(device1, slotCount);
+    createRtvs(device1, rtvHeap1, textures);
+
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, slotCount, L"allocator1_");
+    std::vector<ComPtr<ID3D12CommandAllocator>> copyCommandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_COPY, slotCount, L"copyAllocator_");
+    ComPtr<ID3D12GraphicsCommandList> list1 = createCommandList(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators1[0], L"list1");
+    ComPtr<ID3D12GraphicsCommandList> copyList1 = createCommandList(device1, D3D12_COMMAND_LIST_TYPE_COPY, copyCommandAllocators1[0], L"copyList");
+    CHECK_HR(list1->Close());
+    CHECK_HR(copyList1->Close());
+
+    // The shared heap is created once on the producer and opened on every display
+    ComPtr<ID3D12Heap> sharedHeap1 = createSharedHeap(device1, slotCount);
+    HANDLE sharedHeapHandle = createSharedHeapHandle(device1, sharedHeap1);
+    std::vector<ComPtr<ID3D12Resource>> sharedHeapTextures1 = createSharedHeapTexture(device1, sharedHeap1, slotCount);
+
+    ComPtr<ID3D12Fence> renderFence = createFence(device1, D3D12_FENCE_FLAG_NONE);
+    ComPtr<ID3D12Fence> sharedFence1 = createFence(device1, D3D12_FENCE_FLAG_SHARED | D3D12_FENCE_FLAG_SHARED_CROSS_ADAPTER);
+    HANDLE sharedFenceHandle = createSharedFenceHandle(device1, sharedFence1);
+    UINT64 renderFenceValue = 2;
+    UINT64 sharedFenceValue = 2;
+
+    const UINT queryCount1 = slotCount * 2;
+    ComPtr<ID3D12QueryHeap> queryHeap1 = createQueryHeap(device1, D3D12_QUERY_HEAP_TYPE_COPY_QUEUE_TIMESTAMP, queryCount1);
+    ComPtr<ID3D12Resource> readBackBuffer1 = createReadbackBuffer(device1, queryCount1);
+    UINT64 timestampFrequencyCopyQueue = 0;
+    copyQueue1->GetTimestampFrequency(&timestampFrequencyCopyQueue);
+
+    const UINT rtvDescriptorSize1 = device1->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+    std::vector<Display> displays(displayCount);
+    for (UINT i = 0; i < displayCount; ++i)
+    {
+        Display& display = displays[i];
+        display.adapterIndex = i == 0 ? 0 : i + 1;
+        display.device = createDevice(adapters[display.adapterIndex]);
+        std::cout << display.adapterIndex << ": isCrossAdapterSupported = " << isCrossAdapterSupported(display.device) << std::endl;
+
+        display.directQueue = createCommandQueue(display.device, D3D12_COMMAND_LIST_TYPE_DIRECT);
+        display.hwnd = createRenderWindow(hInstance, nCmdShow, "Display " + std::to_string(display.adapterIndex));
+        display.swapChain = createSwapChain(factory, display.directQueue, display.hwnd, c_swapChainFrameCount);
+        display.backBuffers = getBackBuffers(display.swapChain, c_swapChainFrameCount);
+
+        const std::wstring allocatorName = L"allocator" + std::to_wstring(display.adapterIndex) + L"_";
+        display.commandAllocators = createCommandAllocators(display.device, D3D12_COMMAND_LIST_TYPE_DIRECT, c_swapChainFrameCount, allocatorName);
+        display.list = createCommandList(display.device, D3D12_COMMAND_LIST_TYPE_DIRECT, display.commandAllocators[0], L"list" + std::to_wstring(display.adapterIndex));
+        CHECK_HR(display.list->Close());
+
+        display.sharedHeap = openSharedHeapHandle(display.device, sharedHeapHandle);
+        display.sharedHeapTextures = createSharedHeapTexture(display.device, display.sharedHeap, slotCount);
+        display.sharedFence = openSharedFenceHandle(display.device, sharedFenceHandle);
+
+        display.frameFence = createFence(display.device, D3D12_FENCE_FLAG_NONE);
+        display.frameFenceValues.assign(c_swapChainFrameCount, 0);
+
+        display.queryHeap = createQueryHeap(display.device, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, c_swapChainFrameCount * 2);
+        display.readBackBuffer = createReadbackBuffer(display.device, c_swapChainFrameCount * 2);
+        display.directQueue->GetTimestampFrequency(&display.timestampFrequency);
+    }
+
+    // All CPU waits on GPU work go through this
+    FenceWaiter<ID3D12Fence> fenceWaiter;
+    FanOutSlots fanOut(slotCount, displayCount);
+    std::atomic<bool> running{true};
+    std::vector<QueryData> queryData1;
+
+    std::thread producerThread([&] {
+        // Render (=clear) on GPU 1 and copy the result to the shared heap once for all displays
+        framegraph::FrameGraph graph;
+        const framegraph::QueueId graphDirectQueue = graph.addQueue(1, framegraph::QueueType::Direct);
+        const framegraph::QueueId graphCopyQueue = graph.addQueue(1, framegraph::QueueType::Copy);
+        std::vector<ID3D12Resource*> graphResources;
+        std::vector<framegraph::ResourceId> textureIds;
+        std::vector<framegraph::ResourceId> sharedHeapTextureIds;
+        for (UINT i = 0; i < slotCount; ++i)
+        {
+            graphResources.push_back(textures[i].Get());
+            textureIds.push_back(graph.addResource(framegraph::Common));
+            graphResources.push_back(sharedHeapTextures1[i].Get());
+            sharedHeapTextureIds.push_back(graph.addResource(framegraph::Common));
+        }
+
+        // Prefer slots that every display's fence is already done with
+        const FanOutSlots::ReachedFunction reached = [&](uint32_t display, uint64_t value) {
+            return displays[display].frameFence->GetCompletedValue() >= value;
+        };
+
+        std::vector<UINT64> slotReadyValues(slotCount, 0);
+        std::vector<uint64_t> releaseValues;
+        float blue = 0.0f;
+
+        while (running)
+        {
+            UINT slot = 0;
+            if (!fanOut.acquire(slot, releaseValues, reached))
+            {
+                break;
+            }
+
+            // Each display only has to be done with its own copy out of the slot
+            std::vector<FenceWait<ID3D12Fence>> waits;
+            for (UINT i = 0; i < displayCount; ++i)
+            {
+                waits.push_back({displays[i].frameFence.Get(), releaseValues[i]});
+            }
+            waits.push_back({sharedFence1.Get(), slotReadyValues[slot]});
+            CHECK(fenceWaiter.wait(waits, WaitMode::All));
+            if (slotReadyValues[slot] != 0)
+            {
+                queryData1.push_back(readQueryData(readBackBuffer1, slot));
+            }
+
+            graph.beginFrame();
+            const framegraph::PassId renderPassId = graph.addPass(graphDirectQueue, {framegraph::write(textureIds[slot], framegraph::RenderTarget)});
+            const framegraph::PassId copyPassId = graph.addPass(graphCopyQueue, {framegraph::read(textureIds[slot], framegraph::CopySource), framegraph::write(sharedHeapTextureIds[slot], framegraph::CopyDest)});
+            const framegraph::CompiledFrame compiled = graph.compile();
+            CHECK(compiled.errors.empty());
+            const framegraph::CompiledPass& renderPass = compiled.passes[renderPassId];
+            const framegraph::CompiledPass& copyPass = compiled.passes[copyPassId];
+
+            CHECK_HR(commandAllocators1[slot]->Reset());
+            CHECK_HR(list1->Reset(commandAllocators1[slot].Get(), nullptr));
+            recordBarriers(list1, renderPass.barriersBefore, graphResources);
+
+            blue = blue > 1.0f ? 0.0f : blue + 0.01f;
+            float clearColor[4] = {0.0f, 0.2f, blue, 1.0f};
+            CD3DX12_CPU_DESCRIPTOR_HANDLE textureRtv = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap1->GetCPUDescriptorHandleForHeapStart(), slot, rtvDescriptorSize1);
+            list1->ClearRenderTargetView(textureRtv, clearColor, 0, nullptr);
+            recordBarriers(list1, renderPass.barriersAfter, graphResources);
+            CHECK_HR(list1->Close());
+
+            {
+                ID3D12CommandList* commandLists[] = {list1.Get()};
+                directQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
+                if (renderPass.signalIndex > 0)
+                {
+                    CHECK_HR(directQueue1->Signal(renderFence.Get(), renderFenceValue + renderPass.signalIndex - 1));
+                }
+            }
+
+            // Wait for the render to be completed
+            for (const framegraph::QueueWait& wait : copyPass.waits)
+            {
+                CHECK(wait.queue == graphDirectQueue);
+                CHECK_HR(copyQueue1->Wait(renderFence.Get(), renderFenceValue + wait.signalIndex - 1));
+            }
+            renderFenceValue += compiled.signalCounts[graphDirectQueue];
+
+            // Copy the result to the shared heap
+            CHECK_HR(copyCommandAllocators1[slot]->Reset());
+            CHECK_HR(copyList1->Reset(copyCommandAllocators1[slot].Get(), nullptr));
+
+            const UINT queryIndex = slot * 2;
+            copyList1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+
+            D3D12_RESOURCE_DESC textureDesc = textures[slot]->GetDesc();
+            D3D12_PLACED_SUBRESOURCE_FOOTPRINT renderTargetLayout;
+            device1->GetCopyableFootprints(&textureDesc, 0, 1, 0, &renderTargetLayout, nullptr, nullptr, nullptr);
+
+            CD3DX12_TEXTURE_COPY_LOCATION dest(sharedHeapTextures1[slot].Get(), renderTargetLayout);
+            CD3DX12_TEXTURE_COPY_LOCATION src(textures[slot].Get(), 0);
+            CD3DX12_BOX box(0, 0, c_width, c_height);
+            copyList1->CopyTextureRegion(&dest, 0, 0, 0, &src, &box);
+
+            copyList1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+            copyList1->ResolveQueryData(
+                queryHeap1.Get(),
+                D3D12_QUERY_TYPE_TIMESTAMP,
+                queryIndex, // Start index
+                2, // Number of queries
+                readBackBuffer1.Get(),
+                queryIndex * sizeof(UINT64)); // Destination buffer offset
+            CHECK_HR(copyList1->Close());
+
+            {
+                ID3D12CommandList* commandLists[] = {copyList1.Get()};
+                copyQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
+                CHECK_HR(copyQueue1->Signal(sharedFence1.Get(), sharedFenceValue));
+            }
+
+            slotReadyValues[slot] = sharedFenceValue;
+            fanOut.publish(slot, sharedFenceValue);
+            ++sharedFenceValue;
+        }
+    });
+
+    std::vector<std::thread> consumerThreads;
+    for (UINT displayIndex = 0; displayIndex < displayCount; ++displayIndex)
+    {
+        consumerThreads.emplace_back([&, displayIndex] {
+            // Copy the newest frame from the shared heap to the back buffer and present
+            Display& display = displays[displayIndex];
+
+            framegraph::FrameGraph graph;
+            const framegraph::QueueId graphDirectQueue = graph.addQueue(display.adapterIndex, framegraph::QueueType::Direct);
+            std::vector<ID3D12Resource*> graphResources;
+            std::vector<framegraph::ResourceId> backBufferIds;
+            for (UINT i = 0; i < c_swapChainFrameCount; ++i)
+            {
+                graphResources.push_back(display.backBuffers[i].Get());
+                backBufferIds.push_back(graph.addResource(framegraph::Present));
+            }
+
+            FanOutFrame frame{};
+            while (fanOut.take(displayIndex, frame))
+            {
+                const UINT frameIndex = display.swapChain->GetCurrentBackBufferIndex();
+                if (display.frameFenceValues[frameIndex] != 0)
+                {
+                    CHECK(fenceWaiter.wait(display.frameFence.Get(), display.frameFenceValues[frameIndex]));
+                    display.queryData.push_back(readQueryData(display.readBackBuffer, frameIndex));
+                }
+
+                graph.beginFrame();
+                const framegraph::PassId copyPassId = graph.addPass(graphDirectQueue, {framegraph::write(backBufferIds[frameIndex], framegraph::CopyDest)});
+                graph.setFinalState(backBufferIds[frameIndex], framegraph::Present);
+                const framegraph::CompiledFrame compiled = graph.compile();
+                CHECK(compiled.errors.empty());
+                const framegraph::CompiledPass& copyPass = compiled.passes[copyPassId];
+
+                CHECK_HR(display.commandAllocators[frameIndex]->Reset());
+                CHECK_HR(display.list->Reset(display.commandAllocators[frameIndex].Get(), nullptr));
+
+                ID3D12Resource* backBuffer = display.backBuffers[frameIndex].Get();
+                recordBarriers(display.list, copyPass.barriersBefore, graphResources);
+
+                D3D12_RESOURCE_DESC backBufferTextureDesc = backBuffer->GetDesc();
+                D3D12_PLACED_SUBRESOURCE_FOOTPRINT textureLayout;
+                display.device->GetCopyableFootprints(&backBufferTextureDesc, 0, 1, 0, &textureLayout, nullptr, nullptr, nullptr);
+
+                CD3DX12_TEXTURE_COPY_LOCATION dest(backBuffer, 0);
+                CD3DX12_TEXTURE_COPY_LOCATION src(display.sharedHeapTextures[frame.slot].Get(), textureLayout);
+                CD3DX12_BOX box(0, 0, c_width, c_height);
+                const UINT queryIndex = frameIndex * 2;
+                display.list->EndQuery(display.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+                display.list->CopyTextureRegion(&dest, 0, 0, 0, &src, &box);
+                display.list->EndQuery(display.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+
+                recordBarriers(display.list, copyPass.barriersAfter, graphResources);
+
+                display.list->ResolveQueryData(
+                    display.queryHeap.Get(),
+                    D3D12_QUERY_TYPE_TIMESTAMP,
+                    queryIndex, // Start index
+                    2, // Number of queries
+                    display.readBackBuffer.Get(),
+                    queryIndex * sizeof(UINT64)); // Destination buffer offset
+                CHECK_HR(display.list->Close());
+
+                // Wait for the copy to the shared heap to be completed
+                CHECK_HR(display.directQueue->Wait(display.sharedFence.Get(), frame.readyValue));
+                ID3D12CommandList* commandLists[] = {display.list.Get()};
+                display.directQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
+                CHECK_HR(display.directQueue->Signal(display.frameFence.Get(), display.presentFenceValue));
+                display.frameFenceValues[frameIndex] = display.presentFenceValue;
+
+                // The slot is handed back as soon as the copy is queued, the producer
+                // waits for this display's fence before it writes the slot again
+                fanOut.release(displayIndex, frame.slot, display.presentFenceValue);
+                ++display.presentFenceValue;
+
+                display.swapChain->Present(1, 0);
+
+                pacing::PresentSample presentSample{};
+                if (pacing::sampleSwapChain(display.swapChain.Get(), presentSample))
+                {
+                    display.presentSamples.push_back(presentSample);
+                }
+            }
+        });
+    }
+
+    MSG msg = {};
+    while (GetMessage(&msg, nullptr, 0, 0) > 0)
+    {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    running = false;
+    fanOut.stop();
+    producerThread.join();
+    for (std::thread& consumerThread : consumerThreads)
+    {
+        consumerThread.join();
+    }
+
+    // Wait for every adapter, including frames that were copied to the shared heap but never consumed
+    std::vector<FenceWait<ID3D12Fence>> idleWaits;
+    for (const Display& display : displays)
+    {
+        for (UINT64 frameFenceValue : display.frameFenceValues)
+        {
+            idleWaits.push_back({display.frameFence.Get(), frameFenceValue});
+        }
+    }
+    idleWaits.push_back({sharedFence1.Get(), sharedFenceValue - 1});
+    CHECK(fenceWaiter.wait(idleWaits, WaitMode::All));
+
+    double copyTimeTotal1 = 0.0;
+    for (const QueryData& q : queryData1)
+    {
+        double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / timestampFrequencyCopyQueue;
+        copyTimeTotal1 += elapsedTimeInSeconds;
+    }
+
+    const double qpcFrequency = pacing::qpcFrequency();
+
+    std::ofstream myfile;
+    myfile.open("dx12fanoutout.txt");
+    myfile << "Displays: " << displayCount << ", published frames: " << fanOut.publishedFrames() << std::endl
+           << "Average copy times" << std::endl
+           << "1: " << (copyTimeTotal1 / queryData1.size() * 1000.0) << "ms" << std::endl;
+    for (UINT i = 0; i < displayCount; ++i)
+    {
+        const Display& display = displays[i];
+        double copyTimeTotal = 0.0;
+        for (const QueryData& q : display.queryData)
+        {
+            double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / display.timestampFrequency;
+            copyTimeTotal += elapsedTimeInSeconds;
+        }
+        myfile << display.adapterIndex << ": " << (copyTimeTotal / display.queryData.size() * 1000.0) << "ms, skipped frames: " << fanOut.skippedFrames(i) << std::endl;
+    }
+    for (const Display& display : displays)
+    {
+        myfile << "Display " << display.adapterIndex << std::endl;
+        pacing::writeReport(myfile, pacing::analyze(display.presentSamples, qpcFrequency));
+
+        std::ofstream traceFile("dx12fanoutpresent" + std::to_string(display.adapterIndex) + ".txt");
+        pacing::writeTrace(traceFile, display.presentSamples, qpcFrequency);
+    }
+    myfile.close();
+
+    return 0;
+}
\ No newline at end of file
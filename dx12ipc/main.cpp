@@ -0,0 +1,928 @@
+#include <d3d12.h>
+#include <d3dx12.h>
+#include <dxgi1_4.h>
+#include <comdef.h>
+#include <wrl/client.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#include "IpcChannel.hpp"
+#include "FenceWaiter.hpp"
+#include "FrameGraph.hpp"
+#include "FramePacing.hpp"
+
+using Microsoft::WRL::ComPtr;
+
+#define CHECK(f)                                                                                      \
+    do                                                                                                \
+    {                                                                                                 \
+        if (!(f))                                                                                     \
+        {                                                                                             \
+            std::cerr << "Terminate. " << #f << " failed at " << __FILE__ << ":" << __LINE__ << "\n"; \
+            std::terminate();                                                                         \
+        }                                                                                             \
+    } while (false)
+
+#define CHECK_HR(f)                                                                                   \
+    do                                                                                                \
+    {                                                                                                 \
+        HRESULT hr = f;                                                                               \
+        if (FAILED((hr)))                                                                             \
+        {                                                                                             \
+            std::cerr << "Terminate. " << #f << " failed at " << __FILE__ << ":" << __LINE__ << "\n"; \
+            std::cerr << _com_error(hr).ErrorMessage() << std::endl;                                  \
+            std::terminate();                                                                         \
+        }                                                                                             \
+    } while (false)
+
+const int c_width = 7680;
+const int c_height = 3744;
+const UINT c_swapChainFrameCount = 3;
+const UINT c_framesInFlight = 3; // Render and transfer slots, independent of the back buffers
+DXGI_FORMAT c_format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+const CD3DX12_RESOURCE_DESC c_textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+    c_format,
+    c_width,
+    c_height,
+    1u, // array size
+    1u, // mip
+    1, // count
+    0, // quality
+    D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+    D3D12_TEXTURE_LAYOUT_UNKNOWN,
+    0u);
+
+struct QueryData
+{
+    UINT64 start;
+    UINT64 end;
+};
+
+UINT align(UINT size, UINT alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+void enableConsole()
+{
+    AllocConsole();
+    FILE* dummy;
+    freopen_s(&dummy, "CONOUT$", "w", stdout);
+    freopen_s(&dummy, "CONOUT$", "w", stderr);
+    freopen_s(&dummy, "CONIN$", "r", stdin);
+
+    std::cout.clear();
+    std::clog.clear();
+    std::cerr.clear();
+    std::cin.clear();
+}
+
+LRESULT CALLBACK windowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    switch (uMsg)
+    {
+    case WM_KEYDOWN:
+        if (wParam == VK_ESCAPE)
+        {
+            PostQuitMessage(0);
+        }
+        return 0;
+    case WM_DESTROY:
+        PostQuitMessage(0);
+        return 0;
+
+    default:
+        return DefWindowProc(hwnd, uMsg, wParam, lParam);
+    }
+}
+
+HWND createRenderWindow(HINSTANCE hInstance, int nCmdShow)
+{
+    const LPCSTR windowClassName = "DX11WindowClass";
+    const LPCSTR windowTitle = "DirectX 11 Window";
+
+    WNDCLASSEX wc{};
+    wc.cbSize = sizeof(WNDCLASSEX);
+    wc.style = CS_HREDRAW | CS_VREDRAW;
+    wc.lpfnWndProc = windowProc;
+    wc.hInstance = hInstance;
+    wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+    wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+    wc.lpszClassName = windowClassName;
+
+    CHECK(RegisterClassEx(&wc));
+
+    RECT rect = {0, 0, c_width, c_height};
+    AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW, FALSE);
+
+    HWND hwnd = CreateWindowEx(
+        0, // Optional window styles
+        windowClassName, // Window class name
+        windowTitle, // Window title
+        WS_OVERLAPPEDWINDOW, // Window style
+        CW_USEDEFAULT,
+        CW_USEDEFAULT, // Position
+        rect.right - rect.left, // Width
+        rect.bottom - rect.top, // Height
+        nullptr, // Parent window
+        nullptr, // Menu
+        hInstance, // Instance handle
+        nullptr // Additional application data
+    );
+
+    CHECK(hwnd);
+
+    ShowWindow(hwnd, nCmdShow);
+    UpdateWindow(hwnd);
+
+    return hwnd;
+}
+
+ComPtr<IDXGIFactory4> createFactory()
+{
+    UINT dxgiFactoryFlags = 0;
+#if defined(_DEBUG)
+    { // Enable the debug layer (requires the Graphics Tools "optional feature").
+        ComPtr<ID3D12Debug> debugController;
+        if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+        {
+            debugController->EnableDebugLayer();
+            dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+        }
+    }
+#endif
+
+    ComPtr<IDXGIFactory4> factory;
+    CHECK_HR(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+    return factory;
+}
+
+std::vector<ComPtr<IDXGIAdapter>> getAdapters(IDXGIFactory4* factory)
+{
+    UINT i = 0;
+    IDXGIAdapter* adapter;
+    std::vector<ComPtr<IDXGIAdapter>> adapters;
+    while (factory->EnumAdapters(i, &adapter) != DXGI_ERROR_NOT_FOUND)
+    {
+        adapters.push_back(adapter);
+        ++i;
+    }
+    return adapters;
+}
+
+void printAdapters(std::vector<ComPtr<IDXGIAdapter>>& adapters)
+{
+    int i = 0;
+    for (ComPtr<IDXGIAdapter> adapter : adapters)
+    {
+        DXGI_ADAPTER_DESC desc;
+        adapter->GetDesc(&desc);
+
+        std::wcout << "Adapter " << i << ": " << desc.Description << "\n";
+        ++i;
+    }
+}
+
+ComPtr<ID3D12Device> createDevice(ComPtr<IDXGIAdapter> adapter)
+{
+    ComPtr<ID3D12Device> device;
+    CHECK_HR(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device)));
+    return device;
+}
+
+bool isCrossAdapterSupported(ComPtr<ID3D12Device> device)
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+    CHECK_HR(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, reinterpret_cast<void*>(&options), sizeof(options)));
+    return options.CrossAdapterRowMajorTextureSupported;
+}
+
+ComPtr<ID3D12CommandQueue> createCommandQueue(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc{};
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    queueDesc.Type = type;
+
+    ComPtr<ID3D12CommandQueue> queue;
+
+    CHECK_HR(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&queue)));
+    return queue;
+}
+
+ComPtr<IDXGISwapChain3> createSwapChain(ComPtr<IDXGIFactory4> factory, ComPtr<ID3D12CommandQueue> queue, HWND hwnd, UINT bufferCount)
+{
+    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+    swapChainDesc.BufferCount = bufferCount;
+    swapChainDesc.Width = c_width;
+    swapChainDesc.Height = c_height;
+    swapChainDesc.Format = c_format;
+    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+    swapChainDesc.SampleDesc.Count = 1;
+
+    ComPtr<IDXGISwapChain1> swapChain;
+    CHECK_HR(factory->CreateSwapChainForHwnd(
+        queue.Get(),
+        hwnd,
+        &swapChainDesc,
+        nullptr,
+        nullptr,
+        &swapChain));
+
+    ComPtr<IDXGISwapChain3> swapChain3;
+    CHECK_HR(swapChain.As(&swapChain3));
+    return swapChain3;
+}
+
+std::vector<ComPtr<ID3D12Resource>> getBackBuffers(ComPtr<IDXGISwapChain3> swapChain, UINT count)
+{
+    std::vector<ComPtr<ID3D12Resource>> backBuffers(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(swapChain->GetBuffer(i, IID_PPV_ARGS(&backBuffers[i])));
+    }
+    return backBuffers;
+}
+
+ComPtr<ID3D12DescriptorHeap> createRtvHeap(ComPtr<ID3D12Device> device, UINT count)
+{
+    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{};
+    rtvHeapDesc.NumDescriptors = count;
+    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+
+    ComPtr<ID3D12DescriptorHeap> heap;
+    CHECK_HR(device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&heap)));
+    return heap;
+}
+
+std::vector<ComPtr<ID3D12Resource>> createTextures(ComPtr<ID3D12Device> device, UINT count)
+{
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &c_textureDesc,
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&textures[i])));
+    }
+    return textures;
+}
+
+std::vector<ComPtr<ID3D12Resource>> createSharedTextures(ComPtr<ID3D12Device> device, UINT count)
+{
+    CD3DX12_RESOURCE_DESC textureDesc = c_textureDesc;
+    textureDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_CROSS_ADAPTER;
+    textureDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+    std::vector<ComPtr<ID3D12Resource>> textures(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_SHARED | D3D12_HEAP_FLAG_SHARED_CROSS_ADAPTER,
+            &textureDesc,
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&textures[i])));
+    }
+    return textures;
+}
+
+void createRtvs(ComPtr<ID3D12Device> device, ComPtr<ID3D12DescriptorHeap> heap, const std::vector<ComPtr<ID3D12Resource>>& textures)
+{
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(heap->GetCPUDescriptorHandleForHeapStart());
+    const UINT rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        device->CreateRenderTargetView(textures[i].Get(), nullptr, rtvHandle);
+        rtvHandle.Offset(1, rtvDescriptorSize);
+    }
+}
+
+std::vector<HANDLE> createSharedTextureHandles(ComPtr<ID3D12Device> device, std::vector<ComPtr<ID3D12Resource>> textures)
+{
+    std::vector<HANDLE> handles;
+    for (ComPtr<ID3D12Resource> texture : textures)
+    {
+        HANDLE handle = nullptr;
+        CHECK_HR(device->CreateSharedHandle(
+            texture.Get(),
+            nullptr,
+            GENERIC_ALL,
+            nullptr,
+            &handle));
+        handles.push_back(handle);
+    }
+    return handles;
+}
+
+std::vector<ComPtr<ID3D12Resource>> openSharedTextureHandles(ComPtr<ID3D12Device> device, std::vector<HANDLE> handles)
+{
+    std::vector<ComPtr<ID3D12Resource>> sharedTextures;
+    for (HANDLE handle : handles)
+    {
+        ComPtr<ID3D12Resource> tex;
+        CHECK_HR(device->OpenSharedHandle(handle, IID_PPV_ARGS(&tex)));
+        sharedTextures.push_back(tex);
+        CloseHandle(handle);
+    }
+    return sharedTextures;
+}
+
+std::vector<ComPtr<ID3D12CommandAllocator>> createCommandAllocators(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, UINT count, const std::wstring& name = L"")
+{
+    std::vector<ComPtr<ID3D12CommandAllocator>> allocators(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR(device->CreateCommandAllocator(type, IID_PPV_ARGS(&allocators[i])));
+        if (!name.empty())
+        {
+            std::wstring wn = name + std::to_wstring(i);
+            allocators[i]->SetName(wn.c_str());
+        }
+    }
+    return allocators;
+}
+
+ComPtr<ID3D12GraphicsCommandList> createCommandList(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, ComPtr<ID3D12CommandAllocator> allocator, const std::wstring& name = L"")
+{
+    ComPtr<ID3D12GraphicsCommandList> list;
+    CHECK_HR(device->CreateCommandList(0, type, allocator.Get(), nullptr, IID_PPV_ARGS(&list)));
+    if (!name.empty())
+    {
+        list->SetName(name.c_str());
+    }
+    return list;
+}
+
+
+ComPtr<ID3D12Fence> createFence(ComPtr<ID3D12Device> device, D3D12_FENCE_FLAGS flags)
+{
+    ComPtr<ID3D12Fence> fence;
+    CHECK_HR(device->CreateFence(1, flags, IID_PPV_ARGS(&fence)));
+    return fence;
+}
+
+HANDLE createSharedFenceHandle(ComPtr<ID3D12Device> device, ComPtr<ID3D12Fence> fence)
+{
+    HANDLE fenceHandle = nullptr;
+    CHECK_HR(device->CreateSharedHandle(
+        fence.Get(),
+        nullptr,
+        GENERIC_ALL,
+        nullptr,
+        &fenceHandle));
+
+    return fenceHandle;
+}
+
+ComPtr<ID3D12Fence> openSharedFenceHandle(ComPtr<ID3D12Device> device, HANDLE handle)
+{
+    ComPtr<ID3D12Fence> sharedFence;
+    CHECK_HR(device->OpenSharedHandle(handle, IID_PPV_ARGS(&sharedFence)));
+    return sharedFence;
+}
+
+ComPtr<ID3D12QueryHeap> createQueryHeap(ComPtr<ID3D12Device> device, D3D12_QUERY_HEAP_TYPE type, UINT count)
+{
+    D3D12_QUERY_HEAP_DESC queryHeapDesc{};
+    queryHeapDesc.Count = count; // Start and end timestamp pairs
+    queryHeapDesc.Type = type;
+
+    ComPtr<ID3D12QueryHeap> queryHeap;
+    device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap));
+    return queryHeap;
+}
+
+ComPtr<ID3D12Resource> createReadbackBuffer(ComPtr<ID3D12Device> device, UINT count)
+{
+    CD3DX12_HEAP_PROPERTIES readbackHeapProps(D3D12_HEAP_TYPE_READBACK);
+    CD3DX12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * count);
+
+    ComPtr<ID3D12Resource> readbackBuffer;
+    device->CreateCommittedResource(
+        &readbackHeapProps,
+        D3D12_HEAP_FLAG_NONE,
+        &readbackBufferDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&readbackBuffer));
+    return readbackBuffer;
+}
+
+QueryData readQueryData(ComPtr<ID3D12Resource> readbackBuffer, UINT slot)
+{
+    const D3D12_RANGE range{slot * 2 * sizeof(UINT64), (slot + 1) * 2 * sizeof(UINT64)};
+    UINT64* mappedData = nullptr;
+    CHECK_HR(readbackBuffer->Map(0, &range, reinterpret_cast<void**>(&mappedData)));
+    QueryData queryData{};
+    queryData.start = mappedData[slot * 2];
+    queryData.end = mappedData[slot * 2 + 1];
+    const D3D12_RANGE writtenRange{0, 0};
+    readbackBuffer->Unmap(0, &writtenRange);
+    return queryData;
+}
+
+// Reads a positive count given as e.g. --frames-in-flight=4 on the command line
+UINT parseCountOption(const std::wstring& commandLine, const std::wstring& name, UINT defaultValue)
+{
+    const size_t position = commandLine.find(name);
+    if (position == std::wstring::npos)
+    {
+        return defaultValue;
+    }
+    const UINT value = static_cast<UINT>(wcstoul(commandLine.c_str() + position + name.size(), nullptr, 10));
+    return value > 0 ? value : defaultValue;
+}
+
+D3D12_RESOURCE_STATES toD3D12State(uint32_t state)
+{
+    D3D12_RESOURCE_STATES d3d12State = D3D12_RESOURCE_STATE_COMMON;
+    if (state & framegraph::RenderTarget)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_RENDER_TARGET;
+    }
+    if (state & framegraph::CopySource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_SOURCE;
+    }
+    if (state & framegraph::CopyDest)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_COPY_DEST;
+    }
+    if (state & framegraph::ShaderResource)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    }
+    if (state & framegraph::UnorderedAccess)
+    {
+        d3d12State |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    }
+    return d3d12State;
+}
+
+// Records one batch of frame graph barriers with a single ResourceBarrier call
+void recordBarriers(ComPtr<ID3D12GraphicsCommandList> list, const std::vector<framegraph::Barrier>& barriers, const std::vector<ID3D12Resource*>& resources)
+{
+    if (barriers.empty())
+    {
+        return;
+    }
+    std::vector<D3D12_RESOURCE_BARRIER> d3d12Barriers;
+    d3d12Barriers.reserve(barriers.size());
+    for (const framegraph::Barrier& barrier : barriers)
+    {
+        d3d12Barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resources[barrier.resource], toD3D12State(barrier.before), toD3D12State(barrier.after)));
+    }
+    list->ResourceBarrier(static_cast<UINT>(d3d12Barriers.size()), d3d12Barriers.data());
+}
+
+
+// The consumer process id keeps the pipes of concurrent runs apart
+std::wstring ipcPipeName(UINT consumerProcessId)
+{
+    return L"\\\\.\\pipe\\mgpu-ipc-" + std::to_wstring(consumerProcessId);
+}
+
+// Render (=clear) on adapter 1 and copy the result to the shared textures that the consumer process reads
+int runProducer(const std::wstring& commandLine)
+{
+    const UINT consumerProcessId = parseCountOption(commandLine, L"--consumer-pid=", 0);
+    const UINT framesInFlight = parseCountOption(commandLine, L"--frames-in-flight=", c_framesInFlight);
+    CHECK(consumerProcessId != 0);
+
+    ComPtr<IDXGIFactory4> factory = createFactory();
+    std::vector<ComPtr<IDXGIAdapter>> adapters = getAdapters(factory.Get());
+    printAdapters(adapters);
+    CHECK(adapters.size() >= 2);
+
+    ComPtr<ID3D12Device> device1 = createDevice(adapters[1]);
+    std::cout << "1: isCrossAdapterSupported = " << isCrossAdapterSupported(device1) << std::endl;
+
+    ComPtr<ID3D12CommandQueue> directQueue1 = createCommandQueue(device1, D3D12_COMMAND_LIST_TYPE_DIRECT);
+    std::vector<ComPtr<ID3D12Resource>> textures1 = createTextures(device1, framesInFlight);
+    ComPtr<ID3D12DescriptorHeap> rtvHeap1 = createRtvHeap(device1, framesInFlight);
+    createRtvs(device1, rtvHeap1, textures1);
+    std::vector<ComPtr<ID3D12Resource>> sharedTextures1 = createSharedTextures(device1, framesInFlight);
+
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators1 = createCommandAllocators(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, framesInFlight, L"allocator1_");
+    ComPtr<ID3D12GraphicsCommandList> list1 = createCommandList(device1, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators1[0], L"list1");
+    CHECK_HR(list1->Close());
+
+    ComPtr<ID3D12Fence> sharedFence1 = createFence(device1, D3D12_FENCE_FLAG_SHARED | D3D12_FENCE_FLAG_SHARED_CROSS_ADAPTER);
+    UINT64 sharedFenceValue = 2;
+
+    const UINT queryCount1 = framesInFlight * 2;
+    ComPtr<ID3D12QueryHeap> queryHeap1 = createQueryHeap(device1, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, queryCount1);
+    ComPtr<ID3D12Resource> readBackBuffer1 = createReadbackBuffer(device1, queryCount1);
+    UINT64 timestampFrequency1 = 0;
+    directQueue1->GetTimestampFrequency(&timestampFrequency1);
+    const UINT rtvDescriptorSize1 = device1->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+    // The handles are duplicated into the consumer, which closes its copies once it has opened them
+    HANDLE consumerProcess = OpenProcess(PROCESS_DUP_HANDLE, FALSE, consumerProcessId);
+    CHECK(consumerProcess);
+    HANDLE pipe = connectIpcPipe(ipcPipeName(consumerProcessId));
+    CHECK(pipe);
+    IpcChannel channel(pipe, consumerProcess);
+
+    std::vector<HANDLE> sharedTextureHandles = createSharedTextureHandles(device1, sharedTextures1);
+    for (UINT i = 0; i < framesInFlight; ++i)
+    {
+        CHECK(channel.sendHandle(i, sharedTextureHandles[i]));
+        CloseHandle(sharedTextureHandles[i]);
+    }
+    HANDLE sharedFenceHandle = createSharedFenceHandle(device1, sharedFence1);
+    CHECK(channel.sendHandle(framesInFlight, sharedFenceHandle));
+    CloseHandle(sharedFenceHandle);
+
+    // The consumer signals this after its last copy out of a slot
+    uint32_t handleIndex = 0;
+    HANDLE consumerFenceHandle = nullptr;
+    CHECK(channel.receiveHandle(handleIndex, consumerFenceHandle));
+    ComPtr<ID3D12Fence> consumerFence1 = openSharedFenceHandle(device1, consumerFenceHandle);
+    CloseHandle(consumerFenceHandle);
+
+    framegraph::FrameGraph graph;
+    const framegraph::QueueId graphQueue1 = graph.addQueue(1, framegraph::QueueType::Direct);
+    std::vector<ID3D12Resource*> graphResources;
+    std::vector<framegraph::ResourceId> textureIds1;
+    std::vector<framegraph::ResourceId> sharedTextureIds1;
+    for (UINT i = 0; i < framesInFlight; ++i)
+    {
+        graphResources.push_back(textures1[i].Get());
+        textureIds1.push_back(graph.addResource(framegraph::Common));
+        graphResources.push_back(sharedTextures1[i].Get());
+        sharedTextureIds1.push_back(graph.addResource(framegraph::Common));
+    }
+
+    // All CPU waits on GPU work go through this
+    FenceWaiter<ID3D12Fence> fenceWaiter;
+    IpcSlotOwnership slots(framesInFlight);
+    std::vector<UINT64> slotReadyValues(framesInFlight, 0);
+    std::vector<QueryData> queryData1;
+    bool running = true;
+    float blue = 0.0f;
+
+    auto handleMessage = [&](const IpcMessage& message) {
+        if (message.type == IpcMessageType::Stop)
+        {
+            running = false;
+            return;
+        }
+        CHECK(message.type == IpcMessageType::SlotReleased);
+        CHECK(slots.release(message.index, message.value));
+    };
+
+    while (running)
+    {
+        // Take back every slot the consumer is done with, block only when it holds all of them
+        IpcMessage message{};
+        while (channel.available() && channel.receive(message))
+        {
+            handleMessage(message);
+        }
+        uint32_t slot = 0;
+        uint64_t releaseValue = 0;
+        while (running && !slots.acquire(slot, releaseValue))
+        {
+            if (!channel.receive(message))
+            {
+                running = false;
+                break;
+            }
+            handleMessage(message);
+        }
+        if (!running)
+        {
+            break;
+        }
+
+        if (slotReadyValues[slot] != 0)
+        {
+            CHECK(fenceWaiter.wait(sharedFence1.Get(), slotReadyValues[slot]));
+            queryData1.push_back(readQueryData(readBackBuffer1, slot));
+        }
+
+        graph.beginFrame();
+        const framegraph::PassId renderPassId = graph.addPass(graphQueue1, {framegraph::write(textureIds1[slot], framegraph::RenderTarget)});
+        const framegraph::PassId copyPassId = graph.addPass(graphQueue1, {framegraph::read(textureIds1[slot], framegraph::CopySource), framegraph::write(sharedTextureIds1[slot], framegraph::CopyDest)});
+        // The consumer reads the shared texture in the common state
+        graph.setFinalState(sharedTextureIds1[slot], framegraph::Common);
+        const framegraph::CompiledFrame compiled = graph.compile();
+        CHECK(compiled.errors.empty());
+        const framegraph::CompiledPass& renderPass = compiled.passes[renderPassId];
+        const framegraph::CompiledPass& copyPass = compiled.passes[copyPassId];
+
+        CHECK_HR(commandAllocators1[slot]->Reset());
+        CHECK_HR(list1->Reset(commandAllocators1[slot].Get(), nullptr));
+        recordBarriers(list1, renderPass.barriersBefore, graphResources);
+
+        blue = blue > 1.0f ? 0.0f : blue + 0.01f;
+        float clearColor[4] = {0.0f, 0.2f, blue, 1.0f};
+        CD3DX12_CPU_DESCRIPTOR_HANDLE textureRtv = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap1->GetCPUDescriptorHandleForHeapStart(), slot, rtvDescriptorSize1);
+        list1->ClearRenderTargetView(textureRtv, clearColor, 0, nullptr);
+
+        recordBarriers(list1, renderPass.barriersAfter, graphResources);
+        recordBarriers(list1, copyPass.barriersBefore, graphResources);
+
+        const UINT queryIndex = slot * 2;
+        list1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+        list1->CopyResource(sharedTextures1[slot].Get(), textures1[slot].Get());
+        list1->EndQuery(queryHeap1.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+        recordBarriers(list1, copyPass.barriersAfter, graphResources);
+
+        list1->ResolveQueryData(
+            queryHeap1.Get(),
+            D3D12_QUERY_TYPE_TIMESTAMP,
+            queryIndex, // Start index
+            2, // Number of queries
+            readBackBuffer1.Get(),
+            queryIndex * sizeof(UINT64)); // Destination buffer offset
+        CHECK_HR(list1->Close());
+
+        // The consumer's copy out of the slot has to finish before the slot is written again
+        if (releaseValue != 0)
+        {
+            CHECK_HR(directQueue1->Wait(consumerFence1.Get(), releaseValue));
+        }
+        ID3D12CommandList* commandLists[] = {list1.Get()};
+        directQueue1->ExecuteCommandLists(_countof(commandLists), commandLists);
+        CHECK_HR(directQueue1->Signal(sharedFence1.Get(), sharedFenceValue));
+
+        CHECK(slots.handOver(slot));
+        if (!channel.send(IpcMessageType::FrameReady, slot, sharedFenceValue))
+        {
+            running = false;
+        }
+        slotReadyValues[slot] = sharedFenceValue;
+        ++sharedFenceValue;
+    }
+
+    CHECK(fenceWaiter.wait(sharedFence1.Get(), sharedFenceValue - 1));
+    CloseHandle(pipe);
+    CloseHandle(consumerProcess);
+
+    double copyTimeTotal1 = 0.0;
+    for (const QueryData& q : queryData1)
+    {
+        double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / timestampFrequency1;
+        copyTimeTotal1 += elapsedTimeInSeconds;
+    }
+
+    std::ofstream myfile;
+    myfile.open("dx12ipcproducerout.txt");
+    myfile << "Frames in flight: " << framesInFlight << std::endl
+           << "Average copy time" << std::endl
+           << "1: " << (copyTimeTotal1 / queryData1.size() * 1000.0) << "ms" << std::endl
+           << "IPC FrameReady send: " << (channel.averageSendTime() * 1000000.0) << "us" << std::endl
+           << "IPC SlotReleased latency: " << (channel.averageLatency() * 1000000.0) << "us" << std::endl;
+    myfile.close();
+
+    return 0;
+}
+
+// Show the frames of the producer process on adapter 0
+int runConsumer(HINSTANCE hInstance, int nCmdShow, const std::wstring& commandLine)
+{
+    HWND hwnd = createRenderWindow(hInstance, nCmdShow);
+    const UINT framesInFlight = parseCountOption(commandLine, L"--frames-in-flight=", c_framesInFlight);
+
+    ComPtr<IDXGIFactory4> factory = createFactory();
+    std::vector<ComPtr<IDXGIAdapter>> adapters = getAdapters(factory.Get());
+    printAdapters(adapters);
+    CHECK(adapters.size() >= 2);
+
+    ComPtr<ID3D12Device> device0 = createDevice(adapters[0]);
+    std::cout << "0: isCrossAdapterSupported = " << isCrossAdapterSupported(device0) << std::endl;
+
+    ComPtr<ID3D12CommandQueue> directQueue0 = createCommandQueue(device0, D3D12_COMMAND_LIST_TYPE_DIRECT);
+    ComPtr<IDXGISwapChain3> swapChain = createSwapChain(factory, directQueue0, hwnd, c_swapChainFrameCount);
+    std::vector<ComPtr<ID3D12Resource>> backBuffers = getBackBuffers(swapChain, c_swapChainFrameCount);
+
+    std::vector<ComPtr<ID3D12CommandAllocator>> commandAllocators0 = createCommandAllocators(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, c_swapChainFrameCount, L"allocator0_");
+    ComPtr<ID3D12GraphicsCommandList> list0 = createCommandList(device0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators0[0], L"list0");
+    CHECK_HR(list0->Close());
+
+    // Shared so that the producer can wait for the copies out of its slots
+    ComPtr<ID3D12Fence> frameFence = createFence(device0, D3D12_FENCE_FLAG_SHARED | D3D12_FENCE_FLAG_SHARED_CROSS_ADAPTER);
+    std::vector<UINT64> frameFenceValues(c_swapChainFrameCount, 0);
+    UINT64 presentFenceValue = 2;
+
+    const UINT queryCount0 = c_swapChainFrameCount * 2;
+    ComPtr<ID3D12QueryHeap> queryHeap0 = createQueryHeap(device0, D3D12_QUERY_HEAP_TYPE_TIMESTAMP, queryCount0);
+    ComPtr<ID3D12Resource> readBackBuffer0 = createReadbackBuffer(device0, queryCount0);
+    UINT64 timestampFrequency0 = 0;
+    directQueue0->GetTimestampFrequency(&timestampFrequency0);
+
+    // Start the producer process and wait for it to connect
+    const UINT processId = GetCurrentProcessId();
+    HANDLE pipe = createIpcPipe(ipcPipeName(processId));
+    CHECK(pipe);
+
+    wchar_t executablePath[MAX_PATH] = {};
+    CHECK(GetModuleFileNameW(nullptr, executablePath, MAX_PATH) > 0);
+    std::wstring producerCommandLine = L"\"" + std::wstring(executablePath) + L"\" --producer --consumer-pid=" + std::to_wstring(processId) + L" --frames-in-flight=" + std::to_wstring(framesInFlight);
+    STARTUPINFOW startupInfo{};
+    startupInfo.cb = sizeof(startupInfo);
+    PROCESS_INFORMATION processInfo{};
+    CHECK(CreateProcessW(nullptr, producerCommandLine.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo));
+    CHECK(acceptIpcPipe(pipe));
+    IpcChannel channel(pipe, processInfo.hProcess);
+
+    // The producer's shared textures and fence, then our frame fence the other way
+    std::vector<HANDLE> sharedTextureHandles(framesInFlight, nullptr);
+    for (UINT i = 0; i < framesInFlight; ++i)
+    {
+        uint32_t handleIndex = 0;
+        CHECK(channel.receiveHandle(handleIndex, sharedTextureHandles[i]));
+        CHECK(handleIndex == i);
+    }
+    std::vector<ComPtr<ID3D12Resource>> sharedTextures0 = openSharedTextureHandles(device0, sharedTextureHandles);
+
+    uint32_t handleIndex = 0;
+    HANDLE sharedFenceHandle = nullptr;
+    CHECK(channel.receiveHandle(handleIndex, sharedFenceHandle));
+    CHECK(handleIndex == framesInFlight);
+    ComPtr<ID3D12Fence> sharedFence0 = openSharedFenceHandle(device0, sharedFenceHandle);
+    CloseHandle(sharedFenceHandle);
+
+    HANDLE frameFenceHandle = createSharedFenceHandle(device0, frameFence);
+    CHECK(channel.sendHandle(0, frameFenceHandle));
+    CloseHandle(frameFenceHandle);
+
+    framegraph::FrameGraph graph;
+    const framegraph::QueueId graphQueue0 = graph.addQueue(0, framegraph::QueueType::Direct);
+    std::vector<ID3D12Resource*> graphResources;
+    std::vector<framegraph::ResourceId> sharedTextureIds0;
+    std::vector<framegraph::ResourceId> backBufferIds;
+    for (UINT i = 0; i < framesInFlight; ++i)
+    {
+        graphResources.push_back(sharedTextures0[i].Get());
+        sharedTextureIds0.push_back(graph.addResource(framegraph::Common));
+    }
+    for (UINT i = 0; i < c_swapChainFrameCount; ++i)
+    {
+        graphResources.push_back(backBuffers[i].Get());
+        backBufferIds.push_back(graph.addResource(framegraph::Present));
+    }
+
+    // All CPU waits on GPU work go through this
+    FenceWaiter<ID3D12Fence> fenceWaiter;
+    IpcSlotOwnership slots(framesInFlight);
+    std::vector<QueryData> queryData0;
+    std::vector<pacing::PresentSample> presentSamples;
+    bool running = true;
+
+    while (running)
+    {
+        MSG msg = {};
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT)
+            {
+                running = false;
+                break;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+
+        IpcMessage message{};
+        if (!channel.receive(message))
+        {
+            // The producer has gone away
+            break;
+        }
+        CHECK(message.type == IpcMessageType::FrameReady);
+        CHECK(slots.handOver(message.index));
+        const UINT slot = message.index;
+
+        const UINT backBufferIndex = swapChain->GetCurrentBackBufferIndex();
+        if (frameFenceValues[backBufferIndex] != 0)
+        {
+            CHECK(fenceWaiter.wait(frameFence.Get(), frameFenceValues[backBufferIndex]));
+            queryData0.push_back(readQueryData(readBackBuffer0, backBufferIndex));
+        }
+
+        graph.beginFrame();
+        const framegraph::PassId copyPassId = graph.addPass(graphQueue0, {framegraph::read(sharedTextureIds0[slot], framegraph::CopySource), framegraph::write(backBufferIds[backBufferIndex], framegraph::CopyDest)});
+        // The producer writes the shared texture again in the common state
+        graph.setFinalState(sharedTextureIds0[slot], framegraph::Common);
+        graph.setFinalState(backBufferIds[backBufferIndex], framegraph::Present);
+        const framegraph::CompiledFrame compiled = graph.compile();
+        CHECK(compiled.errors.empty());
+        const framegraph::CompiledPass& copyPass = compiled.passes[copyPassId];
+
+        CHECK_HR(commandAllocators0[backBufferIndex]->Reset());
+        CHECK_HR(list0->Reset(commandAllocators0[backBufferIndex].Get(), nullptr));
+        recordBarriers(list0, copyPass.barriersBefore, graphResources);
+
+        const UINT queryIndex = backBufferIndex * 2;
+        list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+        list0->CopyResource(backBuffers[backBufferIndex].Get(), sharedTextures0[slot].Get());
+        list0->EndQuery(queryHeap0.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+        recordBarriers(list0, copyPass.barriersAfter, graphResources);
+
+        list0->ResolveQueryData(
+            queryHeap0.Get(),
+            D3D12_QUERY_TYPE_TIMESTAMP,
+            queryIndex, // Start index
+            2, // Number of queries
+            readBackBuffer0.Get(),
+            queryIndex * sizeof(UINT64)); // Destination buffer offset
+        CHECK_HR(list0->Close());
+
+        // Wait for the producer's copy to the shared texture
+        CHECK_HR(directQueue0->Wait(sharedFence0.Get(), message.value));
+        ID3D12CommandList* commandLists[] = {list0.Get()};
+        directQueue0->ExecuteCommandLists(_countof(commandLists), commandLists);
+        CHECK_HR(directQueue0->Signal(frameFence.Get(), presentFenceValue));
+        frameFenceValues[backBufferIndex] = presentFenceValue;
+
+        // The slot goes back right away, the producer's queue waits for the fence value before writing it
+        CHECK(slots.release(slot, presentFenceValue));
+        CHECK(channel.send(IpcMessageType::SlotReleased, slot, presentFenceValue));
+        ++presentFenceValue;
+
+        swapChain->Present(1, 0);
+
+        pacing::PresentSample presentSample{};
+        if (pacing::sampleSwapChain(swapChain.Get(), presentSample))
+        {
+            presentSamples.push_back(presentSample);
+        }
+    }
+
+    // Frames that are still on their way are dropped, the pipe breaks when the producer exits
+    channel.send(IpcMessageType::Stop, 0, 0);
+    IpcMessage message{};
+    while (channel.receive(message))
+    {
+        // Drained until the producer closes its end
+    }
+    WaitForSingleObject(processInfo.hProcess, INFINITE);
+    CloseHandle(processInfo.hThread);
+    CloseHandle(processInfo.hProcess);
+    CloseHandle(pipe);
+
+    std::vector<FenceWait<ID3D12Fence>> idleWaits;
+    for (UINT64 frameFenceValue : frameFenceValues)
+    {
+        idleWaits.push_back({frameFence.Get(), frameFenceValue});
+    }
+    CHECK(fenceWaiter.wait(idleWaits, WaitMode::All));
+
+    double copyTimeTotal0 = 0.0;
+    for (const QueryData& q : queryData0)
+    {
+        double elapsedTimeInSeconds = static_cast<double>(q.end - q.start) / timestampFrequency0;
+        copyTimeTotal0 += elapsedTimeInSeconds;
+    }
+
+    const double qpcFrequency = pacing::qpcFrequency();
+
+    std::ofstream myfile;
+    myfile.open("dx12ipcout.txt");
+    myfile << "Frames in flight: " << framesInFlight << std::endl
+           << "Average copy time" << std::endl
+           << "0: " << (copyTimeTotal0 / queryData0.size() * 1000.0) << "ms" << std::endl
+           << "IPC FrameReady latency: " << (channel.averageLatency() * 1000000.0) << "us" << std::endl
+           << "IPC SlotReleased send: " << (channel.averageSendTime() * 1000000.0) << "us" << std::endl;
+    pacing::writeReport(myfile, pacing::analyze(presentSamples, qpcFrequency));
+    myfile.close();
+
+    std::ofstream traceFile("dx12ipcpresent.txt");
+    pacing::writeTrace(traceFile, presentSamples, qpcFrequency);
+    return 0;
+}
+
+int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
+{
+    /*
+    - the consumer process (started without --producer) owns the window on adapter 0
+      and starts a producer process of the same executable
+    - the producer renders (=clears) on adapter 1 and copies the result to cross adapter
+      shared textures, the handles are duplicated into the consumer over a named pipe
+    - the pipe carries the slot ownership and the fence values of both processes
+    - the consumer copies the frame to its backbuffer and presents
+    */
+    enableConsole();
+
+    const std::wstring commandLine(pCmdLine);
+    if (commandLine.find(L"--producer") != std::wstring::npos)
+    {
+        return runProducer(commandLine);
+    }
+    return runConsumer(hInstance, nCmdShow, commandLine);
+}
\ No newline at end of file
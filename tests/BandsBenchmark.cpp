@@ -0,0 +1,118 @@
+#include "Bands.hpp"
+#include "EmulatedQueue.hpp"
+#include "FenceWaiter.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Latency of the dx12 banded handoff on emulated queues, from the start of the
+// render on adapter 1 to the end of the upload on adapter 0, for a growing
+// number of bands. The queues sleep for the time of their work, the render
+// time of the bands is uneven to stand in for real content.
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+const uint32_t c_height = 3744;
+const double c_renderMs = 6.0;
+const double c_copyMs = 4.0;
+const double c_uploadMs = 4.0;
+const int c_frameCount = 12;
+
+void sleepMs(double ms)
+{
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+}
+
+double averageLatencyMs(uint32_t bandCount)
+{
+    EmulatedFence renderFence(0);
+    EmulatedFence sharedFence(0);
+    EmulatedFence frameFence(0);
+    FenceWaiter<EmulatedFence> waiter;
+    EmulatedQueue direct1;
+    EmulatedQueue copy1;
+    EmulatedQueue direct0;
+
+    std::vector<Clock::time_point> renderStart(c_frameCount);
+    std::vector<Clock::time_point> uploadEnd(c_frameCount);
+    std::mt19937 random(bandCount);
+    std::uniform_real_distribution<double> jitter(0.5, 1.5);
+
+    uint64_t renderValue = 0;
+    uint64_t sharedValue = 0;
+    for (int frame = 0; frame < c_frameCount; ++frame)
+    {
+        std::vector<double> bandMs(bandCount);
+        double total = 0.0;
+        for (double& ms : bandMs)
+        {
+            ms = jitter(random);
+            total += ms;
+        }
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            const double ms = bandMs[band] / total * c_renderMs;
+            direct1.execute([&, frame, band, bandCount, ms] {
+                if (band == 0)
+                {
+                    renderStart[frame] = Clock::now();
+                }
+                sleepMs(ms);
+            });
+            direct1.Signal(&renderFence, ++renderValue);
+        }
+
+        const uint64_t frameValue = sharedValue + bandCount;
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            const uint64_t renderBandValue = bands::bandFenceValue(renderValue, band, bandCount);
+            const bands::Rows rows = bands::bandRows(band, bandCount, c_height);
+            copy1.Wait(&renderFence, renderBandValue);
+            copy1.execute([rows] { sleepMs(c_copyMs * rows.height / c_height); });
+            copy1.Signal(&sharedFence, ++sharedValue);
+        }
+
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            const uint64_t sharedBandValue = bands::bandFenceValue(frameValue, band, bandCount);
+            const bands::Rows rows = bands::bandRows(band, bandCount, c_height);
+            direct0.Wait(&sharedFence, sharedBandValue);
+            direct0.execute([&, frame, band, bandCount, rows] {
+                sleepMs(c_uploadMs * rows.height / c_height);
+                if (band + 1 == bandCount)
+                {
+                    uploadEnd[frame] = Clock::now();
+                }
+            });
+        }
+        direct0.Signal(&frameFence, frame + 1);
+        // One frame at a time, so the latency is not mixed with queueing
+        waiter.wait({{&frameFence, static_cast<uint64_t>(frame + 1)}});
+    }
+
+    double latencyMs = 0.0;
+    for (int frame = 0; frame < c_frameCount; ++frame)
+    {
+        latencyMs += std::chrono::duration<double, std::milli>(uploadEnd[frame] - renderStart[frame]).count() / c_frameCount;
+    }
+    return latencyMs;
+}
+} // namespace
+
+int main()
+{
+    std::cout << "Render " << c_renderMs << " ms, copy " << c_copyMs << " ms, upload " << c_uploadMs << " ms per frame\n";
+    const double whole = averageLatencyMs(1);
+    for (uint32_t bandCount : {1u, 2u, 4u, 8u})
+    {
+        const double latency = averageLatencyMs(bandCount);
+        std::cout << bandCount << (bandCount == 1 ? " band: " : " bands: ") << latency << " ms (" << (latency / whole) << "x)\n";
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "Bands.hpp"
+#include "EmulatedQueue.hpp"
+#include "FenceWaiter.hpp"
+#include "Test.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// The dx12 banded handoff on emulated queues: the render queue of adapter 1
+// signals one fence value per band, its copy queue waits for each band and
+// copies it to the shared fence's timeline, and the direct queue of adapter 0
+// waits for each copied band before it uploads it.
+
+namespace
+{
+const uint32_t c_height = 3744;
+const int c_frameCount = 12;
+
+void testRows()
+{
+    for (uint32_t count : {1u, 3u, 7u, 16u})
+    {
+        uint32_t covered = 0;
+        for (uint32_t band = 0; band < count; ++band)
+        {
+            const bands::Rows rows = bands::bandRows(band, count, c_height);
+            EXPECT(rows.y == covered);
+            EXPECT(rows.height == c_height / count || rows.height == c_height / count + 1);
+            covered += rows.height;
+        }
+        EXPECT(covered == c_height);
+    }
+
+    // The last band signals the frame's value, the others the ones just before it
+    EXPECT(bands::bandFenceValue(10, 0, 1) == 10);
+    EXPECT(bands::bandFenceValue(10, 0, 4) == 7);
+    EXPECT(bands::bandFenceValue(10, 3, 4) == 10);
+}
+
+struct PipelineResult
+{
+    uint32_t outOfOrder = 0; // Bands copied or uploaded before their fence value was reached
+    uint32_t earlyStarts = 0; // Frames whose copy started before the last band was rendered
+};
+
+// With more than one band the render queue does not render band 1 until band 0
+// has been copied, which only finishes if the copy waits for band 0 alone and
+// not for the whole frame. The render value the copy sees when it starts on
+// band 0 is then independent of how the threads are scheduled.
+PipelineResult runPipeline(uint32_t bandCount)
+{
+    EmulatedFence renderFence(0);
+    EmulatedFence sharedFence(0);
+    EmulatedFence frameFence(0);
+    FenceWaiter<EmulatedFence> waiter;
+    EmulatedQueue direct1;
+    EmulatedQueue copy1;
+    EmulatedQueue direct0;
+
+    std::atomic<uint32_t> outOfOrder{0};
+    std::vector<uint64_t> renderSeenByCopy(c_frameCount);
+    std::vector<uint64_t> renderFrameValue(c_frameCount);
+
+    uint64_t renderValue = 0;
+    uint64_t sharedValue = 0;
+    for (int frame = 0; frame < c_frameCount; ++frame)
+    {
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            if (band == 1)
+            {
+                direct1.Wait(&sharedFence, sharedValue + 1);
+            }
+            direct1.execute([] {});
+            direct1.Signal(&renderFence, ++renderValue);
+        }
+        renderFrameValue[frame] = renderValue;
+
+        const uint64_t frameValue = sharedValue + bandCount;
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            const uint64_t renderBandValue = bands::bandFenceValue(renderValue, band, bandCount);
+            copy1.Wait(&renderFence, renderBandValue);
+            copy1.execute([&, frame, band, renderBandValue] {
+                const uint64_t completed = renderFence.GetCompletedValue();
+                outOfOrder += completed < renderBandValue ? 1 : 0;
+                if (band == 0)
+                {
+                    renderSeenByCopy[frame] = completed;
+                }
+            });
+            copy1.Signal(&sharedFence, ++sharedValue);
+        }
+
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            const uint64_t sharedBandValue = bands::bandFenceValue(frameValue, band, bandCount);
+            direct0.Wait(&sharedFence, sharedBandValue);
+            direct0.execute([&, sharedBandValue] { outOfOrder += sharedFence.GetCompletedValue() < sharedBandValue ? 1 : 0; });
+        }
+        direct0.Signal(&frameFence, frame + 1);
+        EXPECT(waiter.wait({{&frameFence, static_cast<uint64_t>(frame + 1)}}));
+    }
+
+    PipelineResult result;
+    result.outOfOrder = outOfOrder;
+    for (int frame = 0; frame < c_frameCount; ++frame)
+    {
+        result.earlyStarts += renderSeenByCopy[frame] < renderFrameValue[frame] ? 1 : 0;
+    }
+    return result;
+}
+
+void testPipeline()
+{
+    const PipelineResult whole = runPipeline(1);
+    EXPECT(whole.outOfOrder == 0);
+    EXPECT(whole.earlyStarts == 0);
+    for (uint32_t bandCount : {2u, 4u, 7u})
+    {
+        const PipelineResult banded = runPipeline(bandCount);
+        EXPECT(banded.outOfOrder == 0);
+        // Band 0 is copied while the later bands are still to be rendered
+        EXPECT(banded.earlyStarts == c_frameCount);
+    }
+}
+} // namespace
+
+int main()
+{
+    testRows();
+    testPipeline();
+    return test::result();
+}
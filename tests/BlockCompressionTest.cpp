@@ -0,0 +1,164 @@
+#include "BlockCompression.hpp"
+#include "Test.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace blockcompression;
+
+namespace
+{
+// A smooth frame with a little noise, alpha ramps across it
+std::vector<uint8_t> makeFrame(uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+    std::vector<uint8_t> rgba(static_cast<size_t>(rowPitch) * height, 0);
+    uint32_t noise = 1;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            noise = noise * 1664525 + 1013904223;
+            uint8_t* pixel = rgba.data() + static_cast<size_t>(y) * rowPitch + x * 4;
+            pixel[0] = static_cast<uint8_t>(x * 255 / width);
+            pixel[1] = static_cast<uint8_t>(y * 255 / height);
+            pixel[2] = static_cast<uint8_t>(128 + ((noise >> 24) & 7));
+            pixel[3] = static_cast<uint8_t>(255 - x * 128 / width);
+        }
+    }
+    return rgba;
+}
+
+std::vector<uint8_t> decode(Format format, const std::vector<uint8_t>& blocks, uint32_t width, uint32_t height)
+{
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    const uint32_t pitch = blockRowPitch(format, width);
+    uint8_t pixels[64];
+    for (uint32_t y = 0; y < height; y += 4)
+    {
+        for (uint32_t x = 0; x < width; x += 4)
+        {
+            const uint8_t* block = blocks.data() + static_cast<size_t>(y / 4) * pitch + x / 4 * blockBytes(format);
+            if (format == Format::Bc1)
+            {
+                decodeBc1Block(block, pixels);
+            }
+            else
+            {
+                EXPECT(decodeBc7Block(block, pixels));
+            }
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                std::memcpy(rgba.data() + (static_cast<size_t>(y + row) * width + x) * 4, pixels + row * 16, 16);
+            }
+        }
+    }
+    return rgba;
+}
+
+// PSNR over the channels the format keeps, BC1 has no alpha
+double psnr(Format format, const std::vector<uint8_t>& source, uint32_t rowPitch, const std::vector<uint8_t>& decoded, uint32_t width, uint32_t height)
+{
+    const int channels = format == Format::Bc1 ? 3 : 4;
+    double squaredError = 0.0;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                const double difference = static_cast<double>(source[static_cast<size_t>(y) * rowPitch + x * 4 + channel]) -
+                                          decoded[(static_cast<size_t>(y) * width + x) * 4 + channel];
+                squaredError += difference * difference;
+            }
+        }
+    }
+    const double meanSquaredError = squaredError / (static_cast<double>(width) * height * channels);
+    return meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : 100.0;
+}
+
+void testSizes()
+{
+    EXPECT(blockBytes(Format::Bc1) == 8);
+    EXPECT(blockBytes(Format::Bc7) == 16);
+    EXPECT(blockRowPitch(Format::Bc1, 1920) == 480 * 8);
+    EXPECT(blockRowPitch(Format::Bc7, 1920) == 480 * 16);
+}
+
+// A block of one color comes back within the precision of the endpoints
+void testSolidBlocks()
+{
+    const uint8_t colors[][4] = {{0, 0, 0, 255}, {255, 255, 255, 255}, {200, 100, 50, 128}, {17, 234, 99, 0}};
+    for (const uint8_t* color : colors)
+    {
+        uint8_t pixels[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            std::memcpy(pixels + i * 4, color, 4);
+        }
+        uint8_t block[16];
+        uint8_t decoded[64];
+
+        encodeBc1Block(pixels, block);
+        decodeBc1Block(block, decoded);
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                EXPECT(std::abs(decoded[i * 4 + channel] - color[channel]) <= 8);
+            }
+            EXPECT(decoded[i * 4 + 3] == 255);
+        }
+
+        encodeBc7Block(pixels, block);
+        EXPECT(decodeBc7Block(block, decoded));
+        for (int i = 0; i < 64; ++i)
+        {
+            EXPECT(std::abs(decoded[i] - color[i % 4]) <= 1);
+        }
+    }
+
+    // Not mode 6
+    const uint8_t mode0[16] = {1};
+    uint8_t decoded[64];
+    EXPECT(!decodeBc7Block(mode0, decoded));
+}
+
+// The threads split the block rows, the output is the same as from one thread
+void testEncoder(Format format, double minimumPsnr)
+{
+    const uint32_t width = 256;
+    const uint32_t height = 128;
+    const uint32_t rowPitch = width * 4 + 64;
+    const std::vector<uint8_t> rgba = makeFrame(width, height, rowPitch);
+    const size_t size = static_cast<size_t>(blockRowPitch(format, width)) * (height / 4);
+
+    std::vector<uint8_t> reference(size);
+    encodeBlockRows(format, rgba.data(), rowPitch, width, 0, height / 4, reference.data());
+    for (uint32_t threadCount : {1u, 3u, 4u})
+    {
+        BlockEncoder encoder(threadCount);
+        EXPECT(encoder.threadCount() == threadCount);
+        // Twice, the workers pick up every frame
+        for (int frame = 0; frame < 2; ++frame)
+        {
+            std::vector<uint8_t> blocks(size, 0xab);
+            encoder.encode(format, rgba.data(), rowPitch, width, height, blocks.data());
+            EXPECT(blocks == reference);
+        }
+    }
+
+    EXPECT(psnr(format, rgba, rowPitch, decode(format, reference, width, height), width, height) >= minimumPsnr);
+}
+} // namespace
+
+int main()
+{
+    testSizes();
+    testSolidBlocks();
+    testEncoder(Format::Bc1, 38.0);
+    testEncoder(Format::Bc7, 42.0);
+    return test::result();
+}
@@ -0,0 +1,148 @@
+#include "EmulatedQueue.hpp"
+#include "FanIn.hpp"
+#include "FenceWaiter.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void testSplitRows()
+{
+    const std::vector<FanInRegion> regions = splitRows(1920, 1081, 3);
+    EXPECT(regions.size() == 3);
+    uint32_t y = 0;
+    for (const FanInRegion& region : regions)
+    {
+        EXPECT(region.x == 0 && region.width == 1920);
+        EXPECT(region.y == y);
+        y += region.height;
+    }
+    EXPECT(y == 1081);
+    // Same rows as the bands of a banded handoff
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        EXPECT(regions[i].y == bands::bandRows(i, 3, 1081).y && regions[i].height == bands::bandRows(i, 3, 1081).height);
+    }
+}
+
+void testCompositionOrder()
+{
+    std::vector<uint64_t> completed{0, 0, 0};
+    const FanInFrame::ReachedFunction reached = [&](uint32_t producer, uint64_t value) { return completed[producer] >= value; };
+
+    FanInFrame frame(3);
+    frame.begin({5, 7, 9});
+    EXPECT(!frame.done());
+    EXPECT(frame.takeReady(reached).empty());
+    EXPECT(frame.pending().size() == 3);
+
+    // The regions are taken in the order their producers finish
+    completed[1] = 7;
+    std::vector<uint32_t> ready = frame.takeReady(reached);
+    EXPECT(ready.size() == 1 && ready[0] == 1);
+    EXPECT((frame.pending() == std::vector<uint32_t>{0, 2}));
+    EXPECT(frame.readyValue(2) == 9);
+
+    completed[0] = 5;
+    completed[2] = 9;
+    ready = frame.takeReady(reached);
+    EXPECT((ready == std::vector<uint32_t>{0, 2}));
+    EXPECT(frame.done());
+    EXPECT(frame.pending().empty());
+    // Only the region of producer 1 was composited before the others were ready
+    EXPECT(frame.earlyCount() == 1);
+
+    // All ready at once, nothing early
+    frame.begin({5, 7, 9});
+    frame.takeReady(reached);
+    EXPECT(frame.done());
+    EXPECT(frame.earlyCount() == 0);
+}
+
+// The dx12fanin composition loop with emulated producers that take different
+// times per frame. The producer that finishes k-th in a frame only starts once
+// k regions of the frame have been composited, so the frame can only complete
+// if every region is composited as soon as its fence is reached, in the order
+// the producers finish and before the slowest one is done.
+void testEmulatedProducers(const std::vector<uint32_t>& finishOrder, uint32_t frameCount)
+{
+    const uint32_t producerCount = static_cast<uint32_t>(finishOrder.size());
+    std::vector<EmulatedFence> fences(producerCount);
+    EmulatedFence compositeFence(0);
+    FenceWaiter<EmulatedFence> waiter;
+    std::vector<EmulatedQueue> producerQueues(producerCount);
+    EmulatedQueue compositeQueue;
+
+    std::mutex mutex;
+    std::vector<uint32_t> composited;
+    uint32_t compositedBeforeSlowest = 0;
+    uint32_t earlyRegionCount = 0;
+    const FanInFrame::ReachedFunction reached = [&](uint32_t producer, uint64_t value) { return fences[producer].GetCompletedValue() >= value; };
+
+    FanInFrame fanIn(producerCount);
+    uint64_t compositeValue = 0;
+    for (uint64_t frame = 1; frame <= frameCount; ++frame)
+    {
+        for (uint32_t rank = 0; rank < producerCount; ++rank)
+        {
+            const uint32_t producer = finishOrder[rank];
+            EmulatedQueue& queue = producerQueues[producer];
+            queue.Wait(&compositeFence, compositeValue + rank);
+            // The render of the region
+            queue.execute([producer] { std::this_thread::sleep_for(std::chrono::microseconds(100 + 150 * producer)); });
+            queue.Signal(&fences[producer], frame);
+        }
+
+        fanIn.begin(std::vector<uint64_t>(producerCount, frame));
+        while (!fanIn.done())
+        {
+            const std::vector<uint32_t> ready = fanIn.takeReady(reached);
+            if (ready.empty())
+            {
+                std::vector<FenceWait<EmulatedFence>> waits;
+                for (uint32_t p : fanIn.pending())
+                {
+                    waits.push_back({&fences[p], fanIn.readyValue(p)});
+                }
+                EXPECT(waiter.wait(waits, WaitMode::Any));
+                continue;
+            }
+            for (uint32_t p : ready)
+            {
+                const bool slowestDone = reached(finishOrder.back(), frame);
+                compositeQueue.execute([&, p, slowestDone] {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    composited.push_back(p);
+                    compositedBeforeSlowest += p != finishOrder.back() && !slowestDone ? 1 : 0;
+                });
+                compositeQueue.Signal(&compositeFence, ++compositeValue);
+            }
+        }
+        earlyRegionCount += fanIn.earlyCount();
+    }
+    EXPECT(waiter.wait(&compositeFence, compositeValue));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT(composited.size() == static_cast<size_t>(producerCount) * frameCount);
+    for (size_t i = 0; i < composited.size(); ++i)
+    {
+        EXPECT(composited[i] == finishOrder[i % producerCount]);
+    }
+    EXPECT(compositedBeforeSlowest == (producerCount - 1) * frameCount);
+    EXPECT(earlyRegionCount == (producerCount - 1) * frameCount);
+}
+} // namespace
+
+int main()
+{
+    testSplitRows();
+    testCompositionOrder();
+    testEmulatedProducers({2, 0, 1}, 20);
+    testEmulatedProducers({3, 1, 0, 2}, 20);
+    return test::result();
+}
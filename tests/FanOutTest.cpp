@@ -0,0 +1,175 @@
+#include "EmulatedQueue.hpp"
+#include "FanOut.hpp"
+#include "FenceWaiter.hpp"
+#include "Test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+FanOutSlots::ReachedFunction reachedBy(const std::vector<EmulatedFence>& fences)
+{
+    return [&fences](uint32_t consumer, uint64_t value) { return fences[consumer].GetCompletedValue() >= value; };
+}
+
+void testReleaseValues()
+{
+    std::vector<EmulatedFence> fences(2);
+    const FanOutSlots::ReachedFunction reached = reachedBy(fences);
+    FanOutSlots fanOut(2, 2);
+    uint32_t slot = 0;
+    std::vector<uint64_t> releaseValues;
+    FanOutFrame frame{};
+
+    // Slot 0 is read first and released with values the fences have not reached
+    EXPECT(fanOut.tryAcquire(slot, releaseValues, reached) && slot == 0);
+    EXPECT(releaseValues == std::vector<uint64_t>({0, 0}));
+    fanOut.publish(slot, 1);
+    EXPECT(fanOut.take(0, frame) && fanOut.take(1, frame) && frame.slot == 0);
+    fanOut.release(0, 0, 5);
+    fanOut.release(1, 0, 7);
+
+    EXPECT(fanOut.tryAcquire(slot, releaseValues, reached) && slot == 1);
+    fanOut.publish(slot, 2);
+    EXPECT(fanOut.take(0, frame) && fanOut.take(1, frame) && frame.slot == 1);
+    fanOut.release(0, 1, 3);
+    fanOut.release(1, 1, 4);
+
+    // Slot 1 is newer but the only one both fences are done with
+    fences[0].Signal(4);
+    fences[1].Signal(4);
+    EXPECT(fanOut.tryAcquire(slot, releaseValues, reached) && slot == 1);
+    EXPECT(releaseValues == std::vector<uint64_t>({3, 4}));
+    fanOut.publish(slot, 3);
+
+    // Slot 0 is still handed out, with the values the producer has to wait for
+    uint32_t other = 0;
+    EXPECT(fanOut.tryAcquire(other, releaseValues, reached) && other == 0);
+    EXPECT(releaseValues == std::vector<uint64_t>({5, 7}));
+    EXPECT(!reached(0, releaseValues[0]) && !reached(1, releaseValues[1]));
+    fences[0].Signal(5);
+    EXPECT(reached(0, releaseValues[0]) && !reached(1, releaseValues[1]));
+}
+
+void testSkippingConsumer()
+{
+    std::vector<EmulatedFence> fences(2);
+    const FanOutSlots::ReachedFunction reached = reachedBy(fences);
+    FanOutSlots fanOut(2, 2);
+    uint32_t slot = 0;
+    std::vector<uint64_t> releaseValues;
+    FanOutFrame frame{};
+
+    EXPECT(fanOut.tryAcquire(slot, releaseValues, reached) && slot == 0);
+    fanOut.publish(slot, 1);
+    EXPECT(fanOut.take(0, frame) && frame.slot == 0);
+    fanOut.release(0, 0, 2);
+
+    // Consumer 1 never takes slot 0, the newer frame replaces it
+    EXPECT(fanOut.tryAcquire(slot, releaseValues, reached) && slot == 1);
+    fanOut.publish(slot, 2);
+    EXPECT(fanOut.skippedFrames(1) == 1 && fanOut.skippedFrames(0) == 0);
+
+    // So slot 0 only waits for consumer 0
+    EXPECT(fanOut.tryAcquire(slot, releaseValues, reached) && slot == 0);
+    EXPECT(releaseValues == std::vector<uint64_t>({2, 0}));
+    EXPECT(reached(1, releaseValues[1]));
+}
+
+// The dx12fanout structure: every consumer reads the slot on its own queue and
+// releases it with the fence value of that read right after submitting it, the
+// read itself may still be running. The producer waits for the release values
+// of every consumer before it writes the slot again. The consumers check that
+// the slot holds their frame from the start to the end of the read, which
+// fails as soon as a slot is written before every consumer is done with it.
+void testEmulatedConsumers(uint32_t consumerCount, uint64_t frameCount)
+{
+    const uint32_t slotCount = consumerCount;
+    std::vector<EmulatedFence> fences(consumerCount);
+    FenceWaiter<EmulatedFence> waiter;
+    std::vector<EmulatedQueue> queues(consumerCount);
+    const FanOutSlots::ReachedFunction reached = reachedBy(fences);
+    FanOutSlots fanOut(slotCount, consumerCount);
+    std::vector<std::atomic<uint64_t>> slotFrames(slotCount);
+    std::atomic<uint64_t> mismatches{0};
+    std::vector<std::atomic<uint64_t>> received(consumerCount);
+
+    std::vector<std::thread> consumers;
+    for (uint32_t consumer = 0; consumer < consumerCount; ++consumer)
+    {
+        consumers.emplace_back([&, consumer] {
+            uint64_t fenceValue = 0;
+            FanOutFrame frame{};
+            while (fanOut.take(consumer, frame))
+            {
+                // The last consumer is slower than the producer and skips frames
+                const std::chrono::microseconds readTime(consumer + 1 == consumerCount ? 1000 : 100);
+                queues[consumer].execute([&slotFrames, &mismatches, frame, readTime] {
+                    mismatches += slotFrames[frame.slot] != frame.frameNumber ? 1 : 0;
+                    std::this_thread::sleep_for(readTime);
+                    mismatches += slotFrames[frame.slot] != frame.frameNumber ? 1 : 0;
+                });
+                queues[consumer].Signal(&fences[consumer], ++fenceValue);
+                fanOut.release(consumer, frame.slot, fenceValue);
+                ++received[consumer];
+                if (consumer + 1 == consumerCount)
+                {
+                    // Like a display that waits for its present
+                    fences[consumer].waitFor(fenceValue);
+                }
+            }
+        });
+    }
+
+    std::vector<uint64_t> releaseValues;
+    for (uint64_t frame = 1; frame <= frameCount; ++frame)
+    {
+        uint32_t slot = 0;
+        EXPECT(fanOut.acquire(slot, releaseValues, reached));
+        std::vector<FenceWait<EmulatedFence>> waits;
+        for (uint32_t consumer = 0; consumer < consumerCount; ++consumer)
+        {
+            waits.push_back({&fences[consumer], releaseValues[consumer]});
+        }
+        EXPECT(waiter.wait(waits, WaitMode::All));
+        slotFrames[slot] = frame;
+        // Stands in for the render and the copy into the slot
+        std::this_thread::sleep_for(std::chrono::microseconds(300));
+        fanOut.publish(slot, frame);
+    }
+
+    // Let the consumers take the last frame before they are stopped
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t consumer = 0; consumer < consumerCount; ++consumer)
+    {
+        while (received[consumer] + fanOut.skippedFrames(consumer) < frameCount && test::secondsSince(start) < 5.0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    fanOut.stop();
+    for (std::thread& consumer : consumers)
+    {
+        consumer.join();
+    }
+
+    EXPECT(mismatches == 0);
+    for (uint32_t consumer = 0; consumer < consumerCount; ++consumer)
+    {
+        EXPECT(received[consumer] + fanOut.skippedFrames(consumer) == frameCount);
+    }
+}
+} // namespace
+
+int main()
+{
+    testReleaseValues();
+    testSkippingConsumer();
+    testEmulatedConsumers(2, 300);
+    testEmulatedConsumers(3, 300);
+    return test::result();
+}
@@ -0,0 +1,214 @@
+#include "EmulatedQueue.hpp"
+#include "FenceWaiter.hpp"
+#include "Test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const auto c_timeout = std::chrono::seconds(5);
+
+// Reaches its value on the given read of the completed value, like a GPU that
+// finishes between two reads. An event armed before that fires only when the
+// fence is read again, so a waiter that stops arming events waits forever.
+class ScriptedFence
+{
+public:
+    ScriptedFence(uint64_t value, int reachedOnRead) :
+        m_value(value),
+        m_reachedOnRead(reachedOnRead)
+    {
+    }
+
+    uint64_t GetCompletedValue()
+    {
+        return ++m_reads >= m_reachedOnRead ? m_value : 0;
+    }
+
+    void SetEventOnCompletion(uint64_t value, NativeEvent event)
+    {
+        if (GetCompletedValue() >= value)
+        {
+            signalNativeEvent(event);
+        }
+    }
+
+private:
+    uint64_t m_value;
+    int m_reachedOnRead;
+    std::atomic<int> m_reads{0};
+};
+
+bool isReady(std::future<void>& future)
+{
+    return future.wait_for(c_timeout) == std::future_status::ready;
+}
+
+void testReachedBeforeArming()
+{
+    // Read once by waitAsync(), once by the waiter thread and reached when its event is armed
+    ScriptedFence fence(1, 3);
+    FenceWaiter<ScriptedFence> waiter;
+    std::promise<void> done;
+    std::future<void> future = done.get_future();
+    EXPECT(waiter.waitAsync({{&fence, 1}}, WaitMode::All, [&done] { done.set_value(); }));
+    EXPECT(isReady(future));
+}
+
+void testEveryFenceIsArmed()
+{
+    // The requests are taken in by the same pass, only the last fence is signalled
+    std::vector<std::unique_ptr<EmulatedFence>> fences;
+    for (int i = 0; i < 8; ++i)
+    {
+        fences.push_back(std::make_unique<EmulatedFence>(0));
+    }
+    FenceWaiter<EmulatedFence> waiter;
+    std::vector<std::promise<void>> done(fences.size());
+    for (size_t i = 0; i < fences.size(); ++i)
+    {
+        EXPECT(waiter.waitAsync({{fences[i].get(), 1}}, WaitMode::All, [&done, i] { done[i].set_value(); }));
+    }
+    std::future<void> last = done.back().get_future();
+    fences.back()->Signal(1);
+    EXPECT(isReady(last));
+    for (size_t i = 0; i + 1 < fences.size(); ++i)
+    {
+        fences[i]->Signal(1);
+        std::future<void> future = done[i].get_future();
+        EXPECT(isReady(future));
+    }
+}
+
+void testModes()
+{
+    EmulatedFence first(0);
+    EmulatedFence second(0);
+    FenceWaiter<EmulatedFence> waiter;
+
+    std::promise<void> anyDone;
+    std::promise<void> allDone;
+    std::future<void> any = anyDone.get_future();
+    std::future<void> all = allDone.get_future();
+    EXPECT(waiter.waitAsync({{&first, 1}, {&second, 1}}, WaitMode::Any, [&anyDone] { anyDone.set_value(); }));
+    EXPECT(waiter.waitAsync({{&first, 1}, {&second, 1}}, WaitMode::All, [&allDone] { allDone.set_value(); }));
+
+    second.Signal(1);
+    EXPECT(isReady(any));
+    EXPECT(all.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+    first.Signal(1);
+    EXPECT(isReady(all));
+
+    // Satisfied requests complete on the calling thread
+    bool called = false;
+    EXPECT(waiter.waitAsync({{&first, 1}}, WaitMode::All, [&called] { called = true; }));
+    EXPECT(called);
+    EXPECT(waiter.wait(&first, 1));
+}
+
+void testSameFenceManyValues()
+{
+    EmulatedFence fence(0);
+    FenceWaiter<EmulatedFence> waiter;
+    const int count = 200;
+    std::vector<std::promise<void>> done(count);
+    std::atomic<int> completed{0};
+    for (int i = 0; i < count; ++i)
+    {
+        EXPECT(waiter.waitAsync({{&fence, static_cast<uint64_t>(i + 1)}}, WaitMode::All, [&done, &completed, i] {
+            ++completed;
+            done[i].set_value();
+        }));
+    }
+    // One fence, so the limit on fences does not apply however many requests there are
+    for (int i = 0; i < count; ++i)
+    {
+        fence.Signal(static_cast<uint64_t>(i + 1));
+        std::future<void> future = done[i].get_future();
+        EXPECT(isReady(future));
+    }
+    EXPECT(completed == count);
+}
+
+void testCompletionOrder()
+{
+    EmulatedFence fence(0);
+    FenceWaiter<EmulatedFence> waiter;
+    const int count = 50;
+    std::mutex mutex;
+    std::vector<int> order;
+    std::promise<void> done;
+    std::future<void> future = done.get_future();
+    for (int i = 0; i < count; ++i)
+    {
+        // Later requests wait for smaller values, all of them are reached by one signal
+        EXPECT(waiter.waitAsync({{&fence, static_cast<uint64_t>(count - i)}}, WaitMode::All, [&, i] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+            if (order.size() == static_cast<size_t>(count))
+            {
+                done.set_value();
+            }
+        }));
+    }
+    fence.Signal(count);
+    EXPECT(isReady(future));
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < static_cast<int>(order.size()); ++i)
+    {
+        EXPECT(order[i] == i);
+    }
+}
+
+void testFenceLimit()
+{
+    std::vector<std::unique_ptr<EmulatedFence>> fences;
+    for (size_t i = 0; i <= FenceWaiter<EmulatedFence>::c_maxFences; ++i)
+    {
+        fences.push_back(std::make_unique<EmulatedFence>(0));
+    }
+    FenceWaiter<EmulatedFence> waiter;
+    std::atomic<size_t> completed{0};
+    for (size_t i = 0; i < FenceWaiter<EmulatedFence>::c_maxFences; ++i)
+    {
+        EXPECT(waiter.waitAsync({{fences[i].get(), 1}}, WaitMode::All, [&completed] { ++completed; }));
+    }
+    EXPECT(!waiter.waitAsync({{fences.back().get(), 1}}, WaitMode::All, [] {}));
+    EXPECT(!waiter.wait(fences.back().get(), 1));
+    // A fence that is already waited on does not count again
+    EXPECT(waiter.waitAsync({{fences.front().get(), 2}}, WaitMode::All, [&completed] { ++completed; }));
+
+    for (size_t i = 0; i < FenceWaiter<EmulatedFence>::c_maxFences; ++i)
+    {
+        fences[i]->Signal(2);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    while (completed < FenceWaiter<EmulatedFence>::c_maxFences + 1 && std::chrono::steady_clock::now() - start < c_timeout)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT(completed == FenceWaiter<EmulatedFence>::c_maxFences + 1);
+
+    // The fences are given back once their requests complete
+    EmulatedQueue queue;
+    queue.Signal(fences.back().get(), 1);
+    EXPECT(waiter.wait(fences.back().get(), 1));
+}
+} // namespace
+
+int main()
+{
+    testReachedBeforeArming();
+    testEveryFenceIsArmed();
+    testModes();
+    testSameFenceManyValues();
+    testCompletionOrder();
+    testFenceLimit();
+    return test::result();
+}
@@ -0,0 +1,147 @@
+#include "Foveation.hpp"
+#include "Test.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace foveation;
+
+namespace
+{
+const uint32_t c_width = 192;
+const uint32_t c_height = 96;
+const uint32_t c_scale = 4;
+
+bool equal(const Rect& a, const Rect& b)
+{
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+bool aligned(const Rect& rect, uint32_t alignment)
+{
+    return rect.x % alignment == 0 && rect.y % alignment == 0 && rect.width % alignment == 0 && rect.height % alignment == 0 && rect.x + rect.width <= c_width &&
+           rect.y + rect.height <= c_height && rect.width > 0 && rect.height > 0;
+}
+
+void testParse()
+{
+    Rect rect;
+    EXPECT(parseRect("10,20,300,400", rect));
+    EXPECT(rect.x == 10 && rect.y == 20 && rect.width == 300 && rect.height == 400);
+    EXPECT(!parseRect("10,20,300", rect));
+    EXPECT(!parseRect("10,20,0,400", rect));
+    EXPECT(!parseRect("", rect));
+}
+
+void testAlign()
+{
+    Rect rect;
+    rect.x = 13;
+    rect.y = 7;
+    rect.width = 50;
+    rect.height = 30;
+    const Rect alignedRect = alignRect(rect, c_width, c_height, c_scale);
+    EXPECT(equal(alignedRect, Rect{12, 4, 48, 28}));
+
+    // Pushed back inside the frame
+    rect.x = c_width - 10;
+    rect.y = c_height;
+    EXPECT(equal(alignRect(rect, c_width, c_height, c_scale), Rect{c_width - 48, c_height - 28, 48, 28}));
+
+    // Larger than the frame, or smaller than one periphery pixel
+    rect = Rect{0, 0, 1000, 1000};
+    EXPECT(equal(alignRect(rect, c_width, c_height, c_scale), Rect{0, 0, c_width, c_height}));
+    rect = Rect{5, 5, 1, 1};
+    EXPECT(equal(alignRect(rect, c_width, c_height, c_scale), Rect{4, 4, c_scale, c_scale}));
+}
+
+// The sweep keeps the size, stays aligned and inside, and reaches every side of the frame
+void testSweep()
+{
+    const Rect rect{0, 0, 40, 24};
+    uint32_t minX = c_width;
+    uint32_t maxX = 0;
+    uint32_t minY = c_height;
+    uint32_t maxY = 0;
+    for (uint64_t frame = 0; frame < 2000; ++frame)
+    {
+        const Rect moved = sweepRect(rect, frame, c_width, c_height, c_scale);
+        EXPECT(aligned(moved, c_scale));
+        EXPECT(moved.width == rect.width && moved.height == rect.height);
+        minX = (std::min)(minX, moved.x);
+        maxX = (std::max)(maxX, moved.x);
+        minY = (std::min)(minY, moved.y);
+        maxY = (std::max)(maxY, moved.y);
+    }
+    EXPECT(minX == 0 && maxX + rect.width >= c_width - c_scale);
+    EXPECT(minY == 0 && maxY + rect.height >= c_height - c_scale);
+}
+
+void testTransferBytes()
+{
+    const Rect roi{0, 0, 48, 24};
+    const TransferBytes bytes = transferBytes(roi, c_width, c_height, c_scale, 4);
+    EXPECT(bytes.full == c_width * c_height * 4);
+    EXPECT(bytes.periphery == (c_width / 4) * (c_height / 4) * 4);
+    EXPECT(bytes.roi == 48 * 24 * 4);
+    // 1/16 for the periphery and 1/16 for the rectangle
+    EXPECT(std::fabs(bytes.savedFraction() - (1.0 - 2.0 / 16.0)) < 1e-12);
+    EXPECT(TransferBytes().savedFraction() == 0.0);
+}
+
+// The producer's periphery and rectangle give back the frame: exact inside the
+// rectangle, close to the original outside of it
+void testReconstruct()
+{
+    const uint32_t pitch = c_width * 4;
+    std::vector<uint8_t> frame(static_cast<size_t>(pitch) * c_height);
+    for (uint32_t y = 0; y < c_height; ++y)
+    {
+        for (uint32_t x = 0; x < c_width; ++x)
+        {
+            uint8_t* pixel = frame.data() + static_cast<size_t>(y) * pitch + x * 4;
+            pixel[0] = static_cast<uint8_t>(x * 255 / c_width);
+            pixel[1] = static_cast<uint8_t>(y * 255 / c_height);
+            pixel[2] = static_cast<uint8_t>(127.5 + 60.0 * std::sin(x * 0.05 + y * 0.03));
+            pixel[3] = 255;
+        }
+    }
+
+    for (uint64_t step = 0; step < 5; ++step)
+    {
+        const Rect rect = sweepRect(Rect{0, 0, 40, 24}, step * 97, c_width, c_height, c_scale);
+        // Padded like mapped staging textures
+        const uint32_t peripheryPitch = c_width / c_scale * 4 + 16;
+        const uint32_t roiPitch = rect.width * 4 + 64;
+        std::vector<uint8_t> periphery(static_cast<size_t>(peripheryPitch) * (c_height / c_scale));
+        std::vector<uint8_t> roi(static_cast<size_t>(roiPitch) * rect.height);
+        upscale::downscaleBox(frame.data(), pitch, c_width, c_height, c_scale, periphery.data(), peripheryPitch);
+        copyRect(frame.data(), pitch, rect, 4, roi.data(), roiPitch);
+
+        std::vector<uint8_t> reconstructed(frame.size());
+        reconstruct(periphery.data(), peripheryPitch, roi.data(), roiPitch, rect, c_width, c_height, c_scale, reconstructed.data(), pitch);
+
+        bool roiExact = true;
+        for (uint32_t row = 0; row < rect.height; ++row)
+        {
+            const size_t offset = static_cast<size_t>(rect.y + row) * pitch + static_cast<size_t>(rect.x) * 4;
+            roiExact = roiExact && std::memcmp(reconstructed.data() + offset, frame.data() + offset, rect.width * 4) == 0;
+        }
+        EXPECT(roiExact);
+        EXPECT(upscale::psnr(frame.data(), reconstructed.data(), pitch, c_width, c_height) >= 35.0);
+    }
+}
+} // namespace
+
+int main()
+{
+    testParse();
+    testAlign();
+    testSweep();
+    testTransferBytes();
+    testReconstruct();
+    return test::result();
+}
@@ -0,0 +1,133 @@
+#include "FrameCapture.hpp"
+#include "Test.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace
+{
+const uint32_t c_width = 100; // Frames are not a multiple of the alignment
+const uint32_t c_height = 60;
+const uint32_t c_bytesPerPixel = 4;
+const uint32_t c_rowBytes = c_width * c_bytesPerPixel;
+const uint32_t c_rowPitch = c_rowBytes + 96;
+
+// In the working directory, tmpfs would not take O_DIRECT
+const std::string c_path = "FrameCaptureTest.cap";
+
+uint8_t pixel(uint64_t frameNumber, uint32_t row, uint32_t byte)
+{
+    return static_cast<uint8_t>(frameNumber * 7 + row * 3 + byte);
+}
+
+std::vector<uint8_t> makeFrame(uint64_t frameNumber)
+{
+    std::vector<uint8_t> rows(static_cast<size_t>(c_rowPitch) * c_height, 0xee);
+    for (uint32_t row = 0; row < c_height; ++row)
+    {
+        for (uint32_t byte = 0; byte < c_rowBytes; ++byte)
+        {
+            rows[static_cast<size_t>(row) * c_rowPitch + byte] = pixel(frameNumber, row, byte);
+        }
+    }
+    return rows;
+}
+
+bool holdsFrame(const uint8_t* rows, uint64_t frameNumber)
+{
+    for (uint32_t row = 0; row < c_height; ++row)
+    {
+        for (uint32_t byte = 0; byte < c_rowBytes; ++byte)
+        {
+            if (rows[static_cast<size_t>(row) * c_rowBytes + byte] != pixel(frameNumber, row, byte))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+uint64_t fileSize(const std::string& path)
+{
+    struct stat info{};
+    return stat(path.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+// More frames than are reserved at a time, every third frame skipped by the capture
+void testWriteAndRead(uint32_t queueDepth)
+{
+    const uint64_t frameCount = c_captureReserveFrames + 10;
+    std::vector<uint64_t> frameNumbers;
+    {
+        CaptureWriter writer(c_path, c_width, c_height, c_bytesPerPixel, queueDepth);
+        EXPECT(writer.isOpen());
+        for (uint64_t frameNumber = 1; frameNumbers.size() < frameCount; ++frameNumber)
+        {
+            if (frameNumber % 3 == 0)
+            {
+                continue;
+            }
+            const std::vector<uint8_t> frame = makeFrame(frameNumber);
+            EXPECT(writer.write(frameNumber, frame.data(), c_rowPitch));
+            frameNumbers.push_back(frameNumber);
+        }
+        writer.finish();
+        EXPECT(!writer.isOpen());
+        EXPECT(!writer.write(1000, makeFrame(1000).data(), c_rowPitch));
+        EXPECT(writer.framesWritten() == frameCount);
+        EXPECT(writer.failedWrites() == 0);
+        EXPECT(writer.throughput() > 0.0);
+    }
+
+    CaptureReader reader(c_path);
+    EXPECT(reader.isOpen());
+    if (!reader.isOpen())
+    {
+        return;
+    }
+    const CaptureFileHeader& header = reader.header();
+    EXPECT(header.width == c_width && header.height == c_height && header.rowBytes == c_rowBytes);
+    EXPECT(header.frameStride % c_captureAlignment == 0 && header.frameStride >= c_rowBytes * c_height);
+    EXPECT(reader.frameCount() == frameCount);
+    // The reserved space past the last frame was cut off again
+    EXPECT(fileSize(c_path) == header.indexOffset + frameCount * sizeof(CaptureIndexEntry));
+    reader.prefetch(frameCount - 2, 4);
+    for (uint64_t i = 0; i < reader.frameCount(); ++i)
+    {
+        EXPECT(reader.frameNumber(i) == frameNumbers[i]);
+        EXPECT(holdsFrame(reader.frame(i), frameNumbers[i]));
+    }
+}
+
+void testRejected()
+{
+    // Not finished, the header is still empty
+    {
+        CaptureWriter writer(c_path, c_width, c_height, c_bytesPerPixel, 2);
+        EXPECT(writer.write(1, makeFrame(1).data(), c_rowPitch));
+        CaptureReader reader(c_path);
+        EXPECT(!reader.isOpen());
+    }
+    EXPECT(CaptureReader(c_path).isOpen());
+
+    // Cut off in the index
+    EXPECT(truncate(c_path.c_str(), static_cast<off_t>(fileSize(c_path) - 1)) == 0);
+    EXPECT(!CaptureReader(c_path).isOpen());
+
+    EXPECT(!CaptureReader("missing.cap").isOpen());
+    EXPECT(!CaptureWriter("missing/FrameCaptureTest.cap", c_width, c_height, c_bytesPerPixel, 2).isOpen());
+}
+} // namespace
+
+int main()
+{
+    testWriteAndRead(1);
+    testWriteAndRead(4);
+    testRejected();
+    std::remove(c_path.c_str());
+    return test::result();
+}
@@ -0,0 +1,225 @@
+#include "FrameGraph.hpp"
+#include "Test.hpp"
+
+#include <vector>
+
+using namespace framegraph;
+
+namespace
+{
+bool hasBarrier(const std::vector<Barrier>& barriers, ResourceId resource, uint32_t before, uint32_t after)
+{
+    for (const Barrier& barrier : barriers)
+    {
+        if (barrier.resource == resource && barrier.before == before && barrier.after == after)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool waitsOn(const CompiledPass& pass, QueueId queue, uint32_t signalIndex)
+{
+    for (const QueueWait& wait : pass.waits)
+    {
+        if (wait.queue == queue && wait.signalIndex == signalIndex)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void testReadStatesAreCombined()
+{
+    FrameGraph graph;
+    const QueueId direct = graph.addQueue(0, QueueType::Direct);
+    const ResourceId texture = graph.addResource(Common);
+    const ResourceId target = graph.addResource(Common);
+
+    graph.beginFrame();
+    graph.addPass(direct, {write(texture, RenderTarget)});
+    graph.addPass(direct, {read(texture, ShaderResource), write(target, RenderTarget)});
+    graph.addPass(direct, {read(texture, CopySource), write(target, CopyDest)});
+    graph.addPass(direct, {read(texture, ShaderResource)});
+    graph.setFinalState(target, Present);
+    const CompiledFrame frame = graph.compile();
+
+    EXPECT(frame.errors.empty());
+    // One barrier into both read states serves the three reads
+    EXPECT(hasBarrier(frame.passes[1].barriersBefore, texture, RenderTarget, ShaderResource | CopySource));
+    EXPECT(frame.passes[2].barriersBefore.size() == 1);
+    EXPECT(hasBarrier(frame.passes[2].barriersBefore, target, RenderTarget, CopyDest));
+    EXPECT(frame.passes[3].barriersBefore.empty());
+    EXPECT(hasBarrier(frame.passes[2].barriersAfter, target, CopyDest, Present));
+    EXPECT(frame.waitCount == 0);
+    EXPECT(frame.signalCounts[direct] == 0);
+    EXPECT(frame.barrierCount == 5);
+    EXPECT(frame.barrierBatchCount == 4);
+}
+
+void testStatesCarryOver()
+{
+    FrameGraph graph;
+    const QueueId direct = graph.addQueue(0, QueueType::Direct);
+    const ResourceId backBuffer = graph.addResource(Present);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        graph.beginFrame();
+        graph.addPass(direct, {write(backBuffer, RenderTarget)});
+        graph.setFinalState(backBuffer, Present);
+        const CompiledFrame frame = graph.compile();
+        EXPECT(hasBarrier(frame.passes[0].barriersBefore, backBuffer, Present, RenderTarget));
+        EXPECT(hasBarrier(frame.passes[0].barriersAfter, backBuffer, RenderTarget, Present));
+        EXPECT(frame.barrierCount == 2);
+    }
+    EXPECT(graph.state(backBuffer) == Present);
+
+    // Already in the state the pass needs
+    graph.beginFrame();
+    graph.addPass(direct, {read(backBuffer, Present)});
+    EXPECT(graph.compile().barrierCount == 0);
+}
+
+void testWriteThenReadOnOtherAdapter()
+{
+    FrameGraph graph;
+    const QueueId render = graph.addQueue(1, QueueType::Direct);
+    const QueueId copy = graph.addQueue(1, QueueType::Copy);
+    const QueueId display = graph.addQueue(0, QueueType::Direct);
+    const ResourceId texture = graph.addResource(Common);
+    const MemoryId sharedMemory = graph.addMemory();
+    const ResourceId shared1 = graph.addResource(sharedMemory, Common);
+    const ResourceId shared0 = graph.addResource(sharedMemory, Common);
+
+    graph.beginFrame();
+    graph.addPass(render, {write(texture, RenderTarget), write(shared1, RenderTarget)});
+    graph.addPass(copy, {read(texture, Common), write(shared1, Common)});
+    graph.addPass(display, {read(shared0, CopySource)});
+    const CompiledFrame frame = graph.compile();
+
+    EXPECT(frame.errors.empty());
+    // One wait for both resources, the transitions to common run after the render pass
+    EXPECT(frame.passes[1].waits.size() == 1);
+    EXPECT(waitsOn(frame.passes[1], render, 1));
+    EXPECT(hasBarrier(frame.passes[0].barriersAfter, texture, RenderTarget, Common));
+    EXPECT(hasBarrier(frame.passes[0].barriersAfter, shared1, RenderTarget, Common));
+    // The other adapter's view of the memory waits for the copy
+    EXPECT(frame.passes[2].waits.size() == 1);
+    EXPECT(waitsOn(frame.passes[2], copy, 1));
+    EXPECT(frame.signalCounts[render] == 1);
+    EXPECT(frame.signalCounts[copy] == 1);
+    EXPECT(frame.signalCounts[display] == 0);
+}
+
+void testCopyAfterReadWaitsForTransition()
+{
+    FrameGraph graph;
+    const QueueId direct = graph.addQueue(0, QueueType::Direct);
+    const QueueId copy = graph.addQueue(0, QueueType::Copy);
+    const ResourceId texture = graph.addResource(Common);
+    const ResourceId other = graph.addResource(Common);
+
+    // The write is from an earlier frame, in this frame both queues only read
+    graph.beginFrame();
+    graph.addPass(direct, {write(texture, RenderTarget)});
+    graph.compile();
+
+    graph.beginFrame();
+    graph.addPass(direct, {read(texture, ShaderResource), write(other, RenderTarget)});
+    graph.addPass(copy, {read(texture, Common)});
+    const CompiledFrame frame = graph.compile();
+
+    EXPECT(frame.errors.empty());
+    EXPECT(hasBarrier(frame.passes[0].barriersBefore, texture, RenderTarget, ShaderResource));
+    EXPECT(hasBarrier(frame.passes[0].barriersAfter, texture, ShaderResource, Common));
+    // Read after read, but the copy may only start once the transition to common has run
+    EXPECT(frame.passes[0].signalIndex == 1);
+    EXPECT(waitsOn(frame.passes[1], direct, 1));
+    EXPECT(graph.state(texture) == Common);
+}
+
+void testReadAfterReadAcrossQueues()
+{
+    FrameGraph graph;
+    const QueueId first = graph.addQueue(0, QueueType::Direct);
+    const QueueId second = graph.addQueue(0, QueueType::Direct);
+    const ResourceId texture = graph.addResource(ShaderResource);
+
+    // Same read state on both queues, nothing to order
+    graph.beginFrame();
+    graph.addPass(first, {read(texture, ShaderResource)});
+    graph.addPass(second, {read(texture, ShaderResource)});
+    CompiledFrame frame = graph.compile();
+    EXPECT(frame.waitCount == 0);
+    EXPECT(frame.barrierCount == 0);
+
+    // The second queue needs another state, its transition waits for the first queue's read
+    graph.beginFrame();
+    graph.addPass(first, {read(texture, ShaderResource)});
+    graph.addPass(second, {read(texture, CopySource)});
+    frame = graph.compile();
+    EXPECT(hasBarrier(frame.passes[1].barriersBefore, texture, ShaderResource, CopySource));
+    EXPECT(waitsOn(frame.passes[1], first, 1));
+    EXPECT(frame.waitCount == 1);
+
+    // And back, the first queue now waits for the second one
+    graph.beginFrame();
+    graph.addPass(second, {read(texture, CopySource)});
+    graph.addPass(first, {read(texture, ShaderResource)});
+    frame = graph.compile();
+    EXPECT(frame.passes[0].barriersBefore.empty());
+    EXPECT(hasBarrier(frame.passes[1].barriersBefore, texture, CopySource, ShaderResource));
+    EXPECT(waitsOn(frame.passes[1], second, 1));
+}
+
+void testWriteAfterReadWaitsForEveryReader()
+{
+    FrameGraph graph;
+    const QueueId first = graph.addQueue(0, QueueType::Direct);
+    const QueueId second = graph.addQueue(1, QueueType::Direct);
+    const QueueId writer = graph.addQueue(2, QueueType::Direct);
+    const MemoryId memory = graph.addMemory();
+    const ResourceId view0 = graph.addResource(memory, CopySource);
+    const ResourceId view1 = graph.addResource(memory, CopySource);
+    const ResourceId view2 = graph.addResource(memory, CopySource);
+
+    graph.beginFrame();
+    graph.addPass(first, {read(view0, CopySource)});
+    graph.addPass(second, {read(view1, CopySource)});
+    graph.addPass(writer, {write(view2, CopyDest)});
+    const CompiledFrame frame = graph.compile();
+    EXPECT(frame.passes[0].waits.empty());
+    EXPECT(frame.passes[1].waits.empty());
+    EXPECT(waitsOn(frame.passes[2], first, 1));
+    EXPECT(waitsOn(frame.passes[2], second, 1));
+    EXPECT(frame.waitCount == 2);
+}
+
+void testErrors()
+{
+    FrameGraph graph;
+    const QueueId copy = graph.addQueue(0, QueueType::Copy);
+    const ResourceId texture = graph.addResource(RenderTarget);
+
+    graph.beginFrame();
+    graph.addPass(copy, {read(texture, Common)});
+    graph.setFinalState(texture, ShaderResource);
+    const CompiledFrame frame = graph.compile();
+    EXPECT(frame.errors.size() == 2);
+}
+} // namespace
+
+int main()
+{
+    testReadStatesAreCombined();
+    testStatesCarryOver();
+    testWriteThenReadOnOtherAdapter();
+    testCopyAfterReadWaitsForTransition();
+    testReadAfterReadAcrossQueues();
+    testWriteAfterReadWaitsForEveryReader();
+    testErrors();
+    return test::result();
+}
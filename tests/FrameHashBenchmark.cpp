@@ -0,0 +1,70 @@
+#include "FrameHash.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Throughput of the CRC-32C kernels over a frame, and the per frame cost of
+// the dx11 --verify budgets with the row sampling they use.
+
+namespace
+{
+// 7680x3840 RGBA8
+const uint32_t c_width = 7680;
+const uint32_t c_height = 3840;
+const uint32_t c_rowBytes = c_width * 4;
+const int c_repeatCount = 5;
+
+template<typename Kernel>
+double throughputGBs(const std::vector<uint8_t>& frame, Kernel kernel)
+{
+    volatile uint32_t sink = 0;
+    sink = kernel(~0u, frame.data(), frame.size());
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < c_repeatCount; ++i)
+    {
+        sink = kernel(~0u, frame.data(), frame.size());
+    }
+    (void)sink;
+    return static_cast<double>(frame.size()) * c_repeatCount / test::secondsSince(start) * 1e-9;
+}
+} // namespace
+
+int main()
+{
+    std::vector<uint8_t> frame(static_cast<size_t>(c_rowBytes) * c_height);
+    for (size_t i = 0; i < frame.size(); ++i)
+    {
+        frame[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+    }
+
+    std::cout << "Frame of " << (frame.size() >> 20) << " MB\n";
+    std::cout << "Software CRC-32C: " << throughputGBs(frame, framehash::crc32cSoftware) << " GB/s\n";
+    if (framehash::hasHardwareCrc32c())
+    {
+        std::cout << "Hardware CRC-32C: " << throughputGBs(frame, framehash::crc32cHardware) << " GB/s\n";
+    }
+    else
+    {
+        std::cout << "Hardware CRC-32C: not supported by this CPU\n";
+    }
+
+    for (uint32_t budgetKb : {64u, 256u, 1024u, 4096u})
+    {
+        const uint32_t rowCount = framehash::rowsForBudget(static_cast<size_t>(budgetKb) * 1024, c_rowBytes, c_height);
+        const int frameCount = 200;
+        size_t hashed = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frameCount; ++i)
+        {
+            const std::vector<uint32_t> rows = framehash::sampleRows(i, c_height, rowCount);
+            hashed += framehash::hashRows(frame.data(), c_rowBytes, c_rowBytes, rows).size();
+        }
+        const double perFrame = test::secondsSince(start) / frameCount;
+        std::cout << "--verify=" << budgetKb << ": " << rowCount << " rows, " << (perFrame * 1e6) << " us per frame"
+                  << (hashed == static_cast<size_t>(rowCount) * frameCount ? "" : " (wrong row count)") << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "FrameHash.hpp"
+#include "Test.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace framehash;
+
+namespace
+{
+void testKnownValues()
+{
+    const char check[] = "123456789";
+    EXPECT(crc32c(check, 9) == 0xe3069283);
+    EXPECT(crc32c(check, 0) == 0);
+    const std::vector<uint8_t> zeros(32, 0);
+    EXPECT(crc32c(zeros.data(), zeros.size()) == 0x8a9136aa);
+}
+
+// Every length and alignment around the 8 byte steps, both kernels agree
+void testKernelsAgree()
+{
+    std::mt19937 random(1);
+    std::vector<uint8_t> data(4096 + 16);
+    for (uint8_t& byte : data)
+    {
+        byte = static_cast<uint8_t>(random());
+    }
+    for (size_t offset = 0; offset < 8; ++offset)
+    {
+        for (size_t size : {size_t(0), size_t(1), size_t(7), size_t(8), size_t(9), size_t(63), size_t(1000), size_t(4096)})
+        {
+            const uint8_t* bytes = data.data() + offset;
+            const uint32_t software = ~crc32cSoftware(~0u, bytes, size);
+            EXPECT(crc32cHardware(~0u, bytes, size) == ~software);
+            EXPECT(crc32c(bytes, size) == software);
+        }
+    }
+}
+
+void testContinued()
+{
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<uint8_t>(i * 13);
+    }
+    const uint32_t whole = crc32c(data.data(), data.size());
+    EXPECT(crc32c(data.data() + 333, data.size() - 333, crc32c(data.data(), 333)) == whole);
+    data[500] ^= 1;
+    EXPECT(crc32c(data.data(), data.size()) != whole);
+}
+
+// Over ceil(height / rowCount) frames every row is sampled, the last ones too
+void testSampleRowsCoverFrame()
+{
+    for (uint32_t height : {1u, 2u, 7u, 100u, 1080u, 2160u})
+    {
+        for (uint32_t rowCount : {1u, 3u, 7u, 64u, 1000u, 5000u})
+        {
+            const uint32_t sampled = rowCount < height ? rowCount : height;
+            const uint32_t period = (height + sampled - 1) / sampled;
+            std::vector<bool> seen(height, false);
+            for (uint64_t frame = 0; frame < period; ++frame)
+            {
+                const std::vector<uint32_t> rows = sampleRows(frame, height, rowCount);
+                EXPECT(rows.size() == sampled);
+                for (size_t i = 0; i < rows.size(); ++i)
+                {
+                    EXPECT(rows[i] < height);
+                    EXPECT(i == 0 || rows[i] > rows[i - 1]);
+                    seen[rows[i]] = true;
+                }
+            }
+            for (uint32_t row = 0; row < height; ++row)
+            {
+                EXPECT(seen[row]);
+            }
+        }
+    }
+    EXPECT(sampleRows(5, 0, 10).empty());
+    EXPECT(sampleRows(5, 10, 0).empty());
+    // 1080 rows in 64 samples leave a remainder that plain spacing never reaches
+    EXPECT(sampleRows(0, 1080, 64).back() >= 1080 - 17);
+}
+
+void testRowsForBudget()
+{
+    EXPECT(rowsForBudget(0, 1024, 100) == 1);
+    EXPECT(rowsForBudget(10 * 1024, 1024, 100) == 10);
+    EXPECT(rowsForBudget(10 * 1024 + 1023, 1024, 100) == 10);
+    EXPECT(rowsForBudget(1 << 30, 1024, 100) == 100);
+    EXPECT(rowsForBudget(1024, 0, 100) == 1);
+}
+
+// A padded source and a packed copy give the same row hashes, a changed byte shows in its row only
+void testHashRows()
+{
+    const uint32_t rowBytes = 300;
+    const uint32_t rowPitch = 512;
+    const uint32_t height = 40;
+    std::vector<uint8_t> padded(static_cast<size_t>(rowPitch) * height, 0xcd);
+    std::vector<uint8_t> packed(static_cast<size_t>(rowBytes) * height);
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        for (uint32_t byte = 0; byte < rowBytes; ++byte)
+        {
+            padded[static_cast<size_t>(row) * rowPitch + byte] = static_cast<uint8_t>(row * 5 + byte);
+        }
+        std::memcpy(packed.data() + static_cast<size_t>(row) * rowBytes, padded.data() + static_cast<size_t>(row) * rowPitch, rowBytes);
+    }
+
+    const std::vector<uint32_t> rows = sampleRows(3, height, 8);
+    const std::vector<uint32_t> source = hashRows(padded.data(), rowPitch, rowBytes, rows);
+    EXPECT(source.size() == rows.size());
+    EXPECT(hashRows(packed.data(), rowBytes, rowBytes, rows) == source);
+
+    packed[static_cast<size_t>(rows[2]) * rowBytes + rowBytes - 1] ^= 0x10;
+    const std::vector<uint32_t> received = hashRows(packed.data(), rowBytes, rowBytes, rows);
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        EXPECT((received[i] != source[i]) == (i == 2));
+    }
+}
+} // namespace
+
+int main()
+{
+    testKnownValues();
+    testKernelsAgree();
+    testContinued();
+    testSampleRowsCoverFrame();
+    testRowsForBudget();
+    testHashRows();
+    return test::result();
+}
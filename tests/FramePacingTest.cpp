@@ -0,0 +1,83 @@
+#include "FramePacing.hpp"
+#include "Test.hpp"
+
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+// A 60 Hz display sampled after every present, every present on screen one vblank after the previous one
+std::vector<pacing::PresentSample> makeSamples(double qpcFrequency, size_t count, size_t missedAt)
+{
+    const double refreshTicks = qpcFrequency / 60.0;
+    std::vector<pacing::PresentSample> samples;
+    uint32_t refresh = 100;
+    for (size_t i = 0; i < count; ++i)
+    {
+        refresh += i == missedAt ? 2 : 1;
+        pacing::PresentSample sample{};
+        sample.presentId = static_cast<uint32_t>(i + 2);
+        sample.presentCount = static_cast<uint32_t>(i + 1);
+        sample.presentRefreshCount = refresh;
+        sample.syncRefreshCount = refresh;
+        sample.syncQpcTime = static_cast<int64_t>(std::llround(refresh * refreshTicks));
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+void testTraceRoundTrip()
+{
+    // Frequencies that the default stream precision would round
+    for (double frequency : {10000000.0, 2995200123.0, 3579545.0})
+    {
+        const std::vector<pacing::PresentSample> samples = makeSamples(frequency, 50, 20);
+        std::stringstream trace;
+        trace.precision(3);
+        pacing::writeTrace(trace, samples, frequency);
+        EXPECT(trace.precision() == 3);
+
+        double readFrequency = 0.0;
+        const std::vector<pacing::PresentSample> read = pacing::readTrace(trace, readFrequency);
+        EXPECT(readFrequency == frequency);
+        EXPECT(read.size() == samples.size());
+        for (size_t i = 0; i < read.size() && i < samples.size(); ++i)
+        {
+            EXPECT(read[i].presentId == samples[i].presentId);
+            EXPECT(read[i].presentCount == samples[i].presentCount);
+            EXPECT(read[i].presentRefreshCount == samples[i].presentRefreshCount);
+            EXPECT(read[i].syncRefreshCount == samples[i].syncRefreshCount);
+            EXPECT(read[i].syncQpcTime == samples[i].syncQpcTime);
+        }
+
+        const pacing::PacingStats original = pacing::analyze(samples, frequency);
+        const pacing::PacingStats replayed = pacing::analyze(read, readFrequency);
+        EXPECT(original.meanInterval == replayed.meanInterval);
+        EXPECT(original.jitter == replayed.jitter);
+    }
+}
+
+void testAnalysis()
+{
+    const double frequency = 10000000.0;
+    const pacing::PacingStats stats = pacing::analyze(makeSamples(frequency, 61, 30), frequency);
+    EXPECT(stats.sampleCount == 61);
+    EXPECT(stats.intervalCount == 60);
+    EXPECT(stats.missedVblanks == 1);
+    EXPECT(stats.framesWithMissedVblanks == 1);
+    EXPECT(std::abs(stats.refreshPeriod - 1.0 / 60.0) < 1e-6);
+    EXPECT(std::abs(stats.maxInterval - 2.0 / 60.0) < 1e-6);
+    EXPECT(stats.meanQueueDepth == 1.0);
+    EXPECT(stats.maxQueueDepth == 1);
+
+    EXPECT(pacing::analyze({}, frequency).intervalCount == 0);
+}
+} // namespace
+
+int main()
+{
+    testTraceRoundTrip();
+    testAnalysis();
+    return test::result();
+}
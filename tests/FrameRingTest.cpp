@@ -0,0 +1,116 @@
+#include "EmulatedQueue.hpp"
+#include "FenceWaiter.hpp"
+#include "FrameRing.hpp"
+#include "Test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void testSlots()
+{
+    FrameRing ring(3);
+    EXPECT(ring.depth() == 3 && ring.frameCount() == 0);
+    for (uint64_t frame = 1; frame <= 7; ++frame)
+    {
+        const uint32_t slot = ring.advance();
+        EXPECT(slot == (frame - 1) % 3 && ring.current() == slot);
+        // The slot was last used three frames ago
+        EXPECT(ring.fenceValue(slot) == (frame > 3 ? frame - 3 : 0));
+        ring.setFenceValue(slot, frame);
+    }
+    EXPECT(ring.frameCount() == 7);
+}
+
+// The dx12 structure with a frame ring of its own depth: the producer thread
+// renders into the ring slots, the consumer copies a slot to the back buffer of
+// the frame and presents it. A ring slot is reused once its copy is done, a
+// back buffer once it has been presented. No back buffer is presented until
+// the first frame has to wait for one, and by then framesInFlight frames have
+// been rendered, which they only can be if the ring does not depend on the
+// back buffers.
+void testFramesInFlightOverBackBuffers(uint32_t framesInFlight, uint32_t backBufferCount, uint64_t frameCount)
+{
+    EmulatedFence renderFence(0);
+    EmulatedFence copyFence(0);
+    EmulatedFence presentFence(0);
+    EmulatedFence startFence(0);
+    FenceWaiter<EmulatedFence> waiter;
+    EmulatedQueue renderQueue;
+    EmulatedQueue copyQueue;
+    EmulatedQueue presentQueue;
+
+    std::vector<std::atomic<uint64_t>> slotFrames(framesInFlight);
+    std::vector<std::atomic<uint64_t>> backBufferFrames(backBufferCount);
+    std::atomic<uint32_t> mismatches{0};
+
+    std::thread producer([&] {
+        FrameRing ring(framesInFlight);
+        for (uint64_t frame = 1; frame <= frameCount; ++frame)
+        {
+            const uint32_t slot = ring.advance();
+            if (ring.fenceValue(slot) != 0 && !waiter.wait(&copyFence, ring.fenceValue(slot)))
+            {
+                ++mismatches;
+            }
+            renderQueue.execute([&slotFrames, slot, frame] {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                slotFrames[slot] = frame;
+            });
+            renderQueue.Signal(&renderFence, frame);
+            // The copy of the frame signals the same value
+            ring.setFenceValue(slot, frame);
+        }
+    });
+
+    std::vector<uint64_t> backBufferValues(backBufferCount, 0);
+    presentQueue.Wait(&startFence, 1);
+    for (uint64_t frame = 1; frame <= frameCount; ++frame)
+    {
+        const uint32_t slot = static_cast<uint32_t>((frame - 1) % framesInFlight);
+        const uint32_t backBuffer = static_cast<uint32_t>((frame - 1) % backBufferCount);
+        if (frame == backBufferCount + 1)
+        {
+            EXPECT(waiter.wait(&renderFence, framesInFlight));
+            EXPECT(presentFence.GetCompletedValue() == 0);
+            startFence.Signal(1);
+        }
+        if (backBufferValues[backBuffer] != 0)
+        {
+            EXPECT(waiter.wait(&presentFence, backBufferValues[backBuffer]));
+        }
+
+        copyQueue.Wait(&renderFence, frame);
+        copyQueue.execute([&, slot, backBuffer, frame] {
+            mismatches += slotFrames[slot] != frame ? 1 : 0;
+            backBufferFrames[backBuffer] = frame;
+        });
+        copyQueue.Signal(&copyFence, frame);
+
+        presentQueue.Wait(&copyFence, frame);
+        presentQueue.execute([&, backBuffer, frame] {
+            mismatches += backBufferFrames[backBuffer] != frame ? 1 : 0;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            mismatches += backBufferFrames[backBuffer] != frame ? 1 : 0;
+        });
+        presentQueue.Signal(&presentFence, frame);
+        backBufferValues[backBuffer] = frame;
+    }
+    producer.join();
+    EXPECT(waiter.wait(&presentFence, frameCount));
+    EXPECT(mismatches == 0);
+}
+} // namespace
+
+int main()
+{
+    testSlots();
+    testFramesInFlightOverBackBuffers(3, 2, 100);
+    testFramesInFlightOverBackBuffers(4, 2, 100);
+    testFramesInFlightOverBackBuffers(2, 3, 100);
+    return test::result();
+}
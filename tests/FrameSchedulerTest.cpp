@@ -0,0 +1,176 @@
+#include "EmulatedQueue.hpp"
+#include "FenceWaiter.hpp"
+#include "FrameScheduler.hpp"
+#include "Test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using Scheduler = FrameScheduler<EmulatedFence>;
+
+FrameTask awaitOne(Scheduler& scheduler, EmulatedFence* fence, uint64_t value, int* stage)
+{
+    *stage = 1;
+    co_await scheduler.fence(fence, value);
+    *stage = 2;
+}
+
+FrameTask awaitAny(Scheduler& scheduler, EmulatedFence* first, EmulatedFence* second, int* stage)
+{
+    const std::vector<FenceWait<EmulatedFence>> waits{{first, 1}, {second, 1}};
+    co_await scheduler.fences(waits, WaitMode::Any);
+    *stage = 1;
+    co_await scheduler.fences(waits, WaitMode::All);
+    *stage = 2;
+}
+
+void testReachedFence()
+{
+    EmulatedFence fence(5);
+    FenceWaiter<EmulatedFence> waiter;
+    Scheduler scheduler(waiter);
+    int stage = 0;
+    scheduler.spawn(awaitOne(scheduler, &fence, 5, &stage));
+    // Never suspended
+    EXPECT(stage == 2);
+    EXPECT(scheduler.inFlight() == 0);
+}
+
+void testSuspendAndResume()
+{
+    EmulatedFence fence(0);
+    FenceWaiter<EmulatedFence> waiter;
+    Scheduler scheduler(waiter);
+    int stage = 0;
+    scheduler.spawn(awaitOne(scheduler, &fence, 1, &stage));
+    EXPECT(stage == 1);
+    EXPECT(scheduler.inFlight() == 1);
+
+    // Nothing is ready, poll() returns right away
+    scheduler.poll();
+    EXPECT(stage == 1);
+
+    fence.Signal(1);
+    scheduler.waitForProgress();
+    EXPECT(stage == 2);
+    EXPECT(scheduler.inFlight() == 0);
+}
+
+void testModes()
+{
+    EmulatedFence first(0);
+    EmulatedFence second(0);
+    FenceWaiter<EmulatedFence> waiter;
+    Scheduler scheduler(waiter);
+    int stage = 0;
+    scheduler.spawn(awaitAny(scheduler, &first, &second, &stage));
+    EXPECT(stage == 0);
+    second.Signal(1);
+    scheduler.waitForProgress();
+    EXPECT(stage == 1);
+    first.Signal(1);
+    scheduler.runUntilIdle();
+    EXPECT(stage == 2);
+}
+
+struct PipelineState
+{
+    std::thread::id driver;
+    std::atomic<uint32_t> wrongThread{0};
+    std::atomic<uint32_t> outOfOrder{0};
+    std::vector<uint64_t> slotFrames; // Written by the render queue, read by the copy queue
+    uint64_t presented = 0; // Only touched by the present queue
+    std::vector<bool> slotInFlight; // Only touched by the driving thread
+};
+
+// One frame of the dx12direct structure: render on one emulated adapter, copy
+// on the other once the render fence is reached, present once the copy has
+// landed and resume when the present fence is reached.
+FrameTask renderFrame(Scheduler& scheduler, PipelineState& state, EmulatedQueue& renderQueue, EmulatedQueue& copyQueue, EmulatedFence& renderFence,
+                      EmulatedFence& copyFence, uint32_t slot, uint64_t frame)
+{
+    renderQueue.execute([&state, slot, frame] {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        state.slotFrames[slot] = frame;
+    });
+    renderQueue.Signal(&renderFence, frame);
+
+    co_await scheduler.fence(&renderFence, frame);
+    if (std::this_thread::get_id() != state.driver)
+    {
+        ++state.wrongThread;
+    }
+
+    copyQueue.execute([&state, slot, frame] {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        if (state.slotFrames[slot] != frame || state.presented + 1 != frame)
+        {
+            ++state.outOfOrder;
+        }
+        state.presented = frame;
+    });
+    copyQueue.Signal(&copyFence, frame);
+
+    co_await scheduler.fence(&copyFence, frame);
+    if (std::this_thread::get_id() != state.driver)
+    {
+        ++state.wrongThread;
+    }
+    state.slotInFlight[slot] = false;
+}
+
+void testPipeline(uint32_t framesInFlight, uint64_t frameCount)
+{
+    EmulatedFence renderFence(0);
+    EmulatedFence copyFence(0);
+    EmulatedQueue renderQueue;
+    EmulatedQueue copyQueue;
+    FenceWaiter<EmulatedFence> waiter;
+    Scheduler scheduler(waiter);
+
+    PipelineState state;
+    state.driver = std::this_thread::get_id();
+    state.slotFrames.assign(framesInFlight, 0);
+    state.slotInFlight.assign(framesInFlight, false);
+
+    size_t maxInFlight = 0;
+    for (uint64_t frame = 1; frame <= frameCount; ++frame)
+    {
+        scheduler.poll();
+        // The frame that still holds the slot is in flight and resumes the scheduler
+        const uint32_t slot = static_cast<uint32_t>((frame - 1) % framesInFlight);
+        while (state.slotInFlight[slot])
+        {
+            scheduler.waitForProgress();
+        }
+        state.slotInFlight[slot] = true;
+        scheduler.spawn(renderFrame(scheduler, state, renderQueue, copyQueue, renderFence, copyFence, slot, frame));
+        maxInFlight = (std::max)(maxInFlight, scheduler.inFlight());
+    }
+    scheduler.runUntilIdle();
+
+    EXPECT(copyFence.GetCompletedValue() == frameCount);
+    EXPECT(state.wrongThread == 0);
+    EXPECT(state.outOfOrder == 0);
+    EXPECT(maxInFlight <= framesInFlight);
+    // More than one frame was actually in flight at once
+    EXPECT(framesInFlight == 1 || maxInFlight > 1);
+}
+} // namespace
+
+int main()
+{
+    testReachedFence();
+    testSuspendAndResume();
+    testModes();
+    for (uint32_t framesInFlight : {1u, 2u, 4u})
+    {
+        testPipeline(framesInFlight, 200);
+    }
+    return test::result();
+}
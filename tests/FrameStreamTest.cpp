@@ -0,0 +1,122 @@
+#include "FrameStream.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const uint32_t c_width = 64;
+const uint32_t c_height = 32;
+const uint32_t c_bytesPerPixel = 4;
+const uint32_t c_format = 1;
+const uint32_t c_rowBytes = c_width * c_bytesPerPixel;
+
+// A connected pair of sockets on loopback
+bool connectLoopback(StreamSocket& sender, StreamSocket& receiver)
+{
+    const uint16_t port = static_cast<uint16_t>(40000 + getpid() % 20000);
+    std::thread acceptThread([&] { receiver = acceptStream(port); });
+    sender = c_invalidStreamSocket;
+    // The listener may not be up yet
+    for (int attempt = 0; attempt < 500 && sender == c_invalidStreamSocket; ++attempt)
+    {
+        sender = connectStream("127.0.0.1", port);
+        if (sender == c_invalidStreamSocket)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    if (sender == c_invalidStreamSocket)
+    {
+        // Unblocks the accept
+        closeStreamSocket(connectStream("127.0.0.1", port));
+    }
+    acceptThread.join();
+    return sender != c_invalidStreamSocket && receiver != c_invalidStreamSocket;
+}
+
+// Rows of rowPitch bytes, the packed part of every row is stamped with the frame number
+std::vector<uint8_t> makeFrame(uint64_t frameNumber, uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+    std::vector<uint8_t> rows(static_cast<size_t>(rowPitch) * height, 0xee);
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        for (uint32_t byte = 0; byte < width * c_bytesPerPixel; ++byte)
+        {
+            rows[static_cast<size_t>(row) * rowPitch + byte] = static_cast<uint8_t>(frameNumber + row + byte);
+        }
+    }
+    return rows;
+}
+
+bool holdsFrame(const std::vector<uint8_t>& pixels, uint64_t frameNumber)
+{
+    for (uint32_t row = 0; row < c_height; ++row)
+    {
+        for (uint32_t byte = 0; byte < c_rowBytes; ++byte)
+        {
+            if (pixels[static_cast<size_t>(row) * c_rowBytes + byte] != static_cast<uint8_t>(frameNumber + row + byte))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void testStream()
+{
+    StreamSocket senderSocket = c_invalidStreamSocket;
+    StreamSocket receiverSocket = c_invalidStreamSocket;
+    EXPECT(connectLoopback(senderSocket, receiverSocket));
+    if (senderSocket == c_invalidStreamSocket || receiverSocket == c_invalidStreamSocket)
+    {
+        return;
+    }
+
+    std::thread senderThread([senderSocket] {
+        StreamSender sender(senderSocket);
+        const std::vector<uint8_t> packed = makeFrame(1, c_width, c_height, c_rowBytes);
+        sender.send(1, packed.data(), c_rowBytes, c_width, c_height, c_format, c_bytesPerPixel);
+        // A mapped texture pads its rows
+        const std::vector<uint8_t> padded = makeFrame(2, c_width, c_height, c_rowBytes + 64);
+        sender.send(2, padded.data(), c_rowBytes + 64, c_width, c_height, c_format, c_bytesPerPixel);
+        // Another format and a frame that does not fit are skipped by the receiver
+        sender.send(3, packed.data(), c_rowBytes, c_width, c_height, c_format + 1, c_bytesPerPixel);
+        const std::vector<uint8_t> large = makeFrame(4, c_width, c_height * 8, c_rowBytes);
+        sender.send(4, large.data(), c_rowBytes, c_width, c_height * 8, c_format, c_bytesPerPixel);
+        // Frame 5 was dropped by the sender
+        const std::vector<uint8_t> last = makeFrame(6, c_width, c_height, c_rowBytes);
+        sender.send(6, last.data(), c_rowBytes, c_width, c_height, c_format, c_bytesPerPixel);
+        shutdownStream(senderSocket);
+    });
+
+    StreamReceiver receiver(receiverSocket, StreamFormat{c_width, c_height, c_rowBytes, c_format});
+    std::vector<uint8_t> pixels(static_cast<size_t>(c_rowBytes) * c_height);
+    StreamFrameHeader header{};
+    EXPECT(receiver.receive(header, pixels.data(), pixels.size()));
+    EXPECT(header.frameNumber == 1 && holdsFrame(pixels, 1));
+    EXPECT(receiver.receive(header, pixels.data(), pixels.size()));
+    EXPECT(header.frameNumber == 2 && holdsFrame(pixels, 2));
+    // The stream survives the skipped frames
+    EXPECT(receiver.receive(header, pixels.data(), pixels.size()));
+    EXPECT(header.frameNumber == 6 && holdsFrame(pixels, 6));
+    EXPECT(!receiver.receive(header, pixels.data(), pixels.size()));
+    senderThread.join();
+
+    EXPECT(receiver.framesReceived() == 3);
+    EXPECT(receiver.framesDropped() == 2);
+    EXPECT(receiver.framesMissed() == 1);
+    closeStreamSocket(senderSocket);
+    closeStreamSocket(receiverSocket);
+}
+} // namespace
+
+int main()
+{
+    testStream();
+    return test::result();
+}
@@ -0,0 +1,91 @@
+#include "HostMemory.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+// Page faults and copy bandwidth of a frame sized host buffer from
+// HostBuffer against one from plain new. The new'd buffer pays a fault on the
+// first touch of every page, which lands in the first frame that is copied
+// into it, and walks the frame with 4 KB TLB entries unless transparent huge
+// pages happen to back it.
+
+namespace
+{
+// 7680x3840 RGBA8, about the size of the frames the samples move
+const size_t c_frameSize = size_t(7680) * 3840 * 4;
+const int c_copyCount = 20;
+
+struct Result
+{
+    double allocateMs;
+    uint64_t allocateFaults;
+    double firstCopyMs;
+    uint64_t firstCopyFaults;
+    double bandwidthGBs;
+};
+
+uint8_t* dataOf(const std::unique_ptr<uint8_t[]>& buffer)
+{
+    return buffer.get();
+}
+
+uint8_t* dataOf(const HostBuffer& buffer)
+{
+    return buffer.data();
+}
+
+template<typename Allocate>
+Result measure(const uint8_t* source, Allocate allocate)
+{
+    Result result{};
+    uint64_t faults = pageFaultCount();
+    auto start = std::chrono::steady_clock::now();
+    const auto buffer = allocate();
+    result.allocateMs = test::secondsSince(start) * 1000.0;
+    result.allocateFaults = pageFaultCount() - faults;
+    // Published through a static so the compiler can neither drop the copies
+    // into a buffer nobody reads nor move them out of the timed sections
+    static uint8_t* volatile destination = nullptr;
+    destination = dataOf(buffer);
+
+    faults = pageFaultCount();
+    start = std::chrono::steady_clock::now();
+    std::memcpy(destination, source, c_frameSize);
+    result.firstCopyMs = test::secondsSince(start) * 1000.0;
+    result.firstCopyFaults = pageFaultCount() - faults;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < c_copyCount; ++i)
+    {
+        std::memcpy(destination, source, c_frameSize);
+    }
+    result.bandwidthGBs = static_cast<double>(c_frameSize) * c_copyCount / test::secondsSince(start) * 1e-9;
+    return result;
+}
+
+void print(const char* name, const Result& result)
+{
+    std::cout << name << ": allocate " << result.allocateMs << " ms, " << result.allocateFaults << " faults; first copy " << result.firstCopyMs << " ms, "
+              << result.firstCopyFaults << " faults; then " << result.bandwidthGBs << " GB/s\n";
+}
+} // namespace
+
+int main()
+{
+    HostBuffer source(c_frameSize);
+    if (source.data() == nullptr)
+    {
+        std::cout << "Could not allocate the source frame\n";
+        return 1;
+    }
+    std::memset(source.data(), 0x3c, c_frameSize);
+    std::cout << "Frame of " << (c_frameSize >> 20) << " MB, source on " << hostPagesName(source.pages()) << "\n";
+
+    print("new", measure(source.data(), [] { return std::unique_ptr<uint8_t[]>(new uint8_t[c_frameSize]); }));
+    print("HostBuffer", measure(source.data(), [] { return HostBuffer(c_frameSize); }));
+    return 0;
+}
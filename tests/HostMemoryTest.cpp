@@ -0,0 +1,68 @@
+#include "HostMemory.hpp"
+#include "Test.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+const size_t c_size = size_t(6) << 20;
+
+void testEmpty()
+{
+    HostBuffer buffer;
+    EXPECT(buffer.data() == nullptr);
+    EXPECT(buffer.size() == 0);
+}
+
+void testPrefaulted(int node)
+{
+    HostBuffer buffer(c_size, node);
+    EXPECT(buffer.data() != nullptr);
+    if (buffer.data() == nullptr)
+    {
+        return;
+    }
+    EXPECT(buffer.size() == c_size);
+    // Huge pages need a reserved pool, ordinary pages are always there
+    EXPECT(hostPagesName(buffer.pages()) != nullptr);
+
+    // Every page was faulted in when the buffer was created, the frames that reuse it do not fault
+    const uint64_t faults = pageFaultCount();
+    std::memset(buffer.data(), 0x5a, buffer.size());
+    EXPECT(pageFaultCount() - faults < 16);
+    EXPECT(buffer.data()[0] == 0x5a && buffer.data()[c_size - 1] == 0x5a);
+}
+
+void testMove()
+{
+    HostBuffer first(c_size);
+    uint8_t* data = first.data();
+    const HostPages pages = first.pages();
+    EXPECT(data != nullptr);
+
+    HostBuffer second(std::move(first));
+    EXPECT(first.data() == nullptr && first.size() == 0);
+    EXPECT(second.data() == data && second.size() == c_size && second.pages() == pages);
+
+    HostBuffer third(c_size / 2);
+    third = std::move(second);
+    EXPECT(second.data() == nullptr);
+    EXPECT(third.data() == data && third.size() == c_size);
+    third.data()[c_size - 1] = 1;
+
+    third = HostBuffer();
+    EXPECT(third.data() == nullptr);
+}
+} // namespace
+
+int main()
+{
+    testEmpty();
+    testPrefaulted(-1);
+    // Node 0 exists on every machine
+    testPrefaulted(0);
+    testMove();
+    return test::result();
+}
@@ -0,0 +1,214 @@
+#include "IpcChannel.hpp"
+#include "Test.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+const uint32_t c_slotCount = 3;
+const uint32_t c_frameCount = 2000;
+const size_t c_slotSize = 4096;
+
+void testOwnership()
+{
+    IpcSlotOwnership slots(2);
+    uint32_t slot = 0;
+    uint64_t releaseValue = 0;
+    EXPECT(slots.acquire(slot, releaseValue) && slot == 0 && releaseValue == 0);
+    EXPECT(slots.handOver(slot));
+    EXPECT(!slots.handOver(slot));
+    EXPECT(slots.acquire(slot, releaseValue) && slot == 1);
+    EXPECT(slots.handOver(slot));
+    EXPECT(slots.withConsumer() == 2);
+    EXPECT(!slots.acquire(slot, releaseValue));
+
+    // Released in the other order, the slot freed first is written first
+    EXPECT(slots.release(1, 10));
+    EXPECT(slots.release(0, 11));
+    EXPECT(!slots.release(0, 12));
+    EXPECT(!slots.release(5, 1));
+    EXPECT(slots.acquire(slot, releaseValue) && slot == 1 && releaseValue == 10);
+    EXPECT(slots.acquire(slot, releaseValue) && slot == 0 && releaseValue == 11);
+}
+
+void testMessagesAndHandles()
+{
+    int sockets[2] = {-1, -1};
+    EXPECT(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    IpcChannel producer(sockets[0]);
+    IpcChannel consumer(sockets[1]);
+
+    EXPECT(!consumer.available());
+    EXPECT(producer.send(IpcMessageType::FrameReady, 2, 42));
+    EXPECT(consumer.available());
+    IpcMessage message{};
+    EXPECT(consumer.receive(message));
+    EXPECT(message.type == IpcMessageType::FrameReady && message.index == 2 && message.value == 42);
+    EXPECT(consumer.averageLatency() >= 0.0);
+
+    // The received descriptor refers to the same memory
+    const int memory = memfd_create("IpcChannelTest", MFD_CLOEXEC);
+    EXPECT(memory >= 0 && ftruncate(memory, c_slotSize) == 0);
+    EXPECT(producer.sendHandle(7, memory));
+    uint32_t index = 0;
+    int received = -1;
+    EXPECT(consumer.receiveHandle(index, received));
+    EXPECT(index == 7 && received >= 0 && received != memory);
+    const char text[] = "shared";
+    EXPECT(pwrite(memory, text, sizeof(text), 0) == static_cast<ssize_t>(sizeof(text)));
+    char readBack[sizeof(text)] = {};
+    EXPECT(pread(received, readBack, sizeof(readBack), 0) == static_cast<ssize_t>(sizeof(readBack)));
+    EXPECT(std::memcmp(text, readBack, sizeof(text)) == 0);
+
+    // Anything but a handle is not taken for one
+    EXPECT(producer.send(IpcMessageType::Stop, 0, 0));
+    EXPECT(!consumer.receiveHandle(index, received));
+
+    close(received);
+    close(memory);
+    close(sockets[0]);
+    EXPECT(!consumer.receive(message));
+    close(sockets[1]);
+}
+
+// The consumer process of testTwoProcesses(). Returns the number of errors as its exit code.
+int runConsumer(int socket)
+{
+    IpcChannel channel(socket);
+    uint32_t index = 0;
+    int memory = -1;
+    int fence = -1;
+    if (!channel.receiveHandle(index, memory) || index != 0)
+    {
+        return 100;
+    }
+    if (!channel.receiveHandle(index, fence) || index != 1)
+    {
+        return 102;
+    }
+    void* mapped = mmap(nullptr, c_slotSize * c_slotCount, PROT_READ, MAP_SHARED, memory, 0);
+    if (mapped == MAP_FAILED)
+    {
+        return 101;
+    }
+    const uint64_t* slots = static_cast<const uint64_t*>(mapped);
+
+    int errors = 0;
+    uint64_t lastFrame = 0;
+    uint64_t fenceValue = 0;
+    IpcSlotOwnership ownership(c_slotCount);
+    IpcMessage message{};
+    while (channel.receive(message) && message.type != IpcMessageType::Stop)
+    {
+        // The frame is announced before it is written, the fence tells when it has been
+        while (fenceValue < message.value)
+        {
+            uint64_t count = 0;
+            if (read(fence, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))
+            {
+                return 103;
+            }
+            fenceValue += count;
+        }
+        // The producer stamps the slot with the frame number, which is the FrameReady value here
+        const uint64_t* slot = slots + message.index * (c_slotSize / sizeof(uint64_t));
+        errors += message.type != IpcMessageType::FrameReady || !ownership.handOver(message.index) ? 1 : 0;
+        errors += slot[0] != message.value || slot[c_slotSize / sizeof(uint64_t) - 1] != message.value ? 1 : 0;
+        errors += message.value != lastFrame + 1 ? 1 : 0;
+        lastFrame = message.value;
+        ownership.release(message.index, message.value);
+        if (!channel.send(IpcMessageType::SlotReleased, message.index, message.value))
+        {
+            ++errors;
+            break;
+        }
+    }
+    errors += lastFrame != c_frameCount ? 1 : 0;
+    munmap(mapped, c_slotSize * c_slotCount);
+    close(memory);
+    close(fence);
+    return errors > 99 ? 99 : errors;
+}
+
+// A producer process writes frames into slots of shared memory and hands
+// them to a consumer process through the channel, which hands them back. Like
+// a GPU fence, an eventfd shared over the channel tells the consumer when the
+// write of a frame that has already been handed over has landed. Its counter
+// is the fence value, i.e. the number of frames written.
+void testTwoProcesses()
+{
+    int sockets[2] = {-1, -1};
+    EXPECT(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        close(sockets[0]);
+        _exit(runConsumer(sockets[1]));
+    }
+    close(sockets[1]);
+
+    const int memory = memfd_create("IpcChannelTest", MFD_CLOEXEC);
+    EXPECT(memory >= 0 && ftruncate(memory, c_slotSize * c_slotCount) == 0);
+    void* mapped = mmap(nullptr, c_slotSize * c_slotCount, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+    EXPECT(mapped != MAP_FAILED);
+    uint64_t* slots = static_cast<uint64_t*>(mapped);
+
+    const int fence = eventfd(0, EFD_CLOEXEC);
+    EXPECT(fence >= 0);
+
+    IpcChannel channel(sockets[0]);
+    EXPECT(channel.sendHandle(0, memory));
+    EXPECT(channel.sendHandle(1, fence));
+    IpcSlotOwnership ownership(c_slotCount);
+    uint32_t wrongReleases = 0;
+    for (uint64_t frame = 1; frame <= c_frameCount; ++frame)
+    {
+        uint32_t slot = 0;
+        uint64_t releaseValue = 0;
+        while (!ownership.acquire(slot, releaseValue))
+        {
+            IpcMessage message{};
+            if (!channel.receive(message))
+            {
+                break;
+            }
+            wrongReleases += message.type != IpcMessageType::SlotReleased || !ownership.release(message.index, message.value) ? 1 : 0;
+        }
+        EXPECT(ownership.handOver(slot));
+        EXPECT(channel.send(IpcMessageType::FrameReady, slot, frame));
+        uint64_t* data = slots + slot * (c_slotSize / sizeof(uint64_t));
+        for (size_t i = 0; i < c_slotSize / sizeof(uint64_t); ++i)
+        {
+            data[i] = frame;
+        }
+        const uint64_t written = 1;
+        EXPECT(write(fence, &written, sizeof(written)) == static_cast<ssize_t>(sizeof(written)));
+    }
+    EXPECT(channel.send(IpcMessageType::Stop, 0, 0));
+
+    int status = 0;
+    EXPECT(waitpid(child, &status, 0) == child);
+    EXPECT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    EXPECT(wrongReleases == 0);
+    EXPECT(channel.averageSendTime() > 0.0);
+
+    munmap(mapped, c_slotSize * c_slotCount);
+    close(memory);
+    close(fence);
+    close(sockets[0]);
+}
+} // namespace
+
+int main()
+{
+    testOwnership();
+    testMessagesAndHandles();
+    testTwoProcesses();
+    return test::result();
+}
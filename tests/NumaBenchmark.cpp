@@ -0,0 +1,69 @@
+#include "HostMemory.hpp"
+#include "Numa.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+// Copy bandwidth of a thread on one NUMA node between frame buffers placed on
+// each node, the dx11 host hop with --numa=local against --numa=remote. The
+// thread reads a frame from a buffer on one node and writes it to a buffer on
+// the other, for every pair of nodes.
+
+namespace
+{
+// 3840x2160 RGBA8
+const size_t c_frameSize = size_t(3840) * 2160 * 4;
+const int c_copyCount = 20;
+
+double copyBandwidth(int threadNode, int sourceNode, int destinationNode)
+{
+    double bandwidth = 0.0;
+    // A thread of its own, so the binding does not stick to the main thread
+    std::thread thread([&] {
+        bindThreadToNumaNode(threadNode);
+        HostBuffer source(c_frameSize, sourceNode);
+        HostBuffer destination(c_frameSize, destinationNode);
+        if (source.data() == nullptr || destination.data() == nullptr)
+        {
+            return;
+        }
+        std::memset(source.data(), 0x3c, c_frameSize);
+        std::memcpy(destination.data(), source.data(), c_frameSize);
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < c_copyCount; ++i)
+        {
+            std::memcpy(destination.data(), source.data(), c_frameSize);
+        }
+        bandwidth = static_cast<double>(c_frameSize) * c_copyCount / test::secondsSince(start) * 1e-9;
+    });
+    thread.join();
+    return bandwidth;
+}
+} // namespace
+
+int main()
+{
+    const int nodeCount = static_cast<int>(numaNodeCount());
+    std::cout << "NUMA nodes: " << nodeCount << ", frame of " << (c_frameSize >> 20) << " MB\n";
+    if (nodeCount < 2)
+    {
+        std::cout << "One node, remote placement cannot be measured\n";
+    }
+    for (int threadNode = 0; threadNode < nodeCount; ++threadNode)
+    {
+        for (int sourceNode = 0; sourceNode < nodeCount; ++sourceNode)
+        {
+            for (int destinationNode = 0; destinationNode < nodeCount; ++destinationNode)
+            {
+                std::cout << "Thread on node " << threadNode << ", node " << sourceNode << " to node " << destinationNode << ": "
+                          << copyBandwidth(threadNode, sourceNode, destinationNode) << " GB/s\n";
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "Numa.hpp"
+#include "Test.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+// A device directory of a fake /sys/bus/pci/devices
+void addDevice(const std::string& root, const char* name, const char* numaNode)
+{
+    const std::string path = root + "/" + name;
+    mkdir(path.c_str(), 0755);
+    if (numaNode != nullptr)
+    {
+        FILE* file = std::fopen((path + "/numa_node").c_str(), "w");
+        std::fputs(numaNode, file);
+        std::fclose(file);
+    }
+}
+
+void testParse()
+{
+    PciAddress address{};
+    EXPECT(parsePciAddress("0000:3b:00.0", address));
+    EXPECT(address.domain == 0 && address.bus == 0x3b && address.device == 0 && address.function == 0);
+    EXPECT(parsePciAddress("0001:af:1f.7", address));
+    EXPECT(address.domain == 1 && address.bus == 0xaf && address.device == 0x1f && address.function == 7);
+    EXPECT(!parsePciAddress(".", address));
+    EXPECT(!parsePciAddress("0000:3b:00.0:pcie", address));
+}
+
+// Two identical GPUs on different sockets, the address and not the order decides
+void testMatchByAddress()
+{
+    char pattern[] = "/tmp/NumaTestXXXXXX";
+    const char* root = mkdtemp(pattern);
+    EXPECT(root != nullptr);
+    if (root == nullptr)
+    {
+        return;
+    }
+    addDevice(root, "0000:00:00.0", "0");
+    addDevice(root, "0000:d8:00.0", "1");
+    addDevice(root, "0000:3b:00.0", "0");
+    addDevice(root, "0000:5e:00.1", "-1");
+    addDevice(root, "0001:d8:00.0", "2");
+    addDevice(root, "0000:86:00.0", nullptr);
+
+    EXPECT(pciDeviceNumaNode(PciAddress{0, 0xd8, 0, 0}, root) == 1);
+    EXPECT(pciDeviceNumaNode(PciAddress{0, 0x3b, 0, 0}, root) == 0);
+    EXPECT(pciDeviceNumaNode(PciAddress{1, 0xd8, 0, 0}, root) == 2);
+    // No node on a single socket machine, no such device or no file
+    EXPECT(pciDeviceNumaNode(PciAddress{0, 0x5e, 0, 1}, root) == c_anyNumaNode);
+    EXPECT(pciDeviceNumaNode(PciAddress{0, 0x5e, 0, 0}, root) == c_anyNumaNode);
+    EXPECT(pciDeviceNumaNode(PciAddress{0, 0x86, 0, 0}, root) == c_anyNumaNode);
+    EXPECT(pciDeviceNumaNode(PciAddress{0, 0xd8, 0, 0}, std::string(root) + "/missing") == c_anyNumaNode);
+
+    const std::string command = std::string("rm -rf ") + root;
+    EXPECT(std::system(command.c_str()) == 0);
+}
+
+void testNodes()
+{
+    const uint32_t count = numaNodeCount();
+    EXPECT(count >= 1);
+    EXPECT(remoteNumaNode(c_anyNumaNode) == c_anyNumaNode);
+    EXPECT(remoteNumaNode(0) == (count > 1 ? 1 : 0));
+    EXPECT(remoteNumaNode(static_cast<int>(count) - 1) == 0);
+
+    EXPECT(!bindThreadToNumaNode(c_anyNumaNode));
+    EXPECT(!bindThreadToNumaNode(1 << 20));
+    // Node 0 has processors wherever there is a node directory at all
+    if (access("/sys/devices/system/node/node0/cpulist", R_OK) == 0)
+    {
+        EXPECT(bindThreadToNumaNode(0));
+    }
+}
+} // namespace
+
+int main()
+{
+    testParse();
+    testMatchByAddress();
+    testNodes();
+    return test::result();
+}
@@ -0,0 +1,131 @@
+#include "PixelFormat.hpp"
+#include "Test.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace pixelformat;
+
+namespace
+{
+uint32_t packPixel(uint16_t r, uint16_t g, uint16_t b, uint16_t a)
+{
+    const uint16_t source[4] = {r, g, b, a};
+    uint32_t packed = 0;
+    packRgba16fToRgb10a2Software(source, &packed, 1);
+    return packed;
+}
+
+void testFormats()
+{
+    EXPECT(bytesPerPixel(Format::Rgba8) == 4);
+    EXPECT(bytesPerPixel(Format::Rgb10a2) == 4);
+    EXPECT(bytesPerPixel(Format::Rgba16f) == 8);
+    for (Format format : {Format::Rgba8, Format::Rgb10a2, Format::Rgba16f})
+    {
+        EXPECT(parseFormat(formatName(format)) == format);
+    }
+    EXPECT(parseFormat("bgra8") == Format::Rgba8);
+}
+
+void testHalfToFloat()
+{
+    EXPECT(halfToFloat(0x0000) == 0.0f && !std::signbit(halfToFloat(0x0000)));
+    EXPECT(halfToFloat(0x8000) == 0.0f && std::signbit(halfToFloat(0x8000)));
+    EXPECT(halfToFloat(0x3c00) == 1.0f);
+    EXPECT(halfToFloat(0x3800) == 0.5f);
+    EXPECT(halfToFloat(0xc000) == -2.0f);
+    EXPECT(halfToFloat(0x7bff) == 65504.0f);
+    EXPECT(halfToFloat(0x0001) == std::ldexp(1.0f, -24));
+    EXPECT(halfToFloat(0x03ff) == std::ldexp(1023.0f, -24));
+    EXPECT(std::isinf(halfToFloat(0x7c00)) && halfToFloat(0x7c00) > 0.0f);
+    EXPECT(std::isinf(halfToFloat(0xfc00)) && halfToFloat(0xfc00) < 0.0f);
+    EXPECT(std::isnan(halfToFloat(0x7e00)));
+}
+
+void testPackValues()
+{
+    const uint16_t one = 0x3c00;
+    const uint16_t zero = 0x0000;
+    EXPECT(packPixel(one, one, one, one) == 0xffffffff);
+    EXPECT(packPixel(zero, zero, zero, zero) == 0);
+    EXPECT(packPixel(one, zero, zero, zero) == 1023);
+    EXPECT(packPixel(zero, one, zero, zero) == 1023u << 10);
+    EXPECT(packPixel(zero, zero, one, zero) == 1023u << 20);
+    EXPECT(packPixel(zero, zero, zero, one) == 3u << 30);
+    // 0.5 * 1023 = 511.5 rounds to even, 0.5 * 3 = 1.5 too
+    EXPECT(packPixel(0x3800, zero, zero, 0x3800) == (512u | 2u << 30));
+    // Clamped, NaN to 0
+    EXPECT(packPixel(0xbc00, 0x4000, 0x7c00, 0x7e00) == (1023u << 10 | 1023u << 20));
+}
+
+// Every half value in every channel, the F16C path gives the same bits as the scalar one
+void testKernelsAgree()
+{
+    const uint32_t pixelCount = 65536 + 3; // Not a multiple of the four pixels per step
+    std::vector<uint16_t> source(static_cast<size_t>(pixelCount) * 4);
+    for (uint32_t i = 0; i < pixelCount; ++i)
+    {
+        const uint16_t value = static_cast<uint16_t>(i);
+        source[i * 4 + 0] = value;
+        source[i * 4 + 1] = static_cast<uint16_t>(value * 7);
+        source[i * 4 + 2] = static_cast<uint16_t>(~value);
+        source[i * 4 + 3] = static_cast<uint16_t>(value ^ 0x3c00);
+    }
+    std::vector<uint32_t> software(pixelCount);
+    std::vector<uint32_t> hardware(pixelCount, 0xdeadbeef);
+    packRgba16fToRgb10a2Software(source.data(), software.data(), pixelCount);
+    // Without F16C the hardware path would not run, the dispatch falls back to the scalar one
+    if (hasF16c())
+    {
+        packRgba16fToRgb10a2Hardware(source.data(), hardware.data(), pixelCount);
+        EXPECT(hardware == software);
+    }
+}
+
+// Pitches with padding, only the packed pixels of every row are written
+void testPackFrame()
+{
+    const uint32_t width = 13;
+    const uint32_t height = 5;
+    const uint32_t sourcePitch = width * 8 + 24;
+    const uint32_t destinationPitch = width * 4 + 12;
+    std::vector<uint8_t> source(static_cast<size_t>(sourcePitch) * height, 0xff);
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            // 0 or 1 in every channel, by position
+            const uint16_t pixel[4] = {static_cast<uint16_t>(x % 2 ? 0x3c00 : 0), static_cast<uint16_t>(row % 2 ? 0x3c00 : 0), 0x3c00, 0};
+            std::memcpy(source.data() + static_cast<size_t>(row) * sourcePitch + x * 8, pixel, sizeof(pixel));
+        }
+    }
+    std::vector<uint8_t> destination(static_cast<size_t>(destinationPitch) * height, 0xab);
+    packRgba16fToRgb10a2(source.data(), sourcePitch, destination.data(), destinationPitch, width, height);
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint32_t packed = 0;
+            std::memcpy(&packed, destination.data() + static_cast<size_t>(row) * destinationPitch + x * 4, 4);
+            EXPECT(packed == ((x % 2 ? 1023u : 0u) | (row % 2 ? 1023u : 0u) << 10 | 1023u << 20));
+        }
+        for (uint32_t byte = width * 4; byte < destinationPitch; ++byte)
+        {
+            EXPECT(destination[static_cast<size_t>(row) * destinationPitch + byte] == 0xab);
+        }
+    }
+}
+} // namespace
+
+int main()
+{
+    testFormats();
+    testHalfToFloat();
+    testPackValues();
+    testKernelsAgree();
+    testPackFrame();
+    return test::result();
+}
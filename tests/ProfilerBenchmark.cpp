@@ -0,0 +1,85 @@
+#include "Profiler.hpp"
+#include "Test.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Cost of one PROFILE_SCOPE marker, on one thread and on several at once. The
+// markers are meant to stay under c_budgetNs so that a frame loop with a few
+// dozen of them does not notice.
+
+namespace
+{
+const double c_budgetNs = 20.0;
+const int c_markerCount = 1000000;
+
+#if MGPU_PROFILE
+double timestampNs()
+{
+    const auto start = std::chrono::steady_clock::now();
+    volatile uint64_t sink = 0;
+    for (int i = 0; i < c_markerCount; ++i)
+    {
+        sink = profiler::now();
+    }
+    (void)sink;
+    return test::secondsSince(start) * 1e9 / c_markerCount;
+}
+
+double markerNs()
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < c_markerCount; ++i)
+    {
+        PROFILE_SCOPE(Record);
+    }
+    return test::secondsSince(start) * 1e9 / c_markerCount;
+}
+#endif
+} // namespace
+
+int main()
+{
+#if MGPU_PROFILE
+    std::cout << "Timestamp source: " << (MGPU_PROFILE_TSC ? "TSC" : "steady_clock") << "\n";
+    std::cout << "One timestamp: " << timestampNs() << " ns\n";
+
+    markerNs();
+    const double single = markerNs();
+    std::cout << "Marker, one thread: " << single << " ns\n";
+    double worst = single;
+
+    // Threads that share a core would measure each other, so one per core
+    const unsigned threadCount = std::thread::hardware_concurrency();
+    if (threadCount < 2)
+    {
+        std::cout << "Marker, several threads: skipped, there is one core\n";
+    }
+    std::vector<double> perThread(threadCount);
+    if (threadCount >= 2)
+    {
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([&perThread, i] { perThread[i] = markerNs(); });
+        }
+        double slowest = 0.0;
+        for (unsigned i = 0; i < threadCount; ++i)
+        {
+            threads[i].join();
+            slowest = (std::max)(slowest, perThread[i]);
+        }
+        std::cout << "Marker, " << threadCount << " threads: " << slowest << " ns on the slowest\n";
+        worst = (std::max)(worst, slowest);
+    }
+
+    std::cout << "Budget of " << c_budgetNs << " ns per marker: " << (worst <= c_budgetNs ? "met" : "NOT met") << "\n";
+#else
+    std::cout << "Built with MGPU_PROFILE=0, the markers are compiled out\n";
+#endif
+    return 0;
+}
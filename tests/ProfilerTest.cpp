@@ -0,0 +1,54 @@
+#include "Profiler.hpp"
+#include "Test.hpp"
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+int main()
+{
+    // Enough samples to fill a few chunks on every thread
+    const size_t perThread = profiler::c_chunkSampleCount * 3 + 17;
+    const size_t threadCount = 4;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([perThread] {
+            for (size_t i = 0; i < perThread; ++i)
+            {
+                PROFILE_SCOPE(Record);
+            }
+            const profiler::ThreadBuffer& buffer = profiler::threadBuffer();
+            EXPECT(buffer.size() == perThread);
+            EXPECT(buffer.chunks.size() == 4);
+
+            // Samples that were recorded first stay where they are
+            const profiler::Sample* first = &(*buffer.chunks.front())[0];
+            for (size_t i = 0; i < profiler::c_chunkSampleCount; ++i)
+            {
+                PROFILE_SCOPE(Wait);
+            }
+            EXPECT(first == &(*buffer.chunks.front())[0]);
+            EXPECT(first->stage == profiler::Stage::Record);
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    const auto stats = profiler::aggregate();
+    const profiler::StageStats& record = stats[static_cast<size_t>(profiler::Stage::Record)];
+    const profiler::StageStats& wait = stats[static_cast<size_t>(profiler::Stage::Wait)];
+    EXPECT(record.count == perThread * threadCount);
+    EXPECT(wait.count == profiler::c_chunkSampleCount * threadCount);
+    EXPECT(record.min >= 0.0 && record.min <= record.max);
+    EXPECT(stats[static_cast<size_t>(profiler::Stage::Present)].count == 0);
+
+    std::ostringstream report;
+    PROFILE_REPORT(report);
+    EXPECT(report.str().find("Record: ") != std::string::npos);
+    EXPECT(report.str().find("Present: ") == std::string::npos);
+    return test::result();
+}
@@ -0,0 +1,122 @@
+#include "EmulatedQueue.hpp"
+#include "FrameCapture.hpp"
+#include "Test.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The dx11 --replay producer on the CPU-emulated path: the frames of a capture
+// are uploaded from the mapped file on an EmulatedQueue at a fixed rate, the
+// next frames prefetched after every upload, and wrap around at the end.
+
+namespace
+{
+const uint32_t c_width = 256;
+const uint32_t c_height = 128;
+const uint32_t c_bytesPerPixel = 4;
+const uint32_t c_rowBytes = c_width * c_bytesPerPixel;
+const uint64_t c_capturedFrames = 10;
+const uint64_t c_prefetchFrames = 3;
+const std::string c_path = "ReplayTest.cap";
+
+void fillFrame(std::vector<uint8_t>& rows, uint64_t frameNumber)
+{
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        rows[i] = static_cast<uint8_t>(frameNumber * 31 + i * 7 + (i >> 10));
+    }
+}
+
+bool capture()
+{
+    CaptureWriter writer(c_path, c_width, c_height, c_bytesPerPixel, 4);
+    std::vector<uint8_t> rows(static_cast<size_t>(c_rowBytes) * c_height);
+    for (uint64_t frameNumber = 1; frameNumber <= c_capturedFrames; ++frameNumber)
+    {
+        fillFrame(rows, frameNumber);
+        if (!writer.write(frameNumber, rows.data(), c_rowBytes))
+        {
+            return false;
+        }
+    }
+    writer.finish();
+    return writer.framesWritten() == c_capturedFrames;
+}
+
+struct ReplayResult
+{
+    std::vector<uint64_t> frameNumbers; // As seen in the uploaded texture
+    double seconds = 0.0;
+};
+
+ReplayResult replay(const CaptureReader& reader, uint64_t frameCount, uint32_t rate)
+{
+    ReplayResult result;
+    const size_t frameSize = static_cast<size_t>(reader.header().rowBytes) * reader.header().height;
+    std::vector<uint8_t> texture(frameSize);
+    std::vector<uint8_t> expected(frameSize);
+    EmulatedFence uploadFence(0);
+    EmulatedQueue queue;
+
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    const auto start = std::chrono::steady_clock::now();
+    auto nextReplayTime = start;
+    reader.prefetch(0, c_prefetchFrames);
+    for (uint64_t replayed = 0; replayed < frameCount; ++replayed)
+    {
+        std::this_thread::sleep_until(nextReplayTime);
+        const uint64_t replayFrame = replayed % reader.frameCount();
+        const uint8_t* source = reader.frame(replayFrame);
+        queue.execute([&texture, source, frameSize] { std::memcpy(texture.data(), source, frameSize); });
+        queue.Signal(&uploadFence, replayed + 1);
+        reader.prefetch(replayFrame + 1, c_prefetchFrames);
+        nextReplayTime = (std::max)(nextReplayTime + period, std::chrono::steady_clock::now());
+
+        uploadFence.waitFor(replayed + 1);
+        fillFrame(expected, reader.frameNumber(replayFrame));
+        result.frameNumbers.push_back(texture == expected ? reader.frameNumber(replayFrame) : 0);
+    }
+    result.seconds = test::secondsSince(start);
+    return result;
+}
+
+void testReplay()
+{
+    EXPECT(capture());
+    CaptureReader reader(c_path);
+    EXPECT(reader.isOpen() && reader.frameCount() == c_capturedFrames);
+    if (!reader.isOpen())
+    {
+        return;
+    }
+
+    const uint64_t frameCount = c_capturedFrames * 2 + 5;
+    const uint32_t rate = 200;
+    const ReplayResult first = replay(reader, frameCount, rate);
+    EXPECT(first.frameNumbers.size() == frameCount);
+    for (uint64_t i = 0; i < first.frameNumbers.size(); ++i)
+    {
+        // Frame i of the replay is frame i of the capture, wrapped around
+        EXPECT(first.frameNumbers[i] == i % c_capturedFrames + 1);
+    }
+    // Paced at the rate, the first frame goes out right away
+    EXPECT(first.seconds >= (frameCount - 1) / static_cast<double>(rate));
+
+    // A second run replays the same frames in the same order
+    const ReplayResult second = replay(reader, frameCount, rate);
+    EXPECT(second.frameNumbers == first.frameNumbers);
+}
+} // namespace
+
+int main()
+{
+    testReplay();
+    std::remove(c_path.c_str());
+    return test::result();
+}
@@ -0,0 +1,182 @@
+#include "EmulatedQueue.hpp"
+#include "FenceWaiter.hpp"
+#include "FrameRing.hpp"
+#include "SpscQueue.hpp"
+#include "Test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void testOrderAndCapacity()
+{
+    SpscQueue<int> queue(3);
+    EXPECT(queue.capacity() == 3);
+    EXPECT(queue.empty());
+    EXPECT(queue.tryPush(1));
+    EXPECT(queue.tryPush(2));
+    EXPECT(queue.tryPush(3));
+    EXPECT(!queue.tryPush(4));
+
+    int value = 0;
+    EXPECT(queue.tryPop(value) && value == 1);
+    EXPECT(queue.tryPush(4));
+    EXPECT(queue.pop(value) && value == 2);
+    EXPECT(queue.pop(value) && value == 3);
+    EXPECT(queue.pop(value) && value == 4);
+    EXPECT(!queue.tryPop(value));
+    EXPECT(queue.empty());
+}
+
+void testCancel()
+{
+    SpscQueue<int> queue(2);
+    std::atomic<int> result{-1};
+    std::thread consumer([&] {
+        int value = 0;
+        result = queue.pop(value) ? 1 : 0;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT(result == -1);
+    queue.cancel();
+    consumer.join();
+    EXPECT(result == 0);
+
+    // Values pushed before the cancel are still handed out
+    SpscQueue<int> pending(2);
+    EXPECT(pending.tryPush(7));
+    pending.cancel();
+    int value = 0;
+    EXPECT(pending.pop(value) && value == 7);
+    EXPECT(!pending.pop(value));
+}
+
+void testBlockingStress()
+{
+    // A small queue so both sides keep running into full and empty
+    const uint32_t count = 500000;
+    SpscQueue<uint32_t> queue(4);
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            while (!queue.tryPush(i))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    uint32_t value = 0;
+    while (expected < count && queue.pop(value))
+    {
+        if (value != expected)
+        {
+            break;
+        }
+        ++expected;
+    }
+    producer.join();
+    EXPECT(expected == count);
+}
+
+struct FrameHandoff
+{
+    uint32_t slot;
+    uint64_t fenceValue;
+};
+
+// The dx12 structure with emulated adapters: a producer thread renders into
+// ring slots on one adapter, a consumer thread copies them out on the other
+// and gives the slots back once the copy has finished. Every slot holds the
+// number of the frame rendered into it, a slot that is written before the
+// consumer is done with it shows up as a wrong number.
+void testEmulatedAdapters(uint32_t framesInFlight, uint32_t frameCount)
+{
+    EmulatedFence renderFence(0);
+    EmulatedFence copyFence(0);
+    EmulatedQueue renderQueue;
+    EmulatedQueue copyQueue;
+    FenceWaiter<EmulatedFence> fenceWaiter;
+
+    SpscQueue<FrameHandoff> readySlots(framesInFlight);
+    SpscQueue<FrameHandoff> freeSlots(framesInFlight);
+    std::vector<std::atomic<uint32_t>> slotFrames(framesInFlight);
+    std::atomic<uint32_t> corrupted{0};
+    std::atomic<uint32_t> copied{0};
+
+    std::thread producer([&] {
+        FrameRing ring(framesInFlight);
+        uint64_t renderValue = 0;
+        for (uint32_t frame = 1; frame <= frameCount; ++frame)
+        {
+            const uint32_t slot = ring.advance();
+            if (ring.fenceValue(slot) != 0)
+            {
+                FrameHandoff released{};
+                if (!freeSlots.pop(released) || released.slot != slot || !fenceWaiter.wait(&copyFence, released.fenceValue))
+                {
+                    ++corrupted;
+                    return;
+                }
+            }
+            renderQueue.execute([&slotFrames, slot, frame] { slotFrames[slot] = frame; });
+            renderQueue.Signal(&renderFence, ++renderValue);
+            ring.setFenceValue(slot, renderValue);
+            if (!readySlots.tryPush(FrameHandoff{slot, renderValue}))
+            {
+                ++corrupted;
+                return;
+            }
+        }
+    });
+
+    std::thread consumer([&] {
+        uint64_t copyValue = 0;
+        for (uint32_t frame = 1; frame <= frameCount; ++frame)
+        {
+            FrameHandoff handoff{};
+            if (!readySlots.pop(handoff))
+            {
+                return;
+            }
+            // The copy queue waits on the render fence like the dx12 shared fence wait
+            copyQueue.Wait(&renderFence, handoff.fenceValue);
+            copyQueue.execute([&slotFrames, &corrupted, &copied, handoff, frame] {
+                if (slotFrames[handoff.slot] != frame)
+                {
+                    ++corrupted;
+                }
+                ++copied;
+            });
+            copyQueue.Signal(&copyFence, ++copyValue);
+            if (!freeSlots.tryPush(FrameHandoff{handoff.slot, copyValue}))
+            {
+                ++corrupted;
+            }
+        }
+    });
+
+    producer.join();
+    consumer.join();
+    EXPECT(fenceWaiter.wait(&copyFence, frameCount));
+    EXPECT(corrupted == 0);
+    EXPECT(copied == frameCount);
+}
+} // namespace
+
+int main()
+{
+    testOrderAndCapacity();
+    testCancel();
+    testBlockingStress();
+    for (uint32_t framesInFlight : {1u, 2u, 3u, 8u})
+    {
+        testEmulatedAdapters(framesInFlight, 5000);
+    }
+    return test::result();
+}
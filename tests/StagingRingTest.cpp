@@ -0,0 +1,180 @@
+#include "EmulatedQueue.hpp"
+#include "FanOut.hpp"
+#include "StagingRing.hpp"
+#include "Test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const std::chrono::milliseconds c_timeout(10);
+
+void testStates()
+{
+    FanOutSlots fanOut(2, 1);
+    StagingRing staging(fanOut, 2);
+    uint32_t slot = 0;
+    StagingRing::SlotState previous = StagingRing::SlotState::Free;
+
+    EXPECT(staging.acquire(slot, previous, c_timeout) == StagingRing::Acquire::Acquired);
+    EXPECT(slot == 0 && previous == StagingRing::SlotState::Free);
+    staging.copyIssued(slot);
+    EXPECT(staging.acquire(slot, previous, c_timeout) == StagingRing::Acquire::Acquired);
+    EXPECT(slot == 1);
+    staging.copyIssued(slot);
+    EXPECT(staging.state(0) == StagingRing::SlotState::Copying);
+
+    // Both slots are being copied
+    EXPECT(staging.acquire(slot, previous, c_timeout) == StagingRing::Acquire::PublishOldest);
+    EXPECT(staging.hasCopying() && staging.oldestCopying() == 0);
+    staging.publishOldest();
+    EXPECT(staging.state(0) == StagingRing::SlotState::Mapped);
+    // Slot 0 waits to be taken by the consumer
+    EXPECT(staging.acquire(slot, previous, c_timeout) == StagingRing::Acquire::PublishOldest);
+    staging.publishOldest();
+    EXPECT(!staging.hasCopying());
+
+    // The consumer skipped slot 0 for the newer slot 1
+    EXPECT(staging.acquire(slot, previous, c_timeout) == StagingRing::Acquire::Acquired);
+    EXPECT(slot == 0 && previous == StagingRing::SlotState::Mapped);
+    EXPECT(staging.state(0) == StagingRing::SlotState::Free);
+    staging.copyIssued(slot);
+    FanOutFrame frame{};
+    EXPECT(fanOut.take(0, frame) && frame.slot == 1);
+    EXPECT(staging.acquire(slot, previous, c_timeout) == StagingRing::Acquire::PublishOldest);
+    staging.publishOldest();
+
+    // The consumer reads slot 1 and slot 0 waits for it
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT(staging.acquire(slot, previous, c_timeout) == StagingRing::Acquire::Busy);
+    EXPECT(std::chrono::steady_clock::now() - start >= c_timeout);
+
+    std::thread consumer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        fanOut.release(0, 1, 0);
+    });
+    EXPECT(staging.acquire(slot, previous, std::chrono::seconds(5)) == StagingRing::Acquire::Acquired);
+    EXPECT(slot == 1 && previous == StagingRing::SlotState::Mapped);
+    consumer.join();
+}
+
+// The dx11 render thread with an emulated adapter: copies into the staging
+// slots run on an EmulatedQueue, a slot is "mapped" once the copy fence has
+// reached its value and every consumer checks that a slot holds the frame it
+// was published with for as long as it reads it.
+void testEmulatedDevice(uint32_t consumerCount, uint64_t frameCount)
+{
+    const uint32_t slotCount = consumerCount + 2;
+    FanOutSlots fanOut(slotCount, consumerCount);
+    StagingRing staging(fanOut, slotCount);
+    EmulatedFence copyFence(0);
+    EmulatedQueue copyQueue;
+    std::vector<std::atomic<uint64_t>> slotFrames(slotCount);
+    std::vector<uint64_t> copyValues(slotCount, 0);
+    std::atomic<uint64_t> mismatches{0};
+    std::vector<std::atomic<uint64_t>> received(consumerCount);
+
+    std::vector<std::thread> consumers;
+    for (uint32_t consumer = 0; consumer < consumerCount; ++consumer)
+    {
+        consumers.emplace_back([&, consumer] {
+            FanOutFrame frame{};
+            uint64_t last = 0;
+            while (fanOut.take(consumer, frame))
+            {
+                mismatches += frame.frameNumber <= last ? 1 : 0;
+                last = frame.frameNumber;
+                mismatches += slotFrames[frame.slot] != frame.frameNumber ? 1 : 0;
+                // The first consumer is slow, so the others skip nothing and it skips frames
+                std::this_thread::sleep_for(std::chrono::microseconds(consumer == 0 ? 2000 : 50));
+                mismatches += slotFrames[frame.slot] != frame.frameNumber ? 1 : 0;
+                ++received[consumer];
+                fanOut.release(consumer, frame.slot, 0);
+            }
+        });
+    }
+
+    uint64_t copyValue = 0;
+    uint64_t rendered = 0;
+    uint64_t iterations = 0;
+    uint64_t busy = 0;
+    while (rendered < frameCount || staging.hasCopying())
+    {
+        ++iterations;
+        while (staging.hasCopying() && copyFence.GetCompletedValue() >= copyValues[staging.oldestCopying()])
+        {
+            staging.publishOldest();
+        }
+        if (rendered == frameCount)
+        {
+            // The loop above may have published the last copy
+            if (staging.hasCopying())
+            {
+                copyFence.waitFor(copyValues[staging.oldestCopying()]);
+            }
+            continue;
+        }
+
+        uint32_t slot = 0;
+        StagingRing::SlotState previous = StagingRing::SlotState::Free;
+        const StagingRing::Acquire acquired = staging.acquire(slot, previous, c_timeout);
+        if (acquired == StagingRing::Acquire::PublishOldest)
+        {
+            copyFence.waitFor(copyValues[staging.oldestCopying()]);
+            staging.publishOldest();
+            continue;
+        }
+        if (acquired == StagingRing::Acquire::Busy)
+        {
+            ++busy;
+            continue;
+        }
+
+        const uint64_t frame = ++rendered;
+        copyQueue.execute([&slotFrames, slot, frame] {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            slotFrames[slot] = frame;
+        });
+        copyQueue.Signal(&copyFence, ++copyValue);
+        copyValues[slot] = copyValue;
+        staging.copyIssued(slot);
+    }
+
+    // Let the consumers take the last frame before they are stopped
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t consumer = 0; consumer < consumerCount; ++consumer)
+    {
+        while (received[consumer] + fanOut.skippedFrames(consumer) < frameCount && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    fanOut.stop();
+    for (std::thread& consumer : consumers)
+    {
+        consumer.join();
+    }
+
+    EXPECT(mismatches == 0);
+    EXPECT(fanOut.publishedFrames() == frameCount);
+    for (uint32_t consumer = 0; consumer < consumerCount; ++consumer)
+    {
+        EXPECT(received[consumer] + fanOut.skippedFrames(consumer) == frameCount);
+    }
+    EXPECT(fanOut.skippedFrames(0) > 0);
+    // Every pass of the loop acquires, publishes or waits, none of them spins
+    EXPECT(iterations <= 3 * frameCount + busy);
+}
+} // namespace
+
+int main()
+{
+    testStates();
+    testEmulatedDevice(1, 300);
+    testEmulatedDevice(3, 300);
+    return test::result();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// A minimal check macro for the tests of the common headers. A failed check
+// prints where it failed and the test carries on, main() returns the number
+// of failures so ctest reports the test as failed.
+
+#include <chrono>
+#include <iostream>
+
+namespace test
+{
+inline int& failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline int result()
+{
+    if (failures() > 0)
+    {
+        std::cout << failures() << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
+
+inline double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace test
+
+#define EXPECT(condition)                                                                    \
+    do                                                                                       \
+    {                                                                                        \
+        if (!(condition))                                                                    \
+        {                                                                                    \
+            std::cout << __FILE__ << ":" << __LINE__ << " Check failed: " #condition "\n"; \
+            ++test::failures();                                                              \
+        }                                                                                    \
+    } while (false)
@@ -0,0 +1,82 @@
+#include "Test.hpp"
+#include "Tiles.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void testPlanTiles()
+{
+    const std::vector<Tile> tiles = planTiles(7680, 3744, 3, 2, {0, 1});
+    EXPECT(tiles.size() == 6);
+    uint64_t area = 0;
+    for (const Tile& tile : tiles)
+    {
+        area += static_cast<uint64_t>(tile.width) * tile.height;
+    }
+    EXPECT(area == 7680ull * 3744ull);
+    EXPECT(tiles[2].x + tiles[2].width == 7680);
+    EXPECT(tiles[5].y + tiles[5].height == 3744);
+    // Each adapter drives a contiguous run of tiles
+    EXPECT(tiles[0].adapter == 0 && tiles[2].adapter == 0);
+    EXPECT(tiles[3].adapter == 1 && tiles[5].adapter == 1);
+
+    const std::vector<Tile> uneven = planTiles(100, 100, 3, 1, {4});
+    EXPECT(uneven[2].width == 34);
+    EXPECT(uneven[1].adapter == 4);
+}
+
+void testPresentSync()
+{
+    const uint32_t tileCount = 4;
+    const uint64_t frameCount = 200;
+    PresentSync sync(tileCount);
+    std::vector<std::atomic<uint64_t>> presents(tileCount);
+    std::atomic<uint32_t> ahead{0};
+
+    std::vector<std::thread> tiles;
+    for (uint32_t tile = 0; tile < tileCount; ++tile)
+    {
+        tiles.emplace_back([&, tile] {
+            while (sync.waitForPresent(tile))
+            {
+                const uint64_t frame = ++presents[tile];
+                // No tile gets more than one frame ahead of another
+                for (const std::atomic<uint64_t>& other : presents)
+                {
+                    ahead += other + 1 < frame ? 1 : 0;
+                }
+                sync.presented(tile);
+            }
+        });
+    }
+
+    for (uint64_t frame = 0; frame < frameCount; ++frame)
+    {
+        sync.presentAll();
+        for (const std::atomic<uint64_t>& count : presents)
+        {
+            EXPECT(count == frame + 1);
+        }
+    }
+    sync.stop();
+    for (std::thread& tile : tiles)
+    {
+        tile.join();
+    }
+
+    EXPECT(ahead == 0);
+    EXPECT(sync.maxSkew() >= sync.averageSkew());
+    EXPECT(sync.averageSkew() >= 0.0);
+}
+} // namespace
+
+int main()
+{
+    testPlanTiles();
+    testPresentSync();
+    return test::result();
+}
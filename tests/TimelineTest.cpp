@@ -0,0 +1,169 @@
+#include "Bands.hpp"
+#include "EmulatedQueue.hpp"
+#include "FenceWaiter.hpp"
+#include "Test.hpp"
+#include "Timeline.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using Point = SyncPoint<EmulatedFence>;
+
+void testSignals()
+{
+    EmulatedFence fence(1);
+    Timeline<EmulatedFence> timeline(&fence, 1, "render");
+    FenceWaiter<EmulatedFence> waiter;
+
+    // A point of no timeline is always reached
+    EXPECT(waitSyncPoints(waiter, {Point(), Point()}, "cpu"));
+    EXPECT(timeline.last().value() == 1 && timeline.isReached(timeline.last()));
+
+    // The values follow the initial value one by one
+    const Point first = timeline.signal("direct1");
+    const Point second = timeline.signal("copy1");
+    EXPECT(first.value() == 2 && second.value() == 3);
+    EXPECT(first.timeline() == &timeline && first.fence() == &fence);
+    EXPECT(timeline.last().value() == 3);
+    EXPECT(timeline.signalledBy(2) == "direct1" && timeline.signalledBy(3) == "copy1");
+    EXPECT(timeline.signalledBy(1).empty());
+    EXPECT(!timeline.isReached(first));
+    fence.Signal(2);
+    EXPECT(timeline.isReached(first) && !timeline.isReached(second));
+
+    // Only the last c_historySize signals are kept
+    for (size_t i = 0; i < Timeline<EmulatedFence>::c_historySize; ++i)
+    {
+        timeline.signal("direct1");
+    }
+    const std::vector<Timeline<EmulatedFence>::Signal> history = timeline.history();
+    EXPECT(history.size() == Timeline<EmulatedFence>::c_historySize);
+    EXPECT(history.back().value == timeline.last().value());
+    EXPECT(timeline.signalledBy(3).empty());
+    EXPECT(timeline.errors().empty());
+}
+
+void testDeadlock()
+{
+    EmulatedFence fence(0);
+    Timeline<EmulatedFence> timeline(&fence, 0, "render");
+    FenceWaiter<EmulatedFence> waiter;
+    const Point point = timeline.signal("direct1");
+
+    // A value that has not been handed out is rejected without blocking
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT(!waitSyncPoints(waiter, {point, timeline.at(5)}, "cpu"));
+    EXPECT(!notifySyncPoints(waiter, {timeline.at(5)}, "cpu", [] {}));
+    EXPECT(test::secondsSince(start) < 0.05);
+    const std::vector<std::string> errors = timeline.errors();
+    EXPECT(errors.size() == 2);
+    EXPECT(!errors.empty() && errors[0].find("direct1") != std::string::npos);
+}
+
+void testOtherTimeline()
+{
+    EmulatedFence renderFence(0);
+    EmulatedFence sharedFence(0);
+    Timeline<EmulatedFence> render(&renderFence, 0, "render");
+    Timeline<EmulatedFence> shared(&sharedFence, 0, "shared");
+    shared.signal("copy1");
+    const Point point = render.signal("direct1");
+
+    // Same value, but the point is of another fence
+    EXPECT(render.check(point, "copy1"));
+    EXPECT(!shared.check(point, "direct0"));
+    EXPECT(shared.errors().size() == 1 && render.errors().empty());
+}
+
+// The banded structure of dx12: the render queue signals a point per band, the
+// copy queue waits on each of them and signals the shared timeline, the
+// display queue waits on every band of the shared timeline and presents.
+void testPipeline()
+{
+    const uint32_t bandCount = 4;
+    const uint32_t frameCount = 30;
+    EmulatedFence renderFence(0);
+    EmulatedFence sharedFence(0);
+    EmulatedFence presentFence(0);
+    // The queues go first, they may still signal the waiter's events
+    FenceWaiter<EmulatedFence> waiter;
+    EmulatedQueue direct1;
+    EmulatedQueue copy1;
+    EmulatedQueue direct0;
+    Timeline<EmulatedFence> render(&renderFence, 0, "render");
+    Timeline<EmulatedFence> shared(&sharedFence, 0, "shared");
+    Timeline<EmulatedFence> present(&presentFence, 0, "present");
+
+    std::atomic<uint32_t> outOfOrder{0};
+    std::vector<Point> backBuffers(3);
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        Point& backBuffer = backBuffers[frame % backBuffers.size()];
+        EXPECT(waitSyncPoints(waiter, {backBuffer}, "main"));
+
+        std::vector<Point> renderPoints;
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            direct1.execute([] { std::this_thread::sleep_for(std::chrono::microseconds(100)); });
+            renderPoints.push_back(render.signal("direct1"));
+            direct1.Signal(&renderFence, renderPoints.back().value());
+        }
+
+        Point copyPoint;
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            EXPECT(render.check(renderPoints[band], "copy1"));
+            copy1.Wait(&renderFence, renderPoints[band].value());
+            copy1.execute([&outOfOrder, &renderFence, value = renderPoints[band].value()] {
+                outOfOrder += renderFence.GetCompletedValue() < value ? 1 : 0;
+            });
+            copyPoint = shared.signal("copy1");
+            copy1.Signal(&sharedFence, copyPoint.value());
+        }
+
+        for (uint32_t band = 0; band < bandCount; ++band)
+        {
+            const Point point = shared.at(bands::bandFenceValue(copyPoint.value(), band, bandCount));
+            EXPECT(shared.check(point, "direct0"));
+            direct0.Wait(&sharedFence, point.value());
+            direct0.execute([&outOfOrder, &sharedFence, value = point.value()] {
+                outOfOrder += sharedFence.GetCompletedValue() < value ? 1 : 0;
+            });
+        }
+        backBuffer = present.signal("direct0");
+        direct0.Signal(&presentFence, backBuffer.value());
+    }
+
+    // One request for everything still in flight, over all three timelines
+    std::atomic<bool> notified{false};
+    EXPECT(notifySyncPoints(waiter, {present.last(), shared.last()}, "main", [&notified] { notified = true; }));
+    EXPECT(waitSyncPoints(waiter, {backBuffers[0], backBuffers[1], backBuffers[2], shared.last(), render.last()}, "main"));
+    const auto start = std::chrono::steady_clock::now();
+    while (!notified && test::secondsSince(start) < 1.0)
+    {
+        std::this_thread::yield();
+    }
+    EXPECT(notified);
+    EXPECT(outOfOrder == 0);
+    EXPECT(presentFence.GetCompletedValue() == frameCount);
+    EXPECT(sharedFence.GetCompletedValue() == frameCount * bandCount);
+    EXPECT(render.errors().empty() && shared.errors().empty() && present.errors().empty());
+
+    // Any of the points, one of which is always reached
+    EXPECT(waitSyncPoints(waiter, {present.signal("direct0"), Point()}, "main", WaitMode::Any));
+}
+} // namespace
+
+int main()
+{
+    testSignals();
+    testDeadlock();
+    testOtherTimeline();
+    testPipeline();
+    return test::result();
+}
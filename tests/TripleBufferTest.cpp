@@ -0,0 +1,116 @@
+#include "Test.hpp"
+#include "TripleBuffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace
+{
+void testSlots()
+{
+    TripleBuffer buffer;
+    EXPECT(!buffer.acquire());
+    const uint32_t first = buffer.back();
+    EXPECT(!buffer.publish());
+    EXPECT(buffer.back() != first);
+    EXPECT(buffer.acquire());
+    EXPECT(buffer.front() == first);
+    EXPECT(!buffer.acquire());
+
+    // The newest of two frames wins, the older one is reported dropped
+    buffer.publish();
+    const uint32_t newest = buffer.back();
+    EXPECT(buffer.publish());
+    EXPECT(buffer.acquire());
+    EXPECT(buffer.front() == newest);
+    EXPECT(buffer.front() != buffer.back());
+}
+
+void testCancel()
+{
+    TripleBuffer buffer;
+    std::atomic<int> result{-1};
+    std::thread consumer([&] { result = buffer.acquireBlocking() ? 1 : 0; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT(result == -1);
+    buffer.cancel();
+    consumer.join();
+    EXPECT(result == 0);
+
+    // A frame published before the cancel is still handed out
+    TripleBuffer published;
+    published.publish();
+    published.cancel();
+    EXPECT(published.acquireBlocking());
+    EXPECT(!published.acquireBlocking());
+}
+
+// Every slot holds two copies of a sequence number that the producer writes
+// one after the other. A consumer that sees them differ reads a slot while it
+// is being written, one that sees them go backwards got an older frame.
+struct Frame
+{
+    std::atomic<uint64_t> first{0};
+    std::atomic<uint64_t> second{0};
+};
+
+void testStress(uint64_t frameCount, bool slowConsumer)
+{
+    TripleBuffer buffer;
+    Frame frames[TripleBuffer::c_slotCount];
+    std::atomic<uint64_t> dropped{0};
+
+    std::thread producer([&] {
+        for (uint64_t frame = 1; frame <= frameCount; ++frame)
+        {
+            Frame& slot = frames[buffer.back()];
+            slot.first.store(frame, std::memory_order_relaxed);
+            slot.second.store(frame, std::memory_order_relaxed);
+            dropped += buffer.publish() ? 1 : 0;
+            if (!slowConsumer && frame % 64 == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        buffer.cancel();
+    });
+
+    uint64_t acquired = 0;
+    uint64_t last = 0;
+    uint64_t torn = 0;
+    uint64_t backwards = 0;
+    while (buffer.acquireBlocking())
+    {
+        ++acquired;
+        const Frame& slot = frames[buffer.front()];
+        const uint64_t first = slot.first.load(std::memory_order_relaxed);
+        if (slowConsumer)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+        const uint64_t second = slot.second.load(std::memory_order_relaxed);
+        torn += first != second ? 1 : 0;
+        backwards += first <= last ? 1 : 0;
+        last = first;
+    }
+    producer.join();
+
+    EXPECT(torn == 0);
+    EXPECT(backwards == 0);
+    // Every frame was either acquired or dropped, and the last one always arrives
+    EXPECT(acquired + dropped == frameCount);
+    EXPECT(last == frameCount);
+    EXPECT(!slowConsumer || dropped > 0);
+}
+} // namespace
+
+int main()
+{
+    testSlots();
+    testCancel();
+    testStress(200000, false);
+    testStress(20000, true);
+    return test::result();
+}
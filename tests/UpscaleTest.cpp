@@ -0,0 +1,119 @@
+#include "Test.hpp"
+#include "Upscale.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+using namespace upscale;
+
+namespace
+{
+// Smooth content with some detail, the kind of frame a downscaled transfer suits
+std::vector<uint8_t> makeFrame(uint32_t width, uint32_t height, uint32_t pitch)
+{
+    std::vector<uint8_t> rgba(static_cast<size_t>(pitch) * height, 0);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t* pixel = rgba.data() + static_cast<size_t>(y) * pitch + x * 4;
+            pixel[0] = static_cast<uint8_t>(127.5 + 127.5 * std::sin(x * 0.11) * std::cos(y * 0.07));
+            pixel[1] = static_cast<uint8_t>(x * 255 / width);
+            pixel[2] = static_cast<uint8_t>(y * 255 / height);
+            pixel[3] = 255;
+        }
+    }
+    return rgba;
+}
+
+void testFilter()
+{
+    EXPECT(lanczos2(0.0) == 1.0);
+    EXPECT(std::fabs(lanczos2(1.0)) < 1e-12 && std::fabs(lanczos2(-1.0)) < 1e-12);
+    EXPECT(lanczos2(2.0) == 0.0 && lanczos2(-2.5) == 0.0);
+    EXPECT(lanczos2(0.5) == lanczos2(-0.5) && lanczos2(0.5) > 0.5);
+    EXPECT(lanczos2(1.5) < 0.0);
+
+    for (uint32_t scale : {1u, 2u, 3u, 4u})
+    {
+        const Lanczos2Taps taps(scale);
+        EXPECT(taps.offsets.size() == scale && taps.weights.size() == scale * 4);
+        for (uint32_t phase = 0; phase < scale; ++phase)
+        {
+            const float sum = taps.weights[phase * 4] + taps.weights[phase * 4 + 1] + taps.weights[phase * 4 + 2] + taps.weights[phase * 4 + 3];
+            EXPECT(std::fabs(sum - 1.0f) < 1e-6f);
+        }
+    }
+}
+
+void testDownscale()
+{
+    // 2x2 blocks of 0, 1, 2, 3 average to 1.5, rounded up
+    const uint8_t source[2 * 8] = {0, 10, 20, 255, 1, 10, 21, 255, 2, 10, 22, 255, 3, 10, 23, 255};
+    uint8_t destination[4] = {};
+    downscaleBox(source, 8, 2, 2, 2, destination, 4);
+    EXPECT(destination[0] == 2 && destination[1] == 10 && destination[2] == 22 && destination[3] == 255);
+}
+
+// Scale 1 is the identity, a flat frame stays flat at any scale
+void testExactCases()
+{
+    const uint32_t width = 24;
+    const uint32_t height = 16;
+    const std::vector<uint8_t> frame = makeFrame(width, height, width * 4);
+    std::vector<uint8_t> output(frame.size());
+    upscaleLanczos2(frame.data(), width * 4, width, height, 1, output.data(), width * 4);
+    EXPECT(output == frame);
+    EXPECT(std::isinf(psnr(frame.data(), output.data(), width * 4, width, height)));
+
+    const std::vector<uint8_t> flat(static_cast<size_t>(width) * height * 4, 77);
+    for (uint32_t scale : {2u, 3u})
+    {
+        std::vector<uint8_t> upscaled(flat.size() * scale * scale);
+        upscaleLanczos2(flat.data(), width * 4, width, height, scale, upscaled.data(), width * scale * 4);
+        EXPECT(upscaled == std::vector<uint8_t>(upscaled.size(), 77));
+    }
+}
+
+// The separable SSE2 path matches the plain definition up to a rounding step,
+// and a downscaled and upscaled frame stays close to the original
+void testMatchesReference(uint32_t scale, double minimumPsnr)
+{
+    const uint32_t width = 96 * scale;
+    const uint32_t height = 40 * scale;
+    const uint32_t pitch = width * 4;
+    const std::vector<uint8_t> frame = makeFrame(width, height, pitch);
+
+    const uint32_t smallWidth = width / scale;
+    const uint32_t smallHeight = height / scale;
+    // Padded like a mapped texture
+    const uint32_t smallPitch = smallWidth * 4 + 32;
+    std::vector<uint8_t> small(static_cast<size_t>(smallPitch) * smallHeight);
+    downscaleBox(frame.data(), pitch, width, height, scale, small.data(), smallPitch);
+
+    std::vector<uint8_t> reference(frame.size());
+    std::vector<uint8_t> fast(frame.size());
+    upscaleLanczos2Reference(small.data(), smallPitch, smallWidth, smallHeight, scale, reference.data(), pitch);
+    upscaleLanczos2(small.data(), smallPitch, smallWidth, smallHeight, scale, fast.data(), pitch);
+    int maxDifference = 0;
+    for (size_t i = 0; i < fast.size(); ++i)
+    {
+        maxDifference = (std::max)(maxDifference, std::abs(fast[i] - reference[i]));
+    }
+    EXPECT(maxDifference <= 1);
+    EXPECT(psnr(frame.data(), fast.data(), pitch, width, height) >= minimumPsnr);
+}
+} // namespace
+
+int main()
+{
+    testFilter();
+    testDownscale();
+    testExactCases();
+    testMatchesReference(2, 45.0);
+    testMatchesReference(3, 45.0);
+    testMatchesReference(4, 42.0);
+    return test::result();
+}